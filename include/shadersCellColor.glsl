@@ -0,0 +1,94 @@
+// cell instance data and coloring (included into vertex shaders of cells)...
+
+in vec3 instancePosition;
+in float instanceRadius;
+in float instanceTissue;
+in float instanceState;
+in float instancePressure;
+in vec4 instanceConcentrations;   // O2, TAF, pericytes, medicine
+
+// cell colors (size of arrays must match MAX_PALETTE_TISSUES and sat::csLast)...
+layout(std140) uniform CellPalette
+{
+    vec4 tissueColor[32];    // rgb, 1.0 if tissue is shown
+    vec4 tissueParams[32];   // max pressure
+    vec4 stateColor[6];      // rgb, 1.0 if state has color
+};
+
+uniform int colorMode;       // COLOR_MODE_* flags
+uniform float pressureMin;
+uniform float pressureMax;
+uniform vec4 clipPlane;
+
+bool cell_visible()
+{
+    int t = int(instanceTissue + 0.5);
+    return tissueColor[t].w != 0.0 && dot(clipPlane, vec4(instancePosition, 1.0)) > 0.0;
+}
+
+vec3 cell_color()
+{
+    int t = int(instanceTissue + 0.5);
+    int s = int(instanceState + 0.5);
+
+    // average of selected colors...
+    vec3 sum = vec3(0.0);
+    float cnt = 0.0;
+
+    if ((colorMode & 1) != 0)
+    {
+        sum += tissueColor[t].rgb;
+        cnt += 1.0;
+    }
+
+    if ((colorMode & 2) != 0)
+    {
+        sum += stateColor[s].rgb*stateColor[s].w;
+        cnt += stateColor[s].w;
+    }
+
+    if ((colorMode & 4) != 0)
+    {
+        if (pressureMax == pressureMin)
+            sum += vec3(0.5);
+        else
+        {
+            float p;
+            if (instancePressure < 0.0)
+                p = 0.0;
+            else if (instancePressure > 1.0)
+                p = 1.0;
+            else
+                p = (instancePressure - pressureMin)/(pressureMax - pressureMin);
+            if (instancePressure > tissueParams[t].x)
+                sum += vec3(p, p*0.75, p*0.75);
+            else
+                sum += vec3(p);
+        }
+        cnt += 1.0;
+    }
+
+    vec4 c = clamp(instanceConcentrations, 0.0, 1.0);
+    if ((colorMode & 8) != 0)
+    {
+        sum += vec3(0.0, 0.0, c.x);
+        cnt += 1.0;
+    }
+    if ((colorMode & 16) != 0)
+    {
+        sum += vec3(0.0, c.y, 0.0);
+        cnt += 1.0;
+    }
+    if ((colorMode & 64) != 0)
+    {
+        sum += vec3(c.z, c.z, 0.0);
+        cnt += 1.0;
+    }
+    if ((colorMode & 32) != 0)
+    {
+        sum += vec3(c.w, c.w, 0.0);
+        cnt += 1.0;
+    }
+
+    return cnt > 0.0 ? sum/cnt : vec3(0.0);
+}
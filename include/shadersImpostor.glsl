@@ -0,0 +1,83 @@
+[vertex]=================================================================
+
+in vec3 position;             // quad corner (-1..1, -1..1, 0)
+
+#include "shadersCellColor.glsl"
+
+uniform mat4 mv_matrix;       // model -> eye space
+uniform mat4 p_matrix;        // eye space -> clip space
+
+out vec3 fragPos;             // point of quad (eye space)
+out vec3 fragCenter;          // center of sphere (eye space)
+out float fragRadius;         // radius of sphere (eye space)
+out vec3 fragColor;
+
+void main()
+{
+    fragColor = vec3(0.0);
+    fragCenter = vec3(0.0);
+    fragRadius = 0.0;
+    fragPos = vec3(0.0);
+
+    vec3 c = (mv_matrix*vec4(instancePosition, 1.0)).xyz;
+    float r = instanceRadius*length(mv_matrix[0].xyz);
+    float d = length(c);
+
+    // hidden, clipped or containing the eye -> out of view volume...
+    if (!cell_visible() || d <= r*1.001)
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    // quad facing the eye, large enough to cover silhouette of sphere...
+    vec3 w = -c/d;
+    vec3 u = normalize(abs(w.y) < 0.99 ? cross(vec3(0.0, 1.0, 0.0), w) : cross(vec3(1.0, 0.0, 0.0), w));
+    vec3 v = cross(w, u);
+    float s = r*d/sqrt(d*d - r*r);
+
+    fragPos = c + (u*position.x + v*position.y)*s;
+    fragCenter = c;
+    fragRadius = r;
+    fragColor = cell_color();
+
+    gl_Position = p_matrix*vec4(fragPos, 1.0);
+}
+
+
+
+[fragment]===============================================================
+
+in vec3 fragPos;
+in vec3 fragCenter;
+in float fragRadius;
+in vec3 fragColor;
+
+uniform mat4 mv_matrix;
+uniform mat4 p_matrix;
+uniform float ambient;
+uniform float diffuse;
+uniform vec3 lightDir;        // model space
+
+out vec4 color;
+
+void main()
+{
+    // ray from eye through quad point hits sphere?...
+    vec3 ray = normalize(fragPos);
+    float b = dot(ray, fragCenter);
+    float disc = b*b - dot(fragCenter, fragCenter) + fragRadius*fragRadius;
+    if (disc < 0.0)
+        discard;
+
+    vec3 hit = ray*(b - sqrt(disc));
+    vec3 n = (hit - fragCenter)/fragRadius;
+
+    // depth of hit point...
+    vec4 hit_clip = p_matrix*vec4(hit, 1.0);
+    gl_FragDepth = 0.5*hit_clip.z/hit_clip.w + 0.5;
+
+    // light is given in model space...
+    n = normalize(transpose(mat3(mv_matrix))*n);
+    color = vec4(fragColor*(ambient + max(dot(n, lightDir), 0.0)*diffuse), 1.0);
+}
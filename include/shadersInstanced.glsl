@@ -2,9 +2,8 @@
 
 in vec3 position;
 in vec3 normal;
-in vec3 instancePosition;
-in float instanceRadius;
-in vec3 instanceColor;
+
+#include "shadersCellColor.glsl"
 
 uniform mat4 pv_matrix;
 
@@ -13,16 +12,19 @@ out vec3 fragColor;
 
 void main()
 {
-    mat4 m_matrix = mat4(instanceRadius, 0.0, 0.0, 0.0,
-                         0.0, instanceRadius, 0.0, 0.0,
-                         0.0, 0.0, instanceRadius, 0.0,
-                         instancePosition.x, instancePosition.y, instancePosition.z, 1.0);
-
-    mat4 pvm_matrix = pv_matrix*m_matrix;
-
-    gl_Position = pvm_matrix*vec4(position, 1.0);
-    fragColor = instanceColor;
-    fragNormal = normalize(mat3(transpose(inverse(m_matrix)))*normal);
+    // hidden or clipped cells are moved out of view volume...
+    if (!cell_visible())
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        fragColor = vec3(0.0);
+        fragNormal = normal;
+        return;
+    }
+
+    fragColor = cell_color();
+
+    gl_Position = pv_matrix*vec4(instancePosition + position*instanceRadius, 1.0);
+    fragNormal = normal;
 }
 
 
@@ -0,0 +1,59 @@
+[vertex]=================================================================
+
+in vec3 position;
+in vec3 normal;
+in vec3 instancePos1;
+in vec3 instancePos2;
+in float instanceRadius;
+in vec3 instanceColor;
+
+uniform mat4 pv_matrix;
+uniform int tip;             // 0: cylinder, 1/2: sphere at tip #1/#2
+
+out vec3 fragNormal;
+out vec3 fragColor;
+
+void main()
+{
+    // rounded tips...
+    if (tip != 0)
+    {
+        vec3 center = tip == 1 ? instancePos1 : instancePos2;
+        gl_Position = pv_matrix*vec4(center + position*instanceRadius, 1.0);
+        fragColor = instanceColor;
+        fragNormal = normal;
+        return;
+    }
+
+    // orthonormal basis (u, v, w) with w along tube axis...
+    vec3 axis = instancePos2 - instancePos1;
+    float len = length(axis);
+    vec3 w = len > 0.0 ? axis/len : vec3(0.0, 0.0, 1.0);
+    vec3 u = normalize(abs(w.z) < 0.9 ? cross(w, vec3(0.0, 0.0, 1.0)) : cross(w, vec3(1.0, 0.0, 0.0)));
+    vec3 v = cross(u, w);
+
+    // cylinder model: radius 1, from z = 0 to z = -1...
+    vec3 p = instancePos1 + (u*position.x + v*position.y)*instanceRadius - w*position.z*len;
+
+    gl_Position = pv_matrix*vec4(p, 1.0);
+    fragColor = instanceColor;
+    fragNormal = normalize(u*normal.x + v*normal.y - w*normal.z);
+}
+
+
+
+[fragment]===============================================================
+
+in vec3 fragNormal;
+in vec3 fragColor;
+
+uniform float ambient;
+uniform float diffuse;
+uniform vec3 lightDir;
+
+out vec4 color;
+
+void main()
+{
+    color = vec4(fragColor*(ambient + max(dot(fragNormal, lightDir), 0.0)*diffuse), 1.0);
+}
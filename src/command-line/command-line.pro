@@ -1,5 +1,5 @@
 QT -= core gui
-CONFIG   += console
+CONFIG   += console c++11 thread
 
 SOURCES += \
     main.cpp \
@@ -10,7 +10,11 @@ SOURCES += \
     ../editor/anycellblock.cpp \
     ../editor/anyglobalsettings.cpp \
     ../editor/anysimulationsettings.cpp \
+    ../editor/anysoftwarerenderer.cpp \
     ../editor/anytissuesettings.cpp \
+    ../editor/anytrajectory.cpp \
+    ../editor/anyoutputsnapshot.cpp \
+    ../editor/anyoutputwriter.cpp \
     ../editor/anytube.cpp \
     ../editor/anytubebundle.cpp \
     ../editor/anytubeline.cpp \
@@ -24,7 +28,9 @@ SOURCES += \
     ../editor/simulation.cpp \
     ../editor/statistics.cpp \
     ../editor/timers.cpp \
-    ../editor/anyeditable.cpp
+    ../editor/anyeditable.cpp \
+    ../editor/anysimulationcontext.cpp \
+    ../editor/anysimulation.cpp
 
 INCLUDEPATH += ../Editor
 
@@ -40,10 +46,16 @@ HEADERS += \
     ../editor/anyglobalsdialog.h \
     ../editor/anyglobalsettings.h \
     ../editor/anysimulationsettings.h \
+    ../editor/anysoftwarerenderer.h \
     ../editor/anytissuesettings.h \
+    ../editor/anytissueinteraction.h \
+    ../editor/anytrajectory.h \
+    ../editor/anyoutputsnapshot.h \
+    ../editor/anyoutputwriter.h \
     ../editor/anytube.h \
     ../editor/anytubebox.h \
     ../editor/anytubebundle.h \
+    ../editor/anytubechain.h \
     ../editor/anytubeline.h \
     ../editor/anytubemerge.h \
     ../editor/anytubularsystemsettings.h \
@@ -62,4 +74,9 @@ HEADERS += \
     ../editor/types.h \
     ../editor/version.h \
     ../editor/anyeditable.h \
-    ../editor/anyeditabledialog.h
+    ../editor/anyeditabledialog.h \
+    ../editor/anysimulationcontext.h \
+    ../editor/anysimulation.h
+
+QMAKE_CXXFLAGS += -fopenmp
+QMAKE_LFLAGS += -fopenmp
@@ -1,6 +1,10 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <omp.h>
+#include <vector>
+#include <sys/stat.h>
+#include <direct.h>
 
 #include "../editor/version.h"
 #include "../editor/scene.h"
@@ -13,7 +17,14 @@
 #include "../editor/anyglobalsettings.h"
 #include "../editor/anytissuesettings.h"
 #include "../editor/anytubularsystemsettings.h"
+#include "../editor/anycellblock.h"
+#include "../editor/anybarrier.h"
+#include "../editor/anytubebundle.h"
+#include "../editor/anysimulation.h"
+#include "../editor/anysimulationcontext.h"
+#include "../editor/anysoftwarerenderer.h"
 #include "../editor/statistics.h"
+#include "../editor/anyoutputwriter.h"
 #include "../editor/model.h"
 #include "../editor/log.h"
 
@@ -23,6 +34,9 @@
 #define HOME_DIR_WIN "/Desktop/Motpuca"
 #define HOME_DIR_WIN_DBG "/Desktop/Motpuca"
 
+#define MAX_SCALING_THREADS 64
+#define DEFAULT_SCALING_STEPS 20
+
 
 void setup_directories(const char *directory)
 {
@@ -50,12 +64,13 @@ bool load_scene(const char *fname, const char *directory)
         scene::DeallocateCellBlocks();
         scene::DeallocateTubeLines();
         scene::DeallocateTubeBundles();
+        scene::DeallocateInteractionSettings();
         scene::DeallocateTissueSettings();
         scene::DeallocateBarriers();
         DeallocateDefinitions();
 
-        SimulationSettings.reset();
-        TubularSystemSettings.reset();
+        Simulation->settings.reset();
+        Simulation->tubular_settings.reset();
         VisualSettings.reset();
 
         char basefile[P_MAX_PATH];
@@ -76,7 +91,7 @@ void generate_scene()
 {
     try
     {
-        if (!GlobalSettings.simulation_allocated)
+        if (!Simulation->allocated)
             scene::AllocSimulation();
 
         scene::GenerateTubesInAllTubeBundles();
@@ -90,19 +105,30 @@ void generate_scene()
 }
 
 
-void display_statistics()
+void display_statistics(anyOutputWriter &writer, char const *prefix)
+/**
+  Prints one line of statistics of current simulation. Line is printed at once, so lines
+  of simulations running at the same time are not mixed.
+
+  \param writer -- output writer of simulation
+  \param prefix -- printed at the beginning of line
+*/
 {
-    printf("Step: %d; Time: %s", SimulationSettings.step, SecToString(SimulationSettings.time));
+    char line[1000];
+    int len = snprintf(line, sizeof(line), "%sStep: %d; Time: %s", prefix, Simulation->settings.step, SecToString(Simulation->settings.time));
 
     // loop over all tissues...
-    anyTissueSettings *ts = scene::FirstTissueSettings;
-    while (ts)
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
+    while (ts && len < (int)sizeof(line))
     {
-        printf("; %s: %d", ts->name, ts->no_cells[0]);
+        len += snprintf(line + len, sizeof(line) - len, "; %s: %d", ts->name, ts->no_cells[0]);
         ts = ts->next;
     }
 
-    printf("; %s: %d (%d)\n", MODEL_TUBE_SHORTNAME_PL_PCHAR, scene::NoTubes, scene::NoTubeChains);
+    if (len < (int)sizeof(line))
+        snprintf(line + len, sizeof(line) - len, "; %s: %d (%d); Output lag: %d", MODEL_TUBE_SHORTNAME_PL_PCHAR,
+                 Simulation->no_tubes, Simulation->no_tube_chains, writer.lag(Simulation->settings.step));
+    printf("%s\n", line);
 }
 
 
@@ -129,76 +155,480 @@ void report_timers()
 }
 
 
-int main(int argc, char **argv)
-{
-    printf("%s, %d.%d.%d\n", APP_NAME, MOTPUCA_VERSION, MOTPUCA_SUBVERSION, MOTPUCA_RELEASE);
-
-    GlobalSettings.run_env = sat::reDebug;
-    GlobalSettings.debug = (GlobalSettings.run_env != sat::reProduction);
-
-
-
-    if (argc < 3)
-    {
-        printf("Usage: %s <input-file> <output folder>\n", argv[0]);
-        return 1;
-    }
-
-    DefineAllTimers();
-
-    if (!load_scene(argv[1], argv[2])) return 1;
-    generate_scene();
-
-
+static bool run_simulation(int max_steps, anyOutputWriter &writer, char const *prefix)
+/**
+  Runs current simulation until stop_time (or max_steps steps), saves results in output directory.
+  Povray, ag and VTK files are written by background threads, all of them are
+  written when function returns. Statistics rows are appended to single file.
 
+  \param writer -- output writer used by simulation
+  \param prefix -- prefix of printed statistics lines
+*/
+{
+    writer.start(Simulation->settings.output_threads, Simulation->settings.output_queue);
     try
     {
+        if (Simulation->settings.save_statistics)
+        {
+            char fname[P_MAX_PATH];
+            snprintf(fname, P_MAX_PATH, "%sstatistics.%s", Simulation->output_dir, Simulation->settings.statistics_binary ? "bin" : "csv");
+            try
+            {
+                Simulation->statistics_stream.open(fname, Simulation->settings.statistics_binary, Simulation->settings.statistics_flush_time);
+            }
+            catch (Error *err)
+            {
+                // simulation runs without statistics file...
+                LogError(err);
+            }
+        }
+
         long t = time(0);
-        for (int i = 0; SimulationSettings.time < SimulationSettings.stop_time; i++)
+        for (int i = 0; Simulation->settings.time < Simulation->settings.stop_time && (!max_steps || i < max_steps); i++)
         {
             TimeStep();
 
             if (time(0) - t > 0)
             {
-                display_statistics();
+                display_statistics(writer, prefix);
                 t = time(0);
             }
 
-            if (SimulationSettings.step % SimulationSettings.graph_sampling == 0)
+            if (Simulation->settings.step % Simulation->settings.graph_sampling == 0)
                 AddAllStatistics();
 
-            if (SimulationSettings.save_statistics && SimulationSettings.step % SimulationSettings.save_statistics == 0)
+            if (Simulation->settings.save_statistics && Simulation->settings.step % Simulation->settings.save_statistics == 0)
+                Simulation->statistics_stream.append();
+
+            if (Simulation->settings.save_povray && Simulation->settings.step % Simulation->settings.save_povray == 0)
+                writer.submit(scene::CapturePovRay(0, true));
+            if (Simulation->settings.save_png && Simulation->settings.step % Simulation->settings.save_png == 0)
             {
                 char fname[P_MAX_PATH];
-                snprintf(fname, P_MAX_PATH, "%sstatistics_%08d.csv", GlobalSettings.output_dir, SimulationSettings.step);
-                SaveStatistics(fname);
+                snprintf(fname, P_MAX_PATH, "%sframe_%08d.png", Simulation->output_dir, Simulation->settings.step);
+                SavePNG(fname);
             }
-
-            if (SimulationSettings.save_povray && SimulationSettings.step % SimulationSettings.save_povray == 0)
-                scene::SavePovRay(0, true);
-            if (SimulationSettings.save_ag && SimulationSettings.step % SimulationSettings.save_ag == 0)
+            if (Simulation->settings.save_trajectory && Simulation->settings.step % Simulation->settings.save_trajectory == 0)
+                scene::SaveTrajectoryFrame();
+            if (Simulation->settings.save_ag && Simulation->settings.step % Simulation->settings.save_ag == 0)
+            {
+                char fname[P_MAX_PATH];
+                snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", Simulation->output_dir, Simulation->settings.step);
+                writer.submit(scene::CaptureAG(fname, true));
+            }
+            if (Simulation->settings.save_vtk && Simulation->settings.step % Simulation->settings.save_vtk == 0)
             {
                 char fname[P_MAX_PATH];
-                snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", GlobalSettings.output_dir, SimulationSettings.step);
-                scene::SaveAG(fname, true);
+                snprintf(fname, P_MAX_PATH, "%sstep_%08d.vtu", Simulation->output_dir, Simulation->settings.step);
+                writer.submit(scene::CaptureVTK(fname, true));
             }
 
         }
 
         // save after last step...
-        if (!SimulationSettings.save_ag || SimulationSettings.step % SimulationSettings.save_ag != 0)
+        if (!Simulation->settings.save_ag || Simulation->settings.step % Simulation->settings.save_ag != 0)
         {
             char fname[P_MAX_PATH];
-            snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", GlobalSettings.output_dir, SimulationSettings.step);
-            scene::SaveAG(fname, true);
+            snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", Simulation->output_dir, Simulation->settings.step);
+            writer.submit(scene::CaptureAG(fname, true));
         }
+        writer.shutdown();
+        Simulation->statistics_stream.close();
+        scene::CloseTrajectory();
     }
     catch (Error *err)
     {
         LogError(err);
+        writer.shutdown();
+        Simulation->statistics_stream.close();
+        scene::CloseTrajectory();
+        return false;
     }
+    return true;
+}
 
-    report_timers();
+
+static bool run_variant(anySimulationContext *base, anySimulationContext *v, int index, char const *output_dir, int max_steps, bool concurrent)
+/**
+  Runs one variant of ensemble. Variant starts from base context and saves results in
+  subdirectory of output_dir named after variant.
+
+  \param index -- index of variant (seed of random numbers)
+  \param concurrent -- other variants run at the same time: variant runs in its own
+                       simulation (with copy of tissues of DefaultSimulation), timers are
+                       suspended and random numbers are not seeded
+
+  \returns false if variant could not be started or simulation failed.
+*/
+{
+    anySimulation *simulation = concurrent ? new anySimulation : &DefaultSimulation;
+    Simulation = simulation;
+    SuspendTimers(concurrent);
+
+    char prefix[P_MAX_PATH + 4] = "";
+    if (concurrent)
+        snprintf(prefix, sizeof(prefix), "[%s] ", v->name);
+    printf("\n%sVariant: %s\n", prefix, v->name);
+
+    bool ok = true;
+    try
+    {
+        if (concurrent)
+            scene::CopyTissueSettings(&DefaultSimulation);
+        base->restore(true);
+        v->restore(false);
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        ok = false;
+    }
+
+    if (ok)
+    {
+        snprintf(Simulation->output_dir, P_MAX_PATH, "%s%s/", output_dir, v->name);
+        Slashify(Simulation->output_dir, false);
+        mkdir(Simulation->output_dir);
+
+        DeallocStatistics();
+        if (!concurrent)
+            srand(index + 1);
+
+        anyOutputWriter writer;
+        ok = run_simulation(max_steps, writer, prefix);
+        printf("%s%s\n", prefix, writer.report(Simulation->settings.step));
+    }
+
+    if (concurrent)
+    {
+        scene::DeallocSimulation();
+        scene::DeallocateTissueSettings();
+        delete simulation;
+    }
+    SuspendTimers(false);
+    Simulation = &DefaultSimulation;
+    return ok;
+}
+
+
+static int ensemble(const char *ensemble_fname, const char *fname, const char *directory, int max_steps, int jobs)
+/**
+  Runs every variant from ensemble file. Scene is parsed and generated once, every
+  variant starts from a copy of generated scene and saves results in its own
+  subdirectory of output directory.
+
+  \param jobs -- number of variants run at the same time; with more than one job every
+                 variant runs in one thread (its parallel regions are not split) and
+                 variants are not reproducible (they share random number generator)
+*/
+{
+    if (!load_scene(fname, directory))
+        return 1;
+    generate_scene();
+
+    anySimulationContext base;
+    anySimulationContext *variants = 0;
+    char output_dir[P_MAX_PATH];
+    snprintf(output_dir, P_MAX_PATH, "%s", Simulation->output_dir);
+
+    try
+    {
+        base.store(true);
+        variants = ParseEnsembleFile(ensemble_fname, &base);
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        return 1;
+    }
+
+    std::vector<anySimulationContext *> list;
+    for (anySimulationContext *v = variants; v; v = v->next)
+        list.push_back(v);
+
+    int failed = 0;
+    if (jobs <= 1)
+    {
+        for (int i = 0; i < (int)list.size(); i++)
+            if (!run_variant(&base, list[i], i, output_dir, max_steps, false))
+                failed++;
+    }
+    else
+    {
+        // parallel regions of simulation inside of variant run in variant's thread
+        // (they use Simulation of that thread)...
+        omp_set_max_active_levels(1);
+
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(jobs) reduction(+:failed)
+        for (int i = 0; i < (int)list.size(); i++)
+            if (!run_variant(&base, list[i], i, output_dir, max_steps, true))
+                failed++;
+    }
+
+    DeallocateEnsemble(variants);
+    snprintf(Simulation->output_dir, P_MAX_PATH, "%s", output_dir);
+
+    if (failed)
+        printf("\nFailed variants: %d of %d\n", failed, (int)list.size());
+    return failed ? 1 : 0;
+}
+
+
+static int scaling_timers[MAX_TIMERS];  ///< timers reported in scaling tables
+static int no_scaling_timers = 0;       ///< number of reported timers
+
+
+static void init_scaling_timers()
+{
+    int &i = no_scaling_timers;
+    i = 0;
+    scaling_timers[i++] = TimerSimulationId;
+    scaling_timers[i++] = TimerTubeUpdateId;
+    scaling_timers[i++] = TimerResetForcesId;
+    scaling_timers[i++] = TimerCellCellForcesId;
+    scaling_timers[i++] = TimerCellBarrierForcesId;
+    scaling_timers[i++] = TimerTubeTubeForcesId;
+    scaling_timers[i++] = TimerTubeCellForcesId;
+    scaling_timers[i++] = TimerCellGrowId;
+    scaling_timers[i++] = TimerTubeGrowId;
+    scaling_timers[i++] = TimerRearangeId;
+    scaling_timers[i++] = TimerRemoveTubesId;
+    scaling_timers[i++] = TimerConnectTubeChainsId;
+    scaling_timers[i++] = TimerMergeTubesId;
+    scaling_timers[i++] = TimerUpdatePressuresId;
+    scaling_timers[i++] = TimerCopyConcentrationsId;
+    scaling_timers[i++] = TimerBloodFlowId;
+    scaling_timers[i++] = TimerTissuePropertiesId;
+}
+
+
+static void scale_along_x(anyBoundingBox *b, float origin_x, float factor)
+/**
+  Stretches bounding box along x axis. Coordinates are scaled relative to origin_x.
+*/
+{
+    b->from.x = origin_x + (b->from.x - origin_x)*factor;
+    b->to.x = origin_x + (b->to.x - origin_x)*factor;
+}
+
+
+static void enlarge_scene(int factor)
+/**
+  Enlarges loaded scene 'factor' times along x axis: computational box, barriers,
+  cell blocks and tube bundles are stretched, so amount of work per thread stays
+  (roughly) constant in weak-scaling runs.
+*/
+{
+    if (factor <= 1)
+        return;
+
+    float origin_x = Simulation->settings.comp_box_from.x;
+    Simulation->settings.comp_box_to.x = origin_x + (Simulation->settings.comp_box_to.x - origin_x)*factor;
+
+    for (anyBarrier *b = scene::FirstBarrier; b; b = (anyBarrier *)b->next)
+        scale_along_x(b, origin_x, factor);
+
+    for (anyCellBlock *b = scene::FirstCellBlock; b; b = (anyCellBlock *)b->next)
+        scale_along_x(b, origin_x, factor);
+
+    for (anyTubeBundle *b = scene::FirstTubeBundle; b; b = (anyTubeBundle *)b->next)
+        scale_along_x(b, origin_x, factor);
+}
+
+
+static bool scaling_run(const char *fname, const char *directory, int threads, int enlarge, int steps, long *times)
+/**
+  Loads and generates scene, runs 'steps' time steps using 'threads' threads and
+  stores time of every phase (in milliseconds) in times[].
+
+  \param enlarge -- scene enlargement factor (1 for strong scaling)
+*/
+{
+    if (!load_scene(fname, directory))
+        return false;
+    enlarge_scene(enlarge);
+
+    // same initial configuration for every run...
+    srand(1);
+    generate_scene();
+
+    omp_set_num_threads(threads);
+    ResetTimer(TimerSimulationId);
+
+    try
+    {
+        for (int i = 0; i < steps; i++)
+            TimeStep();
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        return false;
+    }
+
+    for (int i = 0; i < no_scaling_timers; i++)
+        times[i] = GetTimer(scaling_timers[i]);
+
+    int no_cells = 0;
+    for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts; ts = ts->next)
+        no_cells += ts->no_cells[0];
+
+    printf("threads: %d; scene x%d; cells: %d; %s: %d; time: %ld ms\n",
+           threads, enlarge, no_cells, MODEL_TUBE_SHORTNAME_PL_PCHAR, Simulation->no_tubes, times[0]);
+    return true;
+}
+
+
+static void print_scaling_table(char const *title, long times[MAX_TIMERS][MAX_SCALING_THREADS], int max_threads, bool weak)
+/**
+  Prints phase times and parallel efficiency for 1..max_threads threads.
+
+  Strong scaling efficiency: T(1)/(n*T(n)), weak scaling efficiency: T(1)/T(n).
+*/
+{
+    printf("\n%s\n", title);
+    printf("%-22s", "phase");
+    for (int t = 1; t <= max_threads; t++)
+        printf(" %10d", t);
+    printf("\n");
+
+    for (int i = 0; i < no_scaling_timers; i++)
+    {
+        printf("%-22s", GetTimerName(scaling_timers[i]));
+        for (int t = 1; t <= max_threads; t++)
+            printf(" %8ldms", times[i][t - 1]);
+        printf("\n");
+
+        printf("%-22s", "  efficiency");
+        for (int t = 1; t <= max_threads; t++)
+        {
+            long t1 = times[i][0];
+            long tn = times[i][t - 1];
+            if (!t1 || !tn)
+                printf(" %10s", "-");
+            else
+                printf(" %9.0f%%", 100.0*t1/(weak ? tn : t*tn));
+        }
+        printf("\n");
+    }
+}
+
+
+static int scaling(const char *fname, const char *directory, int max_threads, int steps)
+/**
+  Strong- and weak-scaling sweeps: scene is run on 1..max_threads threads
+  (strong scaling), then scene enlarged n times is run on n threads (weak scaling).
+*/
+{
+    static long strong[MAX_TIMERS][MAX_SCALING_THREADS];
+    static long weak[MAX_TIMERS][MAX_SCALING_THREADS];
+
+    init_scaling_timers();
+
+    printf("\nStrong scaling, %d steps...\n", steps);
+    for (int t = 1; t <= max_threads; t++)
+    {
+        long times[MAX_TIMERS];
+        if (!scaling_run(fname, directory, t, 1, steps, times))
+            return 1;
+        for (int i = 0; i < no_scaling_timers; i++)
+            strong[i][t - 1] = times[i];
+    }
+
+    printf("\nWeak scaling, %d steps...\n", steps);
+    for (int t = 1; t <= max_threads; t++)
+    {
+        long times[MAX_TIMERS];
+        if (!scaling_run(fname, directory, t, t, steps, times))
+            return 1;
+        for (int i = 0; i < no_scaling_timers; i++)
+            weak[i][t - 1] = times[i];
+    }
+
+    print_scaling_table("Strong scaling (same scene, n threads):", strong, max_threads, false);
+    print_scaling_table("Weak scaling (scene enlarged n times along x, n threads):", weak, max_threads, true);
 
     return 0;
 }
+
+
+static void usage(char const *prog)
+{
+    printf("Usage: %s [options] <input-file> <output folder>\n", prog);
+    printf("Options:\n");
+    printf("  -steps <n>      stop after n steps (default: run until stop_time)\n");
+    printf("  -threads <n>    number of threads\n");
+    printf("  -scaling <n>    strong/weak-scaling sweep on 1..n threads, no output is saved\n");
+    printf("  -ensemble <f>   run every variant from ensemble file f on the same generated scene\n");
+    printf("  -jobs <n>       run n ensemble variants at the same time, one thread each (default: 1)\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s, %d.%d.%d\n", APP_NAME, MOTPUCA_VERSION, MOTPUCA_SUBVERSION, MOTPUCA_RELEASE);
+
+    GlobalSettings.run_env = sat::reDebug;
+    GlobalSettings.debug = (GlobalSettings.run_env != sat::reProduction);
+
+    int max_steps = 0;
+    int threads = 0;
+    int scaling_threads = 0;
+    char const *ensemble_fname = 0;
+    int jobs = 1;
+
+    // options...
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (!strcmp(argv[arg], "-steps") && arg + 1 < argc)
+            max_steps = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-threads") && arg + 1 < argc)
+            threads = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-scaling") && arg + 1 < argc)
+            scaling_threads = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-ensemble") && arg + 1 < argc)
+            ensemble_fname = argv[++arg];
+        else if (!strcmp(argv[arg], "-jobs") && arg + 1 < argc)
+            jobs = atoi(argv[++arg]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - arg < 2 || scaling_threads < 0 || scaling_threads > MAX_SCALING_THREADS)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    DefineAllTimers();
+
+    if (scaling_threads)
+        return scaling(argv[arg], argv[arg + 1], scaling_threads, max_steps ? max_steps : DEFAULT_SCALING_STEPS);
+
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    if (ensemble_fname)
+    {
+        int ret = ensemble(ensemble_fname, argv[arg], argv[arg + 1], max_steps, jobs);
+        if (jobs <= 1)
+            report_timers();
+        return ret;
+    }
+
+    if (!load_scene(argv[arg], argv[arg + 1])) return 1;
+    generate_scene();
+
+
+
+    bool ok = run_simulation(max_steps, OutputWriter, "");
+
+    report_timers();
+    printf("%s\n", OutputWriter.report(Simulation->settings.step));
+
+    return ok ? 0 : 1;
+}
@@ -48,13 +48,13 @@ void anyBarrier::read_defaults()
     {
         LOG2(llInfo, "Reading defaults for Barrier: ", fname);
 
-        FILE *f = fopen(fname, "r");
+        FILE *f = ParserOpen(fname);
         if (!f)
             throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
 
         scene::ParseBarrier(f, this, false);
 
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
@@ -52,13 +52,13 @@ void anyCellBlock::read_defaults()
     {
         LOG2(llInfo, "Reading defaults for CellBlock: ", fname);
 
-        FILE *f = fopen(fname, "r");
+        FILE *f = ParserOpen(fname);
         if (!f)
             throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
 
         scene::ParseCellBlock(f, this, false);
 
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
@@ -109,7 +109,7 @@ void anyCellBlock::update_from_dialog()
     anyEditable::update_from_dialog();
 
     // find and update tissue...
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
     while (ts)
     {
         if (QString(ts->name) == dialog->dialog->comboBox_tissue->currentText())
@@ -135,7 +135,7 @@ void anyEditable::prepare_dialog()
     }
 
     // build tissue combo... (version #1)
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
     while (ts)
     {
         dialog->dialog->comboBox_tissue->addItem(ts->name);
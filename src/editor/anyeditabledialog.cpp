@@ -103,7 +103,7 @@ void anyEditableDialog::slot_add_tissue_clicked()
     {
         // rebuild tissue combo... (version #1)
         dialog->comboBox_tissue->clear();
-        ts = scene::FirstTissueSettings;
+        ts = Simulation->first_tissue_settings;
         while (ts)
         {
             dialog->comboBox_tissue->addItem(ts->name);
@@ -128,7 +128,7 @@ void anyEditableDialog::slot_load_tissue_clicked()
 
     try
     {
-        FILE *f = fopen(fileopendialog.selectedFiles().at(0).toLatin1(), "r");
+        FILE *f = ParserOpen(fileopendialog.selectedFiles().at(0).toLatin1());
         if (!f)
             throw new Error(__FILE__, __LINE__, (QString("Cannot open file: ") + fileopendialog.selectedFiles().at(0)).toLatin1());
 
@@ -136,7 +136,7 @@ void anyEditableDialog::slot_load_tissue_clicked()
         snprintf(basefile, P_MAX_PATH, "%sinclude/base.ag", GlobalSettings.app_dir);
         ParseFile(basefile, false);
         scene::ParseTissueSettings(f, (anyTissueSettings *)editable, false);
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
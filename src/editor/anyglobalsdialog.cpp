@@ -22,11 +22,11 @@ anyGlobalsDialog::anyGlobalsDialog()
     connect(dialog->pushButton_colorcellnecrosis, SIGNAL(clicked()), this, SLOT(slot_color_clicked()));
     connect(dialog->pushButton_colorcellapoptosis, SIGNAL(clicked()), this, SLOT(slot_color_clicked()));
 
-    dialog->doubleSpinBox_boxsize->setEnabled(!GlobalSettings.simulation_allocated);
-    dialog->spinBox_cellsperbox->setEnabled(!GlobalSettings.simulation_allocated);
-    dialog->spinBox_max_tube_chains->setEnabled(!GlobalSettings.simulation_allocated);
+    dialog->doubleSpinBox_boxsize->setEnabled(!Simulation->allocated);
+    dialog->spinBox_cellsperbox->setEnabled(!Simulation->allocated);
+    dialog->spinBox_max_tube_chains->setEnabled(!Simulation->allocated);
 
-    dialog->spinBox_graphrate->setEnabled(!Statistics);
+    dialog->spinBox_graphrate->setEnabled(Simulation->statistics.empty());
 
     // align columns...
     ColumnResizer* resizer = new ColumnResizer(this);
@@ -97,51 +97,51 @@ void anyGlobalsDialog::prepare_dialog()
     // set up fields...
 
     // simulation settings...
-    dialog->doubleSpinBox_timestep->setValue(SimulationSettings.time_step);
-    dialog->radioButton_2d->setChecked(SimulationSettings.dimensions == 2);
-    dialog->radioButton_3d->setChecked(SimulationSettings.dimensions == 3);
-    dialog->doubleSpinBox_boxsize->setValue(SimulationSettings.box_size);
-    dialog->spinBox_cellsperbox->setValue(SimulationSettings.max_cells_per_box);
-    dialog->doubleSpinBox_forcercut->setValue(SimulationSettings.force_r_cut);
-    dialog->doubleSpinBox_proliferative_o2->setValue(SimulationSettings.proliferative_o2);
-    dialog->doubleSpinBox_medicine_threshold->setValue(SimulationSettings.medicine_threshold);
-    dialog->spinBox_max_tube_chains->setValue(SimulationSettings.max_tube_chains);
-    dialog->doubleSpinBox_add_medicine->setValue(SimulationSettings.add_medicine);
-    dialog->doubleSpinBox_remove_medicine->setValue(SimulationSettings.remove_medicine);
-    dialog->doubleSpinBox_activation_steps->setValue(SimulationSettings.activation_steps);
-    dialog->doubleSpinBox_diffcoefO2->setValue(SimulationSettings.diffusion_coeff[sat::dsO2]);
-    dialog->doubleSpinBox_diffcoefTAF->setValue(SimulationSettings.diffusion_coeff[sat::dsTAF]);
-    dialog->doubleSpinBox_diffcoefPeri->setValue(SimulationSettings.diffusion_coeff[sat::dsPericytes]);
-    dialog->doubleSpinBox_diffcoefMedicine->setValue(SimulationSettings.diffusion_coeff[sat::dsMedicine]);
-    dialog->doubleSpinBox_stop_time->setValue(SimulationSettings.stop_time);
-
-    dialog->spinBox_savepovray->setValue(SimulationSettings.save_povray);
-    dialog->spinBox_saveag->setValue(SimulationSettings.save_ag);
-    dialog->spinBox_savestats->setValue(SimulationSettings.save_statistics);
-    dialog->spinBox_graphrate->setValue(SimulationSettings.graph_sampling);
-
-    dialog->checkBox_sim_diffusion->setChecked(SimulationSettings.sim_phases & sat::spDiffusion);
-    dialog->checkBox_sim_forces->setChecked(SimulationSettings.sim_phases & sat::spForces);
-    dialog->checkBox_sim_mitosis->setChecked(SimulationSettings.sim_phases & sat::spMitosis);
-    dialog->checkBox_sim_tube_div->setChecked(SimulationSettings.sim_phases & sat::spTubeDiv);
-    dialog->checkBox_sim_flow->setChecked(SimulationSettings.sim_phases & sat::spBloodFlow);
-    dialog->checkBox_sim_growth->setChecked(SimulationSettings.sim_phases & sat::spGrow);
+    dialog->doubleSpinBox_timestep->setValue(Simulation->settings.time_step);
+    dialog->radioButton_2d->setChecked(Simulation->settings.dimensions == 2);
+    dialog->radioButton_3d->setChecked(Simulation->settings.dimensions == 3);
+    dialog->doubleSpinBox_boxsize->setValue(Simulation->settings.box_size);
+    dialog->spinBox_cellsperbox->setValue(Simulation->settings.max_cells_per_box);
+    dialog->doubleSpinBox_forcercut->setValue(Simulation->settings.force_r_cut);
+    dialog->doubleSpinBox_proliferative_o2->setValue(Simulation->settings.proliferative_o2);
+    dialog->doubleSpinBox_medicine_threshold->setValue(Simulation->settings.medicine_threshold);
+    dialog->spinBox_max_tube_chains->setValue(Simulation->settings.max_tube_chains);
+    dialog->doubleSpinBox_add_medicine->setValue(Simulation->settings.add_medicine);
+    dialog->doubleSpinBox_remove_medicine->setValue(Simulation->settings.remove_medicine);
+    dialog->doubleSpinBox_activation_steps->setValue(Simulation->settings.activation_steps);
+    dialog->doubleSpinBox_diffcoefO2->setValue(Simulation->settings.diffusion_coeff[sat::dsO2]);
+    dialog->doubleSpinBox_diffcoefTAF->setValue(Simulation->settings.diffusion_coeff[sat::dsTAF]);
+    dialog->doubleSpinBox_diffcoefPeri->setValue(Simulation->settings.diffusion_coeff[sat::dsPericytes]);
+    dialog->doubleSpinBox_diffcoefMedicine->setValue(Simulation->settings.diffusion_coeff[sat::dsMedicine]);
+    dialog->doubleSpinBox_stop_time->setValue(Simulation->settings.stop_time);
+
+    dialog->spinBox_savepovray->setValue(Simulation->settings.save_povray);
+    dialog->spinBox_saveag->setValue(Simulation->settings.save_ag);
+    dialog->spinBox_savestats->setValue(Simulation->settings.save_statistics);
+    dialog->spinBox_graphrate->setValue(Simulation->settings.graph_sampling);
+
+    dialog->checkBox_sim_diffusion->setChecked(Simulation->settings.sim_phases & sat::spDiffusion);
+    dialog->checkBox_sim_forces->setChecked(Simulation->settings.sim_phases & sat::spForces);
+    dialog->checkBox_sim_mitosis->setChecked(Simulation->settings.sim_phases & sat::spMitosis);
+    dialog->checkBox_sim_tube_div->setChecked(Simulation->settings.sim_phases & sat::spTubeDiv);
+    dialog->checkBox_sim_flow->setChecked(Simulation->settings.sim_phases & sat::spBloodFlow);
+    dialog->checkBox_sim_growth->setChecked(Simulation->settings.sim_phases & sat::spGrow);
 
     // tubular system settings...
-    dialog->lineEdit_o2prod->setText(QString::number(TubularSystemSettings.o2_production));
-    dialog->doubleSpinBox_tube_density->setValue(TubularSystemSettings.density);
-    dialog->lineEdit_tube_force_length->setText(QString::number(TubularSystemSettings.force_length_keep_factor));
-    dialog->lineEdit_tube_force_angle->setText(QString::number(TubularSystemSettings.force_angle_factor));
-    dialog->lineEdit_tube_force_bind->setText(QString::number(TubularSystemSettings.force_chain_attr_factor));
-    dialog->lineEdit_lengthening_speed->setText(QString::number(TubularSystemSettings.lengthening_speed));
-    dialog->lineEdit_thickening_speed->setText(QString::number(TubularSystemSettings.thickening_speed));
-    dialog->lineEdit_tube_rep_factor->setText(QString::number(TubularSystemSettings.force_rep_factor));
-    dialog->lineEdit_tube_atr1_factor->setText(QString::number(TubularSystemSettings.force_atr1_factor));
-    dialog->lineEdit_tube_atr2_factor->setText(QString::number(TubularSystemSettings.force_atr2_factor));
-    dialog->doubleSpinBox_tube_min_interphase_time->setValue(TubularSystemSettings.minimum_interphase_time);
-    dialog->doubleSpinBox_tube_TAF_trigger->setValue(TubularSystemSettings.TAFtrigger);
-    dialog->doubleSpinBox_tube_min_blood_flow->setValue(TubularSystemSettings.minimum_blood_flow);
-    dialog->doubleSpinBox_tube_time_degradation->setValue(TubularSystemSettings.time_to_degradation);
+    dialog->lineEdit_o2prod->setText(QString::number(Simulation->tubular_settings.o2_production));
+    dialog->doubleSpinBox_tube_density->setValue(Simulation->tubular_settings.density);
+    dialog->lineEdit_tube_force_length->setText(QString::number(Simulation->tubular_settings.force_length_keep_factor));
+    dialog->lineEdit_tube_force_angle->setText(QString::number(Simulation->tubular_settings.force_angle_factor));
+    dialog->lineEdit_tube_force_bind->setText(QString::number(Simulation->tubular_settings.force_chain_attr_factor));
+    dialog->lineEdit_lengthening_speed->setText(QString::number(Simulation->tubular_settings.lengthening_speed));
+    dialog->lineEdit_thickening_speed->setText(QString::number(Simulation->tubular_settings.thickening_speed));
+    dialog->lineEdit_tube_rep_factor->setText(QString::number(Simulation->tubular_settings.force_rep_factor));
+    dialog->lineEdit_tube_atr1_factor->setText(QString::number(Simulation->tubular_settings.force_atr1_factor));
+    dialog->lineEdit_tube_atr2_factor->setText(QString::number(Simulation->tubular_settings.force_atr2_factor));
+    dialog->doubleSpinBox_tube_min_interphase_time->setValue(Simulation->tubular_settings.minimum_interphase_time);
+    dialog->doubleSpinBox_tube_TAF_trigger->setValue(Simulation->tubular_settings.TAFtrigger);
+    dialog->doubleSpinBox_tube_min_blood_flow->setValue(Simulation->tubular_settings.minimum_blood_flow);
+    dialog->doubleSpinBox_tube_time_degradation->setValue(Simulation->tubular_settings.time_to_degradation);
 
     // visual settings...
     set_color_of_button(dialog->pushButton_colorbackground, VisualSettings.bkg_color);
@@ -181,52 +181,52 @@ anyColor anyGlobalsDialog::get_color_from_button(QPushButton *button) const
 void anyGlobalsDialog::update_from_dialog()
 {
     // simulation settings...
-    SimulationSettings.time_step = dialog->doubleSpinBox_timestep->value();
-    SimulationSettings.dimensions = 2 + dialog->radioButton_3d->isChecked();
-    SimulationSettings.box_size = dialog->doubleSpinBox_boxsize->value();
-    SimulationSettings.max_cells_per_box = dialog->spinBox_cellsperbox->value();
-    SimulationSettings.force_r_cut = dialog->doubleSpinBox_forcercut->value();
-    SimulationSettings.proliferative_o2 = dialog->doubleSpinBox_proliferative_o2->value();
-    SimulationSettings.medicine_threshold = dialog->doubleSpinBox_medicine_threshold->value();
-    SimulationSettings.max_tube_chains = dialog->spinBox_max_tube_chains->value();
-    SimulationSettings.activation_steps = dialog->doubleSpinBox_activation_steps->value();
-    SimulationSettings.diffusion_coeff[sat::dsO2] = dialog->doubleSpinBox_diffcoefO2->value();
-    SimulationSettings.diffusion_coeff[sat::dsTAF] = dialog->doubleSpinBox_diffcoefTAF->value();
-    SimulationSettings.diffusion_coeff[sat::dsPericytes] = dialog->doubleSpinBox_diffcoefPeri->value();
-    SimulationSettings.diffusion_coeff[sat::dsMedicine] = dialog->doubleSpinBox_diffcoefMedicine->value();
-
-    SimulationSettings.save_povray = dialog->spinBox_savepovray->value();
-    SimulationSettings.save_ag = dialog->spinBox_saveag->value();
-    SimulationSettings.save_statistics = dialog->spinBox_savestats->value();
-
-    SimulationSettings.add_medicine = dialog->doubleSpinBox_add_medicine->value();
-    SimulationSettings.remove_medicine = dialog->doubleSpinBox_remove_medicine->value();
-
-    SimulationSettings.graph_sampling = dialog->spinBox_graphrate->value();
-
-    SimulationSettings.sim_phases = dialog->checkBox_sim_diffusion->isChecked()*sat::spDiffusion +
+    Simulation->settings.time_step = dialog->doubleSpinBox_timestep->value();
+    Simulation->settings.dimensions = 2 + dialog->radioButton_3d->isChecked();
+    Simulation->settings.box_size = dialog->doubleSpinBox_boxsize->value();
+    Simulation->settings.max_cells_per_box = dialog->spinBox_cellsperbox->value();
+    Simulation->settings.force_r_cut = dialog->doubleSpinBox_forcercut->value();
+    Simulation->settings.proliferative_o2 = dialog->doubleSpinBox_proliferative_o2->value();
+    Simulation->settings.medicine_threshold = dialog->doubleSpinBox_medicine_threshold->value();
+    Simulation->settings.max_tube_chains = dialog->spinBox_max_tube_chains->value();
+    Simulation->settings.activation_steps = dialog->doubleSpinBox_activation_steps->value();
+    Simulation->settings.diffusion_coeff[sat::dsO2] = dialog->doubleSpinBox_diffcoefO2->value();
+    Simulation->settings.diffusion_coeff[sat::dsTAF] = dialog->doubleSpinBox_diffcoefTAF->value();
+    Simulation->settings.diffusion_coeff[sat::dsPericytes] = dialog->doubleSpinBox_diffcoefPeri->value();
+    Simulation->settings.diffusion_coeff[sat::dsMedicine] = dialog->doubleSpinBox_diffcoefMedicine->value();
+
+    Simulation->settings.save_povray = dialog->spinBox_savepovray->value();
+    Simulation->settings.save_ag = dialog->spinBox_saveag->value();
+    Simulation->settings.save_statistics = dialog->spinBox_savestats->value();
+
+    Simulation->settings.add_medicine = dialog->doubleSpinBox_add_medicine->value();
+    Simulation->settings.remove_medicine = dialog->doubleSpinBox_remove_medicine->value();
+
+    Simulation->settings.graph_sampling = dialog->spinBox_graphrate->value();
+
+    Simulation->settings.sim_phases = dialog->checkBox_sim_diffusion->isChecked()*sat::spDiffusion +
                                     dialog->checkBox_sim_forces->isChecked()*sat::spForces +
                                     dialog->checkBox_sim_growth->isChecked()*sat::spGrow +
                                     dialog->checkBox_sim_mitosis->isChecked()*sat::spMitosis +
                                     dialog->checkBox_sim_tube_div->isChecked()*sat::spTubeDiv +
                                     dialog->checkBox_sim_flow->isChecked()*sat::spBloodFlow;
-    SimulationSettings.stop_time = billion_to_inf(dialog->doubleSpinBox_stop_time->value());
+    Simulation->settings.stop_time = billion_to_inf(dialog->doubleSpinBox_stop_time->value());
 
     // tubular system settings...
-    TubularSystemSettings.o2_production = dialog->lineEdit_o2prod->text().toDouble();
-    TubularSystemSettings.density = dialog->doubleSpinBox_tube_density->value();
-    TubularSystemSettings.force_length_keep_factor = dialog->lineEdit_tube_force_length->text().toDouble();
-    TubularSystemSettings.force_angle_factor = dialog->lineEdit_tube_force_angle->text().toDouble();
-    TubularSystemSettings.force_chain_attr_factor = dialog->lineEdit_tube_force_bind->text().toDouble();
-    TubularSystemSettings.lengthening_speed = dialog->lineEdit_lengthening_speed->text().toDouble();
-    TubularSystemSettings.thickening_speed = dialog->lineEdit_thickening_speed->text().toDouble();
-    TubularSystemSettings.force_rep_factor = dialog->lineEdit_tube_rep_factor->text().toDouble();
-    TubularSystemSettings.force_atr1_factor = dialog->lineEdit_tube_atr1_factor->text().toDouble();
-    TubularSystemSettings.force_atr2_factor = dialog->lineEdit_tube_atr2_factor->text().toDouble();
-    TubularSystemSettings.minimum_interphase_time = dialog->doubleSpinBox_tube_min_interphase_time->value();
-    TubularSystemSettings.TAFtrigger = dialog->doubleSpinBox_tube_TAF_trigger->value();
-    TubularSystemSettings.minimum_blood_flow = dialog->doubleSpinBox_tube_min_blood_flow->value();
-    TubularSystemSettings.time_to_degradation = billion_to_inf(dialog->doubleSpinBox_tube_time_degradation->value());
+    Simulation->tubular_settings.o2_production = dialog->lineEdit_o2prod->text().toDouble();
+    Simulation->tubular_settings.density = dialog->doubleSpinBox_tube_density->value();
+    Simulation->tubular_settings.force_length_keep_factor = dialog->lineEdit_tube_force_length->text().toDouble();
+    Simulation->tubular_settings.force_angle_factor = dialog->lineEdit_tube_force_angle->text().toDouble();
+    Simulation->tubular_settings.force_chain_attr_factor = dialog->lineEdit_tube_force_bind->text().toDouble();
+    Simulation->tubular_settings.lengthening_speed = dialog->lineEdit_lengthening_speed->text().toDouble();
+    Simulation->tubular_settings.thickening_speed = dialog->lineEdit_thickening_speed->text().toDouble();
+    Simulation->tubular_settings.force_rep_factor = dialog->lineEdit_tube_rep_factor->text().toDouble();
+    Simulation->tubular_settings.force_atr1_factor = dialog->lineEdit_tube_atr1_factor->text().toDouble();
+    Simulation->tubular_settings.force_atr2_factor = dialog->lineEdit_tube_atr2_factor->text().toDouble();
+    Simulation->tubular_settings.minimum_interphase_time = dialog->doubleSpinBox_tube_min_interphase_time->value();
+    Simulation->tubular_settings.TAFtrigger = dialog->doubleSpinBox_tube_TAF_trigger->value();
+    Simulation->tubular_settings.minimum_blood_flow = dialog->doubleSpinBox_tube_min_blood_flow->value();
+    Simulation->tubular_settings.time_to_degradation = billion_to_inf(dialog->doubleSpinBox_tube_time_degradation->value());
 
     // visual settings...
     VisualSettings.bkg_color.set_skip_alpha(get_color_from_button(dialog->pushButton_colorbackground));
@@ -18,9 +18,7 @@ public:
     char user_dir[P_MAX_PATH];   ///< user data
     char temp_dir[P_MAX_PATH];   ///< temp dir
     char input_file[P_MAX_PATH]; ///< input file name
-    char output_dir[P_MAX_PATH]; ///< output file name
     sat::anyRunEnv run_env;    ///< environment
-    bool simulation_allocated; ///< simulation is allocated?
     bool save_needed;          ///< save needed?
 
 #ifdef QT_CORE_LIB
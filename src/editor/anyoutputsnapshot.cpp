@@ -0,0 +1,65 @@
+#include <string.h>
+#include <map>
+
+#include "anyoutputsnapshot.h"
+#include "config.h"
+
+
+void anyOutputSnapshot::capture(bool cells_and_tubes)
+/**
+  Copies settings and (optionally) cells and tubes. Must not run in parallel with TimeStep().
+*/
+{
+    source = Simulation;
+    step = Simulation->settings.step;
+    strncpy(output_dir, Simulation->output_dir, P_MAX_PATH - 1);
+    output_dir[P_MAX_PATH - 1] = 0;
+    simulation = Simulation->settings;
+    visual = VisualSettings;
+    tubular = Simulation->tubular_settings;
+
+    cells.clear();
+    tubes.clear();
+    chains.clear();
+    if (!cells_and_tubes)
+        return;
+
+    // cells...
+    if (Simulation->cells)
+    {
+        int first_cell = 0;
+        for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+        {
+            for (int i = 0; i < Simulation->cells[first_cell].no_cells_in_box; i++)
+                if (Simulation->cells[first_cell + i].state != sat::csRemoved)
+                    cells.push_back(Simulation->cells[first_cell + i]);
+            first_cell += Simulation->settings.max_cells_per_box;
+        }
+    }
+
+    // tubes (no reallocation after first copy, links point into tubes[])...
+    std::map<anyTube const *, anyTube *> copies;
+    tubes.reserve(Simulation->no_tubes);
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+        for (anyTube const *v = Simulation->tube_chains[i]->head; v && (int)tubes.size() < Simulation->no_tubes; v = v->next)
+            tubes.push_back(*v);
+
+    int t = 0;
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+        for (anyTube const *v = Simulation->tube_chains[i]->head; v && t < (int)tubes.size(); v = v->next)
+            copies[v] = &tubes[t++];
+
+    for (unsigned i = 0; i < tubes.size(); i++)
+    {
+        anyTube &v = tubes[i];
+        v.next = copies.count(v.next) ? copies[v.next] : 0;
+        v.prev = copies.count(v.prev) ? copies[v.prev] : 0;
+        v.fork = copies.count(v.fork) ? copies[v.fork] : 0;
+        v.base = copies.count(v.base) ? copies[v.base] : 0;
+        v.top = copies.count(v.top) ? copies[v.top] : 0;
+        v.jab = copies.count(v.jab) ? copies[v.jab] : 0;
+        v.chain = 0;
+        if (!v.prev)
+            chains.push_back(&v);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef ANYOUTPUTSNAPSHOT_H
+#define ANYOUTPUTSNAPSHOT_H
+
+#include <vector>
+
+#include "const.h"
+#include "anycell.h"
+#include "anytube.h"
+#include "anysimulationsettings.h"
+#include "anyvisualsettings.h"
+#include "anytubularsystemsettings.h"
+
+class anySimulation;
+
+
+class anyOutputSnapshot
+/**
+  Copy of scene state needed by output files (*.ag, povray), taken between time
+  steps. Tubes are copied chain after chain, their links point to the copies.
+
+  Tissues, barriers, blocks, bundles and lines are not copied (they do not change
+  while simulation runs), jobs writing snapshot read them from source simulation.
+*/
+{
+public:
+    anySimulation *source;             ///< simulation snapshot was taken from
+    int step;                          ///< simulation step
+    char output_dir[P_MAX_PATH];       ///< output directory
+    anySimulationSettings simulation;  ///< simulation settings
+    anyVisualSettings visual;          ///< visual settings
+    anyTubularSystemSettings tubular;  ///< tubular system settings
+    std::vector<anyCell> cells;        ///< cells (without removed ones)
+    std::vector<anyTube> tubes;        ///< tubes
+    std::vector<anyTube *> chains;     ///< first tube of every chain
+
+    anyOutputSnapshot(): source(0), step(0) { output_dir[0] = 0; }
+
+    void capture(bool cells_and_tubes);
+};
+
+
+#endif // ANYOUTPUTSNAPSHOT_H
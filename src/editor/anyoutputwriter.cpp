@@ -0,0 +1,178 @@
+#include <stdio.h>
+
+#include "anyoutputwriter.h"
+#include "timers.h"
+#include "log.h"
+
+anyOutputWriter OutputWriter;  ///< writer of output files (statistics, povray, ag)
+
+
+void anyOutputWriter::start(int no_threads, int queue_size)
+/**
+  Starts writer threads (previous ones are finished first).
+
+  \param no_threads -- number of writer threads (0 -- write jobs in submit())
+  \param queue_size -- maximum number of jobs waiting in queue
+*/
+{
+    shutdown();
+
+    stop = false;
+    max_queue = queue_size > 0 ? queue_size : 1;
+    wait_time = 0;
+    jobs_written = 0;
+    max_lag = 0;
+
+    for (int i = 0; i < no_threads; i++)
+        threads.push_back(std::thread(&anyOutputWriter::thread_main, this));
+}
+
+
+void anyOutputWriter::write_job(anyOutputJob *job)
+{
+    try
+    {
+        job->write();
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+    }
+    delete job;
+}
+
+
+void anyOutputWriter::thread_main()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        while (!stop && queue.empty())
+            job_added.wait(lock);
+        if (queue.empty())
+            return;
+
+        anyOutputJob *job = queue.front();
+        queue.pop_front();
+        running_steps.push_back(job->step);
+        int step = job->step;
+        job_done.notify_all();  // place in queue is free
+
+        lock.unlock();
+        write_job(job);
+        lock.lock();
+
+        for (unsigned i = 0; i < running_steps.size(); i++)
+            if (running_steps[i] == step)
+            {
+                running_steps.erase(running_steps.begin() + i);
+                break;
+            }
+        jobs_written++;
+        job_done.notify_all();
+    }
+}
+
+
+void anyOutputWriter::submit(anyOutputJob *job)
+/**
+  Queues job (takes ownership). Waits if queue is full.
+*/
+{
+    if (threads.empty())
+    {
+        write_job(job);
+        jobs_written++;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if ((int)queue.size() >= max_queue)
+    {
+        long t = Time();
+        while ((int)queue.size() >= max_queue)
+            job_done.wait(lock);
+        wait_time += Time() - t;
+    }
+
+    queue.push_back(job);
+    int l = lag_locked(job->step);
+    if (l > max_lag)
+        max_lag = l;
+    job_added.notify_one();
+}
+
+
+void anyOutputWriter::flush()
+/**
+  Waits until all queued jobs are written.
+*/
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!queue.empty() || !running_steps.empty())
+        job_done.wait(lock);
+}
+
+
+void anyOutputWriter::shutdown()
+/**
+  Writes queued jobs and finishes threads.
+*/
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    job_added.notify_all();
+    for (unsigned i = 0; i < threads.size(); i++)
+        threads[i].join();
+    threads.clear();
+}
+
+
+int anyOutputWriter::pending()
+/**
+  Returns number of jobs queued or being written.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size() + running_steps.size();
+}
+
+
+int anyOutputWriter::lag(int step)
+/**
+  Returns number of steps between given step and oldest data not written yet.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lag_locked(step);
+}
+
+
+int anyOutputWriter::lag_locked(int step)
+{
+    int oldest = step;
+    for (unsigned i = 0; i < queue.size(); i++)
+        if (queue[i]->step < oldest)
+            oldest = queue[i]->step;
+    for (unsigned i = 0; i < running_steps.size(); i++)
+        if (running_steps[i] < oldest)
+            oldest = running_steps[i];
+    return step - oldest;
+}
+
+
+char *anyOutputWriter::report(int step)
+/**
+  Returns output latency report.
+*/
+{
+    static thread_local char r[200];
+    std::lock_guard<std::mutex> lock(mutex);
+    int p = queue.size() + running_steps.size();
+    int l = lag_locked(step);
+    snprintf(r, 200, "Output: %d files written, %d pending (%d steps behind), max. %d steps behind, waited %.3f s for queue",
+             jobs_written, p, l, max_lag, wait_time/1000.0);
+    return r;
+}
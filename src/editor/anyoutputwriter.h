@@ -0,0 +1,76 @@
+#ifndef ANYOUTPUTWRITER_H
+#define ANYOUTPUTWRITER_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "const.h"
+
+
+class anyOutputJob
+/**
+  Output file written from data captured at step boundary. Captured data must not
+  refer to scene memory changed by simulation (cells, tubes, settings), so write()
+  can run in writer thread while next steps are simulated.
+*/
+{
+public:
+    int step;                 ///< simulation step of captured data
+    char fname[P_MAX_PATH];   ///< output file name
+
+    anyOutputJob(): step(0) { fname[0] = 0; }
+    virtual ~anyOutputJob() {}
+
+    virtual void write() = 0;
+};
+
+
+class anyOutputWriter
+/**
+  Pool of writer threads with bounded queue of output jobs.
+
+  submit() blocks while queue is full (backpressure), so simulation is never more
+  than max_queue jobs ahead of disk. Without threads jobs are written at once.
+*/
+{
+private:
+    std::vector<std::thread> threads;
+    std::deque<anyOutputJob *> queue;
+    std::vector<int> running_steps;  ///< steps of jobs being written
+    std::mutex mutex;
+    std::condition_variable job_added;
+    std::condition_variable job_done;
+    int max_queue;
+    bool stop;
+
+    // statistics...
+    long wait_time;           ///< time spent in submit() waiting for free place [ms]
+    int jobs_written;         ///< number of written jobs
+    int max_lag;              ///< maximum number of steps between submitted and written data
+
+    void thread_main();
+    void write_job(anyOutputJob *job);
+    int lag_locked(int step);
+
+public:
+    anyOutputWriter(): max_queue(0), stop(false), wait_time(0), jobs_written(0), max_lag(0) {}
+    ~anyOutputWriter() { shutdown(); }
+
+    void start(int no_threads, int queue_size);
+    void submit(anyOutputJob *job);
+    void flush();
+    void shutdown();
+
+    int pending();
+    int lag(int step);
+    char *report(int step);
+};
+
+
+extern anyOutputWriter OutputWriter;
+
+
+#endif // ANYOUTPUTWRITER_H
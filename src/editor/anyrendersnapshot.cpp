@@ -0,0 +1,171 @@
+#include <math.h>
+
+#include "anyrendersnapshot.h"
+#include "config.h"
+#include "anycell.h"
+#include "anytube.h"
+
+#define SNAPSHOT_FRESH 4
+
+anyRenderSnapshotBuffer RenderSnapshot;  ///< snapshot shared by simulation thread and main view
+
+
+anyRenderSnapshot::~anyRenderSnapshot()
+{
+    delete [] cells;
+    delete [] box_first;
+    delete [] box_fill;
+    delete [] tubes;
+}
+
+
+void anyRenderSnapshot::capture()
+/**
+  Copies current cells and tubes. Must not run in parallel with TimeStep().
+*/
+{
+    step = Simulation->settings.step;
+    no_cells = no_tubes = no_boxes = 0;
+    pressure_avg = 0;
+    max_cell_r = 0;
+
+    if (!Simulation->cells)
+        return;
+
+    // cells...
+    int total_no_cells = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+        total_no_cells += Simulation->cells[box_id*Simulation->settings.max_cells_per_box].no_cells_in_box;
+
+    if (cells_size < total_no_cells)
+    {
+        delete [] cells;
+        cells_size = total_no_cells*3/2;
+        cells = new anySnapshotCell[cells_size];
+    }
+
+    if (boxes_size < Simulation->settings.no_boxes + 1)
+    {
+        delete [] box_first;
+        delete [] box_fill;
+        boxes_size = Simulation->settings.no_boxes + 1;
+        box_first = new int[boxes_size];
+        box_fill = new float[boxes_size];
+    }
+    no_boxes = Simulation->settings.no_boxes;
+    float box_volume = Simulation->settings.box_size*Simulation->settings.box_size*Simulation->settings.box_size;
+
+    int frame = !(Simulation->settings.step % 2);
+    int first_cell = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+    {
+        int cnt = Simulation->cells[first_cell].no_cells_in_box;
+        float cells_volume = 0;
+        box_first[box_id] = no_cells;
+        for (int i = 0; i < cnt; i++)
+        {
+            anyCell const *c = Simulation->cells + first_cell + i;
+            if (c->state == sat::csRemoved)
+                continue;
+
+            anySnapshotCell &sc = cells[no_cells++];
+            sc.pos = c->pos;
+            sc.r = c->r;
+            sc.tissue = c->tissue;
+            sc.state = c->state;
+            sc.pressure = c->pressure_prev;
+            for (int k = 0; k < sat::dsLast; k++)
+                sc.concentrations[k] = c->concentrations[k][frame];
+
+            pressure_avg += c->pressure_avg;
+            cells_volume += (4*M_PI/3)*(c->r*c->r*c->r);
+            if (c->r > max_cell_r)
+                max_cell_r = c->r;
+        }
+        box_fill[box_id] = box_volume > 0 ? cells_volume/box_volume : 0;
+        first_cell += Simulation->settings.max_cells_per_box;
+    }
+    box_first[no_boxes] = no_cells;
+    if (no_cells)
+        pressure_avg /= no_cells;
+
+    // tubes...
+    if (tubes_size < Simulation->no_tubes)
+    {
+        delete [] tubes;
+        tubes_size = Simulation->no_tubes*3/2;
+        tubes = new anySnapshotTube[tubes_size];
+    }
+
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+        for (anyTube const *v = Simulation->tube_chains[i]->head; v && no_tubes < tubes_size; v = v->next)
+        {
+            anySnapshotTube &st = tubes[no_tubes++];
+            st.pos1 = v->pos1;
+            st.pos2 = v->pos2;
+            st.r = v->r;
+            st.fixed_blood_pressure = v->fixed_blood_pressure;
+            st.blood_flow = v->blood_flow;
+        }
+}
+
+
+static int count_boxed_cells()
+/**
+  Returns sum of box counters (cheap, no loop over cells).
+*/
+{
+    int no_cells = 0;
+    if (Simulation->cells)
+        for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+            no_cells += Simulation->cells[box_id*Simulation->settings.max_cells_per_box].no_cells_in_box;
+    return no_cells;
+}
+
+
+void anyRenderSnapshotBuffer::publish()
+/**
+  Captures scene into back frame and makes it the latest frame (writer side).
+*/
+{
+    frames[back].capture();
+    frames[back].serial = ++published_serial;
+
+    published_step = frames[back].step;
+    published_cells = Simulation->cells;
+    published_no_cells = count_boxed_cells();
+    published_last_tube_id = Simulation->last_tube_id;
+    valid = true;
+
+    back = ready.exchange(back | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+
+bool anyRenderSnapshotBuffer::publish_if_changed()
+/**
+  Publishes new frame only if scene has changed since last publish (cheap check:
+  step, cells array, box counters and last tube id). Used when simulation is
+  paused, so repainting static scene does not copy cells again.
+
+  \returns true if new frame was published
+*/
+{
+    if (valid && published_step == Simulation->settings.step && published_cells == Simulation->cells
+        && published_last_tube_id == Simulation->last_tube_id)
+        if (count_boxed_cells() == published_no_cells)
+            return false;
+
+    publish();
+    return true;
+}
+
+
+anyRenderSnapshot const *anyRenderSnapshotBuffer::acquire()
+/**
+  Returns latest published frame (reader side). Returned frame stays valid until next acquire().
+*/
+{
+    if (ready.load() & SNAPSHOT_FRESH)
+        front = ready.exchange(front) & ~SNAPSHOT_FRESH;
+    return frames + front;
+}
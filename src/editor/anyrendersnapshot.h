@@ -0,0 +1,104 @@
+#ifndef ANYRENDERSNAPSHOT_H
+#define ANYRENDERSNAPSHOT_H
+
+#include <atomic>
+
+#include "const.h"
+#include "anyvector.h"
+
+class anyTissueSettings;
+class anyCell;
+
+
+struct anySnapshotCell
+/**
+  Cell data needed for drawing.
+*/
+{
+    anyVector pos;                    ///< position
+    float r;                          ///< radius
+    anyTissueSettings *tissue;        ///< tissue (color, type, max_pressure)
+    sat::CellState state;             ///< state
+    float pressure;                   ///< pressure from previous step
+    float concentrations[sat::dsLast]; ///< concentrations (visible frame)
+};
+
+
+struct anySnapshotTube
+/**
+  Tube data needed for drawing.
+*/
+{
+    anyVector pos1;            ///< tip #1
+    anyVector pos2;            ///< tip #2
+    float r;                   ///< radius
+    bool fixed_blood_pressure; ///< is blood pressure fixed?
+    float blood_flow;          ///< blood flow
+};
+
+
+class anyRenderSnapshot
+/**
+  Copy of cells and tubes taken between time steps.
+*/
+{
+public:
+    int serial;               ///< number of publish that filled this frame
+    int step;                 ///< simulation step of snapshot
+    int no_cells;             ///< number of cells
+    int cells_size;           ///< size of cells[]
+    anySnapshotCell *cells;   ///< cells
+    float max_cell_r;         ///< radius of largest cell
+    int no_boxes;             ///< number of boxes
+    int boxes_size;           ///< size of box_first[] and box_fill[]
+    int *box_first;           ///< index of first cell of box in cells[] (no_boxes + 1 items)
+    float *box_fill;          ///< part of box volume occupied by cells
+    int no_tubes;             ///< number of tubes
+    int tubes_size;           ///< size of tubes[]
+    anySnapshotTube *tubes;   ///< tubes
+    float pressure_avg;       ///< average pressure of all cells
+
+    anyRenderSnapshot(): serial(0), step(-1), no_cells(0), cells_size(0), cells(0), max_cell_r(0), no_boxes(0), boxes_size(0), box_first(0), box_fill(0),
+        no_tubes(0), tubes_size(0), tubes(0), pressure_avg(0) {}
+    ~anyRenderSnapshot();
+
+    void capture();
+};
+
+
+class anyRenderSnapshotBuffer
+/**
+  Triple buffer of render snapshots.
+
+  Simulation thread captures scene into back frame and publishes it (publish()),
+  GUI thread draws front frame, which is replaced by latest published frame in
+  acquire(). Neither side ever waits for the other one.
+*/
+{
+private:
+    anyRenderSnapshot frames[3];
+    std::atomic<int> ready;   ///< index of latest published frame (+ SNAPSHOT_FRESH if not acquired yet)
+    int back;                 ///< frame being filled (writer only)
+    int front;                ///< frame being drawn (reader only)
+
+    // what was published last (writer only)...
+    bool valid;               ///< false forces next publish_if_changed() to capture
+    int published_step;
+    anyCell const *published_cells;
+    int published_no_cells;
+    int published_last_tube_id;
+    int published_serial;
+
+public:
+    anyRenderSnapshotBuffer(): ready(1), back(0), front(2), valid(false), published_step(-1),
+        published_cells(0), published_no_cells(0), published_last_tube_id(0), published_serial(0) {}
+
+    void publish();
+    bool publish_if_changed();
+    void invalidate() { valid = false; }
+    anyRenderSnapshot const *acquire();
+};
+
+extern anyRenderSnapshotBuffer RenderSnapshot;
+
+#endif // ANYRENDERSNAPSHOT_H
@@ -0,0 +1,13 @@
+#include "anysimulation.h"
+
+anySimulation DefaultSimulation;                          ///< simulation loaded and edited by user
+thread_local anySimulation *Simulation = &DefaultSimulation; ///< simulation of calling thread
+
+
+anySimulation::anySimulation(): first_tissue_settings(0), last_tissue_settings(0), no_tissue_settings(0),
+    tissue_interactions(0), no_tissue_ids(0), allocated(false), cells(0), boxed_tubes(0), tube_chains(0),
+    no_tube_chains(0), no_tubes(0), last_tube_id(0), last_tube(0), tube_merge(0), no_tube_merge(0), concentrations(0),
+    random(std::random_device()()), povray_frame(0)
+{
+    output_dir[0] = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef ANYSIMULATION_H
+#define ANYSIMULATION_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <random>
+
+#include "const.h"
+#include "anysimulationsettings.h"
+#include "anytubularsystemsettings.h"
+#include "anytrajectory.h"
+#include "statistics.h"
+
+class anyCell;
+class anyTube;
+class anyTubeBox;
+class anyTubeChain;
+class anyTubeMerge;
+class anyTissueSettings;
+class anyTissueInteraction;
+
+
+class anySimulation
+/**
+  State of one running simulation: settings, tissues, cells, tubes and files written
+  while simulation runs. Scene definition (barriers, blocks, bundles, lines, interaction
+  settings) is shared by all simulations.
+
+  Simulation code works on Simulation, simulation selected in calling thread. Every
+  thread starts with DefaultSimulation (the one loaded and edited by user), so several
+  simulations can run at once only in separate threads, each running its parallel
+  regions in one thread (see ensemble mode of command-line program).
+*/
+{
+public:
+    anySimulationSettings settings;             ///< simulation settings
+    anyTubularSystemSettings tubular_settings;  ///< tubular network settings
+
+    anyTissueSettings *first_tissue_settings;   ///< list of tissues
+    anyTissueSettings *last_tissue_settings;    ///< last tissue in list
+    int no_tissue_settings;                     ///< number of tissues
+    anyTissueInteraction *tissue_interactions;  ///< no_tissue_ids x no_tissue_ids table of tissue pair parameters
+    int no_tissue_ids;                          ///< size of tissue_interactions row (max. tissue id + 1)
+
+    bool allocated;                             ///< cells and tubes arrays are allocated?
+    anyCell *cells;                             ///< cells array (max_cells_per_box slots per box)
+    anyTubeBox *boxed_tubes;                    ///< boxed tube array
+    anyTubeChain **tube_chains;                 ///< tube chains array
+    int no_tube_chains;                         ///< no of tube chains
+    int no_tubes;                               ///< no of tubes
+    int last_tube_id;                           ///< id of last added tube
+    anyTube *last_tube;                         ///< last added tube (next one can be attached to it)
+    std::vector<anyTube *> tubes_by_id;                   ///< tubes indexed by id (0 -- removed)
+    std::unordered_map<int, anyTube *> tubes_by_parsed_id; ///< tubes indexed by id read from file (first tube wins)
+    std::vector<anyTube *> removed_tubes;                 ///< tubes waiting for removal at end of step
+    std::vector<anyTube *> free_tubes;                    ///< pool of removed tubes ready for reuse
+    anyTubeMerge *tube_merge;                   ///< array of tube pairs to merge after tip-tip collision
+    int no_tube_merge;                          ///< number of tube pairs to merge
+    float ***concentrations;                    ///< concentrations in boxes [frame][substance][box]
+    std::mt19937 random;                        ///< random number generator of cell state changes
+
+    char output_dir[P_MAX_PATH];                ///< output directory (with trailing '/')
+    anyStatStore statistics;                    ///< statistics samples
+    anyStatisticsStream statistics_stream;      ///< statistics file
+    anyTrajectoryWriter trajectory;             ///< trajectory file being written
+    anyTrajectoryFrame trajectory_frame;        ///< trajectory frame being saved
+    std::string vtk_series_file;                ///< VTK time series (*.pvd) file name
+    std::vector<std::pair<float, std::string> > vtk_series; ///< times and names of files in VTK series
+    int povray_frame;                           ///< number of last saved povray frame
+
+    anySimulation();
+};
+
+
+extern anySimulation DefaultSimulation;
+extern thread_local anySimulation *Simulation;
+
+
+#endif // ANYSIMULATION_H
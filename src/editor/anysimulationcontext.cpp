@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "anysimulationcontext.h"
+#include "config.h"
+#include "log.h"
+#include "parser.h"
+#include "anycell.h"
+#include "anytube.h"
+#include "anytissuesettings.h"
+
+
+anySimulationContext::anySimulationContext(): next(0), no_tissues(0), tissues(0), has_state(false), cells(0),
+    tube_chains(0), no_tube_chains(0), no_tubes(0), last_tube_id(0)
+{
+    name[0] = 0;
+}
+
+
+anySimulationContext::~anySimulationContext()
+{
+    clear();
+}
+
+
+static void free_tubes(anyTube **chains, int no_chains)
+{
+    for (int i = 0; i < no_chains; i++)
+    {
+        anyTube *v = chains[i], *nv;
+        while (v)
+        {
+            nv = v->next;
+            delete v;
+            v = nv;
+        }
+    }
+}
+
+
+static anyTube *find_clone(std::map<anyTube const *, anyTube *> const &clones, anyTube const *v)
+{
+    if (!v)
+        return 0;
+    std::map<anyTube const *, anyTube *>::const_iterator i = clones.find(v);
+    return i == clones.end() ? 0 : i->second;
+}
+
+
+static void clone_tubes(anyTube * const *src, int no_chains, anyTube **dst)
+/**
+  Deep copy of tube chains. All links between tubes (next, prev, fork, base, top, jab)
+  are redirected to cloned tubes. Cloned tubes are not assigned to any chain object.
+*/
+{
+    std::map<anyTube const *, anyTube *> clones;
+
+    // copy tubes...
+    for (int i = 0; i < no_chains; i++)
+        for (anyTube *v = src[i]; v; v = v->next)
+            clones[v] = new anyTube(*v);
+
+    // relink...
+    for (std::map<anyTube const *, anyTube *>::iterator i = clones.begin(); i != clones.end(); ++i)
+    {
+        anyTube *c = i->second;
+        c->next = find_clone(clones, c->next);
+        c->prev = find_clone(clones, c->prev);
+        c->fork = find_clone(clones, c->fork);
+        c->base = find_clone(clones, c->base);
+        c->top = find_clone(clones, c->top);
+        c->jab = find_clone(clones, c->jab);
+        c->chain = 0;
+    }
+
+    for (int i = 0; i < no_chains; i++)
+        dst[i] = find_clone(clones, src[i]);
+}
+
+
+static void assign_tissue_parameters(anyTissueSettings *dst, anyTissueSettings const *src)
+/**
+  Copies tissue parameters and counters, identity of destination (name, id, links) is kept.
+*/
+{
+    char *name = dst->name;
+    int id = dst->id;
+    anyTissueSettings *next = dst->next;
+    anyEditable *editable_next = dst->anyEditable::next;
+#ifdef QT_CORE_LIB
+    anyEditableDialog *dialog = dst->dialog;
+#endif
+
+    *dst = *src;
+
+    dst->name = name;
+    dst->id = id;
+    dst->next = next;
+    dst->anyEditable::next = editable_next;
+#ifdef QT_CORE_LIB
+    dst->dialog = dialog;
+#endif
+}
+
+
+void anySimulationContext::clear()
+/**
+  Releases stored data.
+*/
+{
+    if (tissues)
+    {
+        // names are owned by scene tissues...
+        for (int i = 0; i < no_tissues; i++)
+            tissues[i].name = 0;
+        delete [] tissues;
+        tissues = 0;
+    }
+    no_tissues = 0;
+
+    delete [] cells;
+    cells = 0;
+
+    if (tube_chains)
+    {
+        free_tubes(tube_chains, no_tube_chains);
+        delete [] tube_chains;
+        tube_chains = 0;
+    }
+    no_tube_chains = no_tubes = last_tube_id = 0;
+
+    has_state = false;
+}
+
+
+void anySimulationContext::store(bool with_state)
+/**
+  Stores current simulation into context.
+
+  \param with_state -- store cells and tubes (simulation must be allocated)?
+*/
+{
+    clear();
+
+    simulation_settings = Simulation->settings;
+    tubular_settings = Simulation->tubular_settings;
+
+    no_tissues = Simulation->no_tissue_settings;
+    tissues = new anyTissueSettings[no_tissues];
+    int i = 0;
+    for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts && i < no_tissues; ts = ts->next, i++)
+        assign_tissue_parameters(tissues + i, ts);
+
+    if (!with_state)
+        return;
+
+    if (!Simulation->allocated)
+        throw new Error(__FILE__, __LINE__, "Cannot store simulation context (simulation not allocated)");
+
+    int no_cell_slots = Simulation->settings.no_boxes*Simulation->settings.max_cells_per_box;
+    cells = new anyCell[no_cell_slots];
+    for (int c = 0; c < no_cell_slots; c++)
+        cells[c] = Simulation->cells[c];
+
+    tube_chains = new anyTube *[Simulation->settings.max_tube_chains];
+    no_tube_chains = Simulation->no_tube_chains;
+    no_tubes = Simulation->no_tubes;
+    last_tube_id = Simulation->last_tube_id;
+    std::vector<anyTube *> heads(no_tube_chains);
+    for (int i = 0; i < no_tube_chains; i++)
+        heads[i] = Simulation->tube_chains[i]->head;
+    clone_tubes(heads.data(), no_tube_chains, tube_chains);
+
+    has_state = true;
+}
+
+
+void anySimulationContext::restore(bool with_state)
+/**
+  Copies context into current simulation (Simulation of calling thread). Context remains
+  unchanged. Current simulation must have the same tissues (with the same ids) as stored
+  one, restored cells are assigned to its tissues.
+
+  \param with_state -- restore cells and tubes (context must have state)?
+*/
+{
+    if (with_state && !has_state)
+        throw new Error(__FILE__, __LINE__, "Cannot restore simulation context (no cells and tubes stored)");
+
+    if (no_tissues != Simulation->no_tissue_settings)
+        throw new Error(__FILE__, __LINE__, "Cannot restore simulation context (tissues changed)");
+
+    if (with_state)
+    {
+        scene::DeallocSimulation();
+        Simulation->settings = simulation_settings;
+        scene::AllocSimulation();
+
+        int no_cell_slots = Simulation->settings.no_boxes*Simulation->settings.max_cells_per_box;
+        for (int c = 0; c < no_cell_slots; c++)
+            Simulation->cells[c] = cells[c];
+
+        // cells were stored in another simulation, switch them to tissues of this one...
+        for (int first_cell = 0; first_cell < no_cell_slots; first_cell += Simulation->settings.max_cells_per_box)
+            for (int c = first_cell; c < first_cell + cells[first_cell].no_cells_in_box; c++)
+                if (cells[c].tissue)
+                    Simulation->cells[c].tissue = scene::FindTissueSettingById(cells[c].tissue->id);
+
+        std::vector<anyTube *> heads(no_tube_chains);
+        clone_tubes(tube_chains, no_tube_chains, heads.data());
+        for (int i = 0; i < no_tube_chains; i++)
+            scene::AddTubeChain(heads[i]);
+        Simulation->no_tubes = no_tubes;
+        Simulation->last_tube_id = last_tube_id;
+        scene::IndexTubes();
+
+        // removal queue was emptied by DeallocSimulation()...
+        for (int i = 0; i < Simulation->no_tube_chains; i++)
+            for (anyTube *v = Simulation->tube_chains[i]->head; v; v = v->next)
+                if (v->state == sat::csRemoved)
+                    scene::QueueTubeRemoval(v);
+    }
+    else
+        Simulation->settings = simulation_settings;
+
+    Simulation->tubular_settings = tubular_settings;
+
+    int i = 0;
+    for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts && i < no_tissues; ts = ts->next, i++)
+        assign_tissue_parameters(ts, tissues + i);
+    scene::UpdateTissueInteractions();
+}
+
+
+static void check_variant_geometry(anySimulationSettings const &base)
+/**
+  Variants share generated cells and tubes, so they cannot change simulation geometry.
+*/
+{
+    if (Simulation->settings.dimensions != base.dimensions
+        || Simulation->settings.comp_box_from != base.comp_box_from
+        || Simulation->settings.comp_box_to != base.comp_box_to
+        || Simulation->settings.box_size != base.box_size
+        || Simulation->settings.max_cells_per_box != base.max_cells_per_box
+        || Simulation->settings.max_tube_chains != base.max_tube_chains
+        || Simulation->settings.max_tube_merge != base.max_tube_merge)
+        throw new Error(__FILE__, __LINE__, "Variant cannot change simulation geometry", 0, ParserFile, ParserLine);
+}
+
+
+static void parse_variant(FILE *f, anySimulationContext *base)
+/**
+  Parses body of 'variant' block. Values are applied on top of base settings.
+*/
+{
+    // get '{'...
+    GetNextToken(f, false);
+    if (Token.type != TT_Symbol || Token.symbol != '{')
+        throw new Error(__FILE__, __LINE__, "Bad block start ('{' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+    // parse...
+    while (23)
+    {
+        GetNextToken(f, false);
+
+        if (Token.type == TT_Ident && !StrCmp(Token.str, "tissue"))
+        {
+            GetNextToken(f, true);
+            if (Token.type != TT_String)
+                throw new Error(__FILE__, __LINE__, "Invalid tissue name", TokenToString(Token), ParserFile, ParserLine);
+            anyTissueSettings *ts = scene::FindTissueSettings(Token.str);
+            if (!ts)
+                throw new Error(__FILE__, __LINE__, "Unknown tissue name in 'variant'", TokenToString(Token), ParserFile, ParserLine);
+
+            char *name = ts->name;
+            scene::ParseTissueSettings(f, ts, false);
+            if (ts->name != name)
+                throw new Error(__FILE__, __LINE__, "Tissue cannot be renamed in 'variant'", ts->name, ParserFile, ParserLine);
+        }
+
+        else if (Token.type == TT_Ident && !StrCmp(Token.str, "simulation"))
+        {
+            ParseSimulationSettings(f);
+            check_variant_geometry(base->simulation_settings);
+        }
+
+        else if (Token.type == TT_Ident && !StrCmp(Token.str, "tubularsystem"))
+            ParseTubularSystemSettings(f);
+
+        // end of 'variant' body?...
+        else if (Token.type == TT_Symbol && Token.symbol == '}')
+            break;
+
+        // end of input file?...
+        else if (Token.type == TT_Eof)
+            throw new Error(__FILE__, __LINE__, "Unexpected end of file", TokenToString(Token), ParserFile, ParserLine);
+
+        else
+            throw new Error(__FILE__, __LINE__, "Unexpected token in 'variant'", TokenToString(Token), ParserFile, ParserLine);
+    }
+}
+
+
+anySimulationContext *ParseEnsembleFile(char const *fname, anySimulationContext *base)
+/**
+  Parses ensemble file, a list of variants of base simulation:
+
+    variant "name"
+     {
+      tissue "tumor" { o2_consumption = 4e-9 }
+      simulation { medicine_threshold = 0.5 }
+     }
+
+  Returned contexts hold settings only (no cells and tubes). Base settings are restored on exit.
+
+  \param fname -- ensemble file name
+  \param base -- context of generated base simulation
+*/
+{
+    LOG2(llInfo, "Reading ensemble file: ", fname);
+
+    ParserFile = fname;
+    FILE *f = ParserOpen(fname);
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for reading", fname);
+
+    anySimulationContext *first = 0, *last = 0;
+
+    try
+    {
+        ParserLine = 1;
+        while (23)
+        {
+            GetNextToken(f, false);
+
+            if (Token.type == TT_Eof) break;
+
+            if (Token.type != TT_Ident || StrCmp(Token.str, "variant"))
+                throw new Error(__FILE__, __LINE__, "Unexpected keyword ('variant' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+            GetNextToken(f, true);
+            if (Token.type != TT_String)
+                throw new Error(__FILE__, __LINE__, "Invalid variant name", TokenToString(Token), ParserFile, ParserLine);
+
+            anySimulationContext *v = new anySimulationContext;
+            snprintf(v->name, P_MAX_PATH, "%s", Token.str);
+            if (!first)
+                first = last = v;
+            else
+            {
+                last->next = v;
+                last = v;
+            }
+
+            base->restore(false);
+            parse_variant(f, base);
+            v->store(false);
+        }
+    }
+    catch (...)
+    {
+        ParserClose(f);
+        DeallocateEnsemble(first);
+        base->restore(false);
+        throw;
+    }
+
+    ParserClose(f);
+    base->restore(false);
+
+    return first;
+}
+
+
+void DeallocateEnsemble(anySimulationContext *first)
+{
+    while (first)
+    {
+        anySimulationContext *n = first->next;
+        delete first;
+        first = n;
+    }
+}
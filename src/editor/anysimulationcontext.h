@@ -0,0 +1,48 @@
+#ifndef ANYSIMULATIONCONTEXT_H
+#define ANYSIMULATIONCONTEXT_H
+
+#include "const.h"
+#include "anysimulationsettings.h"
+#include "anytubularsystemsettings.h"
+
+class anyCell;
+class anyTube;
+class anyTissueSettings;
+
+class anySimulationContext
+/**
+  Snapshot of simulation: settings, tissue parameters and (optionally) cells and tubes.
+
+  Context is filled from current simulation (see anySimulation) by store() and copied
+  to current simulation by restore(). Restoring does not consume context, so one generated
+  scene can be a starting point of many runs, also of runs in other simulations.
+*/
+{
+public:
+    char name[P_MAX_PATH];     ///< name of context (used as name of output subdirectory)
+    anySimulationContext *next; ///< next context in list
+
+    anySimulationSettings simulation_settings;   ///< copy of simulation settings
+    anyTubularSystemSettings tubular_settings;   ///< copy of tubular system settings
+    int no_tissues;                              ///< number of tissues
+    anyTissueSettings *tissues;                  ///< copies of tissue parameters (in scene order)
+
+    bool has_state;            ///< are cells and tubes stored?
+    anyCell *cells;            ///< copy of cells array
+    anyTube **tube_chains;     ///< first tubes of tube chains (tubes are cloned)
+    int no_tube_chains;        ///< number of tube chains
+    int no_tubes;              ///< number of tubes
+    int last_tube_id;          ///< id of last added tube
+
+    anySimulationContext();
+    ~anySimulationContext();
+
+    void store(bool with_state);
+    void restore(bool with_state);
+    void clear();
+};
+
+anySimulationContext *ParseEnsembleFile(char const *fname, anySimulationContext *base);
+void DeallocateEnsemble(anySimulationContext *first);
+
+#endif // ANYSIMULATIONCONTEXT_H
@@ -8,18 +8,29 @@ void anySimulationSettings::reset()
 {
     step = 0;
     max_o2_concentration = 1e-26f;
+    save_png = 0;
+    save_trajectory = 0;
+    statistics_binary = 0;
+    statistics_flush_time = 5;
+    save_vtk = 0;
+    save_ag_tables = 1;
+    output_threads = 2;
+    output_queue = 4;
+    diffusion_every = 1;
+    blood_flow_every = 1;
+    tissue_props_every = 1;
 
     char fname[P_MAX_PATH];
     snprintf(fname, P_MAX_PATH, "%s%ssimulation_settings.ag", GlobalSettings.app_dir, FOLDER_DEFAULTS);
     Slashify(fname, false);
     LOG2(llInfo, "Reading defaults from ", fname);
-    FILE *f = fopen(fname, "r");
+    FILE *f = ParserOpen(fname);
     if (!f)
         throw new Error(__FILE__, __LINE__, "Cannot open file for reading", 0, fname);
     else
     {
         ParseSimulationSettings(f);
-        fclose(f);
+        ParserClose(f);
     }
 
     calculate_derived_values();
@@ -37,10 +37,23 @@ public:
 
     unsigned long sim_phases;  ///< enabled simulation phases/processes
 
+    // multiple time stepping (slow processes run every n-th step with n*time_step)...
+    int diffusion_every;       ///< diffusion (concentration exchange) update interval [steps], limited to stable interval (warning is logged, see CheckDiffusionInterval())
+    int blood_flow_every;      ///< blood pressure and flow update interval [steps], one over-relaxed pressure sweep per update
+    int tissue_props_every;    ///< tissue properties update interval [steps]
+
     // output...
     int save_statistics;       ///< statistics saving frequency
+    int statistics_binary;     ///< save statistics in binary file instead of CSV?
+    float statistics_flush_time; ///< minimum time between writes of statistics file [s]
     int save_povray;           ///< povray saving frequency
     int save_ag;               ///< ag saving frequency
+    int save_ag_tables;        ///< save cells and tubes in *.ag files as tables instead of blocks?
+    int save_png;              ///< png frame saving frequency
+    int save_trajectory;       ///< trajectory frame saving frequency
+    int save_vtk;              ///< VTK (*.vtu) file saving frequency
+    int output_threads;        ///< number of output writer threads (0 -- write in simulation thread)
+    int output_queue;          ///< max number of output files waiting for writer threads
 
     // Simple description of tumor cells mechanism, when medicine is used:
     //
@@ -89,6 +102,4 @@ public:
     void calculate_derived_values();
 };
 
-extern anySimulationSettings SimulationSettings;
-
 #endif // ANYSIMULATIONSETTINGS_H
@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <omp.h>
+
+#include "anysoftwarerenderer.h"
+#include "config.h"
+#include "log.h"
+#include "anycell.h"
+#include "anytube.h"
+#include "anytissuesettings.h"
+
+
+struct anySplat
+/**
+  Sphere or cylinder to draw (eye space) with its rectangle on frame.
+*/
+{
+    anyVector p1;           ///< center of sphere or tip #1 of cylinder
+    anyVector p2;           ///< tip #2 of cylinder
+    float r;                ///< radius
+    bool cylinder;          ///< cylinder or sphere?
+    anyColor color;
+    float diffuse;          ///< diffuse light factor
+    int x1, y1, x2, y2;     ///< rectangle on frame (inclusive)
+};
+
+static thread_local std::vector<anySplat> Splats;  ///< primitives of frame being rendered (in rendering thread)
+
+
+anySoftwareRenderer::~anySoftwareRenderer()
+{
+    delete [] rgb;
+    delete [] depth;
+}
+
+
+void anySoftwareRenderer::setup_camera()
+/**
+  Sets camera as in main view (see GLWidget::paintScene()).
+*/
+{
+    anyVector comp_box_size = Simulation->settings.comp_box_to - Simulation->settings.comp_box_from;
+    float max_comp_box_size = 2.0*MAX(MAX(comp_box_size.x, comp_box_size.y), comp_box_size.z);
+    float dist = 200;
+
+    anyTransform eye_matrix;
+    eye_matrix.setToTranslation(anyVector(0, 0, -max_comp_box_size*0.5 - dist));
+    mv_matrix = eye_matrix*VisualSettings.v_matrix;
+
+    focal = 0.5*height/tan(45.0/2*M_PI/180);
+}
+
+
+bool anySoftwareRenderer::project_box(anyVector const &from, anyVector const &to, int &x1, int &y1, int &x2, int &y2) const
+/**
+  Computes rectangle on frame covering box given in model space.
+
+  \returns false if box is not visible (or is too close to eye)
+*/
+{
+    float sx1 = width, sy1 = height, sx2 = -1, sy2 = -1;
+    for (int i = 0; i < 8; i++)
+    {
+        anyVector e = mv_matrix*anyVector(i & 1 ? to.x : from.x, i & 2 ? to.y : from.y, i & 4 ? to.z : from.z);
+        if (-e.z < near_plane)
+            return false;
+
+        float sx = 0.5*width + focal*e.x/(-e.z);
+        float sy = 0.5*height - focal*e.y/(-e.z);
+        if (sx < sx1) sx1 = sx;
+        if (sx > sx2) sx2 = sx;
+        if (sy < sy1) sy1 = sy;
+        if (sy > sy2) sy2 = sy;
+    }
+
+    x1 = MAX(0, int(floor(sx1)));
+    y1 = MAX(0, int(floor(sy1)));
+    x2 = MIN(width - 1, int(ceil(sx2)));
+    y2 = MIN(height - 1, int(ceil(sy2)));
+    return x1 <= x2 && y1 <= y2;
+}
+
+
+void anySoftwareRenderer::ray(int x, int y, anyVector &dir) const
+/**
+  Returns direction of ray from eye through center of pixel (eye space).
+*/
+{
+    dir.set((x + 0.5 - 0.5*width)/focal, -(y + 0.5 - 0.5*height)/focal, -1);
+    dir.normalize();
+}
+
+
+void anySoftwareRenderer::put_pixel(int x, int y, float t, anyVector const &n, anyColor const &color, float diffuse)
+/**
+  Shades pixel if surface is nearer than current one.
+
+  \param t -- distance from eye
+  \param n -- surface normal (eye space)
+*/
+{
+    int i = y*width + x;
+    if (t >= depth[i])
+        return;
+    depth[i] = t;
+
+    // light direction is given in model space...
+    anyVector nm(mv_matrix.matrix[0]*n.x + mv_matrix.matrix[1]*n.y + mv_matrix.matrix[2]*n.z,
+                 mv_matrix.matrix[4]*n.x + mv_matrix.matrix[5]*n.y + mv_matrix.matrix[6]*n.z,
+                 mv_matrix.matrix[8]*n.x + mv_matrix.matrix[9]*n.y + mv_matrix.matrix[10]*n.z);
+    nm.normalize();
+    float light = 0.2 + MAX(nm | VisualSettings.light_dir_r, 0.0f)*diffuse;
+
+    for (int k = 0; k < 3; k++)
+    {
+        float c = color.rgba_array[k]*light*255 + 0.5;
+        rgb[3*i + k] = c > 255 ? 255 : (c < 0 ? 0 : (unsigned char)c);
+    }
+}
+
+
+static void add_splat(anyVector const &p1, anyVector const &p2, float r, bool cylinder, anyColor const &color, float diffuse,
+                      int x1, int y1, int x2, int y2)
+{
+    anySplat s;
+    s.p1 = p1;
+    s.p2 = p2;
+    s.r = r;
+    s.cylinder = cylinder;
+    s.color = color;
+    s.diffuse = diffuse;
+    s.x1 = x1;
+    s.y1 = y1;
+    s.x2 = x2;
+    s.y2 = y2;
+    Splats.push_back(s);
+}
+
+
+void anySoftwareRenderer::draw_sphere(anyVector const &pos, float r, anyColor const &color, float diffuse)
+/**
+  Adds sphere (model space) to frame.
+*/
+{
+    int x1, y1, x2, y2;
+    anyVector dr(r, r, r);
+    if (!project_box(pos - dr, pos + dr, x1, y1, x2, y2))
+        return;
+
+    float scale = (mv_matrix*anyVector(1, 0, 0) - mv_matrix*vectorZero).length();
+    add_splat(mv_matrix*pos, mv_matrix*pos, r*scale, false, color, diffuse, x1, y1, x2, y2);
+}
+
+
+void anySoftwareRenderer::draw_cylinder(anyVector const &p1, anyVector const &p2, float r, anyColor const &color, float diffuse)
+/**
+  Adds cylinder (model space, without caps) to frame.
+*/
+{
+    int x1, y1, x2, y2;
+    anyVector from(MIN(p1.x, p2.x) - r, MIN(p1.y, p2.y) - r, MIN(p1.z, p2.z) - r);
+    anyVector to(MAX(p1.x, p2.x) + r, MAX(p1.y, p2.y) + r, MAX(p1.z, p2.z) + r);
+    if (!project_box(from, to, x1, y1, x2, y2))
+        return;
+
+    float scale = (mv_matrix*anyVector(1, 0, 0) - mv_matrix*vectorZero).length();
+    add_splat(mv_matrix*p1, mv_matrix*p2, r*scale, true, color, diffuse, x1, y1, x2, y2);
+}
+
+
+void anySoftwareRenderer::rasterize(anySplat const &s, int row_from, int row_to)
+/**
+  Ray-casts sphere or cylinder in rows [row_from, row_to] of its rectangle.
+*/
+{
+    anyVector d;
+
+    if (!s.cylinder)
+    {
+        float cc = (s.p1 | s.p1) - s.r*s.r;
+        for (int y = MAX(s.y1, row_from); y <= MIN(s.y2, row_to); y++)
+            for (int x = s.x1; x <= s.x2; x++)
+            {
+                ray(x, y, d);
+                float b = d | s.p1;
+                float disc = b*b - cc;
+                if (disc < 0)
+                    continue;
+
+                float t = b - sqrt(disc);
+                put_pixel(x, y, t, (d*t - s.p1)/s.r, s.color, s.diffuse);
+            }
+        return;
+    }
+
+    anyVector axis = s.p2 - s.p1;
+    float len = axis.length();
+    if (len <= 0)
+        return;
+    axis = axis/len;
+
+    anyVector m = vectorZero - s.p1;
+    anyVector mp = m - axis*(m | axis);
+    float c = (mp | mp) - s.r*s.r;
+
+    for (int y = MAX(s.y1, row_from); y <= MIN(s.y2, row_to); y++)
+        for (int x = s.x1; x <= s.x2; x++)
+        {
+            ray(x, y, d);
+            anyVector dp = d - axis*(d | axis);
+            float a = dp | dp;
+            if (a < 1e-12)
+                continue;
+            float b = 2*(dp | mp);
+            float disc = b*b - 4*a*c;
+            if (disc < 0)
+                continue;
+
+            float t = (-b - sqrt(disc))/(2*a);
+            anyVector hit = d*t;
+            float h = (hit - s.p1) | axis;
+            if (h < 0 || h > len)
+                continue;
+
+            put_pixel(x, y, t, (hit - s.p1 - axis*h)/s.r, s.color, s.diffuse);
+        }
+}
+
+
+static void cell_color(anyCell const *c, int color_mode, float pressure_min, float pressure_max, int frame, anyColor &color)
+/**
+  Computes color of cell (the same mixing as in main view).
+*/
+{
+    color.set(0, 0, 0, 1, 0);
+
+    // tissue color...
+    if (color_mode & COLOR_MODE_TISSUE_COLOR)
+        color.add(c->tissue->color);
+
+    // state...
+    if (color_mode & COLOR_MODE_STATE)
+    {
+        if (c->state == sat::csAlive || c->state == sat::csAdded)
+            color.add(VisualSettings.cell_alive_color);
+        else if (c->state == sat::csHypoxia)
+            color.add(VisualSettings.cell_hypoxia_color);
+        else if (c->state == sat::csApoptosis)
+            color.add(VisualSettings.cell_apoptosis_color);
+        else if (c->state == sat::csNecrosis)
+            color.add(VisualSettings.cell_necrosis_color);
+    }
+
+    // pressure...
+    if (color_mode & COLOR_MODE_PRESSURE)
+    {
+        float pr = c->pressure_prev;
+        float p;
+        if (pressure_max == pressure_min)
+            color.add(0.5, 0.5, 0.5);
+        else
+        {
+            if (pr < 0)
+                p = 0;
+            else if (pr > 1)
+                p = 1;
+            else
+                p = (pr - pressure_min)/(pressure_max - pressure_min);
+            if (pr > c->tissue->max_pressure)
+                color.add(p, p*0.75, p*0.75);
+            else
+                color.add(p, p, p);
+        }
+    }
+
+    // concentrations...
+    float conc[sat::dsLast];
+    for (int k = 0; k < sat::dsLast; k++)
+    {
+        conc[k] = c->concentrations[k][frame];
+        if (conc[k] < 0)
+            conc[k] = 0;
+        else if (conc[k] > 1)
+            conc[k] = 1;
+    }
+
+    if (color_mode & COLOR_MODE_O2)
+        color.add(0, 0, conc[sat::dsO2]);
+    if (color_mode & COLOR_MODE_TAF)
+        color.add(0, conc[sat::dsTAF], 0);
+    if (color_mode & COLOR_MODE_PERICYTES)
+        color.add(conc[sat::dsPericytes], conc[sat::dsPericytes], 0);
+    if (color_mode & COLOR_MODE_MEDICINE)
+        color.add(conc[sat::dsMedicine], conc[sat::dsMedicine], 0);
+}
+
+
+void anySoftwareRenderer::draw_cells(int color_mode, bool clip)
+/**
+  Adds all cells to frame.
+*/
+{
+    if (!Simulation->cells)
+        return;
+
+    // pressure range (as in main view)...
+    int no_cells = 0;
+    float pressure_avg = 0;
+    int first_cell = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+    {
+        for (int i = 0; i < Simulation->cells[first_cell].no_cells_in_box; i++)
+            if (Simulation->cells[first_cell + i].state != sat::csRemoved)
+            {
+                pressure_avg += Simulation->cells[first_cell + i].pressure_avg;
+                no_cells++;
+            }
+        first_cell += Simulation->settings.max_cells_per_box;
+    }
+    pressure_min = 0;
+    pressure_max = no_cells ? 2*pressure_avg/no_cells : 0;
+
+    int frame = !(Simulation->settings.step % 2);
+    anyColor color;
+
+    first_cell = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+    {
+        for (int i = 0; i < Simulation->cells[first_cell].no_cells_in_box; i++)
+        {
+            anyCell const *c = Simulation->cells + first_cell + i;
+            if (c->state == sat::csRemoved)
+                continue;
+
+            if (clip &&
+                    c->pos.x*VisualSettings.clip_plane[0] +
+                    c->pos.y*VisualSettings.clip_plane[1] +
+                    c->pos.z*VisualSettings.clip_plane[2] +
+                    VisualSettings.clip_plane[3] <= 0
+                    )
+                continue;
+
+            cell_color(c, color_mode, pressure_min, pressure_max, frame, color);
+            draw_sphere(c->pos, c->r, color, 0.8);
+        }
+        first_cell += Simulation->settings.max_cells_per_box;
+    }
+}
+
+
+void anySoftwareRenderer::draw_tubes()
+/**
+  Adds all tubes to frame (cylinders with rounded tips).
+*/
+{
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+        for (anyTube const *v = Simulation->tube_chains[i]->head; v; v = v->next)
+        {
+            anyColor c = VisualSettings.tube_color;
+            c.add(c);
+            if (v->fixed_blood_pressure)
+                c.add(1, 1, 1);
+            else if (!v->blood_flow)
+                c.add(0, 0, 0);
+
+            draw_cylinder(v->pos1, v->pos2, v->r, c, 1.0);
+            draw_sphere(v->pos1, v->r, c, 1.0);
+            draw_sphere(v->pos2, v->r, c, 1.0);
+        }
+}
+
+
+void anySoftwareRenderer::render(int w, int h, int color_mode, bool clip)
+/**
+  Renders cells and tubes.
+
+  \param w, h -- size of frame
+  \param color_mode -- coloring of cells (COLOR_MODE_* flags)
+  \param clip -- clip cells with VisualSettings.clip_plane?
+*/
+{
+    if (frame_size < w*h)
+    {
+        delete [] rgb;
+        delete [] depth;
+        frame_size = w*h;
+        rgb = new unsigned char[3*frame_size];
+        depth = new float[frame_size];
+    }
+    width = w;
+    height = h;
+
+    // background...
+    for (int i = 0; i < width*height; i++)
+    {
+        depth[i] = MAX_float;
+        for (int k = 0; k < 3; k++)
+            rgb[3*i + k] = (unsigned char)(VisualSettings.bkg_color.rgba_array[k]*255 + 0.5);
+    }
+
+    setup_camera();
+
+    Splats.clear();
+    draw_tubes();
+    draw_cells(color_mode, clip);
+
+    // every thread ray-casts its own band of rows (no locking of z-buffer)...
+    std::vector<anySplat> const &splats = Splats;
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int row_from = height*t/nt;
+        int row_to = height*(t + 1)/nt - 1;
+
+        for (int i = 0; i < (int)splats.size(); i++)
+            if (splats[i].y2 >= row_from && splats[i].y1 <= row_to)
+                rasterize(splats[i], row_from, row_to);
+    }
+}
+
+
+// PNG writing...
+
+struct anyCrcTable
+{
+    unsigned long t[256];
+
+    anyCrcTable()
+    {
+        for (int n = 0; n < 256; n++)
+        {
+            unsigned long c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320L ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+    }
+};
+
+
+static unsigned long update_crc(unsigned long crc, unsigned char const *buf, int len)
+{
+    static anyCrcTable const crc_table;  // initialized once, also when PNGs are saved from several threads
+
+    unsigned long const *table = crc_table.t;
+    for (int n = 0; n < len; n++)
+        crc = table[(crc ^ buf[n]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+
+static void put_u32(std::vector<unsigned char> &out, unsigned long x)
+{
+    out.push_back((x >> 24) & 0xff);
+    out.push_back((x >> 16) & 0xff);
+    out.push_back((x >> 8) & 0xff);
+    out.push_back(x & 0xff);
+}
+
+
+static void write_chunk(FILE *f, char const *type, std::vector<unsigned char> const &data)
+{
+    std::vector<unsigned char> chunk;
+    put_u32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+
+    unsigned long crc = update_crc(0xffffffffL, &chunk[4], chunk.size() - 4) ^ 0xffffffffL;
+    put_u32(chunk, crc);
+    fwrite(&chunk[0], 1, chunk.size(), f);
+}
+
+
+class anyBitWriter
+/**
+  LSB-first bit stream (deflate).
+*/
+{
+public:
+    std::vector<unsigned char> &out;
+    unsigned long bits;
+    int no_bits;
+
+    anyBitWriter(std::vector<unsigned char> &o): out(o), bits(0), no_bits(0) {}
+
+    void put(unsigned long value, int n)
+    {
+        bits |= value << no_bits;
+        no_bits += n;
+        while (no_bits >= 8)
+        {
+            out.push_back(bits & 0xff);
+            bits >>= 8;
+            no_bits -= 8;
+        }
+    }
+
+    void put_huffman(unsigned long code, int n)
+    {
+        // Huffman codes are stored starting from most significant bit...
+        unsigned long r = 0;
+        for (int i = 0; i < n; i++)
+            r |= ((code >> i) & 1) << (n - 1 - i);
+        put(r, n);
+    }
+
+    void flush()
+    {
+        if (no_bits)
+            out.push_back(bits & 0xff);
+        bits = 0;
+        no_bits = 0;
+    }
+};
+
+
+static void put_literal(anyBitWriter &bw, int lit)
+{
+    if (lit < 144)
+        bw.put_huffman(0x30 + lit, 8);
+    else if (lit < 256)
+        bw.put_huffman(0x190 + lit - 144, 9);
+    else if (lit < 280)
+        bw.put_huffman(lit - 256, 7);
+    else
+        bw.put_huffman(0xc0 + lit - 280, 8);
+}
+
+
+static void put_match(anyBitWriter &bw, int len, int dist)
+{
+    static int const len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static int const len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static int const dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                       4097, 6145, 8193, 12289, 16385, 24577 };
+    static int const dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int i = 28;
+    while (len_base[i] > len)
+        i--;
+    put_literal(bw, 257 + i);
+    bw.put(len - len_base[i], len_extra[i]);
+
+    int j = 29;
+    while (dist_base[j] > dist)
+        j--;
+    bw.put_huffman(j, 5);
+    bw.put(dist - dist_base[j], dist_extra[j]);
+}
+
+
+static void deflate(std::vector<unsigned char> const &data, int row_size, std::vector<unsigned char> &out)
+/**
+  Compresses data into zlib stream (one block with fixed Huffman codes). Matches are
+  searched only at distance of one pixel and one row, which is enough for flat
+  background and large uniformly shaded areas.
+*/
+{
+    // zlib header...
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    anyBitWriter bw(out);
+    bw.put(1, 1);  // last block
+    bw.put(1, 2);  // fixed Huffman codes
+
+    int n = data.size();
+    int dists[2] = { 3, row_size <= 32768 ? row_size : 0 };
+    int i = 0;
+    while (i < n)
+    {
+        int best_len = 0, best_dist = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            int dist = dists[k];
+            if (!dist || i < dist)
+                continue;
+            int len = 0;
+            while (len < 258 && i + len < n && data[i + len] == data[i + len - dist])
+                len++;
+            if (len > best_len)
+            {
+                best_len = len;
+                best_dist = dist;
+            }
+        }
+
+        if (best_len >= 3)
+        {
+            put_match(bw, best_len, best_dist);
+            i += best_len;
+        }
+        else
+            put_literal(bw, data[i++]);
+    }
+    put_literal(bw, 256);
+    bw.flush();
+
+    // adler32...
+    unsigned long a = 1, b = 0;
+    for (int k = 0; k < n; k++)
+    {
+        a = (a + data[k]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32(out, (b << 16) | a);
+}
+
+
+void anySoftwareRenderer::save_png(char const *fname) const
+/**
+  Saves frame as PNG file (RGB, 8 bits per channel).
+*/
+{
+    FILE *f = fopen(fname, "wb");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
+
+    static unsigned char const signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    fwrite(signature, 1, 8, f);
+
+    // header...
+    std::vector<unsigned char> ihdr;
+    put_u32(ihdr, width);
+    put_u32(ihdr, height);
+    ihdr.push_back(8);  // bit depth
+    ihdr.push_back(2);  // RGB
+    ihdr.push_back(0);  // compression
+    ihdr.push_back(0);  // filter
+    ihdr.push_back(0);  // no interlace
+    write_chunk(f, "IHDR", ihdr);
+
+    // rows with filter type 'none'...
+    int row_size = 3*width + 1;
+    std::vector<unsigned char> raw(row_size*height);
+    for (int y = 0; y < height; y++)
+    {
+        raw[y*row_size] = 0;
+        memcpy(&raw[y*row_size + 1], rgb + 3*y*width, 3*width);
+    }
+
+    std::vector<unsigned char> idat;
+    deflate(raw, row_size, idat);
+    write_chunk(f, "IDAT", idat);
+
+    write_chunk(f, "IEND", std::vector<unsigned char>());
+
+    fclose(f);
+}
+
+
+void SavePNG(char const *fname)
+/**
+  Renders current scene (camera of main view, VisualSettings.png_color_mode coloring)
+  and saves it as PNG file.
+*/
+{
+    static thread_local anySoftwareRenderer renderer;  // ensemble runs save frames from several threads
+
+    LOG2(llInfo, "Saving PNG file: ", fname);
+
+    renderer.render(VisualSettings.window_width, VisualSettings.window_height, VisualSettings.png_color_mode, VisualSettings.png_clip);
+    renderer.save_png(fname);
+}
@@ -0,0 +1,58 @@
+#ifndef ANYSOFTWARERENDERER_H
+#define ANYSOFTWARERENDERER_H
+
+#include "anyvector.h"
+#include "transform.h"
+#include "color.h"
+
+struct anySplat;
+
+class anySoftwareRenderer
+/**
+  Software renderer of cells and tubes. Spheres and cylinders are ray-cast inside
+  their projected bounding rectangles into z-buffered frame. Used for saving
+  frames without OpenGL context (command-line simulation).
+
+  Camera is the same as in main view: VisualSettings.v_matrix, perspective
+  projection with 45 deg. vertical angle and the same distance from scene.
+*/
+{
+private:
+    int width;              ///< width of frame [pixels]
+    int height;             ///< height of frame [pixels]
+    unsigned char *rgb;     ///< frame (3 bytes per pixel, top row first)
+    float *depth;           ///< distance from eye to nearest surface of pixel
+    int frame_size;         ///< size of depth[] (in pixels)
+
+    anyTransform mv_matrix; ///< model -> eye space
+    float focal;            ///< pixels per unit at unit distance from eye
+    float near_plane;       ///< nearest visible distance
+
+    float pressure_min;
+    float pressure_max;
+
+    void setup_camera();
+    bool project_box(anyVector const &from, anyVector const &to, int &x1, int &y1, int &x2, int &y2) const;
+    void ray(int x, int y, anyVector &dir) const;
+    void put_pixel(int x, int y, float t, anyVector const &n, anyColor const &color, float diffuse);
+    void rasterize(anySplat const &s, int row_from, int row_to);
+
+    void draw_sphere(anyVector const &pos, float r, anyColor const &color, float diffuse);
+    void draw_cylinder(anyVector const &p1, anyVector const &p2, float r, anyColor const &color, float diffuse);
+    void draw_cells(int color_mode, bool clip);
+    void draw_tubes();
+
+public:
+    anySoftwareRenderer(): width(0), height(0), rgb(0), depth(0), frame_size(0), focal(1), near_plane(0.01f),
+        pressure_min(0), pressure_max(0) {}
+    ~anySoftwareRenderer();
+
+    void render(int w, int h, int color_mode, bool clip);
+    void save_png(char const *fname) const;
+};
+
+
+void SavePNG(char const *fname);
+
+
+#endif // ANYSOFTWARERENDERER_H
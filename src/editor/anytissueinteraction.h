@@ -0,0 +1,37 @@
+#ifndef ANYTISSUEINTERACTION_H
+#define ANYTISSUEINTERACTION_H
+
+class anyTissueInteraction
+/**
+  Parameters of cell-cell forces for pair of tissues (entry of Simulation->tissue_interactions).
+*/
+{
+public:
+    float force_rep_factor;     ///< repulsion force factor
+    float force_atr1_factor;    ///< first attraction force factor
+    float force_atr2_factor;    ///< second attraction force factor
+    float force_dpd_factor;     ///< PDP gamma factor
+    float dpd_temperature;      ///< T in DPD random force
+
+    anyTissueInteraction(): force_rep_factor(0), force_atr1_factor(0), force_atr2_factor(0), force_dpd_factor(0), dpd_temperature(0) {}
+};
+
+
+class anyInteractionSettings
+/**
+  Interaction parameters of tissue pair set in *.ag file ('interaction' block).
+  Parameters not set are mean values of both tissues.
+*/
+{
+public:
+    char *tissue1;             ///< name of first tissue
+    char *tissue2;             ///< name of second tissue
+    anyTissueInteraction values; ///< parameter values
+    unsigned mask;             ///< set parameters (bit i -- i-th parameter)
+    anyInteractionSettings *next; ///< pointer to next interaction settings
+
+    anyInteractionSettings(): tissue1(0), tissue2(0), mask(0), next(0) {}
+    ~anyInteractionSettings() { delete [] tissue1; delete [] tissue2; }
+};
+
+#endif // ANYTISSUEINTERACTION_H
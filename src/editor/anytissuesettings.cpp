@@ -45,13 +45,13 @@ void anyTissueSettings::read_defaults()
     {
         LOG2(llInfo, "Reading defaults for Tissue: ", fname);
 
-        FILE *f = fopen(fname, "r");
+        FILE *f = ParserOpen(fname);
         if (!f)
             throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
 
         scene::ParseTissueSettings(f, this, false);
 
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
@@ -177,18 +177,18 @@ bool anyTissueSettings::validate_removal()
 
     // is tissue used by any cell?...
     int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
-            if (scene::Cells[first_cell + i].tissue == this)
+            if (Simulation->cells[first_cell + i].tissue == this)
             {
                 dialog->dialog->groupBox_msg->setVisible(true);
                 dialog->dialog->label_msg->setText(QObject::tr("Tissue is used by one or more cell."));
                 return false;
             }
 
-        first_cell += SimulationSettings.max_cells_per_box;
+        first_cell += Simulation->settings.max_cells_per_box;
     }
 
     return true;
@@ -229,6 +229,8 @@ void anyTissueSettings::update_from_dialog()
     o2_hypoxia = dialog->dialog->doubleSpinBox_t_o2hypoxia->value();
     pericyte_production = dialog->dialog->lineEdit_t_per_prod->text().toDouble();
 
+    scene::UpdateTissueInteractions();
+
     LOG(llDebug, "Tissue updated from dialog");
 }
 
@@ -0,0 +1,526 @@
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "anytrajectory.h"
+#include "func.h"
+#include "log.h"
+
+
+static float column_quantum(int column)
+/**
+  Returns quantum of column: > 0 for quantized floats, 0 for integers and -1 for
+  floats stored as bit patterns.
+*/
+{
+    if (column == tcCellX || column == tcCellY || column == tcCellZ
+        || (column >= tcTubeX1 && column <= tcTubeZ2))
+        return TRAJECTORY_POS_QUANTUM;
+    if (column == tcCellR || column == tcTubeR)
+        return TRAJECTORY_R_QUANTUM;
+    if (column >= tcCellConc && column <= tcCellConcLast)
+        return TRAJECTORY_CONC_QUANTUM;
+    if (column == tcTubeBloodPressure || column == tcTubeBloodFlow)
+        return -1;
+    return 0;
+}
+
+
+char const *TrajectoryColumnName(int column)
+{
+    static char const *names[tcLast];
+    if (!names[0])
+    {
+        names[tcCellX] = "x";
+        names[tcCellY] = "y";
+        names[tcCellZ] = "z";
+        names[tcCellR] = "r";
+        names[tcCellState] = "state";
+        names[tcCellTissue] = "tissue";
+        names[tcCellConc + sat::dsO2] = "conc_O2";
+        names[tcCellConc + sat::dsTAF] = "conc_TAF";
+        names[tcCellConc + sat::dsPericytes] = "conc_Pericytes";
+        names[tcCellConc + sat::dsMedicine] = "conc_Medicine";
+        names[tcTubeId] = "id";
+        names[tcTubeX1] = "x1";
+        names[tcTubeY1] = "y1";
+        names[tcTubeZ1] = "z1";
+        names[tcTubeX2] = "x2";
+        names[tcTubeY2] = "y2";
+        names[tcTubeZ2] = "z2";
+        names[tcTubeR] = "r";
+        names[tcTubeState] = "state";
+        names[tcTubeFirst] = "first";
+        names[tcTubeBaseId] = "base_id";
+        names[tcTubeTopId] = "top_id";
+        names[tcTubeFixedBloodPressure] = "fixed_blood_pressure";
+        names[tcTubeBloodPressure] = "blood_pressure";
+        names[tcTubeBloodFlow] = "blood_flow";
+    }
+    return names[column];
+}
+
+
+static bool is_cell_column(int column)
+{
+    return column < tcTubeId;
+}
+
+
+void anyTrajectoryFrame::resize(int cells, int tubes)
+{
+    no_cells = cells;
+    no_tubes = tubes;
+    for (int c = 0; c < tcLast; c++)
+        columns[c].resize(is_cell_column(c) ? cells : tubes);
+}
+
+
+void anyTrajectoryFrame::set_float(int column, int i, float x)
+{
+    float q = column_quantum(column);
+    if (q > 0)
+        columns[column][i] = (int)floor(x/q + 0.5f);
+    else
+        memcpy(&columns[column][i], &x, sizeof(x));
+}
+
+
+float anyTrajectoryFrame::get_float(int column, int i) const
+{
+    float q = column_quantum(column);
+    if (q > 0)
+        return columns[column][i]*q;
+
+    float x;
+    memcpy(&x, &columns[column][i], sizeof(x));
+    return x;
+}
+
+
+// encoding...
+
+static void put_u8(std::vector<unsigned char> &b, unsigned x)
+{
+    b.push_back(x & 0xff);
+}
+
+
+static void put_u32(std::vector<unsigned char> &b, unsigned x)
+{
+    for (int k = 0; k < 4; k++)
+        b.push_back((x >> 8*k) & 0xff);
+}
+
+
+static void put_f32(std::vector<unsigned char> &b, float x)
+{
+    unsigned u;
+    memcpy(&u, &x, sizeof(u));
+    put_u32(b, u);
+}
+
+
+static void put_i64(std::vector<unsigned char> &b, long long x)
+{
+    for (int k = 0; k < 8; k++)
+        b.push_back((x >> 8*k) & 0xff);
+}
+
+
+static void put_str(std::vector<unsigned char> &b, char const *s)
+{
+    int len = s ? strlen(s) : 0;
+    put_u32(b, len);
+    b.insert(b.end(), s, s + len);
+}
+
+
+static void put_varint(std::vector<unsigned char> &b, unsigned x)
+{
+    while (x >= 0x80)
+    {
+        b.push_back((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    b.push_back(x);
+}
+
+
+static unsigned zigzag(int x)
+{
+    return ((unsigned)x << 1) ^ (unsigned)(x >> 31);
+}
+
+
+static int unzigzag(unsigned x)
+{
+    return (int)(x >> 1) ^ -(int)(x & 1);
+}
+
+
+class anyByteReader
+/**
+  Reads little-endian values from buffer.
+*/
+{
+public:
+    unsigned char const *p, *end;
+
+    anyByteReader(std::vector<unsigned char> const &b): p(b.empty() ? 0 : &b[0]), end(b.empty() ? 0 : &b[0] + b.size()) {}
+
+    void need(int n)
+    {
+        if (end - p < n)
+            throw new Error(__FILE__, __LINE__, "Trajectory file is truncated");
+    }
+
+    unsigned u8() { need(1); return *p++; }
+    unsigned u32() { need(4); unsigned x = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24); p += 4; return x; }
+    float f32() { unsigned u = u32(); float x; memcpy(&x, &u, sizeof(x)); return x; }
+    long long i64() { long long lo = u32(); long long hi = u32(); return lo | (hi << 32); }
+
+    unsigned varint()
+    {
+        unsigned x = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            unsigned b = u8();
+            x |= (b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return x;
+        }
+        throw new Error(__FILE__, __LINE__, "Invalid value in trajectory file");
+    }
+};
+
+
+static void read_bytes(FILE *f, long offset, int n, std::vector<unsigned char> &b, char const *fname)
+{
+    b.resize(n);
+    if (fseek(f, offset, SEEK_SET) || (n && fread(&b[0], 1, n, f) != (size_t)n))
+        throw new Error(__FILE__, __LINE__, "Cannot read trajectory file", fname);
+}
+
+
+// writer...
+
+void anyTrajectoryWriter::open(char const *fname, char const *scene, int no_tissues, char const *const *tissue_names,
+                               int no_states, char const *const *state_names)
+/**
+  Creates trajectory file and writes its header.
+
+  \param scene -- scene definition (*.ag text without cells and tubes)
+  \param tissue_names -- names of tissues (indexed by tcCellTissue values)
+  \param state_names -- names of cell states (indexed by state values)
+*/
+{
+    close();
+
+    f = fopen(fname, "wb");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
+    this->fname = fname;
+
+    buffer.clear();
+    buffer.insert(buffer.end(), TRAJECTORY_MAGIC, TRAJECTORY_MAGIC + 4);
+    put_u32(buffer, TRAJECTORY_VERSION);
+    put_str(buffer, scene);
+    put_u32(buffer, no_tissues);
+    for (int i = 0; i < no_tissues; i++)
+        put_str(buffer, tissue_names[i]);
+    put_u32(buffer, no_states);
+    for (int i = 0; i < no_states; i++)
+        put_str(buffer, state_names[i]);
+    fwrite(&buffer[0], 1, buffer.size(), f);
+
+    index.clear();
+    prev.resize(0, 0);
+}
+
+
+void anyTrajectoryWriter::write_frame(anyTrajectoryFrame const &frame)
+/**
+  Appends frame. Every value is stored as difference to value with the same index
+  in previous frame (xor for float bit patterns), so cells that keep their place
+  in box arrays cost a byte or two per column.
+*/
+{
+    if (!f)
+        return;
+
+    anyTrajectoryIndexItem item;
+    item.offset = ftell(f);
+    item.step = frame.step;
+    item.time = frame.time;
+    item.keyframe = index.size() % TRAJECTORY_KEYFRAME == 0;
+
+    buffer.clear();
+    for (int c = 0; c < tcLast; c++)
+    {
+        std::vector<int> const &cur = frame.columns[c];
+        std::vector<int> const &old = prev.columns[c];
+        int n = is_cell_column(c) ? frame.no_cells : frame.no_tubes;
+        int old_n = item.keyframe ? 0 : MIN(n, (int)old.size());
+        bool bits = column_quantum(c) < 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            int ref = i < old_n ? old[i] : 0;
+            if (bits)
+                put_varint(buffer, (unsigned)cur[i] ^ (unsigned)ref);
+            else
+                put_varint(buffer, zigzag(cur[i] - ref));
+        }
+    }
+
+    std::vector<unsigned char> header;
+    header.insert(header.end(), TRAJECTORY_FRAME_MAGIC, TRAJECTORY_FRAME_MAGIC + 4);
+    put_u32(header, frame.step);
+    put_f32(header, frame.time);
+    put_u32(header, frame.no_cells);
+    put_u32(header, frame.no_tubes);
+    put_u8(header, item.keyframe);
+    put_u32(header, buffer.size());
+
+    if (fwrite(&header[0], 1, header.size(), f) != header.size()
+        || (buffer.size() && fwrite(&buffer[0], 1, buffer.size(), f) != buffer.size()))
+        throw new Error(__FILE__, __LINE__, "Cannot write trajectory file", fname.c_str());
+    fflush(f);
+
+    index.push_back(item);
+    prev = frame;
+}
+
+
+void anyTrajectoryWriter::close()
+/**
+  Writes index of frames and closes file.
+*/
+{
+    if (!f)
+        return;
+
+    buffer.clear();
+    long index_offset = ftell(f);
+    buffer.insert(buffer.end(), TRAJECTORY_INDEX_MAGIC, TRAJECTORY_INDEX_MAGIC + 4);
+    put_u32(buffer, index.size());
+    for (unsigned i = 0; i < index.size(); i++)
+    {
+        put_i64(buffer, index[i].offset);
+        put_u32(buffer, index[i].step);
+        put_f32(buffer, index[i].time);
+        put_u8(buffer, index[i].keyframe);
+    }
+    put_i64(buffer, index_offset);
+    buffer.insert(buffer.end(), TRAJECTORY_END_MAGIC, TRAJECTORY_END_MAGIC + 4);
+    fwrite(&buffer[0], 1, buffer.size(), f);
+
+    fclose(f);
+    f = 0;
+    index.clear();
+}
+
+
+// reader...
+
+#define TRAJECTORY_FRAME_HEADER_SIZE 25
+
+
+void anyTrajectoryReader::open(char const *fname)
+/**
+  Opens trajectory file, reads header and index of frames.
+*/
+{
+    close();
+
+    f = fopen(fname, "rb");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
+    this->fname = fname;
+
+    // header (read in pieces, strings may be long)...
+    std::vector<unsigned char> b;
+    read_bytes(f, 0, 8, b, fname);
+    if (memcmp(&b[0], TRAJECTORY_MAGIC, 4))
+        throw new Error(__FILE__, __LINE__, "Not a trajectory file", fname);
+    anyByteReader r(b);
+    r.p += 4;
+    if (r.u32() != TRAJECTORY_VERSION)
+        throw new Error(__FILE__, __LINE__, "Unsupported version of trajectory file", fname);
+
+    long pos = 8;
+    std::vector<std::string> strings;
+    int no_strings = 1;
+    for (int part = 0; part < 3; part++)
+    {
+        if (part)
+        {
+            read_bytes(f, pos, 4, b, fname);
+            no_strings = anyByteReader(b).u32();
+            pos += 4;
+        }
+
+        std::vector<std::string> &dest = part == 1 ? tissue_names : state_names;
+        dest.clear();
+        for (int i = 0; i < no_strings; i++)
+        {
+            read_bytes(f, pos, 4, b, fname);
+            int len = anyByteReader(b).u32();
+            read_bytes(f, pos + 4, len, b, fname);
+            std::string s(b.begin(), b.end());
+            pos += 4 + len;
+
+            if (part == 0)
+                scene = s;
+            else
+                dest.push_back(s);
+        }
+    }
+
+    read_index();
+    if (index.empty() || index[0].offset != pos)
+    {
+        // no index (file was not closed) -- find frames...
+        index.clear();
+        for (;;)
+        {
+            b.resize(TRAJECTORY_FRAME_HEADER_SIZE);
+            if (fseek(f, pos, SEEK_SET) || fread(&b[0], 1, b.size(), f) != b.size() || memcmp(&b[0], TRAJECTORY_FRAME_MAGIC, 4))
+                break;
+
+            anyByteReader h(b);
+            h.p += 4;
+            anyTrajectoryIndexItem item;
+            item.offset = pos;
+            item.step = h.u32();
+            item.time = h.f32();
+            h.u32();
+            h.u32();
+            item.keyframe = h.u8();
+            long size = h.u32();
+
+            // is payload complete?...
+            if (fseek(f, pos + TRAJECTORY_FRAME_HEADER_SIZE + size - 1, SEEK_SET) || fgetc(f) == EOF)
+                break;
+
+            index.push_back(item);
+            pos += TRAJECTORY_FRAME_HEADER_SIZE + size;
+        }
+        LOG2(llInfo, "Trajectory file has no index, frames found by scanning: ", fname);
+    }
+    last_frame = -1;
+}
+
+
+void anyTrajectoryReader::read_index()
+{
+    index.clear();
+
+    std::vector<unsigned char> b;
+    if (fseek(f, 0, SEEK_END))
+        return;
+    long size = ftell(f);
+    if (size < 12 + 8)
+        return;
+
+    read_bytes(f, size - 12, 12, b, fname.c_str());
+    if (memcmp(&b[8], TRAJECTORY_END_MAGIC, 4))
+        return;
+    long index_offset = anyByteReader(b).i64();
+    if (index_offset < 0 || index_offset > size - 20)
+        return;
+
+    read_bytes(f, index_offset, size - 12 - index_offset, b, fname.c_str());
+    if (memcmp(&b[0], TRAJECTORY_INDEX_MAGIC, 4))
+        return;
+    anyByteReader r(b);
+    r.p += 4;
+    int n = r.u32();
+    for (int i = 0; i < n; i++)
+    {
+        anyTrajectoryIndexItem item;
+        item.offset = r.i64();
+        item.step = r.u32();
+        item.time = r.f32();
+        item.keyframe = r.u8();
+        index.push_back(item);
+    }
+}
+
+
+void anyTrajectoryReader::close()
+{
+    if (f)
+        fclose(f);
+    f = 0;
+    index.clear();
+    last_frame = -1;
+}
+
+
+void anyTrajectoryReader::decode_frame(int i, anyTrajectoryFrame const &prev, anyTrajectoryFrame &frame)
+/**
+  Decodes i-th frame (prev must be (i-1)-th frame unless i-th frame is keyframe).
+*/
+{
+    std::vector<unsigned char> b;
+    read_bytes(f, index[i].offset, TRAJECTORY_FRAME_HEADER_SIZE, b, fname.c_str());
+    anyByteReader h(b);
+    if (memcmp(h.p, TRAJECTORY_FRAME_MAGIC, 4))
+        throw new Error(__FILE__, __LINE__, "Invalid frame in trajectory file", fname.c_str());
+    h.p += 4;
+    frame.step = h.u32();
+    frame.time = h.f32();
+    int no_cells = h.u32();
+    int no_tubes = h.u32();
+    bool keyframe = h.u8();
+    int size = h.u32();
+    frame.resize(no_cells, no_tubes);
+
+    read_bytes(f, index[i].offset + TRAJECTORY_FRAME_HEADER_SIZE, size, b, fname.c_str());
+    anyByteReader r(b);
+    for (int c = 0; c < tcLast; c++)
+    {
+        std::vector<int> &cur = frame.columns[c];
+        std::vector<int> const &old = prev.columns[c];
+        int n = cur.size();
+        int old_n = keyframe ? 0 : MIN(n, (int)old.size());
+        bool bits = column_quantum(c) < 0;
+
+        for (int k = 0; k < n; k++)
+        {
+            int ref = k < old_n ? old[k] : 0;
+            if (bits)
+                cur[k] = (int)(r.varint() ^ (unsigned)ref);
+            else
+                cur[k] = unzigzag(r.varint()) + ref;
+        }
+    }
+}
+
+
+anyTrajectoryFrame const &anyTrajectoryReader::read_frame(int i)
+/**
+  Returns i-th frame. Returned frame is valid until next read_frame().
+*/
+{
+    if (i < 0 || i >= (int)index.size())
+        throw new Error(__FILE__, __LINE__, "Invalid frame number", fname.c_str());
+
+    // start from nearest keyframe or from last decoded frame...
+    int first = i;
+    while (first > 0 && !index[first].keyframe)
+        first--;
+    if (last_frame >= first && last_frame <= i)
+        first = last_frame + 1;
+
+    anyTrajectoryFrame next;
+    for (int k = first; k <= i; k++)
+    {
+        decode_frame(k, last, next);
+        std::swap(last, next);
+        last_frame = k;
+    }
+    return last;
+}
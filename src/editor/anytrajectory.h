@@ -0,0 +1,133 @@
+#ifndef ANYTRAJECTORY_H
+#define ANYTRAJECTORY_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "const.h"
+
+#define TRAJECTORY_MAGIC "MTRJ"
+#define TRAJECTORY_FRAME_MAGIC "MTFR"
+#define TRAJECTORY_INDEX_MAGIC "MTIX"
+#define TRAJECTORY_END_MAGIC "MTIE"
+#define TRAJECTORY_VERSION 1
+
+#define TRAJECTORY_POS_QUANTUM 1e-3f   ///< resolution of positions [um]
+#define TRAJECTORY_R_QUANTUM 1e-4f     ///< resolution of radii [um]
+#define TRAJECTORY_CONC_QUANTUM 1e-6f  ///< resolution of concentrations
+#define TRAJECTORY_KEYFRAME 16         ///< every Nth frame is encoded without previous frame
+
+
+enum anyTrajectoryColumn
+/**
+  Columns of trajectory frame. Cell columns have no_cells values, tube columns no_tubes values.
+*/
+{
+    tcCellX, tcCellY, tcCellZ, tcCellR, tcCellState, tcCellTissue,
+    tcCellConc, tcCellConcLast = tcCellConc + sat::dsLast - 1,
+    tcTubeId, tcTubeX1, tcTubeY1, tcTubeZ1, tcTubeX2, tcTubeY2, tcTubeZ2, tcTubeR, tcTubeState,
+    tcTubeFirst, tcTubeBaseId, tcTubeTopId, tcTubeFixedBloodPressure, tcTubeBloodPressure, tcTubeBloodFlow,
+    tcLast
+};
+
+
+class anyTrajectoryFrame
+/**
+  One frame of trajectory in columns. Positions, radii and concentrations are
+  quantized (stored as integers), other floats are stored as bit patterns.
+*/
+{
+public:
+    int step;                         ///< simulation step
+    float time;                       ///< simulation time
+    int no_cells;                     ///< number of cells
+    int no_tubes;                     ///< number of tubes
+    std::vector<int> columns[tcLast]; ///< values
+
+    anyTrajectoryFrame(): step(0), time(0), no_cells(0), no_tubes(0) {}
+
+    void resize(int cells, int tubes);
+    void set_float(int column, int i, float x);
+    float get_float(int column, int i) const;
+    void set_int(int column, int i, int x) { columns[column][i] = x; }
+    int get_int(int column, int i) const { return columns[column][i]; }
+};
+
+
+struct anyTrajectoryIndexItem
+/**
+  Position of frame in trajectory file.
+*/
+{
+    long offset;    ///< offset of frame header
+    int step;       ///< simulation step
+    float time;     ///< simulation time
+    bool keyframe;  ///< encoded without previous frame?
+};
+
+
+class anyTrajectoryWriter
+/**
+  Writes trajectory file: header (scene definition, tissue and state names),
+  frames appended one by one (values delta-encoded against previous frame as
+  zig-zag varints), and index of frames written on close.
+*/
+{
+private:
+    FILE *f;
+    std::string fname;
+    anyTrajectoryFrame prev;   ///< last written frame
+    std::vector<anyTrajectoryIndexItem> index;
+    std::vector<unsigned char> buffer;
+
+public:
+    anyTrajectoryWriter(): f(0) {}
+    ~anyTrajectoryWriter() { close(); }
+
+    bool is_open() const { return f != 0; }
+    void open(char const *fname, char const *scene, int no_tissues, char const *const *tissue_names,
+              int no_states, char const *const *state_names);
+    void write_frame(anyTrajectoryFrame const &frame);
+    void close();
+};
+
+
+class anyTrajectoryReader
+/**
+  Reads frames of trajectory file in any order. Frames are decoded starting from
+  nearest keyframe, so reading frames in order decodes every frame once.
+
+  If file was not closed properly (no index), frames are found by scanning.
+*/
+{
+private:
+    FILE *f;
+    std::string fname;
+    std::vector<anyTrajectoryIndexItem> index;
+    anyTrajectoryFrame last;   ///< last decoded frame
+    int last_frame;            ///< index of last decoded frame (-1 if none)
+
+    void read_index();
+    void decode_frame(int i, anyTrajectoryFrame const &prev, anyTrajectoryFrame &frame);
+
+public:
+    std::string scene;                     ///< scene definition (*.ag without cells and tubes)
+    std::vector<std::string> tissue_names; ///< names of tissues (tcCellTissue values)
+    std::vector<std::string> state_names;  ///< names of states (tcCellState/tcTubeState values)
+
+    anyTrajectoryReader(): f(0), last_frame(-1) {}
+    ~anyTrajectoryReader() { close(); }
+
+    void open(char const *fname);
+    void close();
+    int no_frames() const { return index.size(); }
+    anyTrajectoryIndexItem const &frame_info(int i) const { return index[i]; }
+    anyTrajectoryFrame const &read_frame(int i);
+};
+
+
+char const *TrajectoryColumnName(int column);
+
+
+#endif // ANYTRAJECTORY_H
@@ -9,6 +9,8 @@
 #include "scene.h"
 #include "types.h"
 
+class anyTubeChain;
+
 class anyTube
 /**
   Structure defining tube.
@@ -37,6 +39,7 @@ public:
     anyTube *base;   ///< link to base tube of first forked tube
     anyTube *top;    ///< link to base tube of last forked tube
     anyTube *jab;    ///< link to attached tube
+    anyTubeChain *chain; ///< chain of tube
 
     float concentrations[sat::dsLast][2];
 
@@ -37,13 +37,13 @@ void anyTubeBundle::read_defaults()
     {
         LOG2(llInfo, "Reading defaults for TubeBundle: ", fname);
 
-        FILE *f = fopen(fname, "r");
+        FILE *f = ParserOpen(fname);
         if (!f)
             throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
 
         scene::ParseTubeBundle(f, this, false);
 
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
@@ -0,0 +1,22 @@
+#ifndef ANYTUBECHAIN_H
+#define ANYTUBECHAIN_H
+
+class anyTube;
+
+class anyTubeChain
+/**
+  Chain of tubes linked by next/prev. Every tube points to its chain, so head,
+  tail and length of chain are known without walking it.
+*/
+{
+public:
+    anyTube *head;   ///< first tube
+    anyTube *tail;   ///< last tube
+    int length;      ///< number of tubes
+    int index;       ///< index in Simulation->tube_chains
+    bool merging;    ///< chain is in list of chains to merge in current step
+
+    anyTubeChain(): head(0), tail(0), length(0), index(0), merging(false) {}
+};
+
+#endif // ANYTUBECHAIN_H
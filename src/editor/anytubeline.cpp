@@ -15,13 +15,13 @@ void anyTubeLine::read_defaults()
     {
         LOG2(llInfo, "Reading defaults for TubeLine: ", fname);
 
-        FILE *f = fopen(fname, "r");
+        FILE *f = ParserOpen(fname);
         if (!f)
             throw new Error(__FILE__, __LINE__, "Cannot open file", fname);
 
         scene::ParseTubeLine(f, this, false);
 
-        fclose(f);
+        ParserClose(f);
     }
     catch (Error *err)
     {
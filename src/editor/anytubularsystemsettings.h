@@ -39,6 +39,4 @@ public:
 
 };
 
-extern anyTubularSystemSettings TubularSystemSettings;
-
 #endif // ANYTUBULARSYSTEMSETTINGS_H
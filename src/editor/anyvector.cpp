@@ -104,8 +104,8 @@ void anyVector::set_random(int dim, float length){
 }
 
 char* anyVector::toString() const{
-    static char h[10][100];
-    static int h_indx = 0;
+    static thread_local char h[10][100];
+    static thread_local int h_indx = 0;
     h_indx = (h_indx + 1) % 10;
     snprintf(h[h_indx], 100, "<%g, %g, %g>", x, y, z);
     return h[h_indx];
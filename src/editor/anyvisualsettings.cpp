@@ -10,13 +10,17 @@ void anyVisualSettings::reset()
     snprintf(fname, P_MAX_PATH, "%s%svisual_settings.ag", GlobalSettings.app_dir, FOLDER_DEFAULTS);
     Slashify(fname, false);
     LOG2(llInfo, "Reading defaults from ", fname);
-    FILE *f = fopen(fname, "r");
+    FILE *f = ParserOpen(fname);
     if (!f)
         throw new Error(__FILE__, __LINE__, "Cannot open file for reading", 0, fname);
     else
     {
+        cell_quality = sat::cqNice;
+        occlusion_culling = false;
+        png_color_mode = COLOR_MODE_TISSUE_COLOR;
+        png_clip = false;
         ParseVisualSettings(f);
-        fclose(f);
+        ParserClose(f);
     }
 
     v_matrix.setToIdentity();
@@ -45,6 +45,14 @@ public:
     anyColor clip_plane_color;     ///< color of clipping plane marker
     anyColor tube_color;           ///< color of tubes
 
+    // quality...
+    sat::CellQuality cell_quality; ///< cells drawing (simple/nice/nicest sphere meshes or ray-cast impostors)
+    bool occlusion_culling;        ///< skip boxes surrounded by full boxes?
+
+    // frames saved by simulation (Simulation->settings.save_png)...
+    int png_color_mode;            ///< coloring of cells (COLOR_MODE_* flags)
+    bool png_clip;                 ///< clip cells with clipping plane?
+
     // light...
     anyVector light_dir;  ///< light direction
     anyVector light_dir_r;  ///< rotated light direction
@@ -70,15 +70,15 @@ public:
 
     char *to_HTML() const
     {
-        static char html[9];
+        static thread_local char html[9];
         snprintf(html, 8, "#%02x%02x%02x", int(rgba_array[0]*255), int(rgba_array[1]*255), int(rgba_array[2]*255));
         return html;
     }
 
     char *to_string_rgb() const
     {
-        static char h[10][100];
-        static int h_indx = 0;
+        static thread_local char h[10][100];
+        static thread_local int h_indx = 0;
         h_indx = (h_indx + 1) % 10;
         snprintf(h[h_indx], 100, "<%g, %g, %g>", rgba_array[0], rgba_array[1], rgba_array[2]);
         return h[h_indx];
@@ -86,8 +86,8 @@ public:
 
     char *to_string_rgba() const
     {
-        static char h[10][100];
-        static int h_indx = 0;
+        static thread_local char h[10][100];
+        static thread_local int h_indx = 0;
         h_indx = (h_indx + 1) % 10;
         snprintf(h[h_indx], 100, "<%g, %g, %g, %g>", rgba_array[0], rgba_array[1], rgba_array[2], rgba_array[3]);
         return h[h_indx];
@@ -11,8 +11,6 @@
 
 anyGlobalSettings GlobalSettings;               ///< global settings
 anyVisualSettings VisualSettings;               ///< all visual settings
-anySimulationSettings SimulationSettings;       ///< all simulation settings
-anyTubularSystemSettings TubularSystemSettings; ///< tubular network settings
 
 
 void SaveVisualSettings_ag(FILE *f, anyVisualSettings const *vs)
@@ -46,6 +44,15 @@ void SaveVisualSettings_ag(FILE *f, anyVisualSettings const *vs)
     SAVE_COLOR(f, vs, navigator_color);
     SAVE_COLOR(f, vs, boxes_color);
 
+    SAVE_INT(f, vs, cell_quality);
+    SAVE_INT(f, vs, occlusion_culling);
+
+    SAVE_TRANSFORMATION(f, vs, v_matrix);
+    SAVE_TRANSFORMATION(f, vs, r_matrix);
+    SAVE_TRANSFORMATION(f, vs, clip);
+    SAVE_INT(f, vs, png_color_mode);
+    SAVE_INT(f, vs, png_clip);
+
     fprintf(f, " }\n");
 }
 
@@ -80,9 +87,21 @@ void SaveSimulationSettings_ag(FILE *f, anySimulationSettings const *ss)
     SAVE_INT(f, ss, max_tube_chains);
     SAVE_INT(f, ss, max_tube_merge);
 
+    SAVE_INT(f, ss, diffusion_every);
+    SAVE_INT(f, ss, blood_flow_every);
+    SAVE_INT(f, ss, tissue_props_every);
+
     SAVE_INT(f, ss, save_statistics);
     SAVE_INT(f, ss, save_povray);
     SAVE_INT(f, ss, save_ag);
+    SAVE_INT(f, ss, save_ag_tables);
+    SAVE_INT(f, ss, save_png);
+    SAVE_INT(f, ss, save_trajectory);
+    SAVE_INT(f, ss, statistics_binary);
+    SAVE_float(f, ss, statistics_flush_time);
+    SAVE_INT(f, ss, save_vtk);
+    SAVE_INT(f, ss, output_threads);
+    SAVE_INT(f, ss, output_queue);
 
     SAVE_INT(f, ss, add_medicine);
     SAVE_INT(f, ss, remove_medicine);
@@ -187,7 +206,7 @@ void ParseSimulationSettings(FILE *f)
             throw new Error(__FILE__, __LINE__, "Unexpected token (not string)", TokenToString(Token), ParserFile, ParserLine);
     }
 
-    SimulationSettings.calculate_derived_values();
+    Simulation->settings.calculate_derived_values();
 }
 
 
@@ -258,6 +277,7 @@ void ParseVisualSettings(FILE *f)
     }
 
     VisualSettings.comp_light_dir();
+    VisualSettings.comp_clip_plane();
 }
 
 
@@ -305,6 +325,14 @@ void ParseVisualSettingsValue(FILE *f)
     PARSE_VALUE_COLOR(VisualSettings, navigator_color)
     PARSE_VALUE_COLOR(VisualSettings, boxes_color)
     PARSE_VALUE_VECTOR(VisualSettings, light_dir)
+    PARSE_VALUE_ENUM(VisualSettings, sat::CellQuality, cell_quality)
+    PARSE_VALUE_BOOL(VisualSettings, occlusion_culling)
+
+    PARSE_VALUE_TRANSFORMATION(VisualSettings, v_matrix)
+    PARSE_VALUE_TRANSFORMATION(VisualSettings, r_matrix)
+    PARSE_VALUE_TRANSFORMATION(VisualSettings, clip)
+    PARSE_VALUE_INT(VisualSettings, png_color_mode)
+    PARSE_VALUE_BOOL(VisualSettings, png_clip)
 
   else
       throw new Error(__FILE__, __LINE__, "Unknown token in 'visual'", TokenToString(tv), ParserFile, ParserLine);
@@ -333,37 +361,49 @@ void ParseSimulationSettingsValue(FILE *f)
 
     // assign value...
     if (0) ;
-    PARSE_VALUE_INT(SimulationSettings, dimensions)
-    PARSE_VALUE_INT(SimulationSettings, sim_phases)
-    PARSE_VALUE_float(SimulationSettings, time_step)
-    PARSE_VALUE_float(SimulationSettings, stop_time)
-    PARSE_VALUE_float(SimulationSettings, time)
-    PARSE_VALUE_VECTOR(SimulationSettings, comp_box_from)
-    PARSE_VALUE_VECTOR(SimulationSettings, comp_box_to)
-    PARSE_VALUE_float(SimulationSettings, box_size)
-    PARSE_VALUE_INT(SimulationSettings, max_cells_per_box)
-
-    PARSE_VALUE_float(SimulationSettings, force_r_cut)
-    PARSE_VALUE_float(SimulationSettings, proliferative_o2)
-    PARSE_VALUE_float(SimulationSettings, medicine_threshold)
-
-    PARSE_VALUE_INT(SimulationSettings, max_tube_chains)
-    PARSE_VALUE_INT(SimulationSettings, max_tube_merge)
-
-    PARSE_VALUE_INT(SimulationSettings, save_statistics)
-    PARSE_VALUE_INT(SimulationSettings, save_povray)
-    PARSE_VALUE_INT(SimulationSettings, save_ag)
-
-    PARSE_VALUE_INT(SimulationSettings, graph_sampling)
-
-    PARSE_VALUE_INT(SimulationSettings, add_medicine)
-    PARSE_VALUE_INT(SimulationSettings, remove_medicine)
-    PARSE_VALUE_INT(SimulationSettings, activation_steps)
-
-    PARSE_VALUE_float_N(SimulationSettings, diffusion_coeff[sat::dsO2], diffusion_coeff_o2)
-    PARSE_VALUE_float_N(SimulationSettings, diffusion_coeff[sat::dsTAF], diffusion_coeff_taf)
-    PARSE_VALUE_float_N(SimulationSettings, diffusion_coeff[sat::dsPericytes], diffusion_coeff_pericytes)
-    PARSE_VALUE_float_N(SimulationSettings, diffusion_coeff[sat::dsMedicine], diffusion_coeff_medicine)
+    PARSE_VALUE_INT(Simulation->settings, dimensions)
+    PARSE_VALUE_INT(Simulation->settings, sim_phases)
+    PARSE_VALUE_float(Simulation->settings, time_step)
+    PARSE_VALUE_float(Simulation->settings, stop_time)
+    PARSE_VALUE_float(Simulation->settings, time)
+    PARSE_VALUE_VECTOR(Simulation->settings, comp_box_from)
+    PARSE_VALUE_VECTOR(Simulation->settings, comp_box_to)
+    PARSE_VALUE_float(Simulation->settings, box_size)
+    PARSE_VALUE_INT(Simulation->settings, max_cells_per_box)
+
+    PARSE_VALUE_float(Simulation->settings, force_r_cut)
+    PARSE_VALUE_float(Simulation->settings, proliferative_o2)
+    PARSE_VALUE_float(Simulation->settings, medicine_threshold)
+
+    PARSE_VALUE_INT(Simulation->settings, max_tube_chains)
+    PARSE_VALUE_INT(Simulation->settings, max_tube_merge)
+
+    PARSE_VALUE_INT(Simulation->settings, diffusion_every)
+    PARSE_VALUE_INT(Simulation->settings, blood_flow_every)
+    PARSE_VALUE_INT(Simulation->settings, tissue_props_every)
+
+    PARSE_VALUE_INT(Simulation->settings, save_statistics)
+    PARSE_VALUE_INT(Simulation->settings, save_povray)
+    PARSE_VALUE_INT(Simulation->settings, save_ag)
+    PARSE_VALUE_INT(Simulation->settings, save_ag_tables)
+    PARSE_VALUE_INT(Simulation->settings, save_png)
+    PARSE_VALUE_INT(Simulation->settings, save_trajectory)
+    PARSE_VALUE_INT(Simulation->settings, statistics_binary)
+    PARSE_VALUE_float(Simulation->settings, statistics_flush_time)
+    PARSE_VALUE_INT(Simulation->settings, save_vtk)
+    PARSE_VALUE_INT(Simulation->settings, output_threads)
+    PARSE_VALUE_INT(Simulation->settings, output_queue)
+
+    PARSE_VALUE_INT(Simulation->settings, graph_sampling)
+
+    PARSE_VALUE_INT(Simulation->settings, add_medicine)
+    PARSE_VALUE_INT(Simulation->settings, remove_medicine)
+    PARSE_VALUE_INT(Simulation->settings, activation_steps)
+
+    PARSE_VALUE_float_N(Simulation->settings, diffusion_coeff[sat::dsO2], diffusion_coeff_o2)
+    PARSE_VALUE_float_N(Simulation->settings, diffusion_coeff[sat::dsTAF], diffusion_coeff_taf)
+    PARSE_VALUE_float_N(Simulation->settings, diffusion_coeff[sat::dsPericytes], diffusion_coeff_pericytes)
+    PARSE_VALUE_float_N(Simulation->settings, diffusion_coeff[sat::dsMedicine], diffusion_coeff_medicine)
 
     else
         throw new Error(__FILE__, __LINE__, "Unknown token in 'simulation'", TokenToString(tv), ParserFile, ParserLine);
@@ -392,20 +432,20 @@ void ParseTubularSystemSettingsValue(FILE *f)
 
     // assign value...
     if (0) ;
-    PARSE_VALUE_float(TubularSystemSettings, force_chain_attr_factor)
-    PARSE_VALUE_float(TubularSystemSettings, force_length_keep_factor)
-    PARSE_VALUE_float(TubularSystemSettings, force_angle_factor)
-    PARSE_VALUE_float(TubularSystemSettings, force_rep_factor)
-    PARSE_VALUE_float(TubularSystemSettings, force_atr1_factor)
-    PARSE_VALUE_float(TubularSystemSettings, force_atr2_factor)
-    PARSE_VALUE_float(TubularSystemSettings, density)
-    PARSE_VALUE_float(TubularSystemSettings, o2_production)
-    PARSE_VALUE_float(TubularSystemSettings, lengthening_speed)
-    PARSE_VALUE_float(TubularSystemSettings, thickening_speed)
-    PARSE_VALUE_float(TubularSystemSettings, minimum_interphase_time)
-    PARSE_VALUE_float(TubularSystemSettings, TAFtrigger)
-    PARSE_VALUE_float(TubularSystemSettings, minimum_blood_flow)
-    PARSE_VALUE_float(TubularSystemSettings, time_to_degradation)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_chain_attr_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_length_keep_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_angle_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_rep_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_atr1_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, force_atr2_factor)
+    PARSE_VALUE_float(Simulation->tubular_settings, density)
+    PARSE_VALUE_float(Simulation->tubular_settings, o2_production)
+    PARSE_VALUE_float(Simulation->tubular_settings, lengthening_speed)
+    PARSE_VALUE_float(Simulation->tubular_settings, thickening_speed)
+    PARSE_VALUE_float(Simulation->tubular_settings, minimum_interphase_time)
+    PARSE_VALUE_float(Simulation->tubular_settings, TAFtrigger)
+    PARSE_VALUE_float(Simulation->tubular_settings, minimum_blood_flow)
+    PARSE_VALUE_float(Simulation->tubular_settings, time_to_degradation)
 
     else
         throw new Error(__FILE__, __LINE__, "Unknown token in 'TubularSystem'", TokenToString(tv), ParserFile, ParserLine);
@@ -12,14 +12,15 @@
 #include "scene.h"
 #include "parser.h"
 #include "statistics.h"
+#include "anysimulation.h"
 #include "anyglobalsettings.h"
 #include "anyvisualsettings.h"
 #include "anysimulationsettings.h"
 #include "anytubularsystemsettings.h"
 #include "anyglobalsdialog.h"
 
-#define VALID_BOX(box_x, box_y, box_z) ((box_x) >= 0 && (box_x) < SimulationSettings.no_boxes_x && (box_y) >= 0 && (box_y) < SimulationSettings.no_boxes_y && (box_z) >= 0 && (box_z) < SimulationSettings.no_boxes_z)
-#define BOX_ID(box_x, box_y, box_z) (box_x + box_y*SimulationSettings.no_boxes_x + box_z*SimulationSettings.no_boxes_x*SimulationSettings.no_boxes_y)
+#define VALID_BOX(box_x, box_y, box_z) ((box_x) >= 0 && (box_x) < Simulation->settings.no_boxes_x && (box_y) >= 0 && (box_y) < Simulation->settings.no_boxes_y && (box_z) >= 0 && (box_z) < Simulation->settings.no_boxes_z)
+#define BOX_ID(box_x, box_y, box_z) (box_x + box_y*Simulation->settings.no_boxes_x + box_z*Simulation->settings.no_boxes_x*Simulation->settings.no_boxes_y)
 
 
 void ParseSimulationSettingsValue(FILE *f);
@@ -12,6 +12,14 @@
 
 #define P_MAX_PATH 1024
 
+#define COLOR_MODE_TISSUE_COLOR 1
+#define COLOR_MODE_STATE        2
+#define COLOR_MODE_PRESSURE     4
+#define COLOR_MODE_O2           8
+#define COLOR_MODE_TAF         16
+#define COLOR_MODE_MEDICINE   32
+#define COLOR_MODE_PERICYTES   64
+
 #include <map>
 #include <iostream>
 #include <string>
@@ -37,6 +45,7 @@ namespace sat {
     enum TissueType { ttNormal, ttTumor };
     enum BarrierType { btIn, btOut };
     enum DiffundingSubstances {dsO2, dsTAF, dsPericytes, dsMedicine, dsLast};
+    enum CellQuality { cqSimple, cqNice, cqNicest, cqImpostor };  ///< quality of cells drawing
     enum anyRunEnv { reUnknown, reProduction, reDebug, reRelease };
     enum anySimPhase { spForces = 0x0001, spGrow = 0x0002, spMitosis = 0x0004, spDiffusion = 0x0008, spTubeDiv = 0x0010, spBloodFlow = 0x0020,
                        spALL = 0xFFFF };
@@ -3,6 +3,7 @@ DEFINES += _WIN32_WINNT=0x501
 DEFINES += GUI=1
 
 TEMPLATE = app
+CONFIG += c++11 thread
 HEADERS += mainwindow.h \
     glwidget.h \
     config.h \
@@ -32,17 +33,26 @@ HEADERS += mainwindow.h \
     anyeditabledialog.h \
     anyeditable.h \
     anytissuesettings.h \
+    anytissueinteraction.h \
     anycellblock.h \
     anybarrier.h \
     anytubebundle.h \
     anytubeline.h \
     anytubebox.h \
+    anytubechain.h \
     anytubemerge.h \
     anyglobalsettings.h \
     anyvisualsettings.h \
     anysimulationsettings.h \
     anytubularsystemsettings.h \
     anyglobalsdialog.h \
+    anysimulationcontext.h \
+    anysimulation.h \
+    anyrendersnapshot.h \
+    anysoftwarerenderer.h \
+    anytrajectory.h \
+    anyoutputsnapshot.h \
+    anyoutputwriter.h \
 
 SOURCES += mainwindow.cpp \
     glwidget.cpp \
@@ -75,6 +85,13 @@ SOURCES += mainwindow.cpp \
     anysimulationsettings.cpp \
     anytubularsystemsettings.cpp \
     anyglobalsdialog.cpp \
+    anysimulationcontext.cpp \
+    anysimulation.cpp \
+    anyrendersnapshot.cpp \
+    anysoftwarerenderer.cpp \
+    anytrajectory.cpp \
+    anyoutputsnapshot.cpp \
+    anyoutputwriter.cpp \
 
 FORMS += mainwindow.ui \
     dialogEditable.ui \
@@ -92,6 +109,9 @@ OTHER_FILES +=
 
 DISTFILES += \
     ../../include/shadersInstanced.glsl \
+    ../../include/shadersCellColor.glsl \
+    ../../include/shadersImpostor.glsl \
+    ../../include/shadersTubeInstanced.glsl \
     ../../include/shadersOverlay.glsl \
     ../../include/shadersWireframe.glsl \
     ../../include/shadersSimple.glsl
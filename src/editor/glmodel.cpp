@@ -1,42 +1,200 @@
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QDebug>
+#include <stdlib.h>
+#include <string.h>
 
 #include "glmodel.h"
 #include "log.h"
 #include "glwidget.h"
 
 
+static quint32 fnv1a(QByteArray const &data)
+{
+    quint32 h = 2166136261u;
+    for (int i = 0; i < data.size(); i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
 void rGlModel::load_from_file(QString fname, float scale)
+/**
+  Loads model from binary cache if it matches .model file, otherwise parses
+  .model file and (re)creates cache.
+*/
 {
+    QString cache_fname = cache_file_name(fname);
+    if (load_from_cache(fname, cache_fname, scale))
+        return;
+
     QFile file(fname);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!file.open(QIODevice::ReadOnly))
         throw new Error(__FILE__, __LINE__, "Cannot open file", fname.toLatin1().constData());
-
-    QTextStream ts(&file);
-    source.clear();
-    while (!ts.atEnd())
-        source << ts.readLine();
+    QByteArray source = file.readAll();
     file.close();
 
-    count_items();
+    count_items(source);
     alloc_items();
-    parse_items(scale);
+    parse_items(source, scale);
+
+    save_cache(fname, cache_fname, source, scale);
 }
 
 
-void rGlModel::count_items()
+QString rGlModel::cache_file_name(QString fname)
 {
-    v_cnt = vn_cnt = f_cnt = 0;
-    for (int i = 0; i < source.count(); i++)
+    return QString("%1motpuca_%2.cache").arg(GlobalSettings.temp_dir).arg(QFileInfo(fname).fileName());
+}
+
+
+bool rGlModel::load_from_cache(QString fname, QString cache_fname, float scale)
+/**
+  Reads vertData from cache. Cache is valid if modification time and size of .model
+  file are the same as stored ones, or (if file was only touched/copied) if its hash
+  is the same.
+
+  \returns false if there is no valid cache
+*/
+{
+    QFileInfo info(fname);
+    if (!info.exists())
+        return false;
+
+    QFile cache(cache_fname);
+    if (!cache.open(QIODevice::ReadOnly))
+        return false;
+
+    rGlModelCacheHeader h;
+    if (cache.read((char *)&h, sizeof(h)) != sizeof(h)
+        || memcmp(h.magic, MODEL_CACHE_MAGIC, 4) || h.version != MODEL_CACHE_VERSION || h.scale != scale
+        || h.f_cnt < 0 || h.l_cnt < 0 || h.vn_cnt < 0)
+        return false;
+
+    qint64 data_size = h.l_cnt ? 2*4*h.l_cnt*(qint64)sizeof(float) : 3*6*h.f_cnt*(qint64)sizeof(float);
+    if (cache.size() != (qint64)sizeof(h) + data_size)
+        return false;
+
+    qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    bool touched = h.mtime != mtime || h.size != info.size();
+    if (touched)
     {
-        if (source[i].startsWith("v "))
+        QFile file(fname);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        QByteArray source = file.readAll();
+        if (source.size() != h.size || fnv1a(source) != h.hash)
+            return false;
+    }
+
+    v_cnt = 0;
+    vn_cnt = h.vn_cnt;
+    f_cnt = h.f_cnt;
+    l_cnt = h.l_cnt;
+    delete [] vertData;
+    vertData = new float[data_size/sizeof(float)];
+    if (cache.read((char *)vertData, data_size) != data_size)
+        return false;
+    cache.close();
+
+    // hash matched, so remember new time...
+    if (touched && cache.open(QIODevice::ReadWrite))
+    {
+        h.mtime = mtime;
+        cache.write((char const *)&h, sizeof(h));
+    }
+
+    LOG2(llDebug, "Model loaded from cache: ", cache_fname.toLatin1().constData());
+    return true;
+}
+
+
+void rGlModel::save_cache(QString fname, QString cache_fname, QByteArray const &source, float scale)
+/**
+  Writes vertData with header to cache file. Failure is not an error (cache is optional).
+*/
+{
+    QFile cache(cache_fname);
+    if (!cache.open(QIODevice::WriteOnly))
+    {
+        LOG2(llDebug, "Cannot create model cache: ", cache_fname.toLatin1().constData());
+        return;
+    }
+
+    QFileInfo info(fname);
+    rGlModelCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MODEL_CACHE_MAGIC, 4);
+    h.version = MODEL_CACHE_VERSION;
+    h.mtime = info.lastModified().toMSecsSinceEpoch();
+    h.size = source.size();
+    h.hash = fnv1a(source);
+    h.scale = scale;
+    h.vn_cnt = vn_cnt;
+    h.f_cnt = f_cnt;
+    h.l_cnt = l_cnt;
+
+    int data_size = l_cnt ? getVertDataLineSize() : getVertDataSize();
+    if (cache.write((char const *)&h, sizeof(h)) != sizeof(h) || cache.write((char const *)vertData, data_size) != data_size)
+    {
+        cache.close();
+        cache.remove();
+    }
+}
+
+
+static bool line_starts_with(char const *s, char const *prefix)
+{
+    while (*prefix)
+        if (*s++ != *prefix++)
+            return false;
+    return true;
+}
+
+
+static char const *next_line(char const *s)
+{
+    while (*s && *s != '\n')
+        s++;
+    return *s ? s + 1 : s;
+}
+
+
+static char const *parse_face_vertex(char const *s, int idx[3])
+/**
+  Parses "v", "v/t", "v/t/n" or "v//n" (missing indices are 0).
+*/
+{
+    char *end;
+    idx[0] = idx[1] = idx[2] = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        idx[k] = strtol(s, &end, 10);
+        s = end;
+        if (*s != '/')
+            break;
+        s++;
+    }
+    return s;
+}
+
+
+void rGlModel::count_items(QByteArray const &source)
+{
+    v_cnt = vn_cnt = f_cnt = l_cnt = 0;
+    for (char const *s = source.constData(); *s; s = next_line(s))
+    {
+        if (line_starts_with(s, "v "))
             v_cnt++;
-        else if (source[i].startsWith("vn "))
+        else if (line_starts_with(s, "vn "))
             vn_cnt++;
-        else if (source[i].startsWith("f "))
+        else if (line_starts_with(s, "f "))
             f_cnt++;
-        else if (source[i].startsWith("l "))
+        else if (line_starts_with(s, "l "))
             l_cnt++;
     }
 }
@@ -49,6 +207,7 @@ void rGlModel::alloc_items()
     vn = new float[3*vn_cnt];
     memset(vn, 0, sizeof(float)*3*vn_cnt);
 
+    delete [] vertData;
     if (l_cnt)
         vertData = new float[2*4*l_cnt]; // line segment: 2*(x, y, z, alpha)
     else
@@ -56,103 +215,91 @@ void rGlModel::alloc_items()
 }
 
 
-void rGlModel::parse_items(float scale)
+void rGlModel::parse_items(QByteArray const &source, float scale)
+/**
+  Parses vertices, normals, triangles and lines in one pass (vertices and normals
+  are defined before they are referenced).
+*/
 {
-    QString l;
-    QStringList sl, sl2;
+    char *end;
+    int vp = 0, vnp = 0, fp = 0, lp = 0;
 
-    // wierzcholki...
-    int p = 0;
-    for (int i = 0; i < source.count(); i++)
+    for (char const *s = source.constData(); *s; s = next_line(s))
     {
-        if (source[i].startsWith("v "))
+        // wierzcholki...
+        if (line_starts_with(s, "v ") && vp < v_cnt)
         {
-            l = source[i].mid(2).trimmed();
-            sl = l.split(" ");
-            v[3*p + 0] = sl[0].toFloat()*scale;
-            v[3*p + 1] = sl[1].toFloat()*scale;
-            v[3*p + 2] = sl[2].toFloat()*scale;
-            p++;
+            s += 2;
+            for (int k = 0; k < 3; k++)
+            {
+                v[3*vp + k] = strtof(s, &end)*scale;
+                s = end;
+            }
+            vp++;
         }
-    }
 
-    // normalne...
-    p = 0;
-    for (int i = 0; i < source.count(); i++)
-    {
-        if (source[i].startsWith("vn "))
+        // normalne...
+        else if (line_starts_with(s, "vn ") && vnp < vn_cnt)
         {
-            l = source[i].mid(3).trimmed();
-            sl = l.split(" ");
-            vn[3*p + 0] = sl[0].toFloat();
-            vn[3*p + 1] = sl[1].toFloat();
-            vn[3*p + 2] = sl[2].toFloat();
-            p++;
+            s += 3;
+            for (int k = 0; k < 3; k++)
+            {
+                vn[3*vnp + k] = strtof(s, &end);
+                s = end;
+            }
+            vnp++;
         }
-    }
-
 
-    // trojkaty...
-    p = 0;
-    for (int i = 0; i < source.count(); i++)
-    {
-        if (source[i].startsWith("f "))
+        // trojkaty...
+        else if (line_starts_with(s, "f ") && !l_cnt)
         {
-            l = source[i].mid(2).trimmed();
-            sl = l.split(" ");
-
+            s += 2;
             for (int j = 0; j < 3; j++)
             {
-                sl2 = sl[j].split("/");
-                while (sl2.count() < 3)
-                    sl2.append("");
-
-                int vi = sl2[0].toInt() - 1;
-
-                vertData[6*p + 0] = v[3*vi + 0];
-                vertData[6*p + 1] = v[3*vi + 1];
-                vertData[6*p + 2] = v[3*vi + 2];
-
-                int vni = sl2[2].toInt() - 1;
-                vertData[6*p + 3] = vn[3*vni + 0];
-                vertData[6*p + 4] = vn[3*vni + 1];
-                vertData[6*p + 5] = vn[3*vni + 2];\
-
-                p++;
+                int idx[3];
+                while (*s == ' ' || *s == '\t')
+                    s++;
+                s = parse_face_vertex(s, idx);
+
+                int vi = idx[0] - 1;
+                int vni = idx[2] - 1;
+                float *d = vertData + 6*fp;
+                for (int k = 0; k < 3; k++)
+                {
+                    d[k] = vi >= 0 && vi < v_cnt ? v[3*vi + k] : 0;
+                    d[3 + k] = vni >= 0 && vni < vn_cnt ? vn[3*vni + k] : 0;
+                }
+                fp++;
             }
         }
-    }
 
-    // linie...
-    p = 0;
-    for (int i = 0; i < source.count(); i++)
-    {
-        if (source[i].startsWith("l "))
+        // linie...
+        else if (line_starts_with(s, "l ") && l_cnt)
         {
-            l = source[i].mid(2).trimmed();
-            sl = l.split(" ");
-
+            s += 2;
             for (int j = 0; j < 2; j++)
             {
-                sl2 = sl[j].split("/");
-                if (sl2.count() == 1)
-                    sl2.append("1");
-
-                int vi = sl2[0].toInt() - 1;
-
-                vertData[4*p + 0] = v[3*vi + 0];
-                vertData[4*p + 1] = v[3*vi + 1];
-                vertData[4*p + 2] = v[3*vi + 2];
-
-                float alpha = sl2[1].toFloat();
-                vertData[4*p + 3] = alpha;
-
-                p++;
+                while (*s == ' ' || *s == '\t')
+                    s++;
+                int vi = strtol(s, &end, 10) - 1;
+                s = end;
+                float alpha = 1;
+                if (*s == '/')
+                {
+                    alpha = strtof(s + 1, &end);
+                    s = end;
+                }
+
+                float *d = vertData + 4*lp;
+                for (int k = 0; k < 3; k++)
+                    d[k] = vi >= 0 && vi < v_cnt ? v[3*vi + k] : 0;
+                d[3] = alpha;
+
+                lp++;
             }
         }
     }
 
-
     delete [] v;
     delete [] vn;
 }
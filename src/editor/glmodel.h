@@ -2,13 +2,32 @@
 #define GLMODEL_H
 
 #include <QString>
-#include <QStringList>
+#include <QByteArray>
 
 #include "transform.h"
 #include "glshaderprogram.h"
 #include "config.h"
 
 
+#define MODEL_CACHE_MAGIC "MGLM"
+#define MODEL_CACHE_VERSION 1
+
+
+struct rGlModelCacheHeader
+/**
+  Header of binary model cache (followed by vertData).
+*/
+{
+    char magic[4];      ///< MODEL_CACHE_MAGIC
+    int version;        ///< MODEL_CACHE_VERSION
+    qint64 mtime;       ///< modification time of .model file [ms]
+    qint64 size;        ///< size of .model file
+    quint32 hash;       ///< FNV-1a hash of .model file
+    float scale;        ///< scale of vertices
+    int vn_cnt, f_cnt, l_cnt;
+};
+
+
 class rGlModel
 {
 public:
@@ -38,7 +57,6 @@ public:
 
 private:
     GLWidget *widget;
-    QStringList source;
     int v_cnt, vn_cnt, f_cnt, l_cnt;
     float *vertData;
     float *v, *vn;
@@ -46,11 +64,14 @@ private:
     rGlShaderProgram *gl_program;
 
     void load_from_file(QString fname, float scale = 1.0);
+    QString cache_file_name(QString fname);
+    bool load_from_cache(QString fname, QString cache_fname, float scale);
+    void save_cache(QString fname, QString cache_fname, QByteArray const &source, float scale);
     void make_vao(bool normals);
     void make_vao_lines();
-    void count_items();
+    void count_items(QByteArray const &source);
     void alloc_items();
-    void parse_items(float scale);
+    void parse_items(QByteArray const &source, float scale);
     void generate_tangents();
 
 public:
@@ -7,6 +7,34 @@
 #include "glwidget.h"
 
 
+static QString read_shader_include(QString const &line)
+/**
+  Returns content of file named in '#include "file"' line (file is searched in include folder).
+*/
+{
+    int from = line.indexOf('"');
+    int to = line.lastIndexOf('"');
+    if (from < 0 || to <= from)
+        throw new Error(__FILE__, __LINE__, "Bad shader include", line.toLatin1().constData());
+
+    QString fname = QString("%1include/%2").arg(GlobalSettings.app_dir).arg(line.mid(from + 1, to - from - 1));
+    QFile f(fname);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        throw new Error(__FILE__, __LINE__, "Cannot open shader file.", fname.toLatin1().constData());
+
+    QString source;
+    QTextStream fstr(&f);
+    while (!fstr.atEnd())
+    {
+        QString l = fstr.readLine();
+        if (l.trimmed().length() > 0)
+            source += l + "\n";
+    }
+    f.close();
+    return source;
+}
+
+
 void rGlShaderProgram::init(GLWidget *glWidget, QString shaderfname)
 {
     widget = glWidget;
@@ -33,6 +61,8 @@ void rGlShaderProgram::init(GLWidget *glWidget, QString shaderfname)
             shader_index = 3;
         else if (l.startsWith("[tess eval]"))
             shader_index = 4;
+        else if (l.startsWith("#include") && shader_index != -1)
+            shader_source[shader_index] += read_shader_include(l);
         else if (l.trimmed().length() > 0 && shader_index != -1)
             shader_source[shader_index] += l + "\n";
     }
@@ -147,6 +177,29 @@ void rGlShaderProgram::setUniformFloat2(const GLchar *uniform_name, float x, flo
 }
 
 
+void rGlShaderProgram::setUniformFloat4(const GLchar *uniform_name, float x, float y, float z, float w)
+{
+    int a = getUniformLocation(uniform_name);
+    widget->glUniform4f(a, x, y, z, w);
+}
+
+
+void rGlShaderProgram::setUniformInt(const GLchar *uniform_name, int x)
+{
+    int a = getUniformLocation(uniform_name);
+    widget->glUniform1i(a, x);
+}
+
+
+void rGlShaderProgram::setUniformBlock(const GLchar *block_name, GLuint binding)
+{
+    GLuint i = widget->glGetUniformBlockIndex(program, block_name);
+    if (i == GL_INVALID_INDEX)
+        throw new Error(__FILE__, __LINE__, "Unknown uniform block", block_name);
+    widget->glUniformBlockBinding(program, i, binding);
+}
+
+
 void rGlShaderProgram::setUniformVector(const GLchar *uniform_name, const anyVector &vector)
 {
     int a = getUniformLocation(uniform_name);
@@ -28,6 +28,9 @@ public:
     void setUniformColorRGBA(const GLchar *uniform_name, const anyColor &color);
     void setUniformFloat(const GLchar *uniform_name, float x);
     void setUniformFloat2(const GLchar *uniform_name, float x, float y);
+    void setUniformFloat4(const GLchar *uniform_name, float x, float y, float z, float w);
+    void setUniformInt(const GLchar *uniform_name, int x);
+    void setUniformBlock(const GLchar *block_name, GLuint binding);
     void setUniformVector(const GLchar *uniform_name, const anyVector &vector);
     void setAttrPointer(const GLchar *attr_name, int size, int stride, int offset);
     void setTexture(const GLchar *uniform_name, GLuint slot, GLuint tex);
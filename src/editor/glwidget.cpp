@@ -1,5 +1,6 @@
 #include <QMatrix4x4>
 #include <QTime>
+#include <omp.h>
 
 #include "mainwindow.h"
 #include "glwidget.h"
@@ -35,6 +36,8 @@ void GLWidget::initializeGL()
         // shaders...
         shaderSimple.init(this, "shadersSimple.glsl");
         shaderInstanced.init(this, "shadersInstanced.glsl");
+        shaderTubeInstanced.init(this, "shadersTubeInstanced.glsl");
+        shaderImpostor.init(this, "shadersImpostor.glsl");
         shaderOverlay.init(this, "shadersOverlay.glsl");
         shaderWireframe.init(this, "shadersWireframe.glsl");
 
@@ -42,9 +45,10 @@ void GLWidget::initializeGL()
         sphereModelSimple.init(this, shaderInstanced, "sphereSimple.model");
         sphereModelNice.init(this, shaderInstanced, "sphereNice.model");
         sphereModelNicest.init(this, shaderInstanced, "sphereNicest.model");
-        sphereModelTube.init(this, shaderSimple, "sphereNice.model");
+        impostorModel.init(this, shaderImpostor, "overlaySquare.model");
+        sphereModelTube.init(this, shaderTubeInstanced, "sphereNice.model");
         arrowModel.init(this, shaderSimple, "arrow.model");
-        cylinderModel.init(this, shaderSimple, "cylinder.model");
+        cylinderModel.init(this, shaderTubeInstanced, "cylinder.model");
         boxModel.init(this, shaderWireframe, "box.model");
         clipModel.init(this, shaderWireframe, "clip.model");
         overlaySquare.init(this, shaderOverlay, "overlaySquare.model");
@@ -57,8 +61,18 @@ void GLWidget::initializeGL()
         // font...
 //        loadFont("chars.font");
 
-        // cell instance vbo...
+        // cell and tube instance vbos...
         glGenBuffers(1, &cell_instance_vbo);
+        glGenBuffers(1, &tube_instance_vbo);
+
+        // cell palette ubo...
+        glGenBuffers(1, &cell_palette_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, cell_palette_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(anyCellPalette), 0, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, CELL_PALETTE_BINDING, cell_palette_ubo);
+        shaderInstanced.setUniformBlock("CellPalette", CELL_PALETTE_BINDING);
+        shaderImpostor.setUniformBlock("CellPalette", CELL_PALETTE_BINDING);
 
         opengl_ok = true;
     }
@@ -150,7 +164,7 @@ void GLWidget::paintGL()
 
 void GLWidget::paintScene(float /*eye_shift*/)
 {
-    anyVector comp_box_size = SimulationSettings.comp_box_to - SimulationSettings.comp_box_from;
+    anyVector comp_box_size = Simulation->settings.comp_box_to - Simulation->settings.comp_box_from;
     float max_comp_box_size = 2.0*qMax(qMax(comp_box_size.x,comp_box_size.y), comp_box_size.z);
 
     // prespective matrix...
@@ -160,8 +174,14 @@ void GLWidget::paintScene(float /*eye_shift*/)
     // zoom factor...
     float dl = (VisualSettings.v_matrix*anyVector(1, 0, 0)).length();
 
-    VisualSettings.p_matrix.setToPerspective(45, widget_ratio, 0.01f, max_comp_box_size + dl*dist);
-    VisualSettings.p_matrix.translate(anyVector(0, 0, -max_comp_box_size*0.5 - dist));
+    perspective_matrix.setToPerspective(45, widget_ratio, 0.01f, max_comp_box_size + dl*dist);
+    eye_matrix.setToTranslation(anyVector(0, 0, -max_comp_box_size*0.5 - dist));
+    VisualSettings.p_matrix = perspective_matrix*eye_matrix;
+
+    // latest cells and tubes (simulation thread publishes them while running)...
+    if (!MainWindowPtr->get_run_simulation())
+        RenderSnapshot.publish_if_changed();
+    snapshot = RenderSnapshot.acquire();
 
     if (MainWindowPtr->get_show_elements(SHOW_AXIS))
         draw_axes();
@@ -206,7 +226,7 @@ void GLWidget::draw_comp_box()
 */
 {
     anyTransform dummy;
-    draw_grilled_box(dummy, SimulationSettings.comp_box_from, SimulationSettings.comp_box_to, VisualSettings.comp_box_color);
+    draw_grilled_box(dummy, Simulation->settings.comp_box_from, Simulation->settings.comp_box_to, VisualSettings.comp_box_color);
 }
 
 
@@ -353,13 +373,13 @@ void GLWidget::draw_all_boxes(bool clip)
     int first_cell = 0;
     int box_id = 0;
     anyTransform dummy;
-    for (int box_z = 0; box_z < SimulationSettings.no_boxes_z; box_z++)
-        for (int box_y = 0; box_y < SimulationSettings.no_boxes_y; box_y++)
-            for (int box_x = 0; box_x < SimulationSettings.no_boxes_x; box_x++, box_id++)
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
             {
-                int no_cells = scene::Cells[first_cell].no_cells_in_box + 1;
-                anyVector box_center = anyVector(box_x, box_y, box_z)*SimulationSettings.box_size + SimulationSettings.comp_box_from +
-                        anyVector(SimulationSettings.box_size/2, SimulationSettings.box_size/2, SimulationSettings.box_size/2);
+                int no_cells = Simulation->cells[first_cell].no_cells_in_box + 1;
+                anyVector box_center = anyVector(box_x, box_y, box_z)*Simulation->settings.box_size + Simulation->settings.comp_box_from +
+                        anyVector(Simulation->settings.box_size/2, Simulation->settings.box_size/2, Simulation->settings.box_size/2);
 
                 if (no_cells &&
                         (!clip ||
@@ -369,296 +389,349 @@ void GLWidget::draw_all_boxes(bool clip)
                          VisualSettings.clip_plane[3] > 0))
                 {
                     draw_grilled_box(dummy,
-                                     anyVector(box_x + 0.05, box_y + 0.05, box_z + 0.05)*SimulationSettings.box_size + SimulationSettings.comp_box_from,
-                                     anyVector(box_x + 0.95, box_y + 0.95, box_z + 0.95)*SimulationSettings.box_size + SimulationSettings.comp_box_from,
+                                     anyVector(box_x + 0.05, box_y + 0.05, box_z + 0.05)*Simulation->settings.box_size + Simulation->settings.comp_box_from,
+                                     anyVector(box_x + 0.95, box_y + 0.95, box_z + 0.95)*Simulation->settings.box_size + Simulation->settings.comp_box_from,
                                      VisualSettings.boxes_color);
                     //snprintf(hstr, 100, "%d (%s)", no_cells, anyVector(box_x, box_y, box_z).to_string());
-                    //rglDrawStringOrtho(hstr, anyVector(box_x + 0.05, box_y + 1, box_z + 1)*SimulationSettings.box_size + SimulationSettings.comp_box_from, 1, 0, 1);
+                    //rglDrawStringOrtho(hstr, anyVector(box_x + 0.05, box_y + 1, box_z + 1)*Simulation->settings.box_size + Simulation->settings.comp_box_from, 1, 0, 1);
                 }
 
-                first_cell += SimulationSettings.max_cells_per_box;
+                first_cell += Simulation->settings.max_cells_per_box;
             }
 }
 
 
-void GLWidget::draw_cell(anyCell const *c, float /*p_min*/, float /*p_max*/)
+void GLWidget::make_cell_instance(anySnapshotCell const *c, anyCellInstance &instance) const
 /**
- Draws cell.
+ Copies raw cell data (position, radius, tissue, state, pressure, concentrations)
+ into instance. Colors are mixed by shadersInstanced.glsl.
 
- \param c -- pointer to cell
- \param p_min -- minimum pressure
- \param p_max -- maximum pressure
+ \param c -- pointer to snapshot of cell
+ \param instance -- instance data to fill
 */
 {
-    if (c->tissue->type == sat::ttNormal && !MainWindowPtr->get_show_elements(SHOW_NORMAL))
-        return;
-    if (c->tissue->type == sat::ttTumor && !MainWindowPtr->get_show_elements(SHOW_TUMOR))
-        return;
-
-    anyColor color;
-    color.set(0, 0, 0, 1, 0);
-    int color_mode = MainWindowPtr->get_coloring_mode();
+    instance.x = c->pos.x;
+    instance.y = c->pos.y;
+    instance.z = c->pos.z;
+    instance.radius = c->r;
+    instance.tissue = c->tissue->id < MAX_PALETTE_TISSUES ? c->tissue->id : MAX_PALETTE_TISSUES - 1;
+    instance.state = c->state;
+    instance.pressure = c->pressure;
+    for (int k = 0; k < sat::dsLast; k++)
+        instance.concentrations[k] = c->concentrations[k];
+}
 
-    // tissue color...
-    if (color_mode & COLOR_MODE_TISSUE_COLOR)
-        color.add(c->tissue->color);
 
-    // state...
-    if (color_mode & COLOR_MODE_STATE)
+void GLWidget::fill_cell_instances()
+/**
+ Fills cell_instance[] from snapshot and uploads it to cell_instance_vbo.
+*/
+{
+    // alloc instance data...
+    if (cell_instance_cnt < snapshot->no_cells)
     {
-        if (c->state == sat::csAlive || c->state == sat::csAdded)
-            color.add(VisualSettings.cell_alive_color);
-        else if (c->state == sat::csHypoxia)
-            color.add(VisualSettings.cell_hypoxia_color);
-        else if (c->state == sat::csApoptosis)
-            color.add(VisualSettings.cell_apoptosis_color);
-        else if (c->state == sat::csNecrosis)
-            color.add(VisualSettings.cell_necrosis_color);
+        if (cell_instance != 0)
+            delete [] cell_instance;
+        int n = snapshot->no_cells*3/2;
+        cell_instance = new anyCellInstance[n];
+        cell_instance_cnt = n;
     }
 
-    // pressure...
-    if (color_mode & COLOR_MODE_PRESSURE)
-    {
-        float pr = c->pressure_prev;
-        float p;
-        if (pressure_max == pressure_min)
-            color.add(0.5, 0.5, 0.5);
-        else
-        {
-            if (pr < 0)
-                p = 0;
-            else if (pr > 1)
-                p = 1;
-            else
-                p = (pr - pressure_min)/(pressure_max - pressure_min);
-            if (pr > c->tissue->max_pressure)
-                color.add(p, p*0.75, p*0.75);
-            else
-                color.add(p, p, p);
-        }
-    }
+    cell_instance_to_draw_cnt = snapshot->no_cells;
 
-    // O2 concentration...
-    if (color_mode & COLOR_MODE_O2)
-    {
-        float pr = c->concentrations[sat::dsO2][!(SimulationSettings.step % 2)];
-        float p;
-        if (pr < 0)
-            p = 0;
-        else if (pr > 1)
-            p = 1;
-        else
-            p = pr;
-        color.add(0, 0, p);
-    }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < cell_instance_to_draw_cnt; i++)
+        make_cell_instance(snapshot->cells + i, cell_instance[i]);
 
-    // TAF concentration...
-    if (color_mode & COLOR_MODE_TAF)
-    {
-        float pr = c->concentrations[sat::dsTAF][!(SimulationSettings.step % 2)];
-        float p;
-        if (pr < 0)
-            p = 0;
-        else if (pr > 1)
-            p = 1;
-        else
-            p = pr;
-        color.add(0, p, 0);
-    }
+    // upload...
+    glBindBuffer(GL_ARRAY_BUFFER, cell_instance_vbo);
+    if (cell_instance_vbo_cnt < cell_instance_to_draw_cnt)
+        cell_instance_vbo_cnt = cell_instance_to_draw_cnt*3/2;
 
-    // Pericytes concentration...
-    if (color_mode & COLOR_MODE_PERICYTES)
-    {
-        float pr = c->concentrations[sat::dsPericytes][!(SimulationSettings.step % 2)];
-        float p;
-        if (pr < 0)
-            p = 0;
-        else if (pr > 1)
-            p = 1;
-        else
-            p = pr;
-        color.add(p, p, 0);
-    }
+    // orphan previous storage (GPU may still draw from it) and stream new data...
+    glBufferData(GL_ARRAY_BUFFER, sizeof(anyCellInstance)*cell_instance_vbo_cnt, 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(anyCellInstance)*cell_instance_to_draw_cnt, cell_instance);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    // Medicine concentration...
-    if (color_mode & COLOR_MODE_MEDICINE)
-    {
-        float pr = c->concentrations[sat::dsMedicine][!(SimulationSettings.step % 2)];
-        float p;
-        if (pr < 0)
-            p = 0;
-        else if (pr > 1)
-            p = 1;
-        else
-            p = pr;
-        color.add(p, p, 0);
-    }
 
-    if (cell_instance_to_draw_cnt < cell_instance_cnt)
+static void set_palette_color(float *dst, anyColor const &color, float flag)
+{
+    dst[0] = color.r();
+    dst[1] = color.g();
+    dst[2] = color.b();
+    dst[3] = flag;
+}
+
+
+void GLWidget::fill_cell_palette(unsigned long show, anyCellPalette &palette) const
+/**
+ Fills palette of tissue and state colors.
+
+ \param show -- SHOW_NORMAL/SHOW_TUMOR flags
+ \param palette -- palette to fill
+*/
+{
+    memset(&palette, 0, sizeof(palette));
+
+    for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts; ts = ts->next)
     {
-        cell_instance[cell_instance_to_draw_cnt].x = c->pos.x;
-        cell_instance[cell_instance_to_draw_cnt].y = c->pos.y;
-        cell_instance[cell_instance_to_draw_cnt].z = c->pos.z;
-        cell_instance[cell_instance_to_draw_cnt].radius = c->r;
-        cell_instance[cell_instance_to_draw_cnt].red = color.r();
-        cell_instance[cell_instance_to_draw_cnt].green = color.g();
-        cell_instance[cell_instance_to_draw_cnt].blue = color.b();
-        cell_instance_to_draw_cnt++;
+        if (ts->id < 0 || ts->id >= MAX_PALETTE_TISSUES)
+            continue;
+
+        bool shown = (ts->type == sat::ttNormal && (show & SHOW_NORMAL)) || (ts->type == sat::ttTumor && (show & SHOW_TUMOR));
+        set_palette_color(palette.tissue_color[ts->id], ts->color, shown);
+        palette.tissue_params[ts->id][0] = ts->max_pressure;
+        palette.tissue_params[ts->id][1] = ts->type;
     }
+
+    set_palette_color(palette.state_color[sat::csAdded], VisualSettings.cell_alive_color, 1);
+    set_palette_color(palette.state_color[sat::csAlive], VisualSettings.cell_alive_color, 1);
+    set_palette_color(palette.state_color[sat::csHypoxia], VisualSettings.cell_hypoxia_color, 1);
+    set_palette_color(palette.state_color[sat::csApoptosis], VisualSettings.cell_apoptosis_color, 1);
+    set_palette_color(palette.state_color[sat::csNecrosis], VisualSettings.cell_necrosis_color, 1);
 }
 
 
 void GLWidget::draw_all_cells(bool clip)
 /**
- Draws all cells.
+ Draws all cells. Instance data holds raw cell values and is rebuilt only if snapshot
+ has changed. Coloring mode, visibility and clipping are passed to shader, so
+ changing them does not touch instance data. Cells are drawn as sphere meshes
+ or ray-cast impostors (one quad per cell), see VisualSettings.cell_quality.
 */
 {
-    if (!scene::Cells) return;
+    if (!snapshot) return;
 
-    // calculate number of cells...
-    int total_no_cells = 0;
-    int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    if (snapshot->serial != cell_instance_serial)
     {
-        total_no_cells += scene::Cells[first_cell].no_cells_in_box;
-        first_cell += SimulationSettings.max_cells_per_box;
+        fill_cell_instances();
+        cell_instance_serial = snapshot->serial;
     }
-    if (!total_no_cells)
-        return;
 
-    // alloc instance data...
-    if (cell_instance_cnt < total_no_cells)
+    if (!cell_instance_to_draw_cnt) return;
+
+    // palette (uploaded if any of its values changed: colors, visibility, tissue types and max. pressures)...
+    anyCellPalette palette;
+    fill_cell_palette(MainWindowPtr->get_show_elements(SHOW_NORMAL + SHOW_TUMOR), palette);
+    if (!cell_palette_valid || memcmp(&palette, &cell_palette, sizeof(palette)))
     {
-        if (cell_instance != 0)
-            delete [] cell_instance;
-        int n = total_no_cells*3/2;
-        cell_instance = new anyCellInstance[n];
-        cell_instance_cnt = n;
+        cell_palette = palette;
+        cell_palette_valid = true;
+        glBindBuffer(GL_UNIFORM_BUFFER, cell_palette_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(anyCellPalette), &cell_palette);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
     }
 
+    pressure_min = 0;
+    pressure_max = snapshot->pressure_avg*2;
 
-    first_cell = 0;
-    float p_avg = 0;
-    int p_cnt = 0;
-    cell_instance_to_draw_cnt = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    bool moving = MainWindowPtr->get_run_simulation() || MainWindowPtr->is_mouse_pressed();
+    rGlShaderProgram *program;
+    rGlModel *model;
+    switch (VisualSettings.cell_quality)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
-        for (int i = 0; i < no_cells; i++)
-            // draw only active cells...
-            if (scene::Cells[first_cell + i].state != sat::csRemoved)
-            {
-                p_avg += scene::Cells[first_cell + i].pressure_avg;
-                p_cnt++;
-                if (!clip ||
-                        scene::Cells[first_cell + i].pos.x*VisualSettings.clip_plane[0] +
-                        scene::Cells[first_cell + i].pos.y*VisualSettings.clip_plane[1] +
-                        scene::Cells[first_cell + i].pos.z*VisualSettings.clip_plane[2] +
-                        VisualSettings.clip_plane[3] > 0
-                        )
-                    draw_cell(scene::Cells + first_cell + i, pressure_min, pressure_max);
-            }
-
-        first_cell += SimulationSettings.max_cells_per_box;
+    case sat::cqSimple:
+        program = &shaderInstanced;
+        model = &sphereModelSimple;
+        break;
+    case sat::cqNicest:
+        program = &shaderInstanced;
+        model = moving ? &sphereModelNice : &sphereModelNicest;
+        break;
+    case sat::cqImpostor:
+        program = &shaderImpostor;
+        model = &impostorModel;
+        break;
+    default:
+        program = &shaderInstanced;
+        model = moving ? &sphereModelSimple : &sphereModelNice;
     }
 
+    program->use();
+    set_cell_uniforms(*program, clip);
+    if (program == &shaderImpostor)
+    {
+        program->setUniformMatrix4x4("mv_matrix", eye_matrix*VisualSettings.v_matrix);
+        program->setUniformMatrix4x4("p_matrix", perspective_matrix);
+    }
+    else
+        program->setUniformMatrix4x4("pv_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix);
 
-    shaderInstanced.use();
+    // one instanced call per run of visible boxes...
+    collect_visible_cells(clip);
 
+    glBindVertexArray(model->vao);
     glBindBuffer(GL_ARRAY_BUFFER, cell_instance_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(anyCellInstance)*cell_instance_to_draw_cnt, cell_instance, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    shaderInstanced.setUniformMatrix4x4("pv_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix);
-    shaderInstanced.setUniformFloat("ambient", 0.2f);
-    shaderInstanced.setUniformFloat("diffuse", 0.8f);
-    shaderInstanced.setUniformVector("lightDir", VisualSettings.light_dir_r);
+    for (int i = 0; i < no_cell_runs; i++)
+    {
+        set_cell_attr_pointers(*program, cell_run_first[i]);
+        model->drawInstanced(cell_run_cnt[i], false);
+    }
 
-    rGlModel *sphere;
-    if (MainWindowPtr->get_run_simulation() || MainWindowPtr->is_mouse_pressed())
-        sphere = &sphereModelSimple;
-    else
-        sphere = &sphereModelNice;
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glBindVertexArray(sphere->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, cell_instance_vbo);
 
-    shaderInstanced.setAttrPointer("instancePosition", 3, sizeof(anyCellInstance), 0);
-    shaderInstanced.setAttrPointer("instanceRadius", 1, sizeof(anyCellInstance), 3);
-    shaderInstanced.setAttrPointer("instanceColor", 3, sizeof(anyCellInstance), 4);
+void GLWidget::set_cell_attr_pointers(rGlShaderProgram &program, int first)
+/**
+ Points instance attributes of cell shader to cell_instance_vbo, starting from instance 'first'.
+*/
+{
+    int offset = first*(sizeof(anyCellInstance)/sizeof(float));
+
+    program.setAttrPointer("instancePosition", 3, sizeof(anyCellInstance), offset + 0);
+    program.setAttrPointer("instanceRadius", 1, sizeof(anyCellInstance), offset + 3);
+    program.setAttrPointer("instanceTissue", 1, sizeof(anyCellInstance), offset + 4);
+    program.setAttrPointer("instanceState", 1, sizeof(anyCellInstance), offset + 5);
+    program.setAttrPointer("instancePressure", 1, sizeof(anyCellInstance), offset + 6);
+    program.setAttrPointer("instanceConcentrations", sat::dsLast, sizeof(anyCellInstance), offset + 7);
+}
 
-    sphere->drawInstanced(cell_instance_to_draw_cnt);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+static bool box_outside_plane(float const *plane, anyVector const &from, anyVector const &to)
+/**
+ Returns true if box lies entirely on negative side of plane (a*x + b*y + c*z + d < 0).
+*/
+{
+    // corner farthest in direction of plane normal...
+    float x = plane[0] > 0 ? to.x : from.x;
+    float y = plane[1] > 0 ? to.y : from.y;
+    float z = plane[2] > 0 ? to.z : from.z;
 
-    p_avg = p_cnt > 0 ? p_avg/p_cnt : 0;
-    pressure_min = 0;
-    pressure_max = p_avg*2;
+    return plane[0]*x + plane[1]*y + plane[2]*z + plane[3] < 0;
 }
 
 
-void GLWidget::draw_cylinder(anyVector const &p1, anyVector const &p2, float r, anyColor const &color)
+bool GLWidget::box_occluded(int box_x, int box_y, int box_z) const
+/**
+ Returns true if all 26 neighbours of box are full of cells.
+*/
 {
-    anyTransform m_matrix;
-
-    anyVector vec = p2 - p1;
+    for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                if (!dx && !dy && !dz)
+                    continue;
+                if (!VALID_BOX(box_x + dx, box_y + dy, box_z + dz))
+                    return false;
+                if (snapshot->box_fill[BOX_ID(box_x + dx, box_y + dy, box_z + dz)] < OCCLUSION_BOX_FILL)
+                    return false;
+            }
+    return true;
+}
 
-    if (p1.z == p2.z)
-        vec.z = 0.0001f;
 
-    float l = vec.length();
-    float fi = -vec.z/l;
-    if (fi > 1) fi = 1;
-    else if (fi < -1) fi = -1;
-    fi = 180/M_PI*acos(fi);
-    if (vec.z < 0)
-        fi = -fi;
+void GLWidget::collect_visible_cells(bool clip)
+/**
+ Culls boxes against view frustum and clipping plane (and, if VisualSettings.occlusion_culling
+ is on, boxes hidden inside tissue). Cells of remaining boxes are joined into runs of
+ consecutive instances. Cells of boxes crossing clipping plane are tested in shader.
+*/
+{
+    if (cell_runs_size < snapshot->no_boxes + 1)
+    {
+        delete [] cell_run_first;
+        delete [] cell_run_cnt;
+        cell_runs_size = snapshot->no_boxes + 1;
+        cell_run_first = new int[cell_runs_size];
+        cell_run_cnt = new int[cell_runs_size];
+    }
 
-    m_matrix.translate(p1);
-    if (vec.x != 0.0 || vec.y != 0.0)
-        m_matrix.rotate(fi, vectorZero, anyVector(vec.y*vec.z, -vec.x*vec.z, 0));
-    else
-        m_matrix.rotate(fi, vectorZero, anyVector(1, 0, 0));
+    // boxes of snapshot do not match simulation (should not happen) -- all cells...
+    if (!snapshot->no_boxes || snapshot->no_boxes != Simulation->settings.no_boxes)
+    {
+        cell_run_first[0] = 0;
+        cell_run_cnt[0] = cell_instance_to_draw_cnt;
+        no_cell_runs = 1;
+        return;
+    }
 
-    m_matrix.scale(anyVector(r, r, l));
+    // frustum planes (rows of projection*view matrix) and clipping plane...
+    anyTransform pv = VisualSettings.p_matrix*VisualSettings.v_matrix;
+    float planes[7][4];
+    int no_planes = 0;
+    for (int i = 0; i < 3; i++)
+        for (int sign = -1; sign <= 1; sign += 2)
+        {
+            for (int k = 0; k < 4; k++)
+                planes[no_planes][k] = pv.matrix[4*k + 3] + sign*pv.matrix[4*k + i];
+            no_planes++;
+        }
+    if (clip)
+    {
+        for (int k = 0; k < 4; k++)
+            planes[no_planes][k] = VisualSettings.clip_plane[k];
+        no_planes++;
+    }
 
-    cylinderModel.program()->use();
-    cylinderModel.program()->setUniformMatrix4x4("pvm_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix*m_matrix);
-    cylinderModel.program()->setUniformMatrix3x3("norm_matrix", m_matrix.normMatrix());
-    cylinderModel.program()->setUniformVector("lightDir", VisualSettings.light_dir_r);
-    cylinderModel.program()->setUniformColorRGBA("colorRGBA", color);
-    cylinderModel.program()->setUniformFloat("diffuse", 1.0f);
-    cylinderModel.program()->setUniformFloat("ambient", 0.2f);
-    cylinderModel.draw();
+    // interior is visible if some cells are hidden or clipped...
+    bool occlusion = VisualSettings.occlusion_culling && !clip && Simulation->settings.dimensions == 3
+            && MainWindowPtr->get_show_elements(SHOW_NORMAL + SHOW_TUMOR) == SHOW_NORMAL + SHOW_TUMOR;
 
+    // boxes are enlarged by radius of largest cell (cells stick out of their boxes)...
+    anyVector margin(snapshot->max_cell_r, snapshot->max_cell_r, snapshot->max_cell_r);
+    anyVector box_diag(Simulation->settings.box_size, Simulation->settings.box_size, Simulation->settings.box_size);
 
-    m_matrix.setToTranslation(p1);
-    if (vec.x != 0.0 || vec.y != 0.0)
-        m_matrix.rotate(fi, vectorZero, anyVector(vec.y*vec.z, -vec.x*vec.z, 0));
-    else
-        m_matrix.rotate(fi, vectorZero, anyVector(1, 0, 0));
-    m_matrix.scale(anyVector(r, r, r));
+    no_cell_runs = 0;
+    int box_id = 0;
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
+            {
+                int first = snapshot->box_first[box_id];
+                int cnt = snapshot->box_first[box_id + 1] - first;
+                if (!cnt)
+                    continue;
+
+                if (occlusion && box_occluded(box_x, box_y, box_z))
+                    continue;
+
+                anyVector from = anyVector(box_x, box_y, box_z)*Simulation->settings.box_size + Simulation->settings.comp_box_from - margin;
+                anyVector to = from + box_diag + margin + margin;
+                bool outside = false;
+                for (int p = 0; p < no_planes && !outside; p++)
+                    outside = box_outside_plane(planes[p], from, to);
+                if (outside)
+                    continue;
+
+                // join with previous run?...
+                if (no_cell_runs && cell_run_first[no_cell_runs - 1] + cell_run_cnt[no_cell_runs - 1] == first)
+                    cell_run_cnt[no_cell_runs - 1] += cnt;
+                else
+                {
+                    cell_run_first[no_cell_runs] = first;
+                    cell_run_cnt[no_cell_runs] = cnt;
+                    no_cell_runs++;
+                }
+            }
+}
 
-    sphereModelTube.program()->setUniformMatrix4x4("pvm_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix*m_matrix);
-    sphereModelTube.program()->setUniformMatrix3x3("norm_matrix", m_matrix.normMatrix());
-    sphereModelTube.draw();
 
-    m_matrix.setToTranslation(p2);
-    if (vec.x != 0.0 || vec.y != 0.0)
-        m_matrix.rotate(fi, vectorZero, anyVector(vec.y*vec.z, -vec.x*vec.z, 0));
+void GLWidget::set_cell_uniforms(rGlShaderProgram &program, bool clip)
+/**
+ Sets uniforms shared by cell shaders (lighting, coloring and clipping).
+*/
+{
+    program.setUniformFloat("ambient", 0.2f);
+    program.setUniformFloat("diffuse", 0.8f);
+    program.setUniformVector("lightDir", VisualSettings.light_dir_r);
+    program.setUniformInt("colorMode", MainWindowPtr->get_coloring_mode());
+    program.setUniformFloat("pressureMin", pressure_min);
+    program.setUniformFloat("pressureMax", pressure_max);
+    if (clip)
+        program.setUniformFloat4("clipPlane", VisualSettings.clip_plane[0], VisualSettings.clip_plane[1], VisualSettings.clip_plane[2], VisualSettings.clip_plane[3]);
     else
-        m_matrix.rotate(fi, vectorZero, anyVector(1, 0, 0));
-    m_matrix.scale(anyVector(r, r, r));
-
-    sphereModelTube.program()->setUniformMatrix4x4("pvm_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix*m_matrix);
-    sphereModelTube.program()->setUniformMatrix3x3("norm_matrix", m_matrix.normMatrix());
-    sphereModelTube.draw();
+        program.setUniformFloat4("clipPlane", 0, 0, 0, 1);
 }
 
 
-void GLWidget::draw_tube(anyTube *v)
+void GLWidget::make_tube_instance(anySnapshotTube const *v, anyTubeInstance &instance) const
 /**
- Draws tube.
+ Fills instance data of tube (tips, radius and flow color).
 */
 {
     anyColor c = VisualSettings.tube_color;
@@ -668,25 +741,107 @@ void GLWidget::draw_tube(anyTube *v)
     else if (!v->blood_flow)
         c.add(0, 0, 0);
 
-    draw_cylinder(v->pos1, v->pos2, v->r, c);
+    instance.x1 = v->pos1.x;
+    instance.y1 = v->pos1.y;
+    instance.z1 = v->pos1.z;
+    instance.x2 = v->pos2.x;
+    instance.y2 = v->pos2.y;
+    instance.z2 = v->pos2.z;
+    instance.radius = v->r;
+    instance.red = c.r();
+    instance.green = c.g();
+    instance.blue = c.b();
 }
 
 
+void GLWidget::fill_tube_instances()
+/**
+ Fills tube_instance[] from snapshot and uploads it to tube_instance_vbo.
+*/
+{
+    // alloc instance data...
+    if (tube_instance_cnt < snapshot->no_tubes)
+    {
+        if (tube_instance != 0)
+            delete [] tube_instance;
+        int n = snapshot->no_tubes*3/2;
+        tube_instance = new anyTubeInstance[n];
+        tube_instance_cnt = n;
+    }
+
+    tube_instance_to_draw_cnt = snapshot->no_tubes;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < tube_instance_to_draw_cnt; i++)
+        make_tube_instance(snapshot->tubes + i, tube_instance[i]);
+
+    // upload...
+    glBindBuffer(GL_ARRAY_BUFFER, tube_instance_vbo);
+    if (tube_instance_vbo_cnt < tube_instance_to_draw_cnt)
+        tube_instance_vbo_cnt = tube_instance_to_draw_cnt*3/2;
+
+    // orphan previous storage (GPU may still draw from it) and stream new data...
+    glBufferData(GL_ARRAY_BUFFER, sizeof(anyTubeInstance)*tube_instance_vbo_cnt, 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(anyTubeInstance)*tube_instance_to_draw_cnt, tube_instance);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 
 void GLWidget::draw_all_tubes()
 /**
- Draws all tubes.
+ Draws all tubes. Cylinders are drawn by one instanced call, rounded tips by two
+ more calls reading the same instance buffer (pos1 and pos2 as sphere centers).
+ Instance data is rebuilt only if snapshot or tube color has changed.
 */
 {
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    if (!snapshot) return;
+
+    float palette = VisualSettings.tube_color.r() + 3*VisualSettings.tube_color.g() + 7*VisualSettings.tube_color.b();
+
+    if (snapshot->serial != tube_instance_serial || palette != tube_instance_palette)
     {
-        anyTube *v = scene::TubeChains[i];
-        while (v)
-        {
-            draw_tube(v);
-            v = v->next;
-        }
+        fill_tube_instances();
+
+        tube_instance_serial = snapshot->serial;
+        tube_instance_palette = palette;
+    }
+
+    if (!tube_instance_to_draw_cnt) return;
+
+    // cylinders...
+    shaderTubeInstanced.use();
+
+    shaderTubeInstanced.setUniformMatrix4x4("pv_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix);
+    shaderTubeInstanced.setUniformFloat("ambient", 0.2f);
+    shaderTubeInstanced.setUniformFloat("diffuse", 1.0f);
+    shaderTubeInstanced.setUniformVector("lightDir", VisualSettings.light_dir_r);
+
+    glBindVertexArray(cylinderModel.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, tube_instance_vbo);
+
+    shaderTubeInstanced.setAttrPointer("instancePos1", 3, sizeof(anyTubeInstance), 0);
+    shaderTubeInstanced.setAttrPointer("instancePos2", 3, sizeof(anyTubeInstance), 3);
+    shaderTubeInstanced.setAttrPointer("instanceRadius", 1, sizeof(anyTubeInstance), 6);
+    shaderTubeInstanced.setAttrPointer("instanceColor", 3, sizeof(anyTubeInstance), 7);
+
+    shaderTubeInstanced.setUniformInt("tip", 0);
+    cylinderModel.drawInstanced(tube_instance_to_draw_cnt);
+
+    // tips (same shader, instance data and uniforms)...
+    glBindVertexArray(sphereModelTube.vao);
+
+    shaderTubeInstanced.setAttrPointer("instancePos1", 3, sizeof(anyTubeInstance), 0);
+    shaderTubeInstanced.setAttrPointer("instancePos2", 3, sizeof(anyTubeInstance), 3);
+    shaderTubeInstanced.setAttrPointer("instanceRadius", 1, sizeof(anyTubeInstance), 6);
+    shaderTubeInstanced.setAttrPointer("instanceColor", 3, sizeof(anyTubeInstance), 7);
+
+    for (int tip = 1; tip <= 2; tip++)
+    {
+        shaderTubeInstanced.setUniformInt("tip", tip);
+        sphereModelTube.drawInstanced(tube_instance_to_draw_cnt);
     }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 
@@ -697,7 +852,7 @@ void GLWidget::draw_axes()
 {
     anyTransform m_matrix;
 
-    anyVector scale = (SimulationSettings.comp_box_to - SimulationSettings.comp_box_from)*0.7f;
+    anyVector scale = (Simulation->settings.comp_box_to - Simulation->settings.comp_box_from)*0.7f;
     float max_scale = qMax(qMax(scale.x, scale.y), scale.z);
     scale.x = max_scale;
     scale.y = max_scale;
@@ -784,7 +939,7 @@ void GLWidget::draw_legend()
     if (color_mode & COLOR_MODE_TISSUE_COLOR)
     {
         // tissue colors...
-        anyTissueSettings *ts = scene::FirstTissueSettings;
+        anyTissueSettings *ts = Simulation->first_tissue_settings;
         int ts_cnt = 0;
         while (ts)
         {
@@ -877,7 +1032,7 @@ void GLWidget::draw_legend()
 void GLWidget::draw_clipping_plane()
 {
     anyTransform m_matrix = VisualSettings.clip;
-    m_matrix.scale(anyVector(1, 1, 1)*SimulationSettings.farest_point);
+    m_matrix.scale(anyVector(1, 1, 1)*Simulation->settings.farest_point);
     clipModel.program()->use();
     clipModel.program()->setUniformMatrix4x4("pvm_matrix", VisualSettings.p_matrix*VisualSettings.v_matrix*m_matrix);
     clipModel.program()->setUniformColorRGB("colorRGB", VisualSettings.clip_plane_color);
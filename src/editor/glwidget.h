@@ -13,6 +13,7 @@
 #include "glmodel.h"
 #include "glshaderprogram.h"
 #include "mainwindow.h"
+#include "anyrendersnapshot.h"
 
 
 class OpenGLVersionTest: public QOpenGLFunctions_1_0
@@ -26,10 +27,38 @@ public:
 };
 
 
+#define MAX_PALETTE_TISSUES 32  ///< size of tissue palette (must match shadersInstanced.glsl)
+#define CELL_PALETTE_BINDING 0  ///< binding point of CellPalette uniform block
+#define OCCLUSION_BOX_FILL 0.5  ///< part of box volume occupied by cells to treat box as opaque
+
+
 struct anyCellInstance
 {
     float x, y, z;
     float radius;
+    float tissue;                         ///< palette index of tissue
+    float state;                          ///< sat::CellState
+    float pressure;
+    float concentrations[sat::dsLast];
+};
+
+
+struct anyCellPalette
+/**
+  Cell colors, CellPalette uniform block of shadersInstanced.glsl (std140 layout).
+*/
+{
+    float tissue_color[MAX_PALETTE_TISSUES][4];   ///< rgb, 1 if tissue is shown
+    float tissue_params[MAX_PALETTE_TISSUES][4];  ///< max pressure, tissue type, unused x 2
+    float state_color[sat::csLast][4];            ///< rgb, 1 if state has color
+};
+
+
+struct anyTubeInstance
+{
+    float x1, y1, z1;
+    float x2, y2, z2;
+    float radius;
     float red, green, blue;
 };
 
@@ -56,6 +85,8 @@ private:
     // programs...
     rGlShaderProgram shaderSimple;
     rGlShaderProgram shaderInstanced;
+    rGlShaderProgram shaderTubeInstanced;
+    rGlShaderProgram shaderImpostor;
     rGlShaderProgram shaderOverlay;
     rGlShaderProgram shaderWireframe;
 
@@ -63,6 +94,7 @@ private:
     rGlModel sphereModelSimple;
     rGlModel sphereModelNice;
     rGlModel sphereModelNicest;
+    rGlModel impostorModel;
     rGlModel sphereModelTube;
     rGlModel overlaySquare;
     rGlModel boxModel;
@@ -77,14 +109,46 @@ private:
 
     // instance cell drawing...
     GLuint cell_instance_vbo;
+    int cell_instance_vbo_cnt;          ///< capacity of cell_instance_vbo (in instances)
     anyCellInstance *cell_instance;
     int cell_instance_cnt;
     int cell_instance_to_draw_cnt;
 
+    int cell_instance_serial;           ///< serial of snapshot in cell_instance_vbo
+
+    // visible cells (runs of consecutive cells from boxes that passed culling)...
+    int *cell_run_first;
+    int *cell_run_cnt;
+    int cell_runs_size;
+    int no_cell_runs;
+
+    // cell colors...
+    GLuint cell_palette_ubo;
+    anyCellPalette cell_palette;        ///< palette in cell_palette_ubo
+    bool cell_palette_valid;
+
+    // instance tube drawing...
+    GLuint tube_instance_vbo;
+    int tube_instance_vbo_cnt;          ///< capacity of tube_instance_vbo (in instances)
+    anyTubeInstance *tube_instance;
+    int tube_instance_cnt;
+    int tube_instance_to_draw_cnt;
+    int tube_instance_serial;           ///< serial of snapshot
+    float tube_instance_palette;        ///< checksum of tube color
+
+    // parts of VisualSettings.p_matrix (impostors need eye space)...
+    anyTransform perspective_matrix;    ///< projection
+    anyTransform eye_matrix;            ///< eye shift
+
+    // cells and tubes to draw...
+    anyRenderSnapshot const *snapshot;
+
 
 public:
     GLWidget(QWidget *parent): QOpenGLWidget(parent), mouse_pressed(false), mouse_buttons(0),
-        pressure_min(0), pressure_max(0), opengl_ok(true), drawing(false), cell_instance(0), cell_instance_cnt(0)
+        pressure_min(0), pressure_max(0), opengl_ok(true), drawing(false), cell_instance_vbo_cnt(0), cell_instance(0), cell_instance_cnt(0), cell_instance_to_draw_cnt(0),
+        cell_instance_serial(-1), cell_run_first(0), cell_run_cnt(0), cell_runs_size(0), no_cell_runs(0), cell_palette_valid(false),
+        tube_instance_vbo_cnt(0), tube_instance(0), tube_instance_cnt(0), tube_instance_to_draw_cnt(0), tube_instance_serial(-1), tube_instance_palette(0), snapshot(0)
     {
         QSurfaceFormat sfm = QSurfaceFormat::defaultFormat();
         sfm.setSamples(4);
@@ -110,10 +174,16 @@ protected:
     void draw_all_boxes(bool clip);
     void draw_cell_block(anyCellBlock const *b, bool selected);
     void draw_all_cell_blocks();
-    void draw_cell(anyCell const *c, float p_min, float p_max);
+    void make_cell_instance(anySnapshotCell const *c, anyCellInstance &instance) const;
+    void fill_cell_instances();
+    void fill_cell_palette(unsigned long show, anyCellPalette &palette) const;
+    void set_cell_uniforms(rGlShaderProgram &program, bool clip);
+    void set_cell_attr_pointers(rGlShaderProgram &program, int first);
+    bool box_occluded(int box_x, int box_y, int box_z) const;
+    void collect_visible_cells(bool clip);
     void draw_all_cells(bool clip);
-    void draw_cylinder(anyVector const &p1, anyVector const &p2, float r, const anyColor &color);
-    void draw_tube(anyTube *v);
+    void make_tube_instance(anySnapshotTube const *v, anyTubeInstance &instance) const;
+    void fill_tube_instances();
     void draw_all_tubes();
     void draw_axes();
     void draw_navigator();
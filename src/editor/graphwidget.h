@@ -34,18 +34,19 @@ public:
 //        painter.fillRect(1, 1, width() - 2, height() - 2, QBrush(QColor(VisualSettings.bkg_color.r255(), VisualSettings.bkg_color.g255(), VisualSettings.bkg_color.b255())));
         painter.fillRect(1, 1, width() - 2, height() - 2, QBrush(QColor(255, 255, 255)));
 
-        if (width() > 0 && Statistics)
+        std::lock_guard<std::mutex> lock(Simulation->statistics.mutex);
+        if (width() > 0 && !Simulation->statistics.empty())
         {
-            int fy = (height() - GR_V_SPACE)/(scene::NoTissueSettings + 1);
+            int fy = (height() - GR_V_SPACE)/(Simulation->no_tissue_settings + 1);
 
-            for (int i = 0; i < scene::NoTissueSettings + 1; i++)
+            for (int i = 0; i < Simulation->no_tissue_settings + 1; i++)
             {
-                set_frame(GR_MARGIN_LEFT, GR_V_SPACE + (scene::NoTissueSettings - 1 - i + 1)*fy, width() - GR_MARGIN_RIGHT, (scene::NoTissueSettings - i + 1)*fy);
+                set_frame(GR_MARGIN_LEFT, GR_V_SPACE + (Simulation->no_tissue_settings - 1 - i + 1)*fy, width() - GR_MARGIN_RIGHT, (Simulation->no_tissue_settings - i + 1)*fy);
                 anyTissueSettings *t = scene::FindTissueSettingById(i);
-                if (i < scene::NoTissueSettings)
-                    paint_frame(painter, MaxStatistics.counter[i*sat::csLast], t->name);
+                if (i < Simulation->no_tissue_settings)
+                    paint_frame(painter, Simulation->statistics.max(i*sat::csLast), t->name);
                 else
-                    paint_frame(painter, MaxStatistics.counter[i*sat::csLast], MODEL_TUBE_NAME_PL);
+                    paint_frame(painter, Simulation->statistics.max(i*sat::csLast), MODEL_TUBE_NAME_PL);
                 paint_graph(painter, i);
             }
         }
@@ -92,7 +93,7 @@ public:
     int paint_x_label(QPainter &p, int value, bool label)
     {
         p.setPen(QPen(QColor(200, 200, 200), 1));
-        int x = frame_x1 + value*sx/SimulationSettings.graph_sampling;
+        int x = frame_x1 + value*sx/Simulation->settings.graph_sampling;
         if (x == frame_x2 - 1)
             x = frame_x2;
         p.drawLine(x, height() - frame_y1,
@@ -114,7 +115,7 @@ public:
     void paint_frame(QPainter &p, float max_y, QString label)
     {
         my = (frame_y2 - frame_y1 - 10)/(max_y + 1);
-        sx = float(LastStatistics->step)/SimulationSettings.graph_sampling/(frame_x2 - frame_x1);
+        sx = float(Simulation->statistics.last_step())/Simulation->settings.graph_sampling/(frame_x2 - frame_x1);
         if (sx < 1)
             sx = 1;
         else
@@ -139,19 +140,19 @@ public:
 
         // X...
         paint_x_label(p, 0, true);
-        int tw = paint_x_label(p, LastStatistics->step, true) + 5;
+        int tw = paint_x_label(p, Simulation->statistics.last_step(), true) + 5;
 
         t = 1;
         mn = 5;
-        while (t*sx/SimulationSettings.graph_sampling < tw)
+        while (t*sx/Simulation->settings.graph_sampling < tw)
         {
             t *= mn;     // 1, 5, 10, 50, 100, 500, ...
             mn = 7 - mn; // 2 <-> 5
         }
 
-        for (int i = 0; i < LastStatistics->step; i += t)
-            paint_x_label(p, i, (LastStatistics->step - i)*sx/SimulationSettings.graph_sampling > tw);
-        paint_x_label(p, LastStatistics->step, true);
+        for (int i = 0; i < Simulation->statistics.last_step(); i += t)
+            paint_x_label(p, i, (Simulation->statistics.last_step() - i)*sx/Simulation->settings.graph_sampling > tw);
+        paint_x_label(p, Simulation->statistics.last_step(), true);
 
         p.setPen(QPen(QColor(128, 128, 128), 1));
         p.drawRect(frame_x1, height() - frame_y1, frame_x2 - frame_x1, frame_y1 - frame_y2);
@@ -165,24 +166,47 @@ public:
         p.setClipping(true);
     }
 
-    void paint_graph(QPainter &p, int counter_id)
+    void paint_series(QPainter &p, int counter)
     {
-        anyStatData *sd = Statistics;
+        int n = Simulation->statistics.size();
+
+        if (sx >= 1)
+        {
+            // at most one sample per pixel...
+            float x = 0;
+            int y = Simulation->statistics.get(counter, 0);
+            for (int i = 0; i < n; i++)
+            {
+                p.drawLine(frame_x1 + x, height() - (frame_y1 + y*my), frame_x1 + x + sx, height() - (frame_y1 + Simulation->statistics.get(counter, i)*my));
+                y = Simulation->statistics.get(counter, i);
+                x += sx;
+            }
+            return;
+        }
 
-        float x = 0;
-        int y = sd->counter[counter_id*sat::csLast];
+        // many samples per pixel, draw min..max of every pixel column...
+        int from = 0;
+        for (int x = 0; from < n && x <= frame_x2 - frame_x1; x++)
+        {
+            int to = MIN(n, int((x + 1)/sx));
+            if (to <= from)
+                continue;
+
+            int mn, mx;
+            Simulation->statistics.min_max(counter, from, to, mn, mx);
+            if (from > 0)
+                p.drawLine(frame_x1 + x - 1, height() - (frame_y1 + Simulation->statistics.get(counter, from - 1)*my), frame_x1 + x, height() - (frame_y1 + Simulation->statistics.get(counter, from)*my));
+            p.drawLine(frame_x1 + x, height() - (frame_y1 + mn*my), frame_x1 + x, height() - (frame_y1 + mx*my));
+            from = to;
+        }
+    }
 
+    void paint_graph(QPainter &p, int counter_id)
+    {
         p.setRenderHint(QPainter::Antialiasing, true);
         p.setPen(QPen(QColor(0, 0, 0), 1));
 
-        while (sd)
-        {
-            p.drawLine(frame_x1 + x, height() - (frame_y1 + y*my), frame_x1 + x + sx, height() - (frame_y1 + sd->counter[counter_id*sat::csLast]*my));
-            y = sd->counter[counter_id*sat::csLast];
-            x += sx;
-
-            sd = sd->next;
-        }
+        paint_series(p, counter_id*sat::csLast);
 
         for (int i = 0; i < sat::csLast; i++)
         {
@@ -202,17 +226,7 @@ public:
                 break;
             }
 
-            sd = Statistics;
-            x = 0;
-            y = sd->counter[counter_id*sat::csLast + i];
-            while (sd)
-            {
-                p.drawLine(frame_x1 + x, height() - (frame_y1 + y*my), frame_x1 + x + sx, height() - (frame_y1 + sd->counter[counter_id*sat::csLast + i]*my));
-                y = sd->counter[counter_id*sat::csLast + i];
-                x += sx;
-
-                sd = sd->next;
-            }
+            paint_series(p, counter_id*sat::csLast + i);
         }
     }
 };
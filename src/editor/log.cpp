@@ -122,7 +122,7 @@ char *SecToString(int s)
     int min = s/60;
     s = s%60;
 
-    static char ret[100];
+    static thread_local char ret[100];
     snprintf(ret, 100, "%dd, %02d:%02d:%02d", days, hours, min, s);
 
     return ret + 4*!days;
@@ -93,8 +93,8 @@ int main(int argc, char *argv[])
     // read default settings...
     try
     {
-        SimulationSettings.reset();
-        TubularSystemSettings.reset();
+        Simulation->settings.reset();
+        Simulation->tubular_settings.reset();
         VisualSettings.reset();
     }
     catch (Error *err)
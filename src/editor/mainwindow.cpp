@@ -24,6 +24,9 @@
 #include "anycellblock.h"
 #include "anytubebundle.h"
 #include "anytubeline.h"
+#include "anyrendersnapshot.h"
+#include "anysoftwarerenderer.h"
+#include "anyoutputwriter.h"
 
 MainWindow *MainWindowPtr = 0;
 
@@ -254,22 +257,24 @@ void MainWindow::load_scene(const char *fname)
         scene::DeallocateCellBlocks();
         scene::DeallocateTubeLines();
         scene::DeallocateTubeBundles();
+        scene::DeallocateInteractionSettings();
         scene::DeallocateTissueSettings();
         scene::DeallocateBarriers();
         DeallocateDefinitions();
 
-        SimulationSettings.reset();
-        TubularSystemSettings.reset();
+        Simulation->settings.reset();
+        Simulation->tubular_settings.reset();
         VisualSettings.reset();
 
         char basefile[P_MAX_PATH];
         snprintf(basefile, P_MAX_PATH, "%sinclude/base.ag", GlobalSettings.app_dir);
         ParseFile(basefile, false);
         ParseFile(fname, true);
-        ui->checkBox_show_blocks->setChecked(!GlobalSettings.simulation_allocated);
+        ui->checkBox_show_blocks->setChecked(!Simulation->allocated);
         ui->tabWidget->setTabText(2, tr("Input text: ") + fname);
         this->loadedFile = QFileInfo(fname);
         set_window_name(this->loadedFile.fileName());
+        RenderSnapshot.invalidate();
         ui->glwidget_main_view->repaint();
         display_tree_objects();
         display_statistics();
@@ -308,7 +313,7 @@ void MainWindow::on_pushButton_step_clicked()
     for (int i = 0; i < ui->spinBox_steps->value(); i++)
     {
         TimeStep();
-        if (SimulationSettings.step % SimulationSettings.graph_sampling == 0)
+        if (Simulation->settings.step % Simulation->settings.graph_sampling == 0)
             AddAllStatistics();
     }
     MainWindowPtr->repaint_graph();
@@ -326,12 +331,12 @@ void MainWindow::slot_gl_repaint()
     display_properties();
 
     QString prc;
-    if (SimulationSettings.stop_time < 1000000000)
+    if (Simulation->settings.stop_time < 1000000000)
     {
         if (!ui->progressBar->isVisible()) ui->progressBar->setVisible(true);
-        ui->progressBar->setMaximum(SimulationSettings.stop_time/SimulationSettings.time_step);
-        ui->progressBar->setValue(SimulationSettings.step);
-        prc = " (" + QString::number(int(SimulationSettings.time*100/SimulationSettings.stop_time)) + "%) ";
+        ui->progressBar->setMaximum(Simulation->settings.stop_time/Simulation->settings.time_step);
+        ui->progressBar->setValue(Simulation->settings.step);
+        prc = " (" + QString::number(int(Simulation->settings.time*100/Simulation->settings.stop_time)) + "%) ";
     }
     else
     {
@@ -339,10 +344,11 @@ void MainWindow::slot_gl_repaint()
         prc = "";
     }
 
-    set_simulation_info(QObject::tr("step: ") + QString::number(SimulationSettings.step) + prc + " | " +
-                        QObject::tr("time: ") + SecToString(SimulationSettings.time) + " | " +
-                        QObject::tr("steps per frame: ") + QString::number(SimulationSettings.step - last_step));
-    last_step = SimulationSettings.step;
+    set_simulation_info(QObject::tr("step: ") + QString::number(Simulation->settings.step) + prc + " | " +
+                        QObject::tr("time: ") + SecToString(Simulation->settings.time) + " | " +
+                        QObject::tr("steps per frame: ") + QString::number(Simulation->settings.step - last_step) + " | " +
+                        QObject::tr("output lag: ") + QString::number(OutputWriter.lag(Simulation->settings.step)));
+    last_step = Simulation->settings.step;
 }
 
 
@@ -354,51 +360,87 @@ void MainWindow::run_simulation()
     srand(QDateTime::currentMSecsSinceEpoch());
 
     for (int i = 0; i < 10000; i++)
-        BloodFlow();
+        BloodFlow(true);
 
 
     ResetTimer(TimerSimulationId);
+    OutputWriter.start(Simulation->settings.output_threads, Simulation->settings.output_queue);
+    if (Simulation->settings.save_statistics)
+    {
+        char fname[P_MAX_PATH];
+        snprintf(fname, P_MAX_PATH, "%s%s_statistics.%s", Simulation->output_dir, this->loadedFile.fileName().toLatin1().data(), Simulation->settings.statistics_binary ? "bin" : "csv");
+        try
+        {
+            Simulation->statistics_stream.open(fname, Simulation->settings.statistics_binary, Simulation->settings.statistics_flush_time);
+        }
+        catch (Error *err)
+        {
+            LogError(err);
+        }
+    }
+
     while (simulation_running)
     {
         TimeStep();
 
-        if (SimulationSettings.step % SimulationSettings.graph_sampling == 0)
+        if (Simulation->settings.step % Simulation->settings.graph_sampling == 0)
         {
             AddAllStatistics();
             MainWindowPtr->repaint_graph();
         }
 
-        if (SimulationSettings.save_statistics && SimulationSettings.step % SimulationSettings.save_statistics == 0)
+        if (Simulation->settings.save_statistics && Simulation->settings.step % Simulation->settings.save_statistics == 0)
+            Simulation->statistics_stream.append();
+
+        if (Simulation->settings.save_povray && Simulation->settings.step % Simulation->settings.save_povray == 0)
+            OutputWriter.submit(scene::CapturePovRay(0, true));
+
+        if (Simulation->settings.save_png && Simulation->settings.step % Simulation->settings.save_png == 0)
         {
             char fname[P_MAX_PATH];
-            snprintf(fname, P_MAX_PATH, "%s%s_statistics_%08d.csv", GlobalSettings.output_dir, this->loadedFile.fileName().toLatin1().data(), SimulationSettings.step);
-            SaveStatistics(fname);
+            snprintf(fname, P_MAX_PATH, "%s%s_frame_%08d.png", Simulation->output_dir, this->loadedFile.fileName().toLatin1().data(), Simulation->settings.step);
+            SavePNG(fname);
         }
 
-        if (SimulationSettings.save_povray && SimulationSettings.step % SimulationSettings.save_povray == 0)
-            scene::SavePovRay(0, true);
+        if (Simulation->settings.save_trajectory && Simulation->settings.step % Simulation->settings.save_trajectory == 0)
+            scene::SaveTrajectoryFrame();
+
+        if (Simulation->settings.save_ag && Simulation->settings.step % Simulation->settings.save_ag == 0)
+        {
+            char fname[P_MAX_PATH];
+            snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", Simulation->output_dir, Simulation->settings.step);
+            OutputWriter.submit(scene::CaptureAG(fname, true));
+        }
 
-        if (SimulationSettings.save_ag && SimulationSettings.step % SimulationSettings.save_ag == 0)
+        if (Simulation->settings.save_vtk && Simulation->settings.step % Simulation->settings.save_vtk == 0)
         {
             char fname[P_MAX_PATH];
-            snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", GlobalSettings.output_dir, SimulationSettings.step);
-            scene::SaveAG(fname, true);
+            snprintf(fname, P_MAX_PATH, "%sstep_%08d.vtu", Simulation->output_dir, Simulation->settings.step);
+            OutputWriter.submit(scene::CaptureVTK(fname, true));
         }
 
         if (!get_run_repaint() && t.elapsed() > 1 + 990*!(ui->checkBox_slow->isChecked()))
         {
+            // hand cells and tubes over to main view...
+            RenderSnapshot.publish();
             QMetaObject::invokeMethod(MainWindowPtr, "slot_gl_repaint", Qt::QueuedConnection);
             t.restart();
         }
 
-        if (SimulationSettings.time >= SimulationSettings.stop_time)
+        if (Simulation->settings.time >= Simulation->settings.stop_time)
         {
+            RenderSnapshot.publish();
             simulation_running = false;
 
             QMetaObject::invokeMethod(MainWindowPtr, "slot_set_buttons", Qt::QueuedConnection);
             QMetaObject::invokeMethod(MainWindowPtr, "slot_gl_repaint", Qt::QueuedConnection);
         }
     }
+
+    // write remaining output files...
+    OutputWriter.shutdown();
+    Simulation->statistics_stream.close();
+    LOG(llInfo, OutputWriter.report(Simulation->settings.step));
 }
 
 
@@ -504,7 +546,7 @@ void MainWindow::on_pushButton_gen_blocks_clicked()
 {
     try
     {
-        if (!GlobalSettings.simulation_allocated)
+        if (!Simulation->allocated)
             scene::AllocSimulation();
 
         scene::GenerateTubesInAllTubeBundles();
@@ -521,6 +563,7 @@ void MainWindow::on_pushButton_gen_blocks_clicked()
     slot_set_buttons();
 
     display_properties();
+    RenderSnapshot.invalidate();
     ui->glwidget_main_view->repaint();
 }
 
@@ -552,9 +595,9 @@ void MainWindow::display_properties(QTreeWidgetItem* item)
         ui->textBrowser_stats->clear();
         ui->textBrowser_stats->append(tr("SCENE"));
         ui->textBrowser_stats->append("");
-        ui->textBrowser_stats->append(tr("width: ") + "<b>" + QString::number(SimulationSettings.comp_box_to.x - SimulationSettings.comp_box_from.x) + "</b>");
-        ui->textBrowser_stats->append(tr("height: ") + "<b>" + QString::number(SimulationSettings.comp_box_to.y - SimulationSettings.comp_box_from.z) + "</b>");
-        ui->textBrowser_stats->append(tr("depth: ") + "<b>" + QString::number(SimulationSettings.comp_box_to.z - SimulationSettings.comp_box_from.z) + "</b>");
+        ui->textBrowser_stats->append(tr("width: ") + "<b>" + QString::number(Simulation->settings.comp_box_to.x - Simulation->settings.comp_box_from.x) + "</b>");
+        ui->textBrowser_stats->append(tr("height: ") + "<b>" + QString::number(Simulation->settings.comp_box_to.y - Simulation->settings.comp_box_from.z) + "</b>");
+        ui->textBrowser_stats->append(tr("depth: ") + "<b>" + QString::number(Simulation->settings.comp_box_to.z - Simulation->settings.comp_box_from.z) + "</b>");
     }
     else if (item)
     {
@@ -578,11 +621,11 @@ void MainWindow::display_statistics()
     ui->textBrowser_stats->append(tr("STATISTICS"));
     ui->textBrowser_stats->append("");
 
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
 
     // global data...
-    ui->textBrowser_stats->append(tr("Time: ") + SecToString(SimulationSettings.time));
-    ui->textBrowser_stats->append(tr("Step: ") + QString::number(SimulationSettings.step));
+    ui->textBrowser_stats->append(tr("Time: ") + SecToString(Simulation->settings.time));
+    ui->textBrowser_stats->append(tr("Step: ") + QString::number(Simulation->settings.step));
 
     // loop over all tissues...
     int no_cells = 0;
@@ -607,17 +650,17 @@ void MainWindow::display_statistics()
 
     // tubes...
     ui->textBrowser_stats->append("");
-    ui->textBrowser_stats->append(QString("<b>") + MODEL_TUBECHAIN_SHORTNAME_PL + QString("</b>") + ": " + QString::number(scene::NoTubeChains));
-    ui->textBrowser_stats->append(QString("<b>") + MODEL_TUBE_SHORTNAME_PL + QString("</b>") + ": " + QString::number(scene::NoTubes));
+    ui->textBrowser_stats->append(QString("<b>") + MODEL_TUBECHAIN_SHORTNAME_PL + QString("</b>") + ": " + QString::number(Simulation->no_tube_chains));
+    ui->textBrowser_stats->append(QString("<b>") + MODEL_TUBE_SHORTNAME_PL + QString("</b>") + ": " + QString::number(Simulation->no_tubes));
 
     // global...
     ui->textBrowser_stats->append("");
     ui->textBrowser_stats->append(QString("<b>") + tr("totals") + QString("</b>"));
-    ui->textBrowser_stats->append(tr("  cells: ") + QString::number(no_cells) + " + " + QString::number(scene::NoTubes));
+    ui->textBrowser_stats->append(tr("  cells: ") + QString::number(no_cells) + " + " + QString::number(Simulation->no_tubes));
     if (no_cells > 0)
         ui->textBrowser_stats->append(tr("  pressure: ") + QString::number(pressure_sum/no_cells, 'g', 3));
-    ui->textBrowser_stats->append(tr("  max cells in box: ") + QString::number(SimulationSettings.max_max_cells_per_box) +
-                                  " (" + QString::number(SimulationSettings.max_max_max_cells_per_box) + ")");
+    ui->textBrowser_stats->append(tr("  max cells in box: ") + QString::number(Simulation->settings.max_max_cells_per_box) +
+                                  " (" + QString::number(Simulation->settings.max_max_max_cells_per_box) + ")");
 }
 
 
@@ -703,7 +746,28 @@ void MainWindow::on_pushButton_PovRay_Save_clicked()
 
 void MainWindow::on_pushButton_VTK_Save_clicked()
 {
-    scene::SaveVTK();
+    try
+    {
+        QFileDialog dialog;
+        QList<QUrl> urls;
+        urls << QUrl::fromLocalFile(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation));
+        urls << QUrl::fromLocalFile(QString(GlobalSettings.user_dir) + QString(FOLDER_INPUT_FILES));
+        urls << QUrl::fromLocalFile(QString(GlobalSettings.user_dir) + QString(FOLDER_OUTPUT));
+        dialog.setAcceptMode(QFileDialog::AcceptSave);
+        dialog.setFileMode(QFileDialog::AnyFile);
+        dialog.setSidebarUrls(urls);
+        dialog.setNameFilter(tr("VTK files (*.vtu);;All files (*)"));
+        dialog.setDefaultSuffix("vtu");
+        if (!dialog.exec())
+            return;
+
+        scene::SaveVTK(dialog.selectedFiles().at(0).toLatin1());
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        return;
+    }
 }
 
 
@@ -755,7 +819,7 @@ void MainWindow::display_tree_objects(anyEditable *o)
     tree_barriers->setHidden(!cnt);
 
     // tissues...
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
     cnt = 0;
     while (ts)
     {
@@ -1037,16 +1101,16 @@ void MainWindow::slot_set_buttons()
 {
     // running simulation...
     int no_cells = 0;
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
     while (ts)
     {
         no_cells += ts->no_cells[0];
         ts = ts->next;
     }
 
-    ui->pushButton_run->setEnabled(no_cells + scene::NoTubes > 0 && !simulation_running);
-    ui->pushButton_run_gpu->setEnabled(no_cells + scene::NoTubes > 0 && !simulation_running);
-    ui->pushButton_step->setEnabled(no_cells + scene::NoTubes > 0 && !simulation_running);
+    ui->pushButton_run->setEnabled(no_cells + Simulation->no_tubes > 0 && !simulation_running);
+    ui->pushButton_run_gpu->setEnabled(no_cells + Simulation->no_tubes > 0 && !simulation_running);
+    ui->pushButton_step->setEnabled(no_cells + Simulation->no_tubes > 0 && !simulation_running);
     ui->pushButton_stop->setEnabled(simulation_running);
 
     ui->pushButton_gen_blocks->setEnabled(!simulation_running);
@@ -1319,7 +1383,7 @@ void MainWindow::on_tabWidget_currentChanged(int index)
 
 void MainWindow::on_pushButton_stats_Save_clicked()
 {
-    if (!Statistics)
+    if (Simulation->statistics.empty())
     {
         QMessageBox::information(this, tr("Information"), tr("No statistical data collected yet."));
         return;
@@ -25,14 +25,6 @@
 #define SHOW_CLIPPING_PLANE 512
 #define SHOW_TUBES 1024
 
-#define COLOR_MODE_TISSUE_COLOR 1
-#define COLOR_MODE_STATE        2
-#define COLOR_MODE_PRESSURE     4
-#define COLOR_MODE_O2           8
-#define COLOR_MODE_TAF         16
-#define COLOR_MODE_MEDICINE   32
-#define COLOR_MODE_PERICYTES   64
-
 
 namespace Ui {
     class MainWindow;
@@ -6,12 +6,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <direct.h>
+#include <vector>
 
 #include <sys/stat.h>
 #include "const.h"
 #include "parser.h"
 #include "log.h"
 #include "config.h"
+#include "simulation.h"
 
 #include "anytube.h"
 #include "anybarrier.h"
@@ -19,19 +21,78 @@
 #include "anytubebundle.h"
 #include "anytubeline.h"
 
-static const char *char_newline      = "\n"; ///< newline characters
-static const char *char_ident_start  = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"; ///< ident starting characters
-static const char *char_ident        = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"; ///< ident characters
-static const char *char_string_startend = "\""; ///< string start/end character
-static const char *char_number_start = "0123456789.-+"; ///< number starting characters
-static const char *char_number       = "0123456789.-+eE"; ///< nymber characters
-static const char *char_symbol       = ",<>{}="; ///< symbol characters
-static const char *char_comment_start = "/#"; ///< comment starting characters
+// character classes...
+#define CC_SPACE        0x01  ///< white space (and control characters)
+#define CC_IDENT_START  0x02  ///< ident starting characters
+#define CC_IDENT        0x04  ///< ident characters
+#define CC_NUMBER_START 0x08  ///< number starting characters
+#define CC_NUMBER       0x10  ///< number characters
+#define CC_SYMBOL       0x20  ///< symbol characters
+#define CC_COMMENT      0x40  ///< comment starting characters
+#define CC_STRING       0x80  ///< string start/end character
+
+static unsigned char char_class[256];  ///< CC_* flags of every character
+
+
+static
+void init_char_class()
+{
+    for (int c = 0; c <= ' '; c++)
+        char_class[c] |= CC_SPACE;
+    for (char const *c = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"; *c; c++)
+        char_class[(unsigned char)*c] |= CC_IDENT_START | CC_IDENT;
+    for (char const *c = "_0123456789"; *c; c++)
+        char_class[(unsigned char)*c] |= CC_IDENT;
+    for (char const *c = "0123456789.-+"; *c; c++)
+        char_class[(unsigned char)*c] |= CC_NUMBER_START | CC_NUMBER;
+    for (char const *c = "eE"; *c; c++)
+        char_class[(unsigned char)*c] |= CC_NUMBER;
+    for (char const *c = ",<>{}="; *c; c++)
+        char_class[(unsigned char)*c] |= CC_SYMBOL;
+    for (char const *c = "/#"; *c; c++)
+        char_class[(unsigned char)*c] |= CC_COMMENT;
+    char_class[(unsigned char)'"'] |= CC_STRING;
+}
+
+
+class anyParserInput
+/**
+  Whole input file read to memory, tokens are scanned directly from buffer.
+*/
+{
+public:
+    FILE *f;             ///< file handle used by parsing functions
+    char *data;          ///< file contents
+    char const *p;       ///< current position
+    char const *end;     ///< end of data
+
+    anyParserInput(): f(0), data(0), p(0), end(0) {}
+    ~anyParserInput() { delete [] data; }
+};
+
+static std::vector<anyParserInput *> Inputs;  ///< opened input files
+static anyParserInput *Input = 0;             ///< input of last GetNextToken() call
 
 int ParserLine = 1;   ///< line number of currently parsed file
 char const *ParserFile = 0; ///< name of currently parsed file
 anyToken Token;              ///< parsed token filled by GetNextToken()
 anyDefinition *FirstDefinition = 0, *LastDefinition = 0;
+static std::vector<anyDefinition *> DefinitionTable;  ///< hash table of definitions (chained by next_hash)
+static int NoDefinitions = 0;                         ///< number of definitions
+
+
+struct anyIdent
+/**
+  Interned ident (names of keywords, values and definitions repeat in every block).
+*/
+{
+    unsigned hash;  ///< case insensitive hash
+    int len;        ///< length of name
+    char *name;     ///< name
+};
+
+static std::vector<anyIdent *> IdentTable;  ///< open addressing hash table of interned idents
+static int NoIdents = 0;                    ///< number of interned idents
 
 static
 char lowercase(char c)
@@ -40,6 +101,72 @@ char lowercase(char c)
 }
 
 
+#define HASH_START 2166136261u
+
+static inline
+unsigned hash_char(unsigned h, char c)
+/**
+  FNV-1a step of case insensitive hash.
+*/
+{
+    return (h ^ (unsigned char)lowercase(c))*16777619u;
+}
+
+
+static
+unsigned hash_string(char const *s)
+{
+    unsigned h = HASH_START;
+    while (*s)
+        h = hash_char(h, *s++);
+    return h;
+}
+
+
+static
+anyIdent *intern_ident(char const *s, int len, unsigned hash)
+/**
+  Returns interned ident equal (case sensitive) to s[0..len).
+*/
+{
+    if (2*(NoIdents + 1) > (int)IdentTable.size())
+    {
+        // grow table...
+        std::vector<anyIdent *> old;
+        old.swap(IdentTable);
+        IdentTable.assign(old.empty() ? 256 : 2*old.size(), (anyIdent *)0);
+        for (unsigned i = 0; i < old.size(); i++)
+            if (old[i])
+            {
+                unsigned j = old[i]->hash & (IdentTable.size() - 1);
+                while (IdentTable[j])
+                    j = (j + 1) & (IdentTable.size() - 1);
+                IdentTable[j] = old[i];
+            }
+    }
+
+    unsigned mask = IdentTable.size() - 1;
+    unsigned j = hash & mask;
+    while (IdentTable[j])
+    {
+        anyIdent *id = IdentTable[j];
+        if (id->hash == hash && id->len == len && !memcmp(id->name, s, len))
+            return id;
+        j = (j + 1) & mask;
+    }
+
+    anyIdent *id = new anyIdent;
+    id->hash = hash;
+    id->len = len;
+    id->name = new char[len + 1];
+    memcpy(id->name, s, len);
+    id->name[len] = 0;
+    IdentTable[j] = id;
+    NoIdents++;
+    return id;
+}
+
+
 int StrCmp(char const *s1, char const *s2)
 /**
   Case insensitive string compare.
@@ -62,6 +189,23 @@ int StrCmp(char const *s1, char const *s2)
 
 
 
+static
+anyDefinition *find_definition(char const *name, unsigned hash)
+{
+    if (!NoDefinitions)
+        return 0;
+
+    anyDefinition *d = DefinitionTable[hash & (DefinitionTable.size() - 1)];
+    while (d)
+    {
+        if (d->hash == hash && !StrCmp(d->name, name))
+            return d;
+        d = d->next_hash;
+    }
+    return 0;
+}
+
+
 anyDefinition *FindDefinition(char const *name)
 /**
   Finds definition.
@@ -69,15 +213,27 @@ anyDefinition *FindDefinition(char const *name)
   \param name -- name of definition
 */
 {
-    anyDefinition *d = FirstDefinition;
+    return find_definition(name, hash_string(name));
+}
 
-    while (d)
+
+static
+void set_definition_value(anyDefinition *d, anyToken const &t)
+/**
+  Sets value of definition. String of TT_String value is copied (token points
+  to input buffer).
+*/
+{
+    if (d->value.type == TT_String)
+        delete [] d->value.str;
+
+    d->value = t;
+    if (t.type == TT_String)
     {
-        if (!StrCmp(d->name, name))
-            return d;
-        d = d->next;
+        char *s = new char[t.len + 1];
+        memcpy(s, t.str, t.len + 1);
+        d->value.str = s;
     }
-    return 0;
 }
 
 
@@ -89,12 +245,13 @@ void AddDefinition(char const *name, anyToken const &t)
   \param t -- value
 */
 {
-    anyDefinition *d = FindDefinition(name);
+    unsigned hash = hash_string(name);
+    anyDefinition *d = find_definition(name, hash);
 
     if (d)
     {
         // replace value...
-        d->value = t;
+        set_definition_value(d, t);
     }
     else
     {
@@ -103,7 +260,25 @@ void AddDefinition(char const *name, anyToken const &t)
 
         d->name = new char[strlen(name) + 1];
         strcpy(d->name, name);
-        d->value = t;
+        d->hash = hash;
+        d->value.type = TT_Eof;
+        set_definition_value(d, t);
+
+        if (2*(NoDefinitions + 1) > (int)DefinitionTable.size())
+        {
+            // grow hash table...
+            DefinitionTable.assign(DefinitionTable.empty() ? 64 : 2*DefinitionTable.size(), (anyDefinition *)0);
+            for (anyDefinition *dd = FirstDefinition; dd; dd = dd->next)
+            {
+                anyDefinition *&bucket = DefinitionTable[dd->hash & (DefinitionTable.size() - 1)];
+                dd->next_hash = bucket;
+                bucket = dd;
+            }
+        }
+        anyDefinition *&bucket = DefinitionTable[hash & (DefinitionTable.size() - 1)];
+        d->next_hash = bucket;
+        bucket = d;
+        NoDefinitions++;
 
         if (!FirstDefinition)
             FirstDefinition = LastDefinition = d;
@@ -124,7 +299,7 @@ void ReplaceToken(anyToken &t)
 {
     if (t.type == TT_Ident)
     {
-        anyDefinition *d = FindDefinition(t.str);
+        anyDefinition *d = find_definition(t.str, t.hash);
         if (d)
             t = d->value;
     }
@@ -157,10 +332,15 @@ void DeallocateDefinitions()
     while (d)
     {
         dn = d->next;
+        if (d->value.type == TT_String)
+            delete [] d->value.str;
+        delete [] d->name;
         delete d;
         d = dn;
     }
     FirstDefinition = LastDefinition = 0;
+    DefinitionTable.clear();
+    NoDefinitions = 0;
 }
 
 
@@ -183,11 +363,11 @@ char *TokenToString(anyToken const &t)
     case TT_Ident:
         snprintf(s, 100, "%s", t.str); break;
     case TT_Vector:
-        snprintf(s, 100, "<%g, %g, %g>", t.vector.x, t.vector.y, t.vector.z); break;
+        snprintf(s, 100, "<%g, %g, %g>", t.values[0], t.values[1], t.values[2]); break;
     case TT_Color:
-        snprintf(s, 100, "<%g, %g, %g, %g>", t.color.rgba_array[0], t.color.rgba_array[1], t.color.rgba_array[2], t.color.rgba_array[3]); break;
+        snprintf(s, 100, "<%g, %g, %g, %g>", t.values[0], t.values[1], t.values[2], t.values[3]); break;
     case TT_Transformation:
-        snprintf(s, 300, "%s", t.transformation.toString()); break;
+        snprintf(s, 300, "%s", t.transformation().toString()); break;
     case TT_Symbol:
         snprintf(s, 100, "%c", t.symbol); break;
     }
@@ -195,86 +375,211 @@ char *TokenToString(anyToken const &t)
 }
 
 
-static
-int p_getc(FILE *f)
+FILE *ParserOpen(char const *fname)
 /**
- Gets one character form input file and increases line counter if necessery.
+  Opens file for parsing: whole file is read to memory. File must be closed
+  with ParserClose().
 
- \param f -- input file
+  \param fname -- file name
 */
 {
-    int c = getc(f);
-    if (strchr(char_newline, c))
-        ParserLine++;
-    return c;
+    if (!char_class[(unsigned char)'a'])
+        init_char_class();
+
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return 0;
+
+    anyParserInput *in = new anyParserInput;
+    in->f = f;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0)
+        size = 0;
+
+    in->data = new char[size + 1];
+    size = fread(in->data, 1, size, f);
+    in->data[size] = 0;
+    in->p = in->data;
+    in->end = in->data + size;
+
+    Inputs.push_back(in);
+    return f;
+}
+
+
+void ParserClose(FILE *f)
+/**
+  Closes file opened with ParserOpen().
+*/
+{
+    for (unsigned i = 0; i < Inputs.size(); i++)
+        if (Inputs[i]->f == f)
+        {
+            if (Input == Inputs[i])
+                Input = 0;
+            delete Inputs[i];
+            Inputs.erase(Inputs.begin() + i);
+            break;
+        }
+    if (f)
+        fclose(f);
+}
+
+
+static
+anyParserInput *get_input(FILE *f)
+{
+    if (Input && Input->f == f)
+        return Input;
+
+    for (unsigned i = 0; i < Inputs.size(); i++)
+        if (Inputs[i]->f == f)
+            return Input = Inputs[i];
+
+    throw new Error(__FILE__, __LINE__, "Input file not opened by parser", 0, ParserFile, ParserLine);
 }
 
 
 static
-void p_ungetc(int c, FILE *f)
+void skip_white_space(anyParserInput *in)
 /**
- Ungets one character to input file and decreases line counter if necessary.
+ Skips white space and comments.
 
- \param c -- character to unget
- \param f -- input file
+ \param in -- input
 */
 {
-    ungetc(c, f);
-    if (strchr(char_newline, c))
-        ParserLine--;
+    char const *p = in->p, *end = in->end;
+    int line = ParserLine;
+
+    while (p < end)
+    {
+        unsigned char c = *p;
+        if (char_class[c] & CC_SPACE)
+        {
+            if (c == '\n')
+                line++;
+            p++;
+        }
+        else if (char_class[c] & CC_COMMENT)
+        {
+            // comment to end of line...
+            while (p < end && *p != '\n')
+                p++;
+        }
+        else
+            break;
+    }
+
+    in->p = p;
+    ParserLine = line;
 }
 
 
+static const double pow10_table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
 
 static
-void skip_white_space(FILE *f)
+bool fast_atof(char const *p, char const *end, double &value)
 /**
- Skips white space (including comment). If comment is encountered
- it is skipped and then function is called recursively to skip
- white space after comment.
-
- \param f -- input file
+  Converts decimal number in [p, end) like atof() (longest valid prefix is used).
+  Returns false if result could be inexact (more than 19 digits or large exponent),
+  caller should use strtod() then.
 */
 {
-    int c;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any_digit = false;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        any_digit = true;
+        if (mantissa || *p != '0')
+        {
+            if (++digits > 19)
+                return false;
+            mantissa = mantissa*10 + (*p - '0');
+        }
+    }
+    if (p < end && *p == '.')
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            any_digit = true;
+            if (mantissa || *p != '0')
+            {
+                if (++digits > 19)
+                    return false;
+                mantissa = mantissa*10 + (*p - '0');
+            }
+            exponent--;
+        }
 
-    // white space...
-    while ((c = p_getc(f)) != EOF && c <= ' ')
-        ;
+    if (!any_digit)
+    {
+        value = 0;
+        return true;
+    }
 
-    // comment?...
-    if (strchr(char_comment_start, c))
+    if (p < end && (*p == 'e' || *p == 'E'))
     {
-        while ((c = p_getc(f)) != EOF && !strchr(char_newline, c))
-            ;
-        skip_white_space(f);
+        char const *e = p + 1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            eneg = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9')
+        {
+            int ev = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++)
+                if (ev < 10000)
+                    ev = ev*10 + (*e - '0');
+            exponent += eneg ? -ev : ev;
+        }
     }
-    else if (c != EOF) p_ungetc(c, f);
+
+    // exact only if mantissa and power of 10 are exact doubles...
+    if (mantissa && (mantissa > (1ULL << 53) || exponent < -22 || exponent > 22))
+        return false;
+
+    value = exponent < 0 ? double(mantissa)/pow10_table[-exponent] : double(mantissa)*pow10_table[exponent];
+    if (neg)
+        value = -value;
+    return true;
 }
 
 
 static
-void get_next_token_number(FILE *f)
+void get_next_token_number(anyParserInput *in)
 /**
- Gets next token as number (first character must be from char_number_start).
+ Gets next token as number (first character must be number starting character).
 
- \param f -- input file
+ \param in -- input
 */
 {
-    int c, i = 0;
-    char str[100];
+    char const *start = in->p, *p = in->p;
+    while (p < in->end && (char_class[(unsigned char)*p] & CC_NUMBER))
+        p++;
+    in->p = p;
 
-    // collect characters...
-    while ((c = p_getc(f)) != EOF && strchr(char_number, c))
-        if (i < 100)
-            str[i++] = c;
-    str[i] = 0;
-    if (c != EOF)
-        p_ungetc(c, f);
+    double value;
+    if (!fast_atof(start, p, value))
+    {
+        char str[101];
+        int n = p - start < 100 ? p - start : 100;
+        memcpy(str, start, n);
+        str[n] = 0;
+        value = atof(str);
+    }
 
     // store token...
     Token.type = TT_Number;
-    Token.number = atof(str);
+    Token.number = value;
 }
 
 
@@ -308,48 +613,37 @@ void get_next_token_vector_or_color_or_transformation(FILE *f)
         i++;
     }
     if (i < 3)
-    {
         Token.type = TT_Vector;
-        Token.vector.x = trans.matrix[0];
-        Token.vector.y = trans.matrix[1];
-        Token.vector.z = trans.matrix[2];
-        for (int i = 0; i < 3; i++)
-          Token.color.rgba_array[i] = trans.matrix[i];
-        Token.color.rgba_array[3] = 1;
-    }
     else if (i < 4)
-    {
         Token.type = TT_Color;
-        for (int i = 0; i < 4; i++)
-          Token.color.rgba_array[i] = trans.matrix[i];
-    }
     else
-    {
         Token.type = TT_Transformation;
-        Token.transformation = trans;
-    }
+    memcpy(Token.values, trans.matrix, sizeof(Token.values));
 }
 
 
 static
-void get_next_token_ident(FILE *f, bool replace)
+void get_next_token_ident(anyParserInput *in, bool replace)
 /**
- Gets next token as ident (first character must be from char_ident_start).
+ Gets next token as ident (first character must be ident starting character).
 
- \param f -- input file
+ \param in -- input
  \param replace -- replace token with defined value?
 */
 {
-    int c, i = 0;
+    char const *start = in->p, *p = in->p;
+    unsigned hash = HASH_START;
 
-    while ((c = p_getc(f)) != EOF && strchr(char_ident, c))
-        if (i < 1024)
-            Token.str[i++] = c;
-    Token.str[i] = 0;
-    if (c != EOF)
-        p_ungetc(c, f);
+    while (p < in->end && (char_class[(unsigned char)*p] & CC_IDENT))
+        hash = hash_char(hash, *p++);
+    in->p = p;
 
-    if (!StrCmp(Token.str, "inf"))
+    anyIdent *id = intern_ident(start, p - start, hash);
+    Token.str = id->name;
+    Token.len = id->len;
+    Token.hash = hash;
+
+    if (Token.len == 3 && !StrCmp(Token.str, "inf"))
     {
         Token.number = MAX_float;
         Token.type = TT_Number;
@@ -364,19 +658,28 @@ void get_next_token_ident(FILE *f, bool replace)
 
 
 static
-void get_next_token_string(FILE *f)
+void get_next_token_string(anyParserInput *in)
 /**
- Gets next token as string (first character must be from char_string_startend).
+ Gets next token as string (opening '"' must be already skipped). String is not
+ copied: closing '"' is overwritten with zero in input buffer.
 
- \param f -- input file
+ \param in -- input
 */
 {
-    int c, i = 0;
+    char *start = in->data + (in->p - in->data);
+    char *p = start;
 
-    while ((c = p_getc(f)) != EOF && !strchr(char_string_startend, c))
-        if (i < 1024)
-            Token.str[i++] = c;
-    Token.str[i] = 0;
+    while (p < in->end && !(char_class[(unsigned char)*p] & CC_STRING))
+    {
+        if (*p == '\n')
+            ParserLine++;
+        p++;
+    }
+    Token.str = start;
+    Token.len = p - start;
+    if (p < in->end)
+        *p++ = 0;  // closing '"'
+    in->p = p;
     Token.type = TT_String;
 }
 
@@ -385,35 +688,39 @@ void GetNextToken(FILE *f, bool replace)
 /**
  Gets next token.
 
- \param f -- input file
+ \param f -- input file (opened with ParserOpen())
  \param replace -- replace token with defined value?
 */
 {
-    int c;
-    skip_white_space(f);
-
-    c = p_getc(f);
+    anyParserInput *in = get_input(f);
+    skip_white_space(in);
 
-    if (c == EOF)
-        Token.type = TT_Eof;
-    else if (strchr(char_number_start, c))
-    {
-        p_ungetc(c, f);
-        get_next_token_number(f);
-    }
-    else if (strchr(char_ident_start, c))
+    if (in->p >= in->end)
     {
-        p_ungetc(c, f);
-        get_next_token_ident(f, replace);
+        Token.type = TT_Eof;
+        return;
     }
-    else if (strchr(char_string_startend, c))
+
+    unsigned char c = *in->p;
+    unsigned char cc = char_class[c];
+
+    if (cc & CC_NUMBER_START)
+        get_next_token_number(in);
+    else if (cc & CC_IDENT_START)
+        get_next_token_ident(in, replace);
+    else if (cc & CC_STRING)
     {
-        get_next_token_string(f);
+        in->p++;
+        get_next_token_string(in);
     }
     else if (c == '<')
+    {
+        in->p++;
         get_next_token_vector_or_color_or_transformation(f);
-    else if (strchr(char_symbol, c))
+    }
+    else if (cc & CC_SYMBOL)
     {
+        in->p++;
         Token.type = TT_Symbol;
         Token.symbol = c;
     }
@@ -452,6 +759,59 @@ void ParseBlock(FILE *f, void val_fun(FILE *))
 }
 
 
+int FindName(char const *name, char const *names[], int no_names)
+/**
+  Returns index of name in array of names or -1.
+*/
+{
+    for (int i = 0; i < no_names; i++)
+        if (!StrCmp(name, names[i]))
+            return i;
+    return -1;
+}
+
+
+void ParseColumns(FILE *f, char const *names[], int no_names, std::vector<int> &columns)
+/**
+  Parses column list of table: 'columns { name name ... }'. Names are resolved
+  once, so rows of table are parsed without name lookups.
+
+  \param f -- input file
+  \param names -- known column names
+  \param no_names -- number of known column names
+  \param columns -- indices of parsed columns in names
+*/
+{
+    GetNextToken(f, false);
+    if (Token.type != TT_Ident || StrCmp(Token.str, "columns"))
+        throw new Error(__FILE__, __LINE__, "Syntax error ('columns' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+    GetNextToken(f, false);
+    if (Token.type != TT_Symbol || Token.symbol != '{')
+        throw new Error(__FILE__, __LINE__, "Bad block start ('{' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+    columns.clear();
+    while (23)
+    {
+        GetNextToken(f, false);
+
+        if (Token.type == TT_Symbol && Token.symbol == '}')
+            break;
+
+        if (Token.type != TT_Ident)
+            throw new Error(__FILE__, __LINE__, "Syntax error (column name expected)", TokenToString(Token), ParserFile, ParserLine);
+
+        int c = FindName(Token.str, names, no_names);
+        if (c < 0)
+            throw new Error(__FILE__, __LINE__, "Unknown column", TokenToString(Token), ParserFile, ParserLine);
+        columns.push_back(c);
+    }
+
+    if (columns.empty())
+        throw new Error(__FILE__, __LINE__, "Empty column list", 0, ParserFile, ParserLine);
+}
+
+
 void ParseDefinedValue(FILE *f)
 /**
   Parses 'set name = value' phrase.
@@ -463,7 +823,7 @@ void ParseDefinedValue(FILE *f)
     GetNextToken(f, false);
     if (Token.type != TT_Ident)
         throw new Error(__FILE__, __LINE__, "Syntax error (name of defined value expected)", TokenToString(Token), ParserFile, ParserLine);
-    char *name = Token.str;
+    char const *name = Token.str;  // interned
 
     // get '='...
     GetNextToken(f, false);
@@ -489,7 +849,7 @@ void ParseFile(char const *fname, bool store_filename)
 
     // open file...
     ParserFile = fname;
-    FILE *f = fopen(fname, "r");
+    FILE *f = ParserOpen(fname);
     if (!f)
     {
         throw new Error(__FILE__, __LINE__, "Cannot open file for reading", fname /*ParserFile*/);
@@ -526,6 +886,9 @@ void ParseFile(char const *fname, bool store_filename)
             else if (!StrCmp(Token.str, "tissue"))
                 scene::ParseTissueSettings(f, new anyTissueSettings, true);
 
+            else if (!StrCmp(Token.str, "interaction"))
+                scene::ParseInteractionSettings(f);
+
             else if (!StrCmp(Token.str, "barrier"))
                 scene::ParseBarrier(f, new anyBarrier, true);
 
@@ -538,6 +901,12 @@ void ParseFile(char const *fname, bool store_filename)
             else if (!StrCmp(Token.str, "tube"))
                 scene::ParseTube(f);
 
+            else if (!StrCmp(Token.str, "cells"))
+                scene::ParseCells(f);
+
+            else if (!StrCmp(Token.str, "tubes"))
+                scene::ParseTubes(f);
+
             else if (!StrCmp(Token.str, "tubeline"))
                 scene::ParseTubeLine(f, new anyTubeLine, true);
 
@@ -551,13 +920,14 @@ void ParseFile(char const *fname, bool store_filename)
     catch (...)
     {
         // close file and rethrow...
-        if (f) fclose(f);
+        ParserClose(f);
         throw;
     }
 
-    fclose(f);
+    ParserClose(f);
 
     scene::RelinkTubes();
+    CheckDiffusionInterval();
 
     // store filename and output directory...
     if (store_filename)
@@ -580,12 +950,12 @@ void ParseFile(char const *fname, bool store_filename)
             fname[i] = 0;
 
         // store ouput dir and create it...
-        snprintf(GlobalSettings.output_dir, P_MAX_PATH, "%s%s%s/", GlobalSettings.user_dir, FOLDER_OUTPUT, fname);
-        Slashify(GlobalSettings.output_dir, false);
+        snprintf(Simulation->output_dir, P_MAX_PATH, "%s%s%s/", GlobalSettings.user_dir, FOLDER_OUTPUT, fname);
+        Slashify(Simulation->output_dir, false);
 
-        mkdir(GlobalSettings.output_dir);
+        mkdir(Simulation->output_dir);
 
-        LOG2(llInfo, "Output directory set to: ", GlobalSettings.output_dir);
+        LOG2(llInfo, "Output directory set to: ", Simulation->output_dir);
     }
 }
 
@@ -1,6 +1,8 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <vector>
+
 #include "types.h"
 #include "anyvector.h"
 #include "transform.h"
@@ -12,22 +14,38 @@ typedef enum { TT_Ident, TT_String, TT_Number, TT_Vector, TT_Color, TT_Transform
 #define MAX_IDENT_LEN 1024
 
 struct anyToken
+/**
+  Parsed token. Kept small, because it is copied for every value of every block:
+  string of ident is interned (see GetNextToken()), string of TT_String token
+  points to input buffer (valid until ParserClose()), numeric values share
+  one array.
+*/
  {
   aTokenType type;  ///< type of token
-  float number;      ///< number (set if type == TT_Number)
-  anyVector vector; ///< vector (set if type == TT_Vector)
-  anyColor color;   ///< color (set if type == TT_Color)
-  anyTransform transformation; ///< transformation matrix (set if type == TT_Transformation)
-  char str[MAX_IDENT_LEN];   ///< string (set if type == TT_String)
-  int symbol;       ///< symbol (set if type == TT_Symbol)
+  int len;          ///< length of str (set if type == TT_Ident or TT_String)
+  unsigned hash;    ///< case insensitive hash of str (set if type == TT_Ident)
+  char const *str;  ///< zero terminated string (set if type == TT_Ident or TT_String)
+  union
+   {
+    float number;      ///< number (set if type == TT_Number)
+    int symbol;        ///< symbol (set if type == TT_Symbol)
+    float values[16];  ///< vector, color or transformation matrix (set if type == TT_Vector, TT_Color or TT_Transformation)
+   };
+
+  anyVector vector() const { return anyVector(values[0], values[1], values[2]); }
+  anyColor color() const { return anyColor(values[0], values[1], values[2], type == TT_Color ? values[3] : 1); }
+  anyTransform transformation() const { return anyTransform(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7],
+                                                            values[8], values[9], values[10], values[11], values[12], values[13], values[14], values[15]); }
  };
 
 struct anyDefinition
 {
     char *name;     ///< name
-    anyToken value; ///< value
+    anyToken value; ///< value (string of TT_String value is owned by definition)
+    unsigned hash;  ///< case insensitive hash of name
 
-    anyDefinition *next;
+    anyDefinition *next;       ///< next definition in order of appearance
+    anyDefinition *next_hash;  ///< next definition in hash bucket
 };
 
 extern anyDefinition *FirstDefinition;
@@ -39,9 +57,13 @@ extern char const *ParserFile;
 
 int StrCmp(char const *s1, char const *s2);
 char *TokenToString(anyToken const &t);
+FILE *ParserOpen(char const *fname);
+void ParserClose(FILE *f);
 void GetNextToken(FILE *f, bool replace);
 void ParseFile(char const *fname, bool store_filename);
 void ParseBlock(FILE *f, void val_fun(FILE *));
+int FindName(char const *name, char const *names[], int no_names);
+void ParseColumns(FILE *f, char const *names[], int no_names, std::vector<int> &columns);
 void SaveDefinitions_ag(FILE *f);
 void ReplaceToken(anyToken &t);
 void DeallocateDefinitions();
@@ -85,17 +107,17 @@ void Slashify(char *s, bool add_slash_at_end);
 
 #define PARSE_VALUE_VECTOR(object, name) \
      else if (!StrCmp(tv.str, #name)) \
-      { if (Token.type == TT_Vector) object.name = Token.vector; \
+      { if (Token.type == TT_Vector) object.name = Token.vector(); \
         else throw new Error(__FILE__, __LINE__, "Syntax error (vector expected)", TokenToString(Token), ParserFile, ParserLine); }
 
 #define PARSE_VALUE_COLOR(object, name) \
      else if (!StrCmp(tv.str, #name)) \
-      { if (Token.type == TT_Vector || Token.type == TT_Color) object.name = Token.color; \
+      { if (Token.type == TT_Vector || Token.type == TT_Color) object.name = Token.color(); \
         else throw new Error(__FILE__, __LINE__, "Syntax error (color or vector expected)", TokenToString(Token), ParserFile, ParserLine); }
 
 #define PARSE_VALUE_TRANSFORMATION(object, name) \
      else if (!StrCmp(tv.str, #name)) \
-      { if (Token.type == TT_Transformation) object.name = Token.transformation; \
+      { if (Token.type == TT_Transformation) object.name = Token.transformation(); \
         else throw new Error(__FILE__, __LINE__, "Syntax error (transformation matrix expected)", TokenToString(Token), ParserFile, ParserLine); }
 
 #endif // PARSER_H
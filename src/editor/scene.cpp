@@ -24,6 +24,13 @@
 #include "anycellblock.h"
 #include "anytubebundle.h"
 #include "anytubeline.h"
+#include "anytrajectory.h"
+#include "anyoutputsnapshot.h"
+#include "anyoutputwriter.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 #ifdef QT_CORE_LIB
 #include "mainwindow.h"
@@ -32,7 +39,7 @@
 char const *CellState_names[] = { "-added-", "-removed-", "ALIVE", "HYPOXIA", "APOPTOSIS", "NECROSIS" };
 char const *TissueType_names[] = { "NORMAL", "TUMOR" };
 char const *BarrierType_names[] = { "KEEP_IN", "KEEP_OUT" };
-char const *DiffundingSubstances_names[] = { "O2", "TAF", "Pericytes" };
+char const *DiffundingSubstances_names[] = { "O2", "TAF", "Pericytes", "Medicine" };
 
 namespace scene {
     anyBarrier *FirstBarrier = 0;
@@ -47,22 +54,8 @@ namespace scene {
     anyTubeBundle *FirstTubeBundle = 0;
     anyTubeBundle *LastTubeBundle = 0;
 
-    anyTissueSettings *FirstTissueSettings = 0;
-    anyTissueSettings *LastTissueSettings = 0;
-    int NoTissueSettings = 0;
-
-    anyCell *Cells = 0;
-
-    anyTubeBox *BoxedTubes = 0;    ///< boxed tube array
-    anyTube **TubeChains = 0;      ///< tube chains array
-    int NoTubeChains = 0;          ///< no of tube chains
-    int NoTubes = 0;               ///< no of tubes
-    int LastTubeId = 0;            ///< id of last added tube
-
-    anyTubeMerge *TubelMerge = 0;  ///< array of tube pairs to merge after tip-tip collision
-    int NoTubeMerge = 0;           ///< number of tube pairs to merge
-
-    float ***Concentrations = 0;
+    anyInteractionSettings *FirstInteractionSettings = 0;
+    anyInteractionSettings *LastInteractionSettings = 0;
 
 
     void AddTissueSettings(anyTissueSettings *ts)
@@ -70,18 +63,19 @@ namespace scene {
       Creates new tissue settings and adds to linked list.
     */
     {
-        if (!FirstTissueSettings)
+        if (!Simulation->first_tissue_settings)
         {
-            FirstTissueSettings = LastTissueSettings = ts;
+            Simulation->first_tissue_settings = Simulation->last_tissue_settings = ts;
             ts->id = 0;
         }
         else
         {
-            ts->id = LastTissueSettings->id + 1;
-            LastTissueSettings->next = ts;
-            LastTissueSettings = ts;
+            ts->id = Simulation->last_tissue_settings->id + 1;
+            Simulation->last_tissue_settings->next = ts;
+            Simulation->last_tissue_settings = ts;
         }
-        NoTissueSettings++;
+        Simulation->no_tissue_settings++;
+        UpdateTissueInteractions();
     }
 
 
@@ -91,7 +85,7 @@ namespace scene {
     */
     {
         // find tissue settings...
-        anyTissueSettings *tsb = FirstTissueSettings;
+        anyTissueSettings *tsb = Simulation->first_tissue_settings;
         anyTissueSettings *tsp = 0;
         while (tsb)
         {
@@ -99,19 +93,20 @@ namespace scene {
             {
                 // found...
                 if (!tsp)
-                    FirstTissueSettings = (anyTissueSettings *)tsb->next;
+                    Simulation->first_tissue_settings = (anyTissueSettings *)tsb->next;
                 else
                     tsp->next = tsb->next;
 
-                if (LastTissueSettings == ts)
-                    LastTissueSettings = tsp;
+                if (Simulation->last_tissue_settings == ts)
+                    Simulation->last_tissue_settings = tsp;
 
+                UpdateTissueInteractions();
                 return;
             }
             tsp = tsb;
             tsb = (anyTissueSettings *)tsb->next;
         }
-        NoTissueSettings--;
+        Simulation->no_tissue_settings--;
     }
 
 
@@ -124,7 +119,7 @@ namespace scene {
       \returns pointer to tissue settings or 0
     */
     {
-        anyTissueSettings *ts = FirstTissueSettings;
+        anyTissueSettings *ts = Simulation->first_tissue_settings;
 
         while (ts)
         {
@@ -287,7 +282,7 @@ namespace scene {
       \param f -- output file
     */
     {
-        anyTissueSettings *ts = FirstTissueSettings;
+        anyTissueSettings *ts = Simulation->first_tissue_settings;
 
         while (ts)
         {
@@ -302,7 +297,7 @@ namespace scene {
       Deallocates all tissue settings.
     */
     {
-        anyTissueSettings *ts = FirstTissueSettings, *tsn = 0;
+        anyTissueSettings *ts = Simulation->first_tissue_settings, *tsn = 0;
 
         while (ts)
         {
@@ -310,8 +305,240 @@ namespace scene {
             delete ts;
             ts = tsn;
         }
-        FirstTissueSettings = LastTissueSettings = 0;
-        NoTissueSettings = 0;
+        Simulation->first_tissue_settings = Simulation->last_tissue_settings = 0;
+        Simulation->no_tissue_settings = 0;
+        UpdateTissueInteractions();
+    }
+
+
+    void CopyTissueSettings(anySimulation const *src)
+    /**
+      Replaces tissues of current simulation with copies of tissues of other simulation.
+      Ids are kept (cells refer to tissues by id when copied between simulations), names
+      are shared with source tissues.
+
+      \param src -- simulation to copy tissues from
+    */
+    {
+        DeallocateTissueSettings();
+
+        for (anyTissueSettings const *s = src->first_tissue_settings; s; s = s->next)
+        {
+            anyTissueSettings *ts = new anyTissueSettings(*s);
+            ts->next = 0;
+            ts->anyEditable::next = 0;
+#ifdef QT_CORE_LIB
+            ts->dialog = 0;
+#endif
+
+            if (!Simulation->first_tissue_settings)
+                Simulation->first_tissue_settings = Simulation->last_tissue_settings = ts;
+            else
+            {
+                Simulation->last_tissue_settings->next = ts;
+                Simulation->last_tissue_settings = ts;
+            }
+            Simulation->no_tissue_settings++;
+        }
+        UpdateTissueInteractions();
+    }
+
+
+    enum { ifRep, ifAtr1, ifAtr2, ifDpd, ifDpdTemperature, ifLast };
+    static char const *InteractionField_names[] = { "force_rep_factor", "force_atr1_factor", "force_atr2_factor",
+                                                    "force_dpd_factor", "dpd_temperature" };
+
+    static
+    float &interaction_field(anyTissueInteraction &ti, int field)
+    {
+        switch (field)
+        {
+        case ifRep: return ti.force_rep_factor;
+        case ifAtr1: return ti.force_atr1_factor;
+        case ifAtr2: return ti.force_atr2_factor;
+        case ifDpd: return ti.force_dpd_factor;
+        default: return ti.dpd_temperature;
+        }
+    }
+
+
+    void UpdateTissueInteractions()
+    /**
+      Builds table of interaction parameters for all pairs of tissues. Parameters are
+      mean values of both tissues unless set by 'interaction' block. Must be called
+      whenever tissues are added, removed or changed.
+    */
+    {
+        int n = 0;
+        for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts; ts = ts->next)
+            if (ts->id + 1 > n)
+                n = ts->id + 1;
+
+        if (n != Simulation->no_tissue_ids)
+        {
+            delete [] Simulation->tissue_interactions;
+            Simulation->tissue_interactions = n ? new anyTissueInteraction[n*n] : 0;
+            Simulation->no_tissue_ids = n;
+        }
+
+        // mixed parameters...
+        for (anyTissueSettings *ts1 = Simulation->first_tissue_settings; ts1; ts1 = ts1->next)
+            for (anyTissueSettings *ts2 = Simulation->first_tissue_settings; ts2; ts2 = ts2->next)
+            {
+                anyTissueInteraction &ti = Simulation->tissue_interactions[ts1->id*n + ts2->id];
+                ti.force_rep_factor = (ts1->force_rep_factor + ts2->force_rep_factor)*0.5;
+                ti.force_atr1_factor = (ts1->force_atr1_factor + ts2->force_atr1_factor)*0.5;
+                ti.force_atr2_factor = (ts1->force_atr2_factor + ts2->force_atr2_factor)*0.5;
+                ti.force_dpd_factor = (ts1->force_dpd_factor + ts2->force_dpd_factor)*0.5;
+                ti.dpd_temperature = (ts1->dpd_temperature + ts2->dpd_temperature)*0.5;
+            }
+
+        // overrides (tissues may have been removed or renamed in editor)...
+        for (anyInteractionSettings *is = FirstInteractionSettings; is; is = is->next)
+        {
+            anyTissueSettings *ts1 = FindTissueSettings(is->tissue1);
+            anyTissueSettings *ts2 = FindTissueSettings(is->tissue2);
+            if (!ts1 || !ts2)
+                continue;
+
+            for (int i = 0; i < ifLast; i++)
+                if (is->mask & (1 << i))
+                {
+                    interaction_field(Simulation->tissue_interactions[ts1->id*n + ts2->id], i) = interaction_field(is->values, i);
+                    interaction_field(Simulation->tissue_interactions[ts2->id*n + ts1->id], i) = interaction_field(is->values, i);
+                }
+        }
+    }
+
+
+    static
+    void parse_interaction_settings_value(FILE *f, anyInteractionSettings *is)
+    {
+        anyToken tv;
+
+        // store value name...
+        tv = Token;
+
+        // get '='...
+        GetNextToken(f, false);
+        if (Token.type != TT_Symbol || Token.symbol != '=')
+            throw new Error(__FILE__, __LINE__, "Syntax error ('=' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+        // get value...
+        GetNextToken(f, true);
+
+        // assign value...
+        if (!StrCmp(tv.str, "tissue1") || !StrCmp(tv.str, "tissue2"))
+        {
+            if (Token.type != TT_String)
+                throw new Error(__FILE__, __LINE__, "Invalid tissue name", TokenToString(Token), ParserFile, ParserLine);
+            if (!FindTissueSettings(Token.str))
+                throw new Error(__FILE__, __LINE__, "Unknown tissue", TokenToString(Token), ParserFile, ParserLine);
+
+            char *&name = StrCmp(tv.str, "tissue1") ? is->tissue2 : is->tissue1;
+            delete [] name;
+            name = new char[strlen(Token.str) + 1];
+            strcpy(name, Token.str);
+            return;
+        }
+
+        int field = FindName(tv.str, InteractionField_names, ifLast);
+        if (field < 0)
+            throw new Error(__FILE__, __LINE__, "Unknown token in 'interaction'", TokenToString(tv), ParserFile, ParserLine);
+        if (Token.type != TT_Number)
+            throw new Error(__FILE__, __LINE__, "Syntax error (number expected)", TokenToString(Token), ParserFile, ParserLine);
+
+        interaction_field(is->values, field) = Token.number;
+        is->mask |= 1 << field;
+    }
+
+
+    void ParseInteractionSettings(FILE *f)
+    /**
+      Parses 'interaction' block (parameters of cell-cell forces for pair of tissues).
+
+      \param f -- input file
+    */
+    {
+        // get '{'...
+        GetNextToken(f, false);
+        if (Token.type != TT_Symbol || Token.symbol != '{')
+            throw new Error(__FILE__, __LINE__, "Bad block start ('{' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+        anyInteractionSettings *is = new anyInteractionSettings;
+
+        // parse...
+        while (23)
+        {
+            GetNextToken(f, false);
+
+            if (Token.type == TT_Ident)
+                parse_interaction_settings_value(f, is);
+
+            // end of 'interaction' body?...
+            else if (Token.type == TT_Symbol && Token.symbol == '}')
+                break;
+
+            // end of input file?...
+            else if (Token.type == TT_Eof)
+                throw new Error(__FILE__, __LINE__, "Unexpected end of file", TokenToString(Token), ParserFile, ParserLine);
+
+            else
+                throw new Error(__FILE__, __LINE__, "Unexpected token (not string)", TokenToString(Token), ParserFile, ParserLine);
+        }
+
+        if (!is->tissue1 || !is->tissue2)
+        {
+            delete is;
+            throw new Error(__FILE__, __LINE__, "Tissues of interaction not set ('tissue1' and 'tissue2' expected)", 0, ParserFile, ParserLine);
+        }
+
+        if (!FirstInteractionSettings)
+            FirstInteractionSettings = LastInteractionSettings = is;
+        else
+        {
+            LastInteractionSettings->next = is;
+            LastInteractionSettings = is;
+        }
+        UpdateTissueInteractions();
+    }
+
+
+    void SaveAllInteractionSettings_ag(FILE *f)
+    /**
+      Saves all 'interaction' blocks to *.ag file.
+
+      \param f -- output file
+    */
+    {
+        for (anyInteractionSettings *is = FirstInteractionSettings; is; is = is->next)
+        {
+            fprintf(f, "\nInteraction\n {\n");
+            SAVE_STRING(f, is, tissue1);
+            SAVE_STRING(f, is, tissue2);
+            for (int i = 0; i < ifLast; i++)
+                if (is->mask & (1 << i))
+                    fprintf(f, "  %s = %g\n", InteractionField_names[i], interaction_field(is->values, i));
+            fprintf(f, " }\n");
+        }
+    }
+
+
+    void DeallocateInteractionSettings()
+    /**
+      Deallocates all interaction settings.
+    */
+    {
+        anyInteractionSettings *is = FirstInteractionSettings, *isn = 0;
+
+        while (is)
+        {
+            isn = is->next;
+            delete is;
+            is = isn;
+        }
+        FirstInteractionSettings = LastInteractionSettings = 0;
+        UpdateTissueInteractions();
     }
 
 
@@ -496,39 +723,39 @@ namespace scene {
         LOG(llInfo, "Memory allocation");
 
         // calculate number of boxes...
-        SimulationSettings.no_boxes_x = ceil((SimulationSettings.comp_box_to.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-        SimulationSettings.no_boxes_y = ceil((SimulationSettings.comp_box_to.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-        SimulationSettings.no_boxes_z = ceil((SimulationSettings.comp_box_to.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
-        SimulationSettings.no_boxes_xy = SimulationSettings.no_boxes_x*SimulationSettings.no_boxes_y;
-        SimulationSettings.no_boxes = SimulationSettings.no_boxes_xy*SimulationSettings.no_boxes_z;
+        Simulation->settings.no_boxes_x = ceil((Simulation->settings.comp_box_to.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+        Simulation->settings.no_boxes_y = ceil((Simulation->settings.comp_box_to.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+        Simulation->settings.no_boxes_z = ceil((Simulation->settings.comp_box_to.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
+        Simulation->settings.no_boxes_xy = Simulation->settings.no_boxes_x*Simulation->settings.no_boxes_y;
+        Simulation->settings.no_boxes = Simulation->settings.no_boxes_xy*Simulation->settings.no_boxes_z;
 
         // recalculate derived values...
-        SimulationSettings.calculate_derived_values();
+        Simulation->settings.calculate_derived_values();
 
-        // alloc Cells and TubeChains array...
+        // alloc cells and tube chains arrays...
         try
         {
-            Cells = new anyCell[SimulationSettings.no_boxes*SimulationSettings.max_cells_per_box];
+            Simulation->cells = new anyCell[Simulation->settings.no_boxes*Simulation->settings.max_cells_per_box];
 
-            TubeChains = new anyTube *[SimulationSettings.max_tube_chains];
+            Simulation->tube_chains = new anyTubeChain *[Simulation->settings.max_tube_chains];
 
-            TubelMerge = new anyTubeMerge[SimulationSettings.max_tube_merge];
-            NoTubeMerge = 0;
+            Simulation->tube_merge = new anyTubeMerge[Simulation->settings.max_tube_merge];
+            Simulation->no_tube_merge = 0;
 
-            BoxedTubes = new anyTubeBox[SimulationSettings.no_boxes];
-            for (int i = 0; i < SimulationSettings.no_boxes; i++)
-                BoxedTubes[i].tubes = new anyTube *[SimulationSettings.max_cells_per_box];
+            Simulation->boxed_tubes = new anyTubeBox[Simulation->settings.no_boxes];
+            for (int i = 0; i < Simulation->settings.no_boxes; i++)
+                Simulation->boxed_tubes[i].tubes = new anyTube *[Simulation->settings.max_cells_per_box];
 
-            Concentrations = new float**[2];
+            Simulation->concentrations = new float**[2];
             for(int frame = 0; frame < 2; frame++)
             {
-                Concentrations[frame] = new float*[sat::dsLast];
+                Simulation->concentrations[frame] = new float*[sat::dsLast];
                 for (int i = 0; i < sat::dsLast; i++)
                 {
-                    Concentrations[frame][i] = new float[SimulationSettings.no_boxes];
-                    for (int j = 0; j < SimulationSettings.no_boxes; j++)
+                    Simulation->concentrations[frame][i] = new float[Simulation->settings.no_boxes];
+                    for (int j = 0; j < Simulation->settings.no_boxes; j++)
                     {
-                        Concentrations[frame][i][j]=0;
+                        Simulation->concentrations[frame][i][j]=0;
                     }
                 }
             }
@@ -538,7 +765,7 @@ namespace scene {
             throw new Error(__FILE__, __LINE__, "Memory allocation failed");
         }
 
-        GlobalSettings.simulation_allocated = true;
+        Simulation->allocated = true;
     }
 
 
@@ -557,48 +784,61 @@ namespace scene {
       Deallocates simulation memory.
     */
     {
-        delete [] Cells;
-        Cells = 0;
+        CloseTrajectory();
+
+        delete [] Simulation->cells;
+        Simulation->cells = 0;
 
-        for (int i = 0; i < NoTubeChains; i++)
+        for (int i = 0; i < Simulation->no_tube_chains; i++)
         {
-            anyTube *v = TubeChains[i], *nv;
+            anyTube *v = Simulation->tube_chains[i]->head, *nv;
             while (v)
             {
              nv = v->next;
              delete v;
              v = nv;
             }
-        }
-        delete [] TubeChains;
-        delete [] TubelMerge;
-        NoTubeMerge = 0;
-
-        for (int i = 0; i < SimulationSettings.no_boxes; i++)
-            delete [] BoxedTubes[i].tubes;
-        delete [] BoxedTubes;
-        TubeChains = 0;
-        NoTubes = 0;
-        NoTubeChains = 0;
-        LastTubeId = 0;
-
-        if (Concentrations != 0)
+            delete Simulation->tube_chains[i];
+        }
+        delete [] Simulation->tube_chains;
+        delete [] Simulation->tube_merge;
+        Simulation->tube_merge = 0;
+        Simulation->no_tube_merge = 0;
+
+        if (Simulation->boxed_tubes)
+            for (int i = 0; i < Simulation->settings.no_boxes; i++)
+                delete [] Simulation->boxed_tubes[i].tubes;
+        delete [] Simulation->boxed_tubes;
+        Simulation->boxed_tubes = 0;
+        Simulation->tube_chains = 0;
+        Simulation->no_tubes = 0;
+        Simulation->no_tube_chains = 0;
+        Simulation->last_tube_id = 0;
+        Simulation->last_tube = 0;
+        Simulation->tubes_by_id.clear();
+        Simulation->tubes_by_parsed_id.clear();
+        Simulation->removed_tubes.clear();
+        for (unsigned i = 0; i < Simulation->free_tubes.size(); i++)
+            delete Simulation->free_tubes[i];
+        Simulation->free_tubes.clear();
+
+        if (Simulation->concentrations != 0)
         {
             for (int frame = 0; frame < 2; frame++)
             {
                 for (int i = 0; i < sat::dsLast; i++)
                 {
-                    delete[] Concentrations[frame][i];
-                    Concentrations[frame][i] = 0;
+                    delete[] Simulation->concentrations[frame][i];
+                    Simulation->concentrations[frame][i] = 0;
                 }
-                delete [] Concentrations[frame];
-                Concentrations[frame] = 0;
+                delete [] Simulation->concentrations[frame];
+                Simulation->concentrations[frame] = 0;
             }
         }
-        delete [] Concentrations;
-        Concentrations = 0;
+        delete [] Simulation->concentrations;
+        Simulation->concentrations = 0;
 
-        GlobalSettings.simulation_allocated = false;
+        Simulation->allocated = false;
     }
 
 
@@ -611,9 +851,9 @@ namespace scene {
       \returns box id or -1 if outside computational box
     */
     {
-        int box_x = floor((pos.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-        int box_y = floor((pos.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-        int box_z = floor((pos.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
+        int box_x = floor((pos.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+        int box_y = floor((pos.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+        int box_z = floor((pos.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
 
         if (!VALID_BOX(box_x, box_y, box_z))
             return -1;
@@ -624,7 +864,7 @@ namespace scene {
 
     void AddCell(anyCell *c)
     /**
-      Adds cell to Cells array.
+      Adds cell to cells array.
 
       \param c -- pointer to cell to add
     */
@@ -635,8 +875,8 @@ namespace scene {
             return;
 
         // current number of cells in box...
-        int no_cells = Cells[box_no*SimulationSettings.max_cells_per_box].no_cells_in_box;
-        if (no_cells >= SimulationSettings.max_cells_per_box)
+        int no_cells = Simulation->cells[box_no*Simulation->settings.max_cells_per_box].no_cells_in_box;
+        if (no_cells >= Simulation->settings.max_cells_per_box)
         {
             LOG(llError, "Too many cells in box");
             //        throw new Error(__FILE__, __LINE__, "Too many cells in box");
@@ -647,8 +887,8 @@ namespace scene {
         }
 
         // add cell..
-        Cells[box_no*SimulationSettings.max_cells_per_box + no_cells] = *c;
-        Cells[box_no*SimulationSettings.max_cells_per_box].no_cells_in_box = no_cells + 1;
+        Simulation->cells[box_no*Simulation->settings.max_cells_per_box + no_cells] = *c;
+        Simulation->cells[box_no*Simulation->settings.max_cells_per_box].no_cells_in_box = no_cells + 1;
         c->tissue->no_cells[0]++;
     }
 
@@ -661,26 +901,91 @@ namespace scene {
       \param attach_to_previous -- attach to previously added tube (chain creation)?
     */
     {
-        static anyTube *pv = 0;
+        anyTube *pv = Simulation->last_tube;
 
         if (start_new_chain || !pv)
         {
-            if (NoTubeChains >= SimulationSettings.max_tube_chains)
-                throw new Error(__FILE__, __LINE__, "Too many tube chains");
-            TubeChains[NoTubeChains++] = v;
             v->next = v->prev = 0;
+            AddTubeChain(v);
         }
         else if (attach_to_previous && pv)
+            AppendTube(pv, v);
+        else
+            v->chain = 0;
+
+
+        Simulation->last_tube = v;
+        v->id = ++Simulation->last_tube_id;
+        Simulation->no_tubes++;
+        IndexTube(v);
+    }
+
+
+    anyTube *NewTube()
+    /**
+      Returns new tube with default values (taken from pool of removed tubes if possible).
+    */
+    {
+        if (Simulation->free_tubes.empty())
+            return new anyTube;
+
+        anyTube *v = Simulation->free_tubes.back();
+        Simulation->free_tubes.pop_back();
+        *v = anyTube();
+        return v;
+    }
+
+
+    void FreeTube(anyTube *v)
+    /**
+      Returns tube to pool. Tube must not be linked in scene.
+    */
+    {
+        Simulation->free_tubes.push_back(v);
+    }
+
+
+    void IndexTube(anyTube *v)
+    /**
+      Adds tube to id lookup tables.
+    */
+    {
+        if ((int)Simulation->tubes_by_id.size() <= v->id)
+            Simulation->tubes_by_id.resize(v->id + 1, 0);
+        Simulation->tubes_by_id[v->id] = v;
+
+        if (v->parsed_id)
+            Simulation->tubes_by_parsed_id.insert(std::make_pair(v->parsed_id, v));
+    }
+
+
+    void UnindexTube(anyTube *v)
+    /**
+      Removes tube from id lookup tables (before tube is deleted).
+    */
+    {
+        if (v->id < (int)Simulation->tubes_by_id.size() && Simulation->tubes_by_id[v->id] == v)
+            Simulation->tubes_by_id[v->id] = 0;
+
+        if (v->parsed_id)
         {
-            pv->next = v;
-            v->prev = pv;
-            v->next = 0;
+            std::unordered_map<int, anyTube *>::iterator i = Simulation->tubes_by_parsed_id.find(v->parsed_id);
+            if (i != Simulation->tubes_by_parsed_id.end() && i->second == v)
+                Simulation->tubes_by_parsed_id.erase(i);
         }
+    }
 
 
-        pv = v;
-        v->id = ++LastTubeId;
-        NoTubes++;
+    void IndexTubes()
+    /**
+      Rebuilds id lookup tables from all tubes of scene.
+    */
+    {
+        Simulation->tubes_by_id.assign(Simulation->last_tube_id + 1, 0);
+        Simulation->tubes_by_parsed_id.clear();
+        for (int i = 0; i < Simulation->no_tube_chains; i++)
+            for (anyTube *v = Simulation->tube_chains[i]->head; v; v = v->next)
+                IndexTube(v);
     }
 
 
@@ -703,6 +1008,69 @@ namespace scene {
     }
 
 
+    // fields of cell in 'cell' block and 'cells' table...
+    enum { cfTissue, cfState, cfPos, cfR, cfAge, cfStateAge, cfTimeToNecrosis, cfConcO2, cfConcTAF, cfConcPericytes, cfConcMedicine, cfLast };
+    static char const *CellField_names[] = { "tissue", "state", "pos", "r", "age", "state_age", "time_to_necrosis",
+                                             "conc_O2", "conc_TAF", "conc_Pericytes", "conc_Medicine" };
+
+
+    static
+    void set_cell_field(anyCell *c, int field)
+    /**
+      Assigns value from Token to cell field.
+
+      \param c -- pointer to cell
+      \param field -- cf* field
+    */
+    {
+        switch (field)
+        {
+        case cfTissue:
+            {
+                if (Token.type != TT_String)
+                    throw new Error(__FILE__, __LINE__, "Invalid tissue name", TokenToString(Token), ParserFile, ParserLine);
+                anyTissueSettings *ts = FindTissueSettings(Token.str);
+                if (!ts)
+                    throw new Error(__FILE__, __LINE__, "Unknown tissue name in 'cell'", TokenToString(Token), ParserFile, ParserLine);
+                c->tissue = ts;
+            }
+            break;
+
+        case cfConcO2:
+        case cfConcTAF:
+        case cfConcPericytes:
+        case cfConcMedicine:
+            {
+                if (Token.type != TT_Number)
+                    throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
+                if (Token.number < 0 || Token.number > 1)
+                    throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
+                int k = sat::dsO2 + field - cfConcO2;
+                c->concentrations[k][0] = c->concentrations[k][1] = Token.number;
+            }
+            break;
+
+        case cfPos:
+            if (Token.type != TT_Vector)
+                throw new Error(__FILE__, __LINE__, "Syntax error (vector expected)", TokenToString(Token), ParserFile, ParserLine);
+            c->pos = Token.vector();
+            break;
+
+        default:
+            if (Token.type != TT_Number)
+                throw new Error(__FILE__, __LINE__, "Syntax error (number expected)", TokenToString(Token), ParserFile, ParserLine);
+            switch (field)
+            {
+            case cfState: c->state = (sat::CellState)int(Token.number); break;
+            case cfR: c->r = Token.number; break;
+            case cfAge: c->age = Token.number; break;
+            case cfStateAge: c->state_age = Token.number; break;
+            case cfTimeToNecrosis: c->time_to_necrosis = Token.number; break;
+            }
+        }
+    }
+
+
     void ParseCellValue(FILE *f, anyCell *c)
     /**
       Parses 'cell' block.
@@ -725,56 +1093,26 @@ namespace scene {
         GetNextToken(f, true);
 
         // assign value...
-        if (!StrCmp(tv.str, "tissue"))
-        {
-            if (Token.type != TT_String)
-                throw new Error(__FILE__, __LINE__, "Invalid tissue name", TokenToString(Token), ParserFile, ParserLine);
-            anyTissueSettings *ts = FindTissueSettings(Token.str);
-            if (!ts)
-                throw new Error(__FILE__, __LINE__, "Unknown tissue name in 'cell'", TokenToString(Token), ParserFile, ParserLine);
-            c->tissue = ts;
-        }
-        else if (!StrCmp(tv.str, "conc_O2"))
-        {
-            if (Token.type != TT_Number)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            if (Token.number < 0 || Token.number > 1)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            c->concentrations[sat::dsO2][0] = c->concentrations[sat::dsO2][1] = Token.number;
-        }
-        else if (!StrCmp(tv.str, "conc_TAF"))
-        {
-            if (Token.type != TT_Number)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            if (Token.number < 0 || Token.number > 1)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            c->concentrations[sat::dsTAF][0] = c->concentrations[sat::dsTAF][1] = Token.number;
-        }
-        else if (!StrCmp(tv.str, "conc_Pericytes"))
-        {
-            if (Token.type != TT_Number)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            if (Token.number < 0 || Token.number > 1)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            c->concentrations[sat::dsPericytes][0] = c->concentrations[sat::dsPericytes][1] = Token.number;
-        }
-        else if (!StrCmp(tv.str, "conc_Medicine"))
-        {
-            if (Token.type != TT_Number)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            if (Token.number < 0 || Token.number > 1)
-                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
-            c->concentrations[sat::dsMedicine][0] = c->concentrations[sat::dsMedicine][1] = Token.number;
-        }
-        PARSE_VALUE_VECTOR((*c), pos)
-        PARSE_VALUE_float((*c), r)
-        PARSE_VALUE_float((*c), age)
-        PARSE_VALUE_ENUM((*c), sat::CellState, state)
-        PARSE_VALUE_float((*c), state_age)
-        PARSE_VALUE_float((*c), time_to_necrosis)
+        int field = FindName(tv.str, CellField_names, cfLast);
+        if (field < 0)
+            throw new Error(__FILE__, __LINE__, "Unknown token in 'cell'", TokenToString(tv), ParserFile, ParserLine);
+        set_cell_field(c, field);
+    }
 
-      else
-          throw new Error(__FILE__, __LINE__, "Unknown token in 'cell'", TokenToString(tv), ParserFile, ParserLine);
+
+    static
+    void add_parsed_cell(anyCell *c)
+    {
+        if (!c->tissue)
+            throw new Error(__FILE__, __LINE__, "Tissue of cell not defined", 0, ParserFile, ParserLine);
+        if (c->r == 0)
+            c->r = c->tissue->cell_r;
+        SetCellMass(c);
+
+        if (!Simulation->allocated)
+            AllocSimulation();
+
+        AddCell(c);
     }
 
 
@@ -811,55 +1149,131 @@ namespace scene {
             else
                 throw new Error(__FILE__, __LINE__, "Unexpected token (not string)", TokenToString(Token), ParserFile, ParserLine);
         }
-        if (c.r == 0)
-            c.r = c.tissue->cell_r;
-        SetCellMass(&c);
+        add_parsed_cell(&c);
+    }
 
-        if (!GlobalSettings.simulation_allocated)
-            AllocSimulation();
 
-        AddCell(&c);
-    }
+    void ParseCells(FILE *f)
+    /**
+      Parses 'cells' table: list of columns followed by rows of values, one row per cell.
 
+        Cells
+         {
+          columns { tissue state pos r }
+          "normal" ALIVE <0, 0, 0> 5
+          ...
+         }
 
-    void SaveCell_ag(FILE *f, anyCell *c)
+      \param f -- input file
+    */
     {
-        fprintf(f, "\n");
-        fprintf(f, "Cell\n");
-        fprintf(f, " {\n");
+        // get '{'...
+        GetNextToken(f, false);
+        if (Token.type != TT_Symbol || Token.symbol != '{')
+            throw new Error(__FILE__, __LINE__, "Bad block start ('{' expected)", TokenToString(Token), ParserFile, ParserLine);
 
-        fprintf(f, "  // mass = %g\n", 1/c->one_by_mass);
+        std::vector<int> columns;
+        ParseColumns(f, CellField_names, cfLast, columns);
 
-        fprintf(f, "  tissue = \"%s\"\n", c->tissue->name);
-        SAVE_ENUM(f, c, state, CellState_names);
-        SAVE_VECT(f, c, pos);
-        SAVE_float(f, c, r);
+        anyCell c;
+
+        // parse rows...
+        while (23)
+        {
+            GetNextToken(f, true);
+
+            // end of 'cells' body?...
+            if (Token.type == TT_Symbol && Token.symbol == '}')
+                break;
+
+            // end of input file?...
+            if (Token.type == TT_Eof)
+                throw new Error(__FILE__, __LINE__, "Unexpected end of file", TokenToString(Token), ParserFile, ParserLine);
+
+            for (unsigned i = 0; i < columns.size(); i++)
+            {
+                if (i)
+                    GetNextToken(f, true);
+                set_cell_field(&c, columns[i]);
+            }
+            add_parsed_cell(&c);
+        }
+    }
+
+
+    void SaveCell_ag(FILE *f, anyCell const *c, int frame)
+    {
+        fprintf(f, "\n");
+        fprintf(f, "Cell\n");
+        fprintf(f, " {\n");
+
+        fprintf(f, "  // mass = %g\n", 1/c->one_by_mass);
+
+        fprintf(f, "  tissue = \"%s\"\n", c->tissue->name);
+        SAVE_ENUM(f, c, state, CellState_names);
+        SAVE_VECT(f, c, pos);
+        SAVE_float(f, c, r);
         SAVE_float(f, c, age);
         SAVE_float(f, c, state_age);
         SAVE_float(f, c, time_to_necrosis);
 
-        fprintf(f, "  conc_O2 = %g\n", c->concentrations[sat::dsO2][SimulationSettings.step % 2]);
-        fprintf(f, "  conc_TAF = %g\n", c->concentrations[sat::dsTAF][SimulationSettings.step % 2]);
-        fprintf(f, "  conc_Pericytes = %g\n", c->concentrations[sat::dsPericytes][SimulationSettings.step % 2]);
-        fprintf(f, "  conc_Medicine = %g\n", c->concentrations[sat::dsMedicine][SimulationSettings.step % 2]);
+        fprintf(f, "  conc_O2 = %g\n", c->concentrations[sat::dsO2][frame]);
+        fprintf(f, "  conc_TAF = %g\n", c->concentrations[sat::dsTAF][frame]);
+        fprintf(f, "  conc_Pericytes = %g\n", c->concentrations[sat::dsPericytes][frame]);
+        fprintf(f, "  conc_Medicine = %g\n", c->concentrations[sat::dsMedicine][frame]);
 
         fprintf(f, " }\n");
     }
 
 
-    void SaveAllCells_ag(FILE *f)
+    void SaveAllCells_ag(FILE *f, anyOutputSnapshot const *s)
     {
-        int first_cell = 0;
-        for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+        if (s->simulation.save_ag_tables)
+        {
+            SaveCells_ag(f, s);
+            return;
+        }
+
+        for (unsigned i = 0; i < s->cells.size(); i++)
+            // save only active cells...
+            if (s->cells[i].state > sat::csRemoved)
+                SaveCell_ag(f, &s->cells[i], s->step % 2);
+    }
+
+
+    void SaveCells_ag(FILE *f, anyOutputSnapshot const *s)
+    /**
+      Saves all active cells as 'cells' table.
+
+      \param f -- output file
+      \param s -- snapshot of cells
+    */
+    {
+        int frame = s->step % 2;
+
+        fprintf(f, "\nCells\n {\n  columns {");
+        for (int i = 0; i < cfLast; i++)
+            fprintf(f, " %s", CellField_names[i]);
+        fprintf(f, " }\n");
+
+        for (unsigned i = 0; i < s->cells.size(); i++)
         {
-            int no_cells = Cells[first_cell].no_cells_in_box;
-            for (int i = 0; i < no_cells; i++)
-                // save only active cells...
-                if (Cells[first_cell + i].state > sat::csRemoved)
-                    SaveCell_ag(f, Cells + first_cell + i);
+            anyCell const *c = &s->cells[i];
+            // save only active cells...
+            if (c->state <= sat::csRemoved)
+                continue;
 
-            first_cell += SimulationSettings.max_cells_per_box;
+            fprintf(f, "  \"%s\" %s <%g, %g, %g>", c->tissue->name, CellState_names[c->state], c->pos.x, c->pos.y, c->pos.z);
+            fprintf(f, c->r < MAX_float ? " %g" : " inf", c->r);
+            fprintf(f, c->age < MAX_float ? " %g" : " inf", c->age);
+            fprintf(f, c->state_age < MAX_float ? " %g" : " inf", c->state_age);
+            fprintf(f, c->time_to_necrosis < MAX_float ? " %g" : " inf", c->time_to_necrosis);
+            for (int k = 0; k < sat::dsLast; k++)
+                fprintf(f, " %g", c->concentrations[k][frame]);
+            fprintf(f, "\n");
         }
+
+        fprintf(f, " }\n");
     }
 
 
@@ -965,6 +1379,14 @@ namespace scene {
                 throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
             b->concentrations[sat::dsPericytes] = Token.number;
         }
+        else if (!StrCmp(tv.str, "conc_Medicine"))
+        {
+            if (Token.type != TT_Number)
+                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
+            if (Token.number < 0 || Token.number > 1)
+                throw new Error(__FILE__, __LINE__, "Invalid concentration value", TokenToString(Token), ParserFile, ParserLine);
+            b->concentrations[sat::dsMedicine] = Token.number;
+        }
         PARSE_VALUE_VECTOR((*b), from)
         PARSE_VALUE_VECTOR((*b), to)
         PARSE_VALUE_TRANSFORMATION((*b), trans)
@@ -1446,7 +1868,54 @@ namespace scene {
         float len = v->final_length;
     //    float len = (v->pos2 - v->pos1).length();
         // conversion of density from [kg/m^3] to [kg/um^3] gives 1e-18...
-        v->one_by_mass = 1 / (M_PI*len*v->final_r*v->final_r*TubularSystemSettings.density*1e-18);
+        v->one_by_mass = 1 / (M_PI*len*v->final_r*v->final_r*Simulation->tubular_settings.density*1e-18);
+    }
+
+
+    // fields of tube in 'tube' block and 'tubes' table ('first' is flag in block)...
+    enum { tfId, tfFirst, tfBaseId, tfTopId, tfState, tfPos1, tfPos2, tfLength, tfFinalLength, tfR, tfFinalR, tfAge, tfStateAge,
+           tfBloodPressure, tfFixedBloodPressure, tfLast };
+    static char const *TubeField_names[] = { "id", "first", "base_id", "top_id", "state", "pos1", "pos2", "length", "final_length", "r", "final_r",
+                                             "age", "state_age", "blood_pressure", "fixed_blood_pressure" };
+
+
+    static
+    void set_tube_field(anyTube *v, int field, bool &first_in_chain)
+    /**
+      Assigns value from Token to tube field.
+
+      \param v -- pointer to tube
+      \param field -- tf* field
+      \param first_in_chain -- set by tfFirst field
+    */
+    {
+        if (field == tfPos1 || field == tfPos2)
+        {
+            if (Token.type != TT_Vector)
+                throw new Error(__FILE__, __LINE__, "Syntax error (vector expected)", TokenToString(Token), ParserFile, ParserLine);
+            (field == tfPos1 ? v->pos1 : v->pos2) = Token.vector();
+            return;
+        }
+
+        if (Token.type != TT_Number)
+            throw new Error(__FILE__, __LINE__, field == tfFixedBloodPressure || field == tfFirst ? "Syntax error (0 or 1 expected)" : "Syntax error (number expected)",
+                            TokenToString(Token), ParserFile, ParserLine);
+        switch (field)
+        {
+        case tfId: v->parsed_id = Token.number; break;
+        case tfFirst: first_in_chain = int(Token.number) != 0; break;
+        case tfBaseId: v->base_id = int(Token.number); break;
+        case tfTopId: v->top_id = int(Token.number); break;
+        case tfState: v->state = (sat::CellState)int(Token.number); break;
+        case tfLength: v->length = Token.number; break;
+        case tfFinalLength: v->final_length = Token.number; break;
+        case tfR: v->r = Token.number; break;
+        case tfFinalR: v->final_r = Token.number; break;
+        case tfAge: v->age = Token.number; break;
+        case tfStateAge: v->state_age = Token.number; break;
+        case tfBloodPressure: v->blood_pressure = Token.number; break;
+        case tfFixedBloodPressure: v->fixed_blood_pressure = int(Token.number) != 0; break;
+        }
     }
 
 
@@ -1472,32 +1941,33 @@ namespace scene {
         GetNextToken(f, true);
 
         // assign value...
-        if (false) ;
-        PARSE_VALUE_VECTOR((*v), pos1)
-        PARSE_VALUE_VECTOR((*v), pos2)
-        PARSE_VALUE_float((*v), r)
-        PARSE_VALUE_float((*v), final_r)
-        PARSE_VALUE_float((*v), length)
-        PARSE_VALUE_float((*v), final_length)
-        PARSE_VALUE_ENUM((*v), sat::CellState, state)
-        PARSE_VALUE_float((*v), age)
-        PARSE_VALUE_float((*v), state_age)
-        PARSE_VALUE_INT((*v),  base_id)
-        PARSE_VALUE_INT((*v),  top_id)
-
-        PARSE_VALUE_float((*v), blood_pressure)
-        PARSE_VALUE_BOOL((*v), fixed_blood_pressure)
-
-        else if (!StrCmp(tv.str, "id"))
-        {
-            if (Token.type == TT_Number)
-                v->parsed_id = Token.number;
-            else
-                throw new Error(__FILE__, __LINE__, "Syntax error (number expected)", TokenToString(Token), ParserFile, ParserLine);
-        }
-
-        else
+        int field = FindName(tv.str, TubeField_names, tfLast);
+        if (field < 0 || field == tfFirst)
             throw new Error(__FILE__, __LINE__, "Unknown token in 'tube'", TokenToString(tv), ParserFile, ParserLine);
+        bool dummy;
+        set_tube_field(v, field, dummy);
+    }
+
+
+    static
+    void add_parsed_tube(anyTube *v, bool first_in_chain)
+    {
+        if (v->length == 0)
+            v->length = (v->pos2 - v->pos1).length();
+        if (v->final_length == 0)
+            v->final_length = v->length;
+        if (v->final_r == 0)
+            v->final_r = v->r;
+
+        SetTubeMass(v);
+
+        if (!Simulation->allocated)
+            AllocSimulation();
+
+        AddTube(v, !first_in_chain, first_in_chain);
+
+        if (v->state == sat::csRemoved)
+            QueueTubeRemoval(v);
     }
 
 
@@ -1541,19 +2011,51 @@ namespace scene {
             else
                 throw new Error(__FILE__, __LINE__, "Unexpected token (not string)", TokenToString(Token), ParserFile, ParserLine);
         }
-        if (v->length == 0)
-            v->length = (v->pos2 - v->pos1).length();
-        if (v->final_length == 0)
-            v->final_length = v->length;
-        if (v->final_r == 0)
-            v->final_r = v->r;
+        add_parsed_tube(v, first_in_chain);
+    }
 
-        SetTubeMass(v);
 
-        if (!GlobalSettings.simulation_allocated)
-            AllocSimulation();
+    void ParseTubes(FILE *f)
+    /**
+      Parses 'tubes' table: list of columns followed by rows of values, one row
+      per tube (tubes of chain in order, 'first' column is 1 for first tube in chain).
 
-        AddTube(v, !first_in_chain, first_in_chain);
+      \param f -- input file
+    */
+    {
+        // get '{'...
+        GetNextToken(f, false);
+        if (Token.type != TT_Symbol || Token.symbol != '{')
+            throw new Error(__FILE__, __LINE__, "Bad block start ('{' expected)", TokenToString(Token), ParserFile, ParserLine);
+
+        std::vector<int> columns;
+        ParseColumns(f, TubeField_names, tfLast, columns);
+
+        // parse rows...
+        while (23)
+        {
+            GetNextToken(f, true);
+
+            // end of 'tubes' body?...
+            if (Token.type == TT_Symbol && Token.symbol == '}')
+                break;
+
+            // end of input file?...
+            if (Token.type == TT_Eof)
+                throw new Error(__FILE__, __LINE__, "Unexpected end of file", TokenToString(Token), ParserFile, ParserLine);
+
+            anyTube *v = new anyTube;
+            v->final_r = 0;
+            bool first_in_chain = false;
+
+            for (unsigned i = 0; i < columns.size(); i++)
+            {
+                if (i)
+                    GetNextToken(f, true);
+                set_tube_field(v, columns[i], first_in_chain);
+            }
+            add_parsed_tube(v, first_in_chain);
+        }
     }
 
 
@@ -1595,16 +2097,23 @@ namespace scene {
     }
 
 
-    void SaveAllTubes_ag(FILE *f)
+    void SaveAllTubes_ag(FILE *f, anyOutputSnapshot const *s)
     /**
       Saves all tubes to *.ag file.
 
       \param f -- output file
+      \param s -- snapshot of tubes
     */
     {
-        for (int i = 0; i < NoTubeChains; i++)
+        if (s->simulation.save_ag_tables)
         {
-            anyTube *v = TubeChains[i];
+            SaveTubes_ag(f, s);
+            return;
+        }
+
+        for (unsigned i = 0; i < s->chains.size(); i++)
+        {
+            anyTube *v = s->chains[i];
             while (v)
             {
                 SaveTube_ag(f, v);
@@ -1614,6 +2123,38 @@ namespace scene {
     }
 
 
+    void SaveTubes_ag(FILE *f, anyOutputSnapshot const *s)
+    /**
+      Saves all tubes as 'tubes' table.
+
+      \param f -- output file
+      \param s -- snapshot of tubes
+    */
+    {
+        fprintf(f, "\nTubes\n {\n  columns {");
+        for (int i = 0; i < tfLast; i++)
+            fprintf(f, " %s", TubeField_names[i]);
+        fprintf(f, " }\n");
+
+        for (unsigned i = 0; i < s->chains.size(); i++)
+            for (anyTube *v = s->chains[i]; v; v = v->next)
+            {
+                fprintf(f, "  %d %d %d %d %s", v->id, !v->prev, v->base ? v->base->id : 0, v->top ? v->top->id : 0, CellState_names[v->state]);
+                fprintf(f, " <%g, %g, %g> <%g, %g, %g>", v->pos1.x, v->pos1.y, v->pos1.z, v->pos2.x, v->pos2.y, v->pos2.z);
+                fprintf(f, v->length < MAX_float ? " %g" : " inf", v->length);
+                fprintf(f, v->final_length < MAX_float ? " %g" : " inf", v->final_length);
+                fprintf(f, v->r < MAX_float ? " %g" : " inf", v->r);
+                fprintf(f, v->final_r < MAX_float ? " %g" : " inf", v->final_r);
+                fprintf(f, v->age < MAX_float ? " %g" : " inf", v->age);
+                fprintf(f, v->state_age < MAX_float ? " %g" : " inf", v->state_age);
+                fprintf(f, v->blood_pressure < MAX_float ? " %g" : " inf", v->blood_pressure);
+                fprintf(f, " %d\n", int(v->fixed_blood_pressure));
+            }
+
+        fprintf(f, " }\n");
+    }
+
+
     void DeallocateCellBlocks()
     /**
       Deallocates all blocks of cells.
@@ -1670,9 +2211,111 @@ namespace scene {
     }
 
 
+    class anyGenerationRegion
+    /**
+      Box (barrier or generated cell block) tested by GenerateCellsInBlock() with
+      precomputed inverse transformation. Point passes if it is inside box enlarged
+      by 'enlarge' (pass_inside) or outside of it (!pass_inside).
+    */
+    {
+    public:
+        anyTransform inv;    ///< inverse of box transformation
+        anyVector from, to;  ///< enlarged box in local coordinates
+        float stretch;       ///< upper bound of distance scaling by inv
+        bool pass_inside;    ///< point passes if inside?
+
+        anyGenerationRegion(anyBoundingBox const *bb, float enlarge, bool _pass_inside)
+            : inv(bb->trans.inverted()), from(bb->from - anyVector(enlarge)), to(bb->to + anyVector(enlarge)), pass_inside(_pass_inside)
+        {
+            float s = 0;
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    s += inv.matrix[i + 4*j]*inv.matrix[i + 4*j];
+            stretch = sqrt(s);
+        }
+
+        bool passes(anyVector const &p) const
+        {
+            anyVector p2 = inv*p;
+            bool inside = p2.x >= from.x && p2.x <= to.x
+                       && p2.y >= from.y && p2.y <= to.y
+                       && p2.z >= from.z && p2.z <= to.z;
+            return inside == pass_inside;
+        }
+
+        int classify(anyVector const &center, float h) const
+        /**
+          Classifies sphere: 0 -- no point passes, 1 -- all points pass, 2 -- must be tested.
+        */
+        {
+            anyVector c = inv*center;
+            h *= stretch;
+            if (c.x < from.x - h || c.x > to.x + h || c.y < from.y - h || c.y > to.y + h || c.z < from.z - h || c.z > to.z + h)
+                return !pass_inside;
+            if (c.x >= from.x + h && c.x <= to.x - h && c.y >= from.y + h && c.y <= to.y - h && c.z >= from.z + h && c.z <= to.z - h)
+                return pass_inside;
+            return 2;
+        }
+    };
+
+
+    class anyLatticeRow
+    /**
+      Row of hexagonal lattice (cells along y axis in block coordinates).
+    */
+    {
+    public:
+        float x, y, z;  ///< first site
+        float y_end;    ///< sites are generated for y < y_end
+    };
+
+
+    class anyLatticeSite
+    /**
+      Accepted lattice site.
+    */
+    {
+    public:
+        anyVector pos;
+        float age;
+        float time_to_necrosis;
+    };
+
+
+    static inline
+    unsigned long long mix64(unsigned long long z)
+    /**
+      splitmix64 finalizer.
+    */
+    {
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+
+    static inline
+    float site_random(unsigned long long &state)
+    /**
+      Returns next random number from [0, 1] of lattice site random stream.
+    */
+    {
+        state = mix64(state);
+        return float(state >> 40)/float((1 << 24) - 1);
+    }
+
+
     void GenerateCellsInBlock(anyCellBlock *b)
     /**
       Generates all cells in block.
+
+      Rows of lattice are generated in parallel. Every site has its own random
+      stream (seeded from rand() once per block and site index) and accepted sites
+      are added in lattice order, so result does not depend on number of threads.
+      Barriers and generated blocks are classified per box of computational box
+      (only boxes on their borders are tested per site), tubes are tested only if
+      they are near to box of site.
     */
     {
         LOG3(llDebug, "Generating cells for tissue '", b->tissue->name, "'");
@@ -1689,14 +2332,18 @@ namespace scene {
 
         SetCellMass(&c);
 
-        if (SimulationSettings.dimensions == 3)
+        // lattice rows...
+        std::vector<anyLatticeRow> rows;
+        anyLatticeRow row;
+        float dy;
+        if (Simulation->settings.dimensions == 3)
         {
             // 3D...
             float x_shift = 0;
             float y_shift = r_pack;
             float y_shift_z = 0;
             float dz = 1.6329931618554520654648560498039*r_pack; // 2 * (sqrt(6)/3)
-            float dy = 2*r_pack;
+            dy = 2*r_pack;
             float dx = 1.7320508075688772935274463415059*r_pack;  // 2 * (sqrt(3)/2)
 
             int x_cnt = floor((b->to.x - b->from.x - 2*r_pack)/dx);
@@ -1708,58 +2355,15 @@ namespace scene {
             dy = (b->to.y - b->from.y - 2*r_pack)/y_cnt;
             dz = (b->to.z - b->from.z - 2*r_pack)/z_cnt;
 
+            row.y_end = b->to.y;
             for(float z = b->from.z + r; z <= b->to.z; z += dz)
             {
                 for(float x = b->from.x + r + x_shift; x < b->to.x; x += dx)
                 {
-                    for(float y = b->from.y + r + y_shift + y_shift_z; y < b->to.y; y += dy)
-                    {
-                        c.pos = b->trans*anyVector(x, y, z);
-                        c.pos += anyVector(float(rand())/RAND_MAX*c.r - c.r*0.5,
-                                           float(rand())/RAND_MAX*c.r - c.r*0.5,
-                                           0)*0.5;
-
-                        c.age = float(rand())/float(RAND_MAX) * b->tissue->minimum_interphase_time;
-                        c.state_age = c.age;
-
-                        c.time_to_necrosis = b->tissue->time_to_necrosis + (2*double(rand())/double(RAND_MAX) - 1.0)*b->tissue->time_to_necrosis_var;
-
-                        bool add = true;
-
-                        // barriers...
-                        anyBarrier *br = FirstBarrier;
-                        while (add && br)
-                        {
-                            if (!br->is_point_inside(c.pos, c.r))
-                                add = false;
-                            br = (anyBarrier *)br->next;
-                        }
-
-                        // blocks...
-                        anyCellBlock *bc = FirstCellBlock;
-                        while (add && bc)
-                        {
-                            if (bc->generated
-                                && bc->is_point_inside(c.pos, c.r*0.5))
-                                add = false;
-                            bc = (anyCellBlock *)bc->next;
-                        }
-
-                        // tubes...
-                        for (int i = 0; add && i < NoTubeChains; i++)
-                        {
-                            anyTube *v = TubeChains[i];
-                            while (v && add)
-                            {
-                                if (cell_tube_dist(&c, v) < c.r)
-                                    add = false;
-                                v = v->next;
-                            }
-                        }
-
-                        if (add)
-                            AddCell(&c);
-                    }
+                    row.x = x;
+                    row.y = b->from.y + r + y_shift + y_shift_z;
+                    row.z = z;
+                    rows.push_back(row);
                     y_shift = r_pack - y_shift;
                 }
                 y_shift_z = r_pack - y_shift_z;
@@ -1770,62 +2374,158 @@ namespace scene {
         {
             // 2D...
             float y_shift = r;
-            float dy = 2*r;
+            dy = 2*r;
             float dx = 1.7320508075688772935274463415059*r;  // 2 * (sqrt(3)/2)
+            row.y_end = b->to.y - r;
             for(float x = b->from.x + r; x < b->to.x - r; x += dx)
             {
-                for(float y = b->from.y + r + y_shift; y < b->to.y - r; y += dy)
-                {
-                    c.pos = b->trans*anyVector(x, y, 0);
+                row.x = x;
+                row.y = b->from.y + r + y_shift;
+                row.z = 0;
+                rows.push_back(row);
+                y_shift = r - y_shift;
+            }
+        }
 
-                    c.pos += anyVector(float(rand())/RAND_MAX*c.r - c.r*0.5,
-                                       float(rand())/RAND_MAX*c.r - c.r*0.5,
-                                       0)*0.5;
+        // barriers and generated blocks...
+        std::vector<anyGenerationRegion> regions;
+        for (anyBarrier *br = FirstBarrier; br; br = (anyBarrier *)br->next)
+            if (br->type == sat::btIn)
+                regions.push_back(anyGenerationRegion(br, c.r, true));
+            else
+                regions.push_back(anyGenerationRegion(br, -c.r, false));
+        for (anyCellBlock *bc = FirstCellBlock; bc; bc = (anyCellBlock *)bc->next)
+            if (bc->generated)
+                regions.push_back(anyGenerationRegion(bc, c.r*0.5, false));
+
+        // classify boxes (0 -- reject, 1 -- accept, 2 -- test sites)...
+        int no_boxes = Simulation->settings.no_boxes;
+        float box_size = Simulation->settings.box_size;
+        std::vector<unsigned char> box_class(no_boxes);
+        float h = box_size*0.8660254f*1.001f;  // half of box diagonal (with rounding margin)
+        #pragma omp parallel for schedule(static)
+        for (int box_id = 0; box_id < no_boxes; box_id++)
+        {
+            int box_x = box_id % Simulation->settings.no_boxes_x;
+            int box_y = (box_id/Simulation->settings.no_boxes_x) % Simulation->settings.no_boxes_y;
+            int box_z = box_id/Simulation->settings.no_boxes_xy;
+            anyVector center = Simulation->settings.comp_box_from + anyVector(box_x + 0.5f, box_y + 0.5f, box_z + 0.5f)*box_size;
+
+            int cl = 1;
+            for (unsigned i = 0; cl && i < regions.size(); i++)
+            {
+                int rc = regions[i].classify(center, h);
+                if (rc != 1)
+                    cl = rc;
+            }
+            box_class[box_id] = cl;
+        }
 
-                    c.age = float(rand())/float(RAND_MAX) * b->tissue->minimum_interphase_time;
-                    c.state_age = c.age;
-                    c.time_to_necrosis = b->tissue->time_to_necrosis + (2*double(rand())/double(RAND_MAX) - 1.0)*b->tissue->time_to_necrosis_var;
+        // tubes near boxes (tube is listed in all boxes within cell radius of its bounding box)...
+        std::vector<int> box_first_tube(no_boxes + 1, 0);
+        std::vector<anyTube *> box_tubes;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int i = 0; i < Simulation->no_tube_chains; i++)
+                for (anyTube *v = Simulation->tube_chains[i]->head; v; v = v->next)
+                {
+                    anyVector m1(MIN(v->pos1.x, v->pos2.x), MIN(v->pos1.y, v->pos2.y), MIN(v->pos1.z, v->pos2.z));
+                    anyVector m2(MAX(v->pos1.x, v->pos2.x), MAX(v->pos1.y, v->pos2.y), MAX(v->pos1.z, v->pos2.z));
+                    m1 = (m1 - anyVector(c.r*1.001f) - Simulation->settings.comp_box_from)/box_size;
+                    m2 = (m2 + anyVector(c.r*1.001f) - Simulation->settings.comp_box_from)/box_size;
+
+                    int box_x_1 = MAX(0, int(floor(m1.x))), box_x_2 = MIN(Simulation->settings.no_boxes_x - 1, int(floor(m2.x)));
+                    int box_y_1 = MAX(0, int(floor(m1.y))), box_y_2 = MIN(Simulation->settings.no_boxes_y - 1, int(floor(m2.y)));
+                    int box_z_1 = MAX(0, int(floor(m1.z))), box_z_2 = MIN(Simulation->settings.no_boxes_z - 1, int(floor(m2.z)));
+
+                    for (int box_z = box_z_1; box_z <= box_z_2; box_z++)
+                        for (int box_y = box_y_1; box_y <= box_y_2; box_y++)
+                            for (int box_x = box_x_1; box_x <= box_x_2; box_x++)
+                            {
+                                int box_id = BOX_ID(box_x, box_y, box_z);
+                                if (pass == 0)
+                                    box_first_tube[box_id + 1]++;
+                                else
+                                    box_tubes[box_first_tube[box_id]++] = v;
+                            }
+                }
 
-                    bool add = true;
+            if (pass == 0)
+            {
+                for (int i = 0; i < no_boxes; i++)
+                    box_first_tube[i + 1] += box_first_tube[i];
+                box_tubes.resize(box_first_tube[no_boxes]);
+            }
+            else
+            {
+                // box_first_tube[i] was moved to start of box i + 1...
+                for (int i = no_boxes; i > 0; i--)
+                    box_first_tube[i] = box_first_tube[i - 1];
+                box_first_tube[0] = 0;
+            }
+        }
 
-                    // barriers...
-                    anyBarrier *br = FirstBarrier;
-                    while (add && br)
-                    {
-                        if (!br->is_point_inside(c.pos, c.r))
-                            add = false;
-                        br = (anyBarrier *)br->next;
-                    }
+        // generate rows...
+        unsigned long long seed = mix64((unsigned long long)rand());
+        std::vector<std::vector<anyLatticeSite> > sites(rows.size());
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int ri = 0; ri < (int)rows.size(); ri++)
+        {
+            anyLatticeRow const &lr = rows[ri];
+            anyCell cc;
+            cc.r = c.r;
+            int site = 0;
+            for (float y = lr.y; y < lr.y_end; y += dy, site++)
+            {
+                unsigned long long state = seed ^ mix64(((unsigned long long)ri << 24) ^ site);
 
-                    // blocks...
-                    anyCellBlock *bc = FirstCellBlock;
-                    while (add && bc)
-                    {
-                        if (bc->generated
-                            && bc->is_point_inside(c.pos, c.r*0.5))
-                            add = false;
-                        bc = (anyCellBlock *)bc->next;
-                    }
+                anyLatticeSite ls;
+                ls.pos = b->trans*anyVector(lr.x, y, lr.z);
+                float jx = site_random(state);
+                float jy = site_random(state);
+                ls.pos += anyVector(jx*c.r - c.r*0.5, jy*c.r - c.r*0.5, 0)*0.5;
 
-                    // tubes...
-                    for (int i = 0; add && i < NoTubeChains; i++)
-                    {
-                        anyTube *v = TubeChains[i];
-                        while (v && add)
-                        {
-                            if (cell_tube_dist(&c, v) < c.r)
-                                add = false;
-                            v = v->next;
-                        }
-                    }
+                // outside of computational box (would not be added)...
+                int box_id = GetBoxId(ls.pos);
+                if (box_id == -1 || !box_class[box_id])
+                    continue;
 
-                    if (add)
-                        AddCell(&c);
+                // barriers and generated blocks...
+                if (box_class[box_id] == 2)
+                {
+                    bool add = true;
+                    for (unsigned i = 0; add && i < regions.size(); i++)
+                        add = regions[i].passes(ls.pos);
+                    if (!add)
+                        continue;
                 }
-                y_shift = r - y_shift;
+
+                // tubes...
+                cc.pos = ls.pos;
+                bool add = true;
+                for (int i = box_first_tube[box_id]; add && i < box_first_tube[box_id + 1]; i++)
+                    if (cell_tube_dist(&cc, box_tubes[i]) < cc.r)
+                        add = false;
+                if (!add)
+                    continue;
+
+                ls.age = site_random(state) * b->tissue->minimum_interphase_time;
+                ls.time_to_necrosis = b->tissue->time_to_necrosis + (2*double(site_random(state)) - 1.0)*b->tissue->time_to_necrosis_var;
+                sites[ri].push_back(ls);
             }
         }
 
+        // add cells in lattice order...
+        for (unsigned ri = 0; ri < sites.size(); ri++)
+            for (unsigned i = 0; i < sites[ri].size(); i++)
+            {
+                c.pos = sites[ri][i].pos;
+                c.age = sites[ri][i].age;
+                c.state_age = c.age;
+                c.time_to_necrosis = sites[ri][i].time_to_necrosis;
+                AddCell(&c);
+            }
+
         b->generated = true;
     }
 
@@ -1835,7 +2535,7 @@ namespace scene {
       Generates cells in all blocks.
     */
     {
-        SimulationSettings.max_max_max_cells_per_box = 0;
+        Simulation->settings.max_max_max_cells_per_box = 0;
         bool gen;
         do
         {
@@ -1999,101 +2699,76 @@ namespace scene {
 
 
     static
-    void save_povray_tissues(FILE *f)
+    void save_povray_tissues(FILE *f, anyOutputSnapshot const *s)
     {
-        fprintf(f, "#declare TissueColor = array[%d]\n", NoTissueSettings);
+        fprintf(f, "#declare TissueColor = array[%d]\n", Simulation->no_tissue_settings);
         fprintf(f, "{\n");
-        anyTissueSettings *ts = FirstTissueSettings;
+        anyTissueSettings *ts = Simulation->first_tissue_settings;
         while (ts)
         {
             fprintf(f, "  rgb %s%s\n", ts->color.to_string_rgb(), ts->next ? "," : "");
             ts = ts->next;
         }
         fprintf(f, "}\n");
-        fprintf(f, "#declare TissueType = array[%d]\n", NoTissueSettings);
+        fprintf(f, "#declare TissueType = array[%d]\n", Simulation->no_tissue_settings);
         fprintf(f, "{\n");
-        ts = FirstTissueSettings;
+        ts = Simulation->first_tissue_settings;
         while (ts)
         {
             fprintf(f, "  %d%s\n", int(ts->type), ts->next ? "," : "");
             ts = ts->next;
         }
         fprintf(f, "}\n");
-        fprintf(f, "#declare TubeColor = rgb %s;\n", VisualSettings.tube_color.to_string_rgb());
-        fprintf(f, "#declare InBarrierColor = rgb %s;\n", VisualSettings.in_barrier_color.to_string_rgb());
-        fprintf(f, "#declare OutBarrierColor = rgb %s;\n", VisualSettings.out_barrier_color.to_string_rgb());
+        fprintf(f, "#declare TubeColor = rgb %s;\n", s->visual.tube_color.to_string_rgb());
+        fprintf(f, "#declare InBarrierColor = rgb %s;\n", s->visual.in_barrier_color.to_string_rgb());
+        fprintf(f, "#declare OutBarrierColor = rgb %s;\n", s->visual.out_barrier_color.to_string_rgb());
     }
 
 
     static
-    void save_povray_cells(FILE *f)
+    void save_povray_cells(FILE *f, anyOutputSnapshot const *s, sat::TissueType type)
     {
-        if (!Cells) return;
+        int frame = s->step % 2;
+        for (unsigned i = 0; i < s->cells.size(); i++)
+        {
+            anyCell const &c = s->cells[i];
+            // draw only active cells of given type...
+            if (c.state != sat::csRemoved && c.tissue->type == type)
+            {
+                int clipped =
+                        c.pos.x*s->visual.clip_plane[0] +
+                        c.pos.y*s->visual.clip_plane[1] +
+                        c.pos.z*s->visual.clip_plane[2] +
+                        s->visual.clip_plane[3] > 0;
+
+                fprintf(f, "c(%d, %s, %g, %d, %g, %g, %d)\n",
+                        c.tissue->id,
+                        c.pos.toString(),
+                        c.r,
+                        int(c.state),
+                        c.concentrations[sat::dsO2][frame],
+                        c.concentrations[sat::dsTAF][frame],
+                        clipped);
+            }
+        }
+    }
+
+
+    static
+    void save_povray_cells(FILE *f, anyOutputSnapshot const *s)
+    {
+        if (s->cells.empty()) return;
 
-        int first_cell;
-        int t_id = -1;
         fprintf(f, "\n");
 
         // tumor...
         fprintf(f, "#if (draw_tumor)\n");
-        first_cell = 0;
-        for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-        {
-            int no_cells = Cells[first_cell].no_cells_in_box;
-            for (int i = 0; i < no_cells; i++)
-                // draw only active, tumor cells...
-                if (Cells[first_cell + i].state != sat::csRemoved && Cells[first_cell + i].tissue->type == sat::ttTumor)
-                {
-                    int clipped =
-                            Cells[first_cell + i].pos.x*VisualSettings.clip_plane[0] +
-                            Cells[first_cell + i].pos.y*VisualSettings.clip_plane[1] +
-                            Cells[first_cell + i].pos.z*VisualSettings.clip_plane[2] +
-                            VisualSettings.clip_plane[3] > 0;
-
-                    t_id = Cells[first_cell + i].tissue->id;
-                    fprintf(f, "c(%d, %s, %g, %d, %g, %g, %d)\n",
-                            t_id,
-                            Cells[first_cell + i].pos.toString(),
-                            Cells[first_cell + i].r,
-                            int(Cells[first_cell + i].state),
-                            Cells[first_cell + i].concentrations[sat::dsO2][SimulationSettings.step % 2],
-                            Cells[first_cell + i].concentrations[sat::dsTAF][SimulationSettings.step % 2],
-                            clipped);
-                }
-
-            first_cell += SimulationSettings.max_cells_per_box;
-        }
+        save_povray_cells(f, s, sat::ttTumor);
         fprintf(f, "#end\n");
 
         // normal...
         fprintf(f, "#if (draw_normal)\n");
-        first_cell = 0;
-        for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-        {
-            int no_cells = Cells[first_cell].no_cells_in_box;
-            for (int i = 0; i < no_cells; i++)
-                // draw only active, normal cells...
-                if (Cells[first_cell + i].state != sat::csRemoved && Cells[first_cell + i].tissue->type == sat::ttNormal)
-                {
-                    int clipped =
-                            Cells[first_cell + i].pos.x*VisualSettings.clip_plane[0] +
-                            Cells[first_cell + i].pos.y*VisualSettings.clip_plane[1] +
-                            Cells[first_cell + i].pos.z*VisualSettings.clip_plane[2] +
-                            VisualSettings.clip_plane[3] > 0;
-
-                    t_id = Cells[first_cell + i].tissue->id;
-                    fprintf(f, "c(%d, %s, %g, %d, %g, %g, %d)\n",
-                            t_id,
-                            Cells[first_cell + i].pos.toString(),
-                            Cells[first_cell + i].r,
-                            int(Cells[first_cell + i].state),
-                            Cells[first_cell + i].concentrations[sat::dsO2][SimulationSettings.step % 2],
-                            Cells[first_cell + i].concentrations[sat::dsTAF][SimulationSettings.step % 2],
-                            clipped);
-                }
-
-            first_cell += SimulationSettings.max_cells_per_box;
-        }
+        save_povray_cells(f, s, sat::ttNormal);
         fprintf(f, "#end\n");
     }
 
@@ -2113,16 +2788,16 @@ namespace scene {
 
 
     static
-    void save_povray_tubes(FILE *f)
+    void save_povray_tubes(FILE *f, anyOutputSnapshot const *s)
     {
-        if (!NoTubes) return;
+        if (s->tubes.empty()) return;
 
         fprintf(f, "\n");
         fprintf(f, "#if (draw_tubes)\n");
 
-        for (int i = 0; i < NoTubeChains; i++)
+        for (unsigned i = 0; i < s->chains.size(); i++)
         {
-            anyTube *v = TubeChains[i];
+            anyTube const *v = s->chains[i];
             fprintf(f, "merge\n");
             fprintf(f, "{\n");
             while (v)
@@ -2157,17 +2832,67 @@ namespace scene {
     }
 
 
-    void SavePovRay(char const *povfname, bool save_ani)
+    static
+    void save_povray(char const *fname, anyOutputSnapshot const *s)
     /**
-      Saves povray file(s).
+      Saves main povray file.
+    */
+    {
+        FILE *f = fopen(fname, "w");
+        if (f)
+        {
+            fprintf(f, "// STEP: %d\n", s->step);
+            fprintf(f, "\n");
+            fprintf(f, "#declare BackgroundColor=rgb %s;\n", s->visual.bkg_color.to_string_rgb());
+            fprintf(f, "#declare LightSourcePos=<%g, %g, %g>;\n", s->simulation.comp_box_to.x, s->simulation.comp_box_to.y, s->simulation.comp_box_to.z*3);
+            fprintf(f, "#declare EyePos=%s;\n", s->visual.eye.toString());
+            fprintf(f, "#declare ViewMatrix=array[16] %s\n", s->visual.v_matrix.toString("{", "}"));
+
+            fprintf(f, "\n");
+            fprintf(f, "#include \"%s%smotpuca.pov\"\n", GlobalSettings.user_dir, FOLDER_LIB_POVRAY);
+
+            fprintf(f, "\n");
+
+            // tissues...
+            save_povray_tissues(f, s);
+
+            fprintf(f, "\n");
+            fprintf(f, "union\n{\n");
+
+            // barriers...
+            save_povray_barriers(f);
+
+            // cells...
+            save_povray_cells(f, s);
+
+            // tubes...
+            save_povray_tubes(f, s);
+
+            fprintf(f, "\ntransformation()\n}\n");
+
+            fclose(f);
+        }
+    }
+
+
+    class anyPovRayJob: public anyOutputJob
+    {
+    public:
+        anyOutputSnapshot snapshot;
+
+        void write() { Simulation = snapshot.source; save_povray(fname, &snapshot); }
+    };
+
+
+    anyOutputJob *CapturePovRay(char const *povfname, bool save_ani)
+    /**
+      Writes animation files and takes snapshot for main povray file.
 
       \param povfname -- name of output file, if NULL then name is generated.
       \param save_ani -- save suplementary animation files?
     */
     {
-        static int frame = 0;
-
-        frame++;
+        int frame = ++Simulation->povray_frame;
 
         FILE *f;
         char fname[P_MAX_PATH];
@@ -2175,11 +2900,11 @@ namespace scene {
         if (save_ani)
         {
             // animation file...
-            snprintf(fname, P_MAX_PATH, "%spovray", GlobalSettings.output_dir);
+            snprintf(fname, P_MAX_PATH, "%spovray", Simulation->output_dir);
 
             mkdir(fname);
 
-            snprintf(fname, P_MAX_PATH, "%spovray/pov.ini", GlobalSettings.output_dir);
+            snprintf(fname, P_MAX_PATH, "%spovray/pov.ini", Simulation->output_dir);
             f = fopen(fname, "w");
             if (f)
             {
@@ -2199,7 +2924,7 @@ namespace scene {
             }
 
             // suplementary animation file...
-            snprintf(fname, P_MAX_PATH, "%spovray/pov.pov", GlobalSettings.output_dir);
+            snprintf(fname, P_MAX_PATH, "%spovray/pov.pov", Simulation->output_dir);
             f = fopen(fname, "w");
             if (f)
             {
@@ -2209,119 +2934,298 @@ namespace scene {
         }
 
         // main povray file...
+        anyPovRayJob *job = new anyPovRayJob;
         if (povfname)
-            strncpy(fname, povfname, P_MAX_PATH);
+            strncpy(job->fname, povfname, P_MAX_PATH - 1);
         else
-            snprintf(fname, P_MAX_PATH, "%spovray/%06d.pov", GlobalSettings.output_dir, frame);
+            snprintf(job->fname, P_MAX_PATH, "%spovray/%06d.pov", Simulation->output_dir, frame);
 
-        LOG2(llInfo, "Saving PovRay file: ", fname);
+        LOG2(llInfo, "Saving PovRay file: ", job->fname);
 
-        f = fopen(fname, "w");
-        if (f)
-        {
-            fprintf(f, "// STEP: %d\n", SimulationSettings.step);
-            fprintf(f, "\n");
-            fprintf(f, "#declare BackgroundColor=rgb %s;\n", VisualSettings.bkg_color.to_string_rgb());
-            fprintf(f, "#declare LightSourcePos=<%g, %g, %g>;\n", SimulationSettings.comp_box_to.x, SimulationSettings.comp_box_to.y, SimulationSettings.comp_box_to.z*3);
-            fprintf(f, "#declare EyePos=%s;\n", VisualSettings.eye.toString());
-            fprintf(f, "#declare ViewMatrix=array[16] %s\n", VisualSettings.v_matrix.toString("{", "}"));
+        job->snapshot.capture(true);
+        job->step = job->snapshot.step;
+        return job;
+    }
 
-            fprintf(f, "\n");
-            fprintf(f, "#include \"%s%smotpuca.pov\"\n", GlobalSettings.user_dir, FOLDER_LIB_POVRAY);
 
-            fprintf(f, "\n");
+    void SavePovRay(char const *povfname, bool save_ani)
+    /**
+      Saves povray file(s).
 
-            // tissues...
-            save_povray_tissues(f);
+      \param povfname -- name of output file, if NULL then name is generated.
+      \param save_ani -- save suplementary animation files?
+    */
+    {
+        anyOutputJob *job = CapturePovRay(povfname, save_ani);
+        job->write();
+        delete job;
+    }
 
-            fprintf(f, "\n");
-            fprintf(f, "union\n{\n");
 
-            // barriers...
-            save_povray_barriers(f);
+    class anyVTKArray
+    /**
+      Data array of VTU file (stored in appended section).
+    */
+    {
+    public:
+        char const *name;          ///< array name
+        char const *type;          ///< VTK type name (Float32, Int32, UInt8)
+        int components;            ///< number of components
+        std::vector<char> data;    ///< raw data
 
-            // cells...
-            save_povray_cells(f);
+        anyVTKArray(char const *n, char const *t, int c): name(n), type(t), components(c) {}
 
-            // tubes...
-            save_povray_tubes(f);
+        template <class T>
+        void add(T v) { data.insert(data.end(), (char const *)&v, (char const *)&v + sizeof(T)); }
+        void add(anyVector const &v) { add(v.x); add(v.y); add(v.z); }
+    };
 
-            fprintf(f, "\ntransformation()\n}\n");
 
-            fclose(f);
-        }
+    static
+    void save_vtk_array_header(FILE *f, anyVTKArray const &a, unsigned long long &offset)
+    {
+        fprintf(f, "    <DataArray type=\"%s\" Name=\"%s\"", a.type, a.name);
+        if (a.components > 1)
+            fprintf(f, " NumberOfComponents=\"%d\"", a.components);
+        fprintf(f, " format=\"appended\" offset=\"%llu\"/>\n", offset);
+        offset += sizeof(unsigned long long) + a.data.size();
     }
 
 
-    void SaveVTK()
+    static
+    void save_vtk(char const *fname, anyOutputSnapshot const *s)
+    /**
+      Saves cells (as vertices) and tubes (as lines) to VTK XML unstructured grid
+      file with raw binary data in appended section.
+    */
     {
-        LOG(llInfo, "Saving VTK file: data.vtk");
+        FILE *f = fopen(fname, "wb");
+        if (!f)
+            return;
 
-        FILE *f = fopen("data.vtk", "w");
-        if (f)
+        int frame = s->step % 2;
+        int no_cells = s->cells.size();
+        int no_tubes = s->tubes.size();
+
+        // points...
+        anyVTKArray points("points", "Float32", 3);
+        anyVTKArray point_r("radius", "Float32", 1);
+        for (int i = 0; i < no_cells; i++)
+        {
+            points.add(s->cells[i].pos);
+            point_r.add(s->cells[i].r);
+        }
+        for (int i = 0; i < no_tubes; i++)
+        {
+            points.add(s->tubes[i].pos1);
+            points.add(s->tubes[i].pos2);
+            point_r.add(s->tubes[i].r);
+            point_r.add(s->tubes[i].r);
+        }
+
+        // topology...
+        anyVTKArray connectivity("connectivity", "Int32", 1);
+        anyVTKArray offsets("offsets", "Int32", 1);
+        anyVTKArray types("types", "UInt8", 1);
+        for (int i = 0; i < no_cells; i++)
+        {
+            connectivity.add(int(i));
+            offsets.add(int(i + 1));
+            types.add((unsigned char)1);  // VTK_VERTEX
+        }
+        for (int i = 0; i < no_tubes; i++)
+        {
+            connectivity.add(int(no_cells + 2*i));
+            connectivity.add(int(no_cells + 2*i + 1));
+            offsets.add(int(no_cells + 2*i + 2));
+            types.add((unsigned char)3);  // VTK_LINE
+        }
+
+        // fields (tubes have no tissue, cells have no flow; radius is point data)...
+        std::vector<anyVTKArray> fields;
+        fields.push_back(anyVTKArray("state", "Int32", 1));
+        fields.push_back(anyVTKArray("tissue", "Int32", 1));
+        fields.push_back(anyVTKArray("pressure", "Float32", 1));
+        fields.push_back(anyVTKArray("velocity", "Float32", 3));
+        for (int k = 0; k < sat::dsLast; k++)
+            fields.push_back(anyVTKArray(DiffundingSubstances_names[k], "Float32", 1));
+        fields.push_back(anyVTKArray("blood_pressure", "Float32", 1));
+        fields.push_back(anyVTKArray("blood_flow", "Float32", 1));
+        fields.push_back(anyVTKArray("tube_id", "Int32", 1));
+
+        for (int i = 0; i < no_cells; i++)
+        {
+            anyCell const &c = s->cells[i];
+            int fi = 0;
+            fields[fi++].add(int(c.state));
+            fields[fi++].add(int(c.tissue->id));
+            fields[fi++].add(c.pressure);
+            fields[fi++].add(c.velocity);
+            for (int k = 0; k < sat::dsLast; k++)
+                fields[fi++].add(c.concentrations[k][frame]);
+            fields[fi++].add(0.0f);
+            fields[fi++].add(0.0f);
+            fields[fi++].add(int(-1));
+        }
+        for (int i = 0; i < no_tubes; i++)
+        {
+            anyTube const &v = s->tubes[i];
+            int fi = 0;
+            fields[fi++].add(int(v.state));
+            fields[fi++].add(int(-1));
+            fields[fi++].add(0.0f);
+            fields[fi++].add(anyVector(0, 0, 0));
+            for (int k = 0; k < sat::dsLast; k++)
+                fields[fi++].add(0.0f);
+            fields[fi++].add(v.blood_pressure);
+            fields[fi++].add(v.blood_flow);
+            fields[fi++].add(int(v.id));
+        }
+
+        // XML header...
+        unsigned long long offset = 0;
+        fprintf(f, "<?xml version=\"1.0\"?>\n");
+        fprintf(f, "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n");
+        fprintf(f, "<!-- step: %d, time: %g -->\n", s->step, s->simulation.time);
+        fprintf(f, " <UnstructuredGrid>\n");
+        fprintf(f, "  <Piece NumberOfPoints=\"%d\" NumberOfCells=\"%d\">\n", no_cells + 2*no_tubes, no_cells + no_tubes);
+        fprintf(f, "   <PointData Scalars=\"radius\">\n");
+        save_vtk_array_header(f, point_r, offset);
+        fprintf(f, "   </PointData>\n");
+        fprintf(f, "   <CellData Scalars=\"state\">\n");
+        for (unsigned k = 0; k < fields.size(); k++)
+            save_vtk_array_header(f, fields[k], offset);
+        fprintf(f, "   </CellData>\n");
+        fprintf(f, "   <Points>\n");
+        save_vtk_array_header(f, points, offset);
+        fprintf(f, "   </Points>\n");
+        fprintf(f, "   <Cells>\n");
+        save_vtk_array_header(f, connectivity, offset);
+        save_vtk_array_header(f, offsets, offset);
+        save_vtk_array_header(f, types, offset);
+        fprintf(f, "   </Cells>\n");
+        fprintf(f, "  </Piece>\n");
+        fprintf(f, " </UnstructuredGrid>\n");
+
+        // raw data (same order as headers)...
+        std::vector<anyVTKArray const *> arrays;
+        arrays.push_back(&point_r);
+        for (unsigned k = 0; k < fields.size(); k++)
+            arrays.push_back(&fields[k]);
+        arrays.push_back(&points);
+        arrays.push_back(&connectivity);
+        arrays.push_back(&offsets);
+        arrays.push_back(&types);
+
+        fprintf(f, " <AppendedData encoding=\"raw\">\n_");
+        for (unsigned k = 0; k < arrays.size(); k++)
+        {
+            unsigned long long size = arrays[k]->data.size();
+            fwrite(&size, sizeof(size), 1, f);
+            if (size)
+                fwrite(&arrays[k]->data[0], 1, size, f);
+        }
+        fprintf(f, "\n </AppendedData>\n");
+        fprintf(f, "</VTKFile>\n");
+
+        fclose(f);
+    }
+
+
+    class anyVTKJob: public anyOutputJob
+    {
+    public:
+        anyOutputSnapshot snapshot;
+
+        void write() { Simulation = snapshot.source; save_vtk(fname, &snapshot); }
+    };
+
+
+    static
+    void save_vtk_series(char const *fname, float time)
+    /**
+      Adds file to time series and rewrites <output dir>vtk.pvd. Series is restarted
+      when output directory changes or simulation goes back in time.
+    */
+    {
+        char pvd[P_MAX_PATH];
+        snprintf(pvd, P_MAX_PATH, "%svtk.pvd", Simulation->output_dir);
+        if (Simulation->vtk_series_file != pvd || (!Simulation->vtk_series.empty() && Simulation->vtk_series.back().first >= time))
         {
-            fprintf(f, "# vtk DataFile Version 2.0\n");
-            fprintf(f, "Test data\n");
-            fprintf(f, "ASCII\n");
-            fprintf(f, "DATASET UNSTRUCTURED_GRID\n");
+            Simulation->vtk_series_file = pvd;
+            Simulation->vtk_series.clear();
+        }
 
-            // count cells...
-            int total_no_cells = 0;
-            int first_cell = 0;
-            for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-            {
-                total_no_cells += Cells[first_cell].no_cells_in_box;
-                first_cell += SimulationSettings.max_cells_per_box;
-            }
+        // file name relative to *.pvd...
+        char const *name = fname;
+        if (!strncmp(fname, Simulation->output_dir, strlen(Simulation->output_dir)))
+            name += strlen(Simulation->output_dir);
+        Simulation->vtk_series.push_back(std::make_pair(time, std::string(name)));
 
-            // save coordinates...
-            fprintf(f, "POINTS %d float\n", total_no_cells);
-            first_cell = 0;
-            int no_cells;
-            for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-            {
-                no_cells = Cells[first_cell].no_cells_in_box;
-                for (int i = 0; i < no_cells; i++)
-                    fprintf(f, "%.2f %.2f %.2f\n", Cells[first_cell + i].pos.x, Cells[first_cell + i].pos.y, Cells[first_cell + i].pos.z);
-                first_cell += SimulationSettings.max_cells_per_box;
-            }
+        FILE *f = fopen(pvd, "w");
+        if (!f)
+            return;
+        fprintf(f, "<?xml version=\"1.0\"?>\n");
+        fprintf(f, "<VTKFile type=\"Collection\" version=\"0.1\" byte_order=\"LittleEndian\">\n");
+        fprintf(f, " <Collection>\n");
+        for (unsigned i = 0; i < Simulation->vtk_series.size(); i++)
+            fprintf(f, "  <DataSet timestep=\"%g\" group=\"\" part=\"0\" file=\"%s\"/>\n", Simulation->vtk_series[i].first, Simulation->vtk_series[i].second.c_str());
+        fprintf(f, " </Collection>\n");
+        fprintf(f, "</VTKFile>\n");
+        fclose(f);
+    }
 
-            // save radiuses...
-            fprintf(f, "POINT_DATA %d\n", total_no_cells);
-            fprintf(f, "SCALARS radius float 1\n");
-            fprintf(f, "LOOKUP_TABLE default\n");
-            first_cell = 0;
-            for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-            {
-                no_cells = Cells[first_cell].no_cells_in_box;
-                for (int i = 0; i < no_cells; i++)
-                    fprintf(f, "%g\n", Cells[first_cell + i].r);
-                first_cell += SimulationSettings.max_cells_per_box;
-            }
 
-            fclose(f);
-        }
+    anyOutputJob *CaptureVTK(char const *fname, bool time_series)
+    /**
+      Takes snapshot of cells and tubes for VTK XML (*.vtu) file.
+
+      \param fname -- name of output file
+      \param time_series -- add file to time series in output directory (vtk.pvd)?
+    */
+    {
+        LOG2(llInfo, "Saving VTK file: ", fname);
+
+        anyVTKJob *job = new anyVTKJob;
+        strncpy(job->fname, fname, P_MAX_PATH - 1);
+        job->snapshot.capture(true);
+        job->step = job->snapshot.step;
+
+        if (time_series)
+            save_vtk_series(fname, job->snapshot.simulation.time);
+        return job;
+    }
+
+
+    void SaveVTK(char const *fname)
+    /**
+      Saves VTK XML (*.vtu) file.
+    */
+    {
+        anyOutputJob *job = CaptureVTK(fname, false);
+        job->write();
+        delete job;
     }
 
+
     anyTube *FindTubeById(int id, bool current)
+    /**
+      Returns tube with given id (0 if not found).
+
+      \param id -- id of tube
+      \param current -- id assigned in scene (true) or id read from file (false)
+    */
     {
-        // loop over all tubes...
-        for (int i = 0; i < NoTubeChains; i++)
-        {
-            anyTube *v = TubeChains[i];
-            while (v)
-            {
-                if ((v->id == id && current) || (v->parsed_id == id && !current))
-                    return v;
-                v = v->next;
-            }
-        }
-        return 0;
+        if (current)
+            return id > 0 && id < (int)Simulation->tubes_by_id.size() ? Simulation->tubes_by_id[id] : 0;
+
+        std::unordered_map<int, anyTube *>::const_iterator i = Simulation->tubes_by_parsed_id.find(id);
+        return i == Simulation->tubes_by_parsed_id.end() ? 0 : i->second;
     }
 
     void UpdateSimulationBox()
     {
-        if (GlobalSettings.simulation_allocated)
+        if (Simulation->allocated)
             return;
 
         bool first = true;
@@ -2345,66 +3249,229 @@ namespace scene {
         newfrom = m1 - anyVector(10, 10, 10);
         newto = m2 + anyVector(10, 10, 10);
 
-        if (newfrom != SimulationSettings.comp_box_from ||
-            newto != SimulationSettings.comp_box_to)
+        if (newfrom != Simulation->settings.comp_box_from ||
+            newto != Simulation->settings.comp_box_to)
         {
-            SimulationSettings.comp_box_from = newfrom;
-            SimulationSettings.comp_box_to = newto;
+            Simulation->settings.comp_box_from = newfrom;
+            Simulation->settings.comp_box_to = newto;
         }
     }
 
 
-    void SaveAG(char const *fname, bool save_cells_and_tubes)
+    void SaveAG(FILE *f, anyOutputSnapshot const *s, bool save_cells_and_tubes)
+    {
+        SaveDefinitions_ag(f);
+        fprintf(f, "\n");
+        SaveVisualSettings_ag(f, &s->visual);
+        SaveSimulationSettings_ag(f, &s->simulation);
+        SaveTubularSystemSettings_ag(f, &s->tubular);
+        fprintf(f, "\n//---[ BARRIERS ]---------------------------------------------------------------\n");
+        SaveAllBarriers_ag(f);
+        fprintf(f, "\n//---[ TISSUES ]----------------------------------------------------------------\n");
+        SaveAllTissueSettings_ag(f);
+        SaveAllInteractionSettings_ag(f);
+        fprintf(f, "\n//---[ BLOCKS ]-----------------------------------------------------------------\n");
+        SaveAllCellBlocks_ag(f);
+        fprintf(f, "\n//---[ TUBE BUNDLES ]---------------------------------------------------------\n");
+        SaveAllTubeBundles_ag(f);
+        fprintf(f, "\n//---[ TUBE LINES ]-----------------------------------------------------------\n");
+        SaveAllTubeLines_ag(f);
+
+        if (save_cells_and_tubes)
+        {
+            fprintf(f, "\n//---[ TUBES ]----------------------------------------------------------------\n");
+            SaveAllTubes_ag(f, s);
+            fprintf(f, "\n//---[ CELLS ]------------------------------------------------------------------\n");
+            SaveAllCells_ag(f, s);
+        }
+    }
+
+
+    class anyAGJob: public anyOutputJob
+    {
+    public:
+        anyOutputSnapshot snapshot;
+        bool save_cells_and_tubes;
+
+        void write()
+        {
+            Simulation = snapshot.source;  // job may run in writer thread
+            FILE *f = fopen(fname, "w");
+            if (f)
+            {
+                SaveAG(f, &snapshot, save_cells_and_tubes);
+                fclose(f);
+            }
+        }
+    };
+
+
+    anyOutputJob *CaptureAG(char const *fname, bool save_cells_and_tubes)
+    /**
+      Takes snapshot of scene for *.ag file, file is written by job.
+    */
     {
         LOG2(llInfo, "Saving ag file: ", fname);
-        FILE *f = fopen(fname, "w");
-        if (f)
+        anyAGJob *job = new anyAGJob;
+        strncpy(job->fname, fname, P_MAX_PATH - 1);
+        job->save_cells_and_tubes = save_cells_and_tubes;
+        job->snapshot.capture(save_cells_and_tubes);
+        job->step = job->snapshot.step;
+        return job;
+    }
+
+
+    void SaveAG(char const *fname, bool save_cells_and_tubes)
+    {
+        anyOutputJob *job = CaptureAG(fname, save_cells_and_tubes);
+        job->write();
+        delete job;
+    }
+
+
+    static void open_trajectory()
+    /**
+      Creates trajectory file in output directory. Scene definition (without cells
+      and tubes) goes to file header, so frames can be converted back to *.ag files.
+    */
+    {
+        char fname[P_MAX_PATH];
+        snprintf(fname, P_MAX_PATH, "%strajectory.mtr", Simulation->output_dir);
+        LOG2(llInfo, "Saving trajectory file: ", fname);
+
+        std::string scene_def;
+        FILE *tmp = tmpfile();
+        if (tmp)
         {
-            SaveDefinitions_ag(f);
-            fprintf(f, "\n");
-            SaveVisualSettings_ag(f, &VisualSettings);
-            SaveSimulationSettings_ag(f, &SimulationSettings);
-            SaveTubularSystemSettings_ag(f, &TubularSystemSettings);
-            fprintf(f, "\n//---[ BARRIERS ]---------------------------------------------------------------\n");
-            SaveAllBarriers_ag(f);
-            fprintf(f, "\n//---[ TISSUES ]----------------------------------------------------------------\n");
-            SaveAllTissueSettings_ag(f);
-            fprintf(f, "\n//---[ BLOCKS ]-----------------------------------------------------------------\n");
-            SaveAllCellBlocks_ag(f);
-            fprintf(f, "\n//---[ TUBE BUNDLES ]---------------------------------------------------------\n");
-            SaveAllTubeBundles_ag(f);
-            fprintf(f, "\n//---[ TUBE LINES ]-----------------------------------------------------------\n");
-            SaveAllTubeLines_ag(f);
-
-            if (save_cells_and_tubes)
+            anyOutputSnapshot snapshot;
+            snapshot.capture(false);
+            SaveAG(tmp, &snapshot, false);
+            long size = ftell(tmp);
+            scene_def.resize(size);
+            rewind(tmp);
+            if (size > 0 && fread(&scene_def[0], 1, size, tmp) != (size_t)size)
+                scene_def.clear();
+            fclose(tmp);
+        }
+
+        // names indexed by tissue id...
+        std::vector<char const *> tissue_names;
+        for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts; ts = ts->next)
+        {
+            if ((int)tissue_names.size() <= ts->id)
+                tissue_names.resize(ts->id + 1, "");
+            tissue_names[ts->id] = ts->name;
+        }
+
+        Simulation->trajectory.open(fname, scene_def.c_str(), tissue_names.size(), tissue_names.empty() ? 0 : &tissue_names[0],
+                        sat::csLast, CellState_names);
+    }
+
+
+    void SaveTrajectoryFrame()
+    /**
+      Appends current cells and tubes to trajectory file (opened on first call).
+    */
+    {
+        if (!Simulation->trajectory.is_open())
+            open_trajectory();
+
+        anyTrajectoryFrame &fr = Simulation->trajectory_frame;
+        int frame = Simulation->settings.step % 2;
+
+        int no_cells = 0;
+        if (Simulation->cells)
+            for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+                no_cells += Simulation->cells[box_id*Simulation->settings.max_cells_per_box].no_cells_in_box;
+        fr.resize(no_cells, Simulation->no_tubes);
+        fr.step = Simulation->settings.step;
+        fr.time = Simulation->settings.time;
+
+        // cells...
+        int i = 0;
+        int first_cell = 0;
+        for (int box_id = 0; Simulation->cells && box_id < Simulation->settings.no_boxes; box_id++)
+        {
+            for (int j = 0; j < Simulation->cells[first_cell].no_cells_in_box; j++)
             {
-                fprintf(f, "\n//---[ TUBES ]----------------------------------------------------------------\n");
-                SaveAllTubes_ag(f);
-                fprintf(f, "\n//---[ CELLS ]------------------------------------------------------------------\n");
-                SaveAllCells_ag(f);
+                anyCell const *c = Simulation->cells + first_cell + j;
+                if (c->state <= sat::csRemoved)
+                    continue;
+
+                fr.set_float(tcCellX, i, c->pos.x);
+                fr.set_float(tcCellY, i, c->pos.y);
+                fr.set_float(tcCellZ, i, c->pos.z);
+                fr.set_float(tcCellR, i, c->r);
+                fr.set_int(tcCellState, i, c->state);
+                fr.set_int(tcCellTissue, i, c->tissue->id);
+                for (int k = 0; k < sat::dsLast; k++)
+                    fr.set_float(tcCellConc + k, i, c->concentrations[k][frame]);
+                i++;
             }
-            fclose(f);
+            first_cell += Simulation->settings.max_cells_per_box;
         }
+
+        // tubes...
+        int t = 0;
+        for (int ch = 0; ch < Simulation->no_tube_chains; ch++)
+            for (anyTube const *v = Simulation->tube_chains[ch]->head; v && t < Simulation->no_tubes; v = v->next)
+            {
+                fr.set_int(tcTubeId, t, v->id);
+                fr.set_float(tcTubeX1, t, v->pos1.x);
+                fr.set_float(tcTubeY1, t, v->pos1.y);
+                fr.set_float(tcTubeZ1, t, v->pos1.z);
+                fr.set_float(tcTubeX2, t, v->pos2.x);
+                fr.set_float(tcTubeY2, t, v->pos2.y);
+                fr.set_float(tcTubeZ2, t, v->pos2.z);
+                fr.set_float(tcTubeR, t, v->r);
+                fr.set_int(tcTubeState, t, v->state);
+                fr.set_int(tcTubeFirst, t, !v->prev);
+                fr.set_int(tcTubeBaseId, t, v->base ? v->base->id : -1);
+                fr.set_int(tcTubeTopId, t, v->top ? v->top->id : -1);
+                fr.set_int(tcTubeFixedBloodPressure, t, v->fixed_blood_pressure);
+                fr.set_float(tcTubeBloodPressure, t, v->blood_pressure);
+                fr.set_float(tcTubeBloodFlow, t, v->blood_flow);
+                t++;
+            }
+
+        fr.resize(i, t);
+        Simulation->trajectory.write_frame(fr);
+    }
+
+
+    void CloseTrajectory()
+    /**
+      Finishes trajectory file (writes index of frames).
+    */
+    {
+        Simulation->trajectory.close();
     }
 
 
     void RelinkTubes()
+    /**
+      Links tubes read from file to their base and top tubes (base_id, top_id).
+    */
     {
         // loop over all tubes...
-        for (int i = 0; i < NoTubeChains; i++)
+        for (int i = 0; i < Simulation->no_tube_chains; i++)
         {
-            anyTube *v = TubeChains[i];
+            anyTube *v = Simulation->tube_chains[i]->head;
             while (v)
             {
                 if (v->base_id)
                 {
                   v->base = FindTubeById(v->base_id, false);
+                  if (!v->base)
+                      throw new Error(__FILE__, __LINE__, "Unknown base_id of tube", 0, ParserFile);
                   v->base->fork = v;
                   v->base_id = 0;
                 }
                 if (v->top_id)
                 {
                   v->top = FindTubeById(v->top_id, false);
+                  if (!v->top)
+                      throw new Error(__FILE__, __LINE__, "Unknown top_id of tube", 0, ParserFile);
                   v->top->jab = v;
                   v->top_id = 0;
                 }
@@ -2417,35 +3484,210 @@ namespace scene {
 
     anyTube *FindFirstTube(anyTube *v)
     {
-        while (v->prev)
-            v = v->prev;
-        return v;
+        return v->chain->head;
     }
 
     anyTube *FindLastTube(anyTube *v)
     {
-        while (v->next)
-            v = v->next;
-        return v;
+        return v->chain->tail;
+    }
+
+
+    anyTubeChain *AddTubeChain(anyTube *head)
+    /**
+      Adds new chain starting at given tube. Tubes linked by next are labelled with the chain.
+
+      \param head -- first tube of chain
+    */
+    {
+        if (Simulation->no_tube_chains >= Simulation->settings.max_tube_chains)
+            throw new Error(__FILE__, __LINE__, "Too many tube chains");
+
+        anyTubeChain *ch = new anyTubeChain;
+        ch->head = head;
+        ch->index = Simulation->no_tube_chains;
+        for (anyTube *v = head; v; v = v->next)
+        {
+            v->chain = ch;
+            ch->tail = v;
+            ch->length++;
+        }
+
+        Simulation->tube_chains[Simulation->no_tube_chains++] = ch;
+        return ch;
+    }
+
+
+    static
+    void drop_tube_merge(anyTubeChain *ch)
+    /**
+      Drops pending merge of chain (merges are listed by first tubes of chains).
+    */
+    {
+        if (!ch->merging)
+            return;
+
+        int k = 0;
+        for (int i = 0; i < Simulation->no_tube_merge; i++)
+            if (Simulation->tube_merge[i].t1 == ch->head || Simulation->tube_merge[i].t2 == ch->head)
+            {
+                Simulation->tube_merge[i].t1->chain->merging = false;
+                Simulation->tube_merge[i].t2->chain->merging = false;
+            }
+            else
+                Simulation->tube_merge[k++] = Simulation->tube_merge[i];
+        Simulation->no_tube_merge = k;
+    }
+
+
+    void RemoveTubeChain(anyTubeChain *ch)
+    /**
+      Removes chain from list of chains (tubes are not deleted) and drops its pending merge.
+    */
+    {
+        drop_tube_merge(ch);
+
+        Simulation->tube_chains[ch->index] = Simulation->tube_chains[--Simulation->no_tube_chains];
+        Simulation->tube_chains[ch->index]->index = ch->index;
+        delete ch;
+    }
+
+
+    void AppendTube(anyTube *tail, anyTube *v)
+    /**
+      Links tube after last tube of chain.
+    */
+    {
+        tail->next = v;
+        v->prev = tail;
+        v->next = 0;
+        v->chain = tail->chain;
+        v->chain->tail = v;
+        v->chain->length++;
+    }
+
+
+    void AppendTubeChain(anyTube *tail, anyTubeChain *ch)
+    /**
+      Links whole chain after last tube of other chain. Appended chain is removed.
+    */
+    {
+        anyTubeChain *dst = tail->chain;
+
+        tail->next = ch->head;
+        ch->head->prev = tail;
+        for (anyTube *v = ch->head; v; v = v->next)
+            v->chain = dst;
+        dst->tail = ch->tail;
+        dst->length += ch->length;
+
+        RemoveTubeChain(ch);
+    }
+
+
+    void QueueTubeRemoval(anyTube *v)
+    /**
+      Queues tube for removal by RemoveQueuedTubes().
+    */
+    {
+        Simulation->removed_tubes.push_back(v);
+    }
+
+
+    void RemoveQueuedTubes()
+    /**
+      Removes all queued tubes in one pass. Tubes are unlinked from their chains
+      and from base/fork/top/jab tubes, empty chains are dropped (order of other
+      chains is kept) and tubes are returned to pool.
+    */
+    {
+        if (Simulation->removed_tubes.empty())
+            return;
+
+        bool compact = false;
+        for (unsigned i = 0; i < Simulation->removed_tubes.size(); i++)
+        {
+            anyTube *v = Simulation->removed_tubes[i];
+            anyTubeChain *ch = v->chain;
+
+            // links from other tubes...
+            if (v->base && v->base->fork == v)
+                v->base->fork = 0;
+            if (v->fork && v->fork->base == v)
+                v->fork->base = 0;
+            if (v->top && v->top->jab == v)
+                v->top->jab = 0;
+            if (v->jab && v->jab->top == v)
+                v->jab->top = 0;
+
+            // chain...
+            if (!v->prev && !v->next)
+            {
+                // last tube in chain...
+                drop_tube_merge(ch);
+                Simulation->tube_chains[ch->index] = 0;
+                delete ch;
+                compact = true;
+            }
+            else if (!v->next)
+            {
+                v->prev->next = 0;
+                ch->tail = v->prev;
+                ch->length--;
+            }
+            else if (!v->prev)
+            {
+                drop_tube_merge(ch);
+                v->next->prev = 0;
+                ch->head = v->next;
+                ch->length--;
+            }
+            else
+            {
+                // split chain...
+                v->prev->next = 0;
+                v->next->prev = 0;
+                ch->tail = v->prev;
+                ch->length -= AddTubeChain(v->next)->length + 1;
+            }
+
+            UnindexTube(v);
+            FreeTube(v);
+            Simulation->no_tubes--;
+        }
+        Simulation->removed_tubes.clear();
+
+        // compact list of chains...
+        if (compact)
+        {
+            int n = 0;
+            for (int i = 0; i < Simulation->no_tube_chains; i++)
+                if (Simulation->tube_chains[i])
+                {
+                    Simulation->tube_chains[i]->index = n;
+                    Simulation->tube_chains[n++] = Simulation->tube_chains[i];
+                }
+            Simulation->no_tube_chains = n;
+        }
     }
 
 
     void AddTubesToMerge(anyTube *v1, anyTube *v2)
     {
-        if (NoTubeMerge < SimulationSettings.max_tube_merge)
+        if (Simulation->no_tube_merge < Simulation->settings.max_tube_merge)
         {
-            v1 = FindFirstTube(v1);
-            v2 = FindFirstTube(v2);
+            anyTubeChain *c1 = v1->chain;
+            anyTubeChain *c2 = v2->chain;
 
-            // tube cannot be merged more than once in one simulation step...
-            for (int i = 0; i < NoTubeMerge; i++)
-                if (TubelMerge[i].t1 == v1 || TubelMerge[i].t2 == v1 || TubelMerge[i].t1 == v2 || TubelMerge[i].t2 == v2)
-                    return;
+            // chain cannot be merged more than once in one simulation step...
+            if (c1 == c2 || c1->merging || c2->merging)
+                return;
 
-            TubelMerge[NoTubeMerge].t1 = v1;
-            TubelMerge[NoTubeMerge].t2 = v2;
+            c1->merging = c2->merging = true;
+            Simulation->tube_merge[Simulation->no_tube_merge].t1 = c1->head;
+            Simulation->tube_merge[Simulation->no_tube_merge].t2 = c2->head;
 
-            NoTubeMerge++;
+            Simulation->no_tube_merge++;
         }
     }
 
@@ -2454,13 +3696,17 @@ namespace scene {
     {
         StartTimer(TimerMergeTubesId);
 
-        for (int i = 0; i < NoTubeMerge; i++)
+        for (int i = 0; i < Simulation->no_tube_merge; i++)
         {
             // revert chain #1...
-            anyTube *v = TubelMerge[i].t1;
+            anyTubeChain *ch1 = Simulation->tube_merge[i].t1->chain;
+            anyTubeChain *ch2 = Simulation->tube_merge[i].t2->chain;
+            ch1->merging = ch2->merging = false;
+
+            anyTube *v = Simulation->tube_merge[i].t1;
             anyTube *vn = v->next;
-            anyTube *t1 = FindLastTube(TubelMerge[i].t1);
-            anyTube *t2 = FindLastTube(TubelMerge[i].t2);
+            anyTube *t1 = ch1->tail;
+            anyTube *t2 = ch2->tail;
             while (v)
             {
                 SWAP(anyTube *, v->next, v->prev);
@@ -2473,33 +3719,23 @@ namespace scene {
                     vn = v->next;
             }
 
-            if (TubelMerge[i].t1->base)
+            if (Simulation->tube_merge[i].t1->base)
             {
-                TubelMerge[i].t1->base->fork = 0;
-                TubelMerge[i].t1->base->jab = TubelMerge[i].t1;
-            }
-            TubelMerge[i].t1->top = TubelMerge[i].t1->base;
-            TubelMerge[i].t1->base = 0;
-
-            // remove chain #1 from list of chains...
-            for (int j = 0; j < NoTubeChains; j++)
-            {
-                if (TubeChains[j] == TubelMerge[i].t1)
-                {
-                    TubeChains[j] = TubeChains[NoTubeChains - 1];
-                    NoTubeChains--;
-                    break;
-                }
+                Simulation->tube_merge[i].t1->base->fork = 0;
+                Simulation->tube_merge[i].t1->base->jab = Simulation->tube_merge[i].t1;
             }
+            Simulation->tube_merge[i].t1->top = Simulation->tube_merge[i].t1->base;
+            Simulation->tube_merge[i].t1->base = 0;
 
-            // connect chains...
-            t2->next = t1;
-            t1->prev = t2;
+            // connect chains (chain #1 is removed from list of chains)...
+            ch1->head = t1;
+            ch1->tail = Simulation->tube_merge[i].t1;
+            AppendTubeChain(t2, ch1);
 
             LOG(llDebug, "Chains merged");
         }
 
-        NoTubeMerge = 0;
+        Simulation->no_tube_merge = 0;
 
 
         StopTimer(TimerMergeTubesId);
@@ -2508,7 +3744,7 @@ namespace scene {
 
     anyTissueSettings *FindTissueSettingById(int id)
 {
-    anyTissueSettings *ts = FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
     while (ts)
     {
         if (ts->id == id)
@@ -17,13 +17,18 @@
 #include "anytissuesettings.h"
 #include "anytube.h"
 #include "anytubemerge.h"
+#include "anytubechain.h"
 #include "anytubebox.h"
+#include "anytissueinteraction.h"
 
 
 class anyCellBlock;
 class anyBarrier;
 class anyTubeBundle;
 class anyTubeLine;
+class anyOutputSnapshot;
+class anyOutputJob;
+class anySimulation;
 
 namespace scene {
     extern anyBarrier *FirstBarrier;
@@ -34,16 +39,7 @@ namespace scene {
     extern anyTubeLine *LastTubeLine;
     extern anyTubeBundle *FirstTubeBundle;
     extern anyTubeBundle *LastTubeBundle;
-    extern anyTissueSettings *FirstTissueSettings;
-    extern anyTissueSettings *LastTissueSettings;
-    extern int NoTissueSettings;
-    extern anyCell *Cells;
-    extern anyTube **TubeChains;
-    extern float ***Concentrations;
-    extern int NoTubeChains;
-    extern int NoTubes;
-    extern int LastTubeId;
-    extern anyTubeBox *BoxedTubes;
+    extern anyInteractionSettings *FirstInteractionSettings;
     extern anyTissueSettings *FindTissueSettings(char const *name);
 
     void AddTissueSettings(anyTissueSettings *ts);
@@ -52,8 +48,14 @@ namespace scene {
     void SaveTissueSettings_ag(FILE *f, anyTissueSettings const *ts, bool save_header);
     void SaveAllTissueSettings_ag(FILE *f);
     void DeallocateTissueSettings();
+    void CopyTissueSettings(anySimulation const *src);
     anyTissueSettings *FindTissueSettingById(int id);
 
+    void UpdateTissueInteractions();
+    void ParseInteractionSettings(FILE *f);
+    void SaveAllInteractionSettings_ag(FILE *f);
+    void DeallocateInteractionSettings();
+
     void AddBarrier(anyBarrier *b);
     void RemoveBarrier(anyBarrier *b);
     void ParseBarrier(FILE *f, anyBarrier *b, bool add_to_scene);
@@ -77,8 +79,10 @@ namespace scene {
     void AddCell(anyCell *c);
     void ParseCellValue(FILE *f, anyCell *c);
     void ParseCell(FILE *f);
-    void SaveCell_ag(FILE *f, anyCell *c);
-    void SaveAllCells_ag(FILE *f);
+    void ParseCells(FILE *f);
+    void SaveCell_ag(FILE *f, anyCell const *c, int frame);
+    void SaveAllCells_ag(FILE *f, anyOutputSnapshot const *s);
+    void SaveCells_ag(FILE *f, anyOutputSnapshot const *s);
 
     void AddTubeLine(anyTubeLine *vl);
     void RemoveTubeLine(anyTubeLine *vl);
@@ -103,20 +107,39 @@ namespace scene {
     void SetTubeMass(anyTube *v);
     void ParseTubeValue(FILE *f, anyTube *v);
     void ParseTube(FILE *f);
+    void ParseTubes(FILE *f);
     void SaveTube_ag(FILE *f, anyTube *v);
-    void SaveAllTubes_ag(FILE *f);
+    void SaveAllTubes_ag(FILE *f, anyOutputSnapshot const *s);
+    void SaveTubes_ag(FILE *f, anyOutputSnapshot const *s);
     void SmoothTubeTips(anyTube const *v, anyVector &pos1, anyVector &pos2);
     bool TubesJoined(anyTube *v1, anyTube *v2);
     anyTube *FindTubeById(int id, bool current);
+    void IndexTube(anyTube *v);
+    void UnindexTube(anyTube *v);
+    void IndexTubes();
     void RelinkTubes();
     anyTube *FindFirstTube(anyTube *v);
     anyTube *FindLastTube(anyTube *v);
+    anyTubeChain *AddTubeChain(anyTube *head);
+    void RemoveTubeChain(anyTubeChain *ch);
+    void AppendTube(anyTube *tail, anyTube *v);
+    void AppendTubeChain(anyTube *tail, anyTubeChain *ch);
+    anyTube *NewTube();
+    void FreeTube(anyTube *v);
+    void QueueTubeRemoval(anyTube *v);
+    void RemoveQueuedTubes();
 
     void AddTubesToMerge(anyTube *v1, anyTube *v2);
     void MergeTubes();
+    anyOutputJob *CapturePovRay(char const *povfname, bool save_ani);
     void SavePovRay(char const *povfname, bool save_ani);
-    void SaveVTK();
+    anyOutputJob *CaptureVTK(char const *fname, bool time_series);
+    void SaveVTK(char const *fname);
+    void SaveAG(FILE *f, anyOutputSnapshot const *s, bool save_cells_and_tubes);
+    anyOutputJob *CaptureAG(char const *fname, bool save_cells_and_tubes);
     void SaveAG(char const *fname, bool save_cells_and_tubes);
+    void SaveTrajectoryFrame();
+    void CloseTrajectory();
 
     void AllocSimulation();
     void DeallocSimulation();
@@ -12,6 +12,7 @@
 #include "log.h"
 #include "timers.h"
 #include "scene.h"
+#include "simulation.h"
 
 #include "anytube.h"
 #include "anybarrier.h"
@@ -58,10 +59,27 @@ and tend to be at their highest levels in S and at their lowest near mitosis.
 */
 
 
-// random number generator
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_int_distribution<> dis(0, 12);
+// Hot kernels are templates on number of dimensions (DIM) and on enabled force/diffusion phases (PHASES).
+// DISPATCH_KERNEL() selects matching instantiation once per step (see kernel_phases()), so per-pair
+// tests of Simulation->settings.dimensions and Simulation->settings.sim_phases are resolved at compile time.
+#define KERNEL_PHASES (sat::spForces | sat::spDiffusion)
+#define DISPATCH_KERNEL_DIM(kernel, dim) \
+    switch (kernel_phases()) \
+    { \
+        case 0: kernel<dim, 0>(); break; \
+        case sat::spForces: kernel<dim, sat::spForces>(); break; \
+        case sat::spDiffusion: kernel<dim, sat::spDiffusion>(); break; \
+        default: kernel<dim, KERNEL_PHASES>(); break; \
+    }
+#define DISPATCH_KERNEL(kernel) \
+    if (Simulation->settings.dimensions == 2) \
+    { \
+        DISPATCH_KERNEL_DIM(kernel, 2) \
+    } \
+    else \
+    { \
+        DISPATCH_KERNEL_DIM(kernel, 3) \
+    }
 
 
 // SPH kernel functions
@@ -156,14 +174,14 @@ void cell_density_box2(int box1_first_cell, int box1_no_cells, int box2_x, int b
         return;
 
     int box2_box_id = BOX_ID(box2_x, box2_y, box2_z);
-    int box2_first_cell = box2_box_id*SimulationSettings.max_cells_per_box;
-    int box2_no_cells = scene::Cells[box2_first_cell].no_cells_in_box;
+    int box2_first_cell = box2_box_id*Simulation->settings.max_cells_per_box;
+    int box2_no_cells = Simulation->cells[box2_first_cell].no_cells_in_box;
 
     if (!box2_no_cells) return;
 
     for (int i = 0; i < box1_no_cells; i++)
         for (int j = 0; j < box2_no_cells; j++)
-            cell_density(scene::Cells + box1_first_cell + i, scene::Cells + box2_first_cell + j);
+            cell_density(Simulation->cells + box1_first_cell + i, Simulation->cells + box2_first_cell + j);
 }
 
 void CalculateCellsDensities(){
@@ -175,18 +193,18 @@ void CalculateCellsDensities(){
     int first_cell = 0;
     int no_cells;
 
-    for (int box_z = 0; box_z < SimulationSettings.no_boxes_z; box_z++)
-        for (int box_y = 0; box_y < SimulationSettings.no_boxes_y; box_y++)
-            for (int box_x = 0; box_x < SimulationSettings.no_boxes_x; box_x++, box_id++)
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
             {
-                no_cells = scene::Cells[first_cell].no_cells_in_box;
+                no_cells = Simulation->cells[first_cell].no_cells_in_box;
 
                 if (no_cells)
                 {
                     // inner-box forces...
                     for (int i = 0; i < no_cells - 1; i++)
                         for (int j = i + 1; j < no_cells; j++)
-                            cell_density(scene::Cells + first_cell + i, scene::Cells + first_cell + j);
+                            cell_density(Simulation->cells + first_cell + i, Simulation->cells + first_cell + j);
 
                     // inter-box forces...
                     // (+1, 0, 0)...
@@ -201,13 +219,13 @@ void CalculateCellsDensities(){
                     // (-1, +1, 0)...
                     cell_density_box2(first_cell, no_cells, box_x - 1, box_y + 1, box_z);
 
-                    if (box_z < SimulationSettings.no_boxes_z - 1)
+                    if (box_z < Simulation->settings.no_boxes_z - 1)
                         for (int dx = -1; dx <= 1; dx++)
                             for (int dy = -1; dy <= 1; dy++)
                                 // (dx, dy, +1)...
                                 cell_density_box2(first_cell, no_cells, box_x + dx, box_y + dy, box_z + 1);
                 }
-                first_cell += SimulationSettings.max_cells_per_box;
+                first_cell += Simulation->settings.max_cells_per_box;
             }
 
     StopTimer(TimerDensitiesId);
@@ -250,7 +268,7 @@ int conc_step_current()
   \returns index in concentations[] array associated with current simulation step.
 */
 {
-    return SimulationSettings.step % 2;
+    return Simulation->settings.step % 2;
 }
 
 
@@ -262,7 +280,47 @@ int conc_step_prev()
   \returns index in concentations[] array associated with previous simulation step.
 */
 {
-    return !(SimulationSettings.step % 2);
+    return !(Simulation->settings.step % 2);
+}
+
+
+inline
+int sub_steps(int every)
+/**
+  Returns number of steps covered by one update of process updated every n-th step.
+
+  \param every -- update interval [steps] (values < 1 mean every step)
+*/
+{
+    return every > 1 ? every : 1;
+}
+
+
+inline
+bool sub_step_due(int every)
+/**
+  Checks if process updated every n-th step should be updated in current step.
+
+  \param every -- update interval [steps]
+*/
+{
+    return Simulation->settings.step % sub_steps(every) == 0;
+}
+
+
+static
+unsigned kernel_phases()
+/**
+  Returns force/diffusion phases of DISPATCH_KERNEL() kernels in current step.
+  Diffusion is skipped in steps between its updates (Simulation->settings.diffusion_every).
+*/
+{
+    unsigned phases = Simulation->settings.sim_phases & KERNEL_PHASES;
+
+    if (!sub_step_due(Simulation->settings.diffusion_every))
+        phases &= ~sat::spDiffusion;
+
+    return phases;
 }
 
 
@@ -296,6 +354,7 @@ void limit_velocity(anyVector &v, float limit)
 }
 
 
+template <int DIM>
 void GrowCell(anyCell *c)
 /**
   Growth of cell.
@@ -314,26 +373,27 @@ void GrowCell(anyCell *c)
 {
 //    static bool mutation = true;
     anyTissueSettings *tissue = c->tissue;
+    std::uniform_int_distribution<> dis(0, 12);
 
-    if (SimulationSettings.dimensions == 2)
+    if (DIM == 2)
         c->force.z = 0;
 
     // move...
 
     // dv = F/m*dt...
-    anyVector dv(c->force.x*SimulationSettings.time_step*c->one_by_mass,
-                 c->force.y*SimulationSettings.time_step*c->one_by_mass,
-                 c->force.z*SimulationSettings.time_step*c->one_by_mass);
+    anyVector dv(c->force.x*Simulation->settings.time_step*c->one_by_mass,
+                 c->force.y*Simulation->settings.time_step*c->one_by_mass,
+                 c->force.z*Simulation->settings.time_step*c->one_by_mass);
 
     // v += dv...
     c->velocity += dv;
 
-    //limit_velocity(c->velocity, SimulationSettings.time_step);
+    //limit_velocity(c->velocity, Simulation->settings.time_step);
 
     // dr = v*dt
-    anyVector dr(c->velocity.x*SimulationSettings.time_step,
-                 c->velocity.y*SimulationSettings.time_step,
-                 c->velocity.z*SimulationSettings.time_step);
+    anyVector dr(c->velocity.x*Simulation->settings.time_step,
+                 c->velocity.y*Simulation->settings.time_step,
+                 c->velocity.z*Simulation->settings.time_step);
 
     if (dr.length2() > 1) dr.normalize();
 
@@ -344,7 +404,7 @@ void GrowCell(anyCell *c)
     c->velocity *= 0.5; //@@@
 
 
-    if (SimulationSettings.step % 10 == 0)
+    if (Simulation->settings.step % 10 == 0)
     {
         c->pos_h2 = c->pos_h1;
         c->pos_h1 = c->pos;
@@ -359,7 +419,7 @@ void GrowCell(anyCell *c)
 //    else
 
     c->concentrations[sat::dsO2][conc_step_current()] -= c->tissue->o2_consumption * c->tissue->density
-            / 10e18 * SimulationSettings.time_step / SimulationSettings.max_o2_concentration / 10;
+            / 10e18 * Simulation->settings.time_step / Simulation->settings.max_o2_concentration / 10;
     normalize_conc(c->concentrations[sat::dsO2][conc_step_current()]);
 
     // TAF production...
@@ -372,19 +432,19 @@ void GrowCell(anyCell *c)
     // Pericytes production....
     if (c->state == sat::csAlive)
     {
-        c->concentrations[sat::dsPericytes][conc_step_current()] += c->tissue->pericyte_production * SimulationSettings.time_step;
+        c->concentrations[sat::dsPericytes][conc_step_current()] += c->tissue->pericyte_production * Simulation->settings.time_step;
         normalize_conc(c->concentrations[sat::dsPericytes][conc_step_current()]);
     }
 
     // Medicine diffusion -> if added and not removed
-    if (SimulationSettings.add_medicine < SimulationSettings.step){
-        c->concentrations[sat::dsMedicine][conc_step_current()] -= c->tissue->medicine_consumption * c->tissue->density / 10e18 * SimulationSettings.time_step / SimulationSettings.max_o2_concentration / 10;
+    if (Simulation->settings.add_medicine < Simulation->settings.step){
+        c->concentrations[sat::dsMedicine][conc_step_current()] -= c->tissue->medicine_consumption * c->tissue->density / 10e18 * Simulation->settings.time_step / Simulation->settings.max_o2_concentration / 10;
         normalize_conc(c->concentrations[sat::dsMedicine][conc_step_current()]);
     }
 
-    // Check for how long is medicine concentration above threshold (should be SimulationSettings.activation_steps steps to activate)
+    // Check for how long is medicine concentration above threshold (should be Simulation->settings.activation_steps steps to activate)
     if (strcmp(c->tissue->name, "quiescent_mutated") == 0){
-        if (c->concentrations[sat::dsMedicine][conc_step_current()] > SimulationSettings.proliferative_o2){
+        if (c->concentrations[sat::dsMedicine][conc_step_current()] > Simulation->settings.proliferative_o2){
             ++c->state_age_quiescent_mutated;
         }else {
             c->state_age_quiescent_mutated=0;
@@ -392,8 +452,8 @@ void GrowCell(anyCell *c)
     }
     //mitosis
 
-    if (SimulationSettings.sim_phases & sat::spMitosis
-        && SimulationSettings.step > 1  //< pressures are calculated in steps 0 & 1
+    if (Simulation->settings.sim_phases & sat::spMitosis
+        && Simulation->settings.step > 1  //< pressures are calculated in steps 0 & 1
         && c->state == sat::csAlive
         && c->age > tissue->minimum_interphase_time
         && c->r >= tissue->minimum_mitosis_r
@@ -405,7 +465,7 @@ void GrowCell(anyCell *c)
     {
         // displacement...
         anyVector d;
-        d.set_random(SimulationSettings.dimensions, 0.5*c->r);
+        d.set_random(DIM, 0.5*c->r);
 
         // shrink cell...
         c->r *= 0.79;
@@ -428,8 +488,8 @@ void GrowCell(anyCell *c)
     }
 
     // tissue becomes quiescent -> 02
-    if (SimulationSettings.sim_phases & sat::spMitosis
-        && SimulationSettings.step > 1  //< pressures are calculated in steps 0 & 1
+    if (Simulation->settings.sim_phases & sat::spMitosis
+        && Simulation->settings.step > 1  //< pressures are calculated in steps 0 & 1
         && c->state == sat::csAlive
         && (strcmp(c->tissue->name, "proliferative") == 0)
         && (c->concentrations[sat::dsO2][conc_step_current()] < 0.25)
@@ -442,8 +502,8 @@ void GrowCell(anyCell *c)
     }
 
     // quiescent tissue becomes mutated quiescent -> Medicine
-    if (SimulationSettings.sim_phases & sat::spMitosis
-        && SimulationSettings.step > 1  //< pressures are calculated in steps 0 & 1
+    if (Simulation->settings.sim_phases & sat::spMitosis
+        && Simulation->settings.step > 1  //< pressures are calculated in steps 0 & 1
         && c->state == sat::csAlive
         && (strcmp(c->tissue->name, "quiescent") == 0)
         && (c->concentrations[sat::dsMedicine][conc_step_current()] > 0.7)
@@ -456,27 +516,27 @@ void GrowCell(anyCell *c)
     }
 
     // proliferative tissue dies or nothing  -> Medicine
-    if (SimulationSettings.sim_phases & sat::spMitosis
-        && SimulationSettings.step > 1  //< pressures are calculated in steps 0 & 1
+    if (Simulation->settings.sim_phases & sat::spMitosis
+        && Simulation->settings.step > 1  //< pressures are calculated in steps 0 & 1
         && c->state == sat::csAlive
         && (strcmp(c->tissue->name, "proliferative") == 0)
         && (c->concentrations[sat::dsMedicine][conc_step_current()] >= 0.7)
-        && dis(gen) > 6
+        && dis(Simulation->random) > 6
         )
     {
             change_cell_state(c, sat::csNecrosis);
     }
 
     // mutated quiescent tissue becomes proliferative, dies or stay mutated Q  -> Medicine
-    if (SimulationSettings.sim_phases & sat::spMitosis
-        && SimulationSettings.step > 1  //< pressures are calculated in steps 0 & 1
+    if (Simulation->settings.sim_phases & sat::spMitosis
+        && Simulation->settings.step > 1  //< pressures are calculated in steps 0 & 1
         && c->state == sat::csAlive
         && (strcmp(c->tissue->name, "quiescent_mutated") == 0)
         && (c->concentrations[sat::dsMedicine][conc_step_current()] >= 0.7)
         )
     {
-        if (c->state_age_quiescent_mutated > SimulationSettings.activation_steps){
-            int x = dis(gen);
+        if (c->state_age_quiescent_mutated > Simulation->settings.activation_steps){
+            int x = dis(Simulation->random);
             if (x < 4)
             {
                 change_cell_state(c, sat::csNecrosis);
@@ -517,7 +577,7 @@ void GrowCell(anyCell *c)
                 )
         {
             // growing...
-            c->r += c->tissue->cell_grow_speed*SimulationSettings.time_step;
+            c->r += c->tissue->cell_grow_speed*Simulation->settings.time_step;
             if (c->r > tissue->cell_r)
                 c->r = tissue->cell_r;
             scene::SetCellMass(c);
@@ -536,7 +596,7 @@ void GrowCell(anyCell *c)
         else if(c->r > tissue->dead_r)
         {
             // shrinking...
-            c->r -= tissue->cell_shrink_speed*SimulationSettings.time_step;
+            c->r -= tissue->cell_shrink_speed*Simulation->settings.time_step;
             if (c->r < tissue->dead_r)
                 c->r = tissue->dead_r;
             scene::SetCellMass(c);
@@ -548,8 +608,29 @@ void GrowCell(anyCell *c)
 
 
     // update timers...
-    c->age += SimulationSettings.time_step;
-    c->state_age += SimulationSettings.time_step;
+    c->age += Simulation->settings.time_step;
+    c->state_age += Simulation->settings.time_step;
+}
+
+
+template <int DIM>
+void grow_all_cells()
+/**
+  Growth of all cells (DIM-dimensional simulation).
+*/
+{
+    // loop over all cells...
+    int first_cell = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+    {
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
+        for (int i = 0; i < no_cells; i++)
+            // grow only active cells...
+            if (Simulation->cells[first_cell + i].state != sat::csRemoved)
+                GrowCell<DIM>(Simulation->cells + first_cell + i);
+
+        first_cell += Simulation->settings.max_cells_per_box;
+    }
 }
 
 
@@ -558,22 +639,14 @@ void GrowAllCells()
   Growth of all cells.
 */
 {
-    if (SimulationSettings.sim_phases & sat::spGrow)
+    if (Simulation->settings.sim_phases & sat::spGrow)
     {
         StartTimer(TimerCellGrowId);
 
-        // loop over all cells...
-        int first_cell = 0;
-        for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
-        {
-            int no_cells = scene::Cells[first_cell].no_cells_in_box;
-            for (int i = 0; i < no_cells; i++)
-                // grow only active cells...
-                if (scene::Cells[first_cell + i].state != sat::csRemoved)
-                    GrowCell(scene::Cells + first_cell + i);
-
-            first_cell += SimulationSettings.max_cells_per_box;
-        }
+        if (Simulation->settings.dimensions == 2)
+            grow_all_cells<2>();
+        else
+            grow_all_cells<3>();
 
         StopTimer(TimerCellGrowId);
     }
@@ -588,22 +661,22 @@ void UpdateTubes()
     StartTimer(TimerTubeUpdateId);
 
     // reset boxes...
-    for (int i = 0; i < SimulationSettings.no_boxes; i++)
-        scene::BoxedTubes[i].no_tubes = 0;
+    for (int i = 0; i < Simulation->settings.no_boxes; i++)
+        Simulation->boxed_tubes[i].no_tubes = 0;
 
     // loop over all tubes...
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
             // assign to box...
-            int box_x_1 = floor((v->pos1.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-            int box_y_1 = floor((v->pos1.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-            int box_z_1 = floor((v->pos1.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
-            int box_x_2 = floor((v->pos2.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-            int box_y_2 = floor((v->pos2.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-            int box_z_2 = floor((v->pos2.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
+            int box_x_1 = floor((v->pos1.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+            int box_y_1 = floor((v->pos1.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+            int box_z_1 = floor((v->pos1.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
+            int box_x_2 = floor((v->pos2.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+            int box_y_2 = floor((v->pos2.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+            int box_z_2 = floor((v->pos2.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
 
             if (box_x_1 > box_x_2) SWAP(int, box_x_1, box_x_2);
             if (box_y_1 > box_y_2) SWAP(int, box_y_1, box_y_2);
@@ -620,17 +693,17 @@ void UpdateTubes()
             box_y_2++;
             box_z_2++;
 
-            if (box_x_2 >= 0 && box_x_1 < SimulationSettings.no_boxes_x
-                && box_y_2 >= 0 && box_y_1 < SimulationSettings.no_boxes_y
-                && box_z_2 >= 0 && box_z_1 < SimulationSettings.no_boxes_z)
+            if (box_x_2 >= 0 && box_x_1 < Simulation->settings.no_boxes_x
+                && box_y_2 >= 0 && box_y_1 < Simulation->settings.no_boxes_y
+                && box_z_2 >= 0 && box_z_1 < Simulation->settings.no_boxes_z)
             {
 
-                box_x_1 = MIN(MAX(0, box_x_1), SimulationSettings.no_boxes_x - 1);
-                box_y_1 = MIN(MAX(0, box_y_1), SimulationSettings.no_boxes_y - 1);
-                box_z_1 = MIN(MAX(0, box_z_1), SimulationSettings.no_boxes_z - 1);
-                box_x_2 = MIN(MAX(0, box_x_2), SimulationSettings.no_boxes_x - 1);
-                box_y_2 = MIN(MAX(0, box_y_2), SimulationSettings.no_boxes_y - 1);
-                box_z_2 = MIN(MAX(0, box_z_2), SimulationSettings.no_boxes_z - 1);
+                box_x_1 = MIN(MAX(0, box_x_1), Simulation->settings.no_boxes_x - 1);
+                box_y_1 = MIN(MAX(0, box_y_1), Simulation->settings.no_boxes_y - 1);
+                box_z_1 = MIN(MAX(0, box_z_1), Simulation->settings.no_boxes_z - 1);
+                box_x_2 = MIN(MAX(0, box_x_2), Simulation->settings.no_boxes_x - 1);
+                box_y_2 = MIN(MAX(0, box_y_2), Simulation->settings.no_boxes_y - 1);
+                box_z_2 = MIN(MAX(0, box_z_2), Simulation->settings.no_boxes_z - 1);
 
                 int cnt = 0;
                 for (int box_x = box_x_1; box_x <= box_x_2; box_x++)
@@ -638,8 +711,8 @@ void UpdateTubes()
                         for (int box_z = box_z_1; box_z <= box_z_2; box_z++)
                         {
                     int box_id = BOX_ID(box_x, box_y, box_z);
-                    if (scene::BoxedTubes[box_id].no_tubes < SimulationSettings.max_cells_per_box)
-                        scene::BoxedTubes[box_id].tubes[scene::BoxedTubes[box_id].no_tubes++] = v;
+                    if (Simulation->boxed_tubes[box_id].no_tubes < Simulation->settings.max_cells_per_box)
+                        Simulation->boxed_tubes[box_id].tubes[Simulation->boxed_tubes[box_id].no_tubes++] = v;
                     cnt++;
                 }
             }
@@ -664,57 +737,57 @@ void RearrangeCells()
     StartTimer(TimerRearangeId);
 
     // loop over all cells...
-    SimulationSettings.max_max_cells_per_box = 0;
+    Simulation->settings.max_max_cells_per_box = 0;
     int first_cell = 0;
     int box_id = 0;
-    for (int box_z = 0; box_z < SimulationSettings.no_boxes_z; box_z++)
-        for (int box_y = 0; box_y < SimulationSettings.no_boxes_y; box_y++)
-            for (int box_x = 0; box_x < SimulationSettings.no_boxes_x; box_x++, box_id++)
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
             {
-                int no_cells = scene::Cells[first_cell].no_cells_in_box;
-                if (no_cells > SimulationSettings.max_max_cells_per_box)
-                    SimulationSettings.max_max_cells_per_box = no_cells;
+                int no_cells = Simulation->cells[first_cell].no_cells_in_box;
+                if (no_cells > Simulation->settings.max_max_cells_per_box)
+                    Simulation->settings.max_max_cells_per_box = no_cells;
                 for (int i = 0; i < no_cells; i++)
                 {
                     // promote cell?...
-                    if (scene::Cells[first_cell + i].state == sat::csAdded)
-                        scene::Cells[first_cell + i].state = sat::csAlive;
+                    if (Simulation->cells[first_cell + i].state == sat::csAdded)
+                        Simulation->cells[first_cell + i].state = sat::csAlive;
                     // remove cell?
-                    else if (scene::Cells[first_cell + i].state == sat::csRemoved)
+                    else if (Simulation->cells[first_cell + i].state == sat::csRemoved)
                     {
                         // remove cell...
-                        scene::Cells[first_cell + i].tissue->no_cells[0]--;
+                        Simulation->cells[first_cell + i].tissue->no_cells[0]--;
                         if (i != no_cells - 1)
-                            scene::Cells[first_cell + i] = scene::Cells[first_cell + no_cells - 1];
-                        scene::Cells[first_cell].no_cells_in_box = no_cells - 1;
+                            Simulation->cells[first_cell + i] = Simulation->cells[first_cell + no_cells - 1];
+                        Simulation->cells[first_cell].no_cells_in_box = no_cells - 1;
                         i--;
                         no_cells--;
                         continue;
                     }
 
                     // move to other box?...
-                    if (floor((scene::Cells[first_cell + i].pos.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size) != box_x
-                        || floor((scene::Cells[first_cell + i].pos.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size) != box_y
-                        || floor((scene::Cells[first_cell + i].pos.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size) != box_z)
+                    if (floor((Simulation->cells[first_cell + i].pos.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size) != box_x
+                        || floor((Simulation->cells[first_cell + i].pos.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size) != box_y
+                        || floor((Simulation->cells[first_cell + i].pos.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size) != box_z)
                     {
                         // add cell to proper box...
-                        scene::AddCell(scene::Cells + first_cell + i);
+                        scene::AddCell(Simulation->cells + first_cell + i);
 
-                        scene::Cells[first_cell + i].tissue->no_cells[0]--;
+                        Simulation->cells[first_cell + i].tissue->no_cells[0]--;
                         if (i != no_cells - 1)
-                            scene::Cells[first_cell + i] = scene::Cells[first_cell + no_cells - 1];
-                        scene::Cells[first_cell].no_cells_in_box = no_cells - 1;
+                            Simulation->cells[first_cell + i] = Simulation->cells[first_cell + no_cells - 1];
+                        Simulation->cells[first_cell].no_cells_in_box = no_cells - 1;
                         i--;
                         no_cells--;
                         continue;
                     }
                 }
 
-                first_cell += SimulationSettings.max_cells_per_box;
+                first_cell += Simulation->settings.max_cells_per_box;
             }
 
-    if (SimulationSettings.max_max_max_cells_per_box < SimulationSettings.max_max_cells_per_box)
-        SimulationSettings.max_max_max_cells_per_box = SimulationSettings.max_max_cells_per_box;
+    if (Simulation->settings.max_max_max_cells_per_box < Simulation->settings.max_max_cells_per_box)
+        Simulation->settings.max_max_max_cells_per_box = Simulation->settings.max_max_cells_per_box;
     StopTimer(TimerRearangeId);
 }
 
@@ -724,9 +797,10 @@ void ConnectTubeChains()
     StartTimer(TimerConnectTubeChainsId);
 
     // find all tubes which start in last tube in the other chain...
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *vl = scene::FindLastTube(scene::TubeChains[i]);
+        anyTubeChain *ch = Simulation->tube_chains[i];
+        anyTube *vl = ch->tail;
 
         // case #1...
         if (vl->top && !vl->top->next && !vl->top->top)
@@ -739,15 +813,14 @@ void ConnectTubeChains()
             vl->top = 0;
         }
 
-        // case #2...
-        if (scene::TubeChains[i]->base && !scene::TubeChains[i]->base->next && !scene::TubeChains[i]->base->top)
+        // case #2 (not while any of chains waits for merge, appending would drop the merge)...
+        anyTube *base = ch->head->base;
+        if (base && !base->next && !base->top && !ch->merging && !base->chain->merging)
         {
-            scene::TubeChains[i]->base->next = scene::TubeChains[i];
-            scene::TubeChains[i]->base->fork = 0;
-            scene::TubeChains[i]->prev = scene::TubeChains[i]->base;
-            scene::TubeChains[i]->base = 0;
+            base->fork = 0;
+            ch->head->base = 0;
 
-            scene::TubeChains[i] = scene::TubeChains[--scene::NoTubeChains];
+            scene::AppendTubeChain(base, ch);
             i--;
         }
     }
@@ -787,7 +860,7 @@ void calc_force_dissipative_and_random(anyVector const &p1, anyVector const &p2,
     if (r_len2 == 0) return;
 
     float r_len = sqrt(r_len2);
-    float omega = 1 - r_len/(SimulationSettings.force_r_cut + radius);
+    float omega = 1 - r_len/(Simulation->settings.force_r_cut + radius);
     float w = omega/r_len2;
 
     // dissipative force...
@@ -800,6 +873,7 @@ void calc_force_dissipative_and_random(anyVector const &p1, anyVector const &p2,
 }
 
 
+template <int DIM, unsigned PHASES>
 static
 bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, float &dp, float r, float force_rep_factor, float force_attr1_factor, float force_attr2_factor, bool do_r_cut)
 /**
@@ -828,17 +902,17 @@ bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, floa
     // points in exactly same location...
     if (d_c1c2_len2 == 0)
     {
-        d_c1c2.set_random(SimulationSettings.dimensions, r*0.05);
+        d_c1c2.set_random(DIM, r*0.05);
         d_c1c2_len2 = d_c1c2.length2();
     }
 
     float d_c1c2_len = sqrt(d_c1c2_len2);
     float dr_len = d_c1c2_len - r;
 
-    if (do_r_cut && dr_len > SimulationSettings.force_r_cut)
+    if (do_r_cut && dr_len > Simulation->settings.force_r_cut)
         return false;
 
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (PHASES & sat::spForces)
     {
 
         anyVector dr = d_c1c2*(dr_len/d_c1c2_len);
@@ -850,7 +924,7 @@ bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, floa
 
             dp = force.length();
         }
-        else if (dr_len < SimulationSettings.force_r_peak || !do_r_cut)
+        else if (dr_len < Simulation->settings.force_r_peak || !do_r_cut)
         {
             // attraction (near)...
             force = dr * force_attr1_factor;
@@ -860,7 +934,7 @@ bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, floa
         else
         {
             // attraction (far)...
-            force = dr * (-force_attr2_factor * (dr_len - SimulationSettings.force_r_cut)/dr_len);
+            force = dr * (-force_attr2_factor * (dr_len - Simulation->settings.force_r_cut)/dr_len);
 
             dp = -force.length();
         }
@@ -869,18 +943,84 @@ bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, floa
     return true;
 }
 
+
+static
+bool calc_force(anyVector const &p1, anyVector const &p2, anyVector &force, float &dp, float r, float force_rep_factor, float force_attr1_factor, float force_attr2_factor, bool do_r_cut)
+/**
+  Calculates forces between two spheres (calc_force<>() selected by current simulation settings).
+*/
+{
+    bool forces = Simulation->settings.sim_phases & sat::spForces;
+
+    if (Simulation->settings.dimensions == 2)
+        return forces
+            ? calc_force<2, sat::spForces>(p1, p2, force, dp, r, force_rep_factor, force_attr1_factor, force_attr2_factor, do_r_cut)
+            : calc_force<2, 0>(p1, p2, force, dp, r, force_rep_factor, force_attr1_factor, force_attr2_factor, do_r_cut);
+    else
+        return forces
+            ? calc_force<3, sat::spForces>(p1, p2, force, dp, r, force_rep_factor, force_attr1_factor, force_attr2_factor, do_r_cut)
+            : calc_force<3, 0>(p1, p2, force, dp, r, force_rep_factor, force_attr1_factor, force_attr2_factor, do_r_cut);
+}
+
 float vol(float r) {
     return 4.19 * r * r * r;
 }
 
 
+static const float max_exchange_ratio = 1/14.0f / 200.0f; // okolo 14 kul tej samej wielkosci zmiesci sie obok danej kuli;
+                                            //przez 2 zeby wartosci sie nie zamienily, zamienione na 50 zeby bylo stabilne, uzasadnic
+static const float max_diff_speed = 1/(14.0f*max_exchange_ratio); // stability: ~14 neighbours must not take more than whole difference
+
+
+int StableDiffusionInterval()
+/**
+  Returns longest stable diffusion update interval [steps] for cells of mature size
+  (smallest cell_r of tissues). Longer intervals (Simulation->settings.diffusion_every)
+  are limited to stable step in concentration_exchange().
+
+  \returns stable interval or 0 if diffusion is not limited (no tissues or no diffusion).
+*/
+{
+    float max_coeff = 0;
+    for (int sub = 0; sub < sat::dsLast; sub++)
+        max_coeff = MAX(max_coeff, Simulation->settings.diffusion_coeff[sub]);
+
+    float min_r = 0;
+    for (anyTissueSettings *ts = Simulation->first_tissue_settings; ts; ts = ts->next)
+        if (ts->cell_r > 0 && (!min_r || ts->cell_r < min_r))
+            min_r = ts->cell_r;
+
+    float speed = max_coeff*Simulation->settings.time_step/(4*min_r*min_r);
+    if (!min_r || speed <= 0)
+        return 0;
+
+    return MAX(1, int(MIN(max_diff_speed/speed, 1e9f)));
+}
+
+
+void CheckDiffusionInterval()
+/**
+  Logs warning if diffusion update interval is longer than stable one (diffusion would
+  cover less time than simulation).
+*/
+{
+    int stable = StableDiffusionInterval();
+    if (stable && Simulation->settings.diffusion_every > stable)
+    {
+        char s[100];
+        snprintf(s, sizeof(s), "%d (stable: %d), diffusion is slowed down", Simulation->settings.diffusion_every, stable);
+        LOG2(llError, "Warning: diffusion_every is longer than stable interval: ", s);
+    }
+}
+
+
 static
 void concentration_exchange(float conc1[sat::dsLast][2], float conc2[sat::dsLast][2], float r1, float r2, float dist2, bool bidirectional = true)
 {
     int current_frame = conc_step_current();
     int prev_frame = conc_step_prev();
-    const float max_exchange_ratio = 1/14.0f / 200.0f; // okolo 14 kul tej samej wielkosci zmiesci sie obok danej kuli;
-                                            //przez 2 zeby wartosci sie nie zamienily, zamienione na 50 zeby bylo stabilne, uzasadnic
+    anySimulationSettings const &settings = Simulation->settings;
+    int diff_sub_steps = sub_steps(settings.diffusion_every);
 
     //exchange oxygen and TAF concentrations
     //zuzycie jak w modelu z siecia
@@ -899,7 +1039,12 @@ void concentration_exchange(float conc1[sat::dsLast][2], float conc2[sat::dsLast
 //            if (dist2 < (r1+r2)*(r1+r2)) qDebug("%.2f %.2f", sqrt(dist2), (r1+r2));
             float movingMass = diffLevel * min_vol * max_exchange_ratio;
             //@@@
-            float diffSpeed = SimulationSettings.diffusion_coeff[sub] * SimulationSettings.time_step / dist2;
+            float diffSpeed = settings.diffusion_coeff[sub] * settings.time_step / dist2;
+
+            // sub-cycled diffusion: diff_sub_steps steps at once, limited to stable step
+            // (see CheckDiffusionInterval())...
+            if (diff_sub_steps > 1 && diffSpeed > 0)
+                diffSpeed *= MIN(float(diff_sub_steps), MAX(1.0f, max_diff_speed/diffSpeed));
 //            qDebug("%f", dist2);
 
             if (bidirectional)
@@ -915,6 +1060,7 @@ void concentration_exchange(float conc1[sat::dsLast][2], float conc2[sat::dsLast
 }
 
 
+template <int DIM, unsigned PHASES>
 static
 void cell_cell_force(anyCell *c1, anyCell *c2)
 /**
@@ -926,27 +1072,29 @@ void cell_cell_force(anyCell *c1, anyCell *c2)
 {
     anyVector force;
     float dp;
+    anySimulation const *sim = Simulation;
+    anyTissueInteraction const &ti = sim->tissue_interactions[c1->tissue->id*sim->no_tissue_ids + c2->tissue->id];
 
 
-    if (!calc_force(c1->pos, c2->pos,
+    if (!calc_force<DIM, PHASES>(c1->pos, c2->pos,
                    force, dp,
                    c1->r + c2->r,
-                   (c1->tissue->force_rep_factor + c2->tissue->force_rep_factor)*0.5,
-                   (c1->tissue->force_atr1_factor + c2->tissue->force_atr1_factor)*0.5,
-                   (c1->tissue->force_atr2_factor + c2->tissue->force_atr2_factor)*0.5,
+                   ti.force_rep_factor,
+                   ti.force_atr1_factor,
+                   ti.force_atr2_factor,
                    true))
         return;
 
     c1->nei_cnt[c2->tissue->type]++;
     c2->nei_cnt[c1->tissue->type]++;
 
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (PHASES & sat::spForces)
     {
         calc_force_dissipative_and_random(c1->pos, c2->pos,
                  c1->r + c2->r,
                  c1->velocity, c2->velocity,
-                 (c1->tissue->force_dpd_factor + c2->tissue->force_dpd_factor)*0.5,
-                 (c1->tissue->dpd_temperature + c2->tissue->dpd_temperature)*0.5,
+                 ti.force_dpd_factor,
+                 ti.dpd_temperature,
                  force);
 
         c1->force += force;
@@ -974,7 +1122,7 @@ void cell_cell_force(anyCell *c1, anyCell *c2)
         c2->pressure_sum += c1->pressure_prev;
     }
 
-    if (SimulationSettings.sim_phases & sat::spDiffusion)
+    if (PHASES & sat::spDiffusion)
     {
         concentration_exchange(c1->concentrations, c2->concentrations,
                                c1->r, c2->r,
@@ -983,6 +1131,7 @@ void cell_cell_force(anyCell *c1, anyCell *c2)
 }
 
 
+template <int DIM, unsigned PHASES>
 static
 void cell_cell_forces_box2(int box1_first_cell, int box1_no_cells, int box2_x, int box2_y, int box2_z)
 /**
@@ -999,64 +1148,76 @@ void cell_cell_forces_box2(int box1_first_cell, int box1_no_cells, int box2_x, i
         return;
 
     int box2_box_id = BOX_ID(box2_x, box2_y, box2_z);
-    int box2_first_cell = box2_box_id*SimulationSettings.max_cells_per_box;
-    int box2_no_cells = scene::Cells[box2_first_cell].no_cells_in_box;
+    anyCell *cells = Simulation->cells;
+    int box2_first_cell = box2_box_id*Simulation->settings.max_cells_per_box;
+    int box2_no_cells = cells[box2_first_cell].no_cells_in_box;
 
     if (!box2_no_cells) return;
 
     for (int i = 0; i < box1_no_cells; i++)
         for (int j = 0; j < box2_no_cells; j++)
-            cell_cell_force(scene::Cells + box1_first_cell + i, scene::Cells + box2_first_cell + j);
+            cell_cell_force<DIM, PHASES>(cells + box1_first_cell + i, cells + box2_first_cell + j);
 }
 
 
-void CellCellForces()
+template <int DIM, unsigned PHASES>
+static
+void cell_cell_forces()
 /**
-  Calculates forces between cells.
+  Calculates forces between cells (kernel of CellCellForces()).
 */
 {
-    StartTimer(TimerCellCellForcesId);
-
-
-    // calculate forces...
+    anyCell *cells = Simulation->cells;
     int box_id = 0;
     int first_cell = 0;
     int no_cells;
 
-    for (int box_z = 0; box_z < SimulationSettings.no_boxes_z; box_z++)
-        for (int box_y = 0; box_y < SimulationSettings.no_boxes_y; box_y++)
-            for (int box_x = 0; box_x < SimulationSettings.no_boxes_x; box_x++, box_id++)
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
             {
-                no_cells = scene::Cells[first_cell].no_cells_in_box;
+                no_cells = cells[first_cell].no_cells_in_box;
 
                 if (no_cells)
                 {
                     // inner-box forces...
                     for (int i = 0; i < no_cells - 1; i++)
                         for (int j = i + 1; j < no_cells; j++)
-                            cell_cell_force(scene::Cells + first_cell + i, scene::Cells + first_cell + j);
+                            cell_cell_force<DIM, PHASES>(cells + first_cell + i, cells + first_cell + j);
 
                     // inter-box forces...
                     // (+1, 0, 0)...
-                    cell_cell_forces_box2(first_cell, no_cells, box_x + 1, box_y, box_z);
+                    cell_cell_forces_box2<DIM, PHASES>(first_cell, no_cells, box_x + 1, box_y, box_z);
 
                     // (+1, +1, 0)...
-                    cell_cell_forces_box2(first_cell, no_cells, box_x + 1, box_y + 1, box_z);
+                    cell_cell_forces_box2<DIM, PHASES>(first_cell, no_cells, box_x + 1, box_y + 1, box_z);
 
                     // (0, +1, 0)...
-                    cell_cell_forces_box2(first_cell, no_cells, box_x, box_y + 1, box_z);
+                    cell_cell_forces_box2<DIM, PHASES>(first_cell, no_cells, box_x, box_y + 1, box_z);
 
                     // (-1, +1, 0)...
-                    cell_cell_forces_box2(first_cell, no_cells, box_x - 1, box_y + 1, box_z);
+                    cell_cell_forces_box2<DIM, PHASES>(first_cell, no_cells, box_x - 1, box_y + 1, box_z);
 
-                    if (box_z < SimulationSettings.no_boxes_z - 1)
+                    if (box_z < Simulation->settings.no_boxes_z - 1)
                         for (int dx = -1; dx <= 1; dx++)
                             for (int dy = -1; dy <= 1; dy++)
                                 // (dx, dy, +1)...
-                                cell_cell_forces_box2(first_cell, no_cells, box_x + dx, box_y + dy, box_z + 1);
+                                cell_cell_forces_box2<DIM, PHASES>(first_cell, no_cells, box_x + dx, box_y + dy, box_z + 1);
                 }
-                first_cell += SimulationSettings.max_cells_per_box;
+                first_cell += Simulation->settings.max_cells_per_box;
             }
+}
+
+
+void CellCellForces()
+/**
+  Calculates forces between cells.
+*/
+{
+    StartTimer(TimerCellCellForcesId);
+
+    // calculate forces...
+    DISPATCH_KERNEL(cell_cell_forces)
 
     StopTimer(TimerCellCellForcesId);
 }
@@ -1228,7 +1389,7 @@ void CellBarrierForces()
   Highly UNEFFICIENT bariers - cells interactions.
 */
 {
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (Simulation->settings.sim_phases & sat::spForces)
     {
         StartTimer(TimerCellBarrierForcesId);
 
@@ -1239,20 +1400,20 @@ void CellBarrierForces()
             // loop over all cells...
             int first_cell = 0;
 
-            for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+            for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
             {
-                int no_cells = scene::Cells[first_cell].no_cells_in_box;
+                int no_cells = Simulation->cells[first_cell].no_cells_in_box;
                 for (int i = 0; i < no_cells; i++)
                     // grow only active cells...
-                    if (scene::Cells[first_cell + i].state != sat::csRemoved)
+                    if (Simulation->cells[first_cell + i].state != sat::csRemoved)
                     {
                     if (b->type == sat::btIn)
-                        cell_barrier_in_force(b, scene::Cells + first_cell + i);
+                        cell_barrier_in_force(b, Simulation->cells + first_cell + i);
                     else
-                        cell_barrier_out_force(b, scene::Cells + first_cell + i);
+                        cell_barrier_out_force(b, Simulation->cells + first_cell + i);
                 }
 
-                first_cell += SimulationSettings.max_cells_per_box;
+                first_cell += Simulation->settings.max_cells_per_box;
             }
 
             b = (anyBarrier *)b->next;
@@ -1264,12 +1425,15 @@ void CellBarrierForces()
 
 void TissueProperties()
 /**
-  Calculates tissue properties.
+  Calculates tissue properties (every Simulation->settings.tissue_props_every steps).
 */
 {
+    if (!sub_step_due(Simulation->settings.tissue_props_every))
+        return;
+
     StartTimer(TimerTissuePropertiesId);
 
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
 
     // reset pressures...
     while (ts)
@@ -1281,20 +1445,20 @@ void TissueProperties()
     // add pressures...
     // loop over all cells...
     int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
-            if (scene::Cells[first_cell + i].state != sat::csRemoved)
+            if (Simulation->cells[first_cell + i].state != sat::csRemoved)
             {
-               scene::Cells[first_cell + i].tissue->pressure_sum += scene::Cells[first_cell + i].pressure_avg;
+               Simulation->cells[first_cell + i].tissue->pressure_sum += Simulation->cells[first_cell + i].pressure_avg;
             }
-        first_cell += SimulationSettings.max_cells_per_box;
+        first_cell += Simulation->settings.max_cells_per_box;
     }
 
 
     // calculate average pressures...
-    ts = scene::FirstTissueSettings;
+    ts = Simulation->first_tissue_settings;
     while (ts)
     {
         if (ts->no_cells[0] > 0)
@@ -1320,7 +1484,7 @@ void tube_tube_in_chain_force(anyTube *v)
 
     anyVector dr = v_n->pos1 - v->pos2;
 
-    anyVector force = dr * TubularSystemSettings.force_chain_attr_factor;
+    anyVector force = dr * Simulation->tubular_settings.force_chain_attr_factor;
 
     v->force2 += force;
     v_n->force1 -= force;
@@ -1359,16 +1523,16 @@ void tube_tube_sprout_force_base(anyTube *v)
 
     anyVector vv = v1*v2;
     vv.normalize();
-    force1 = vv*v1*cc*TubularSystemSettings.force_angle_factor;
+    force1 = vv*v1*cc*Simulation->tubular_settings.force_angle_factor;
     v->force1 += force1;
     v->force2 -= force1;
 
-    force2 = vv*v2*cc*TubularSystemSettings.force_angle_factor*r_mod;
+    force2 = vv*v2*cc*Simulation->tubular_settings.force_angle_factor*r_mod;
     v_b->force1 -= force2;
     v_b->force2 += force2;
 
     // connection...
-    calc_force((v_b->pos1 + v_b->pos2)*0.5, v->pos1, force1, dp, 0, TubularSystemSettings.force_chain_attr_factor, TubularSystemSettings.force_chain_attr_factor, TubularSystemSettings.force_chain_attr_factor, false);
+    calc_force((v_b->pos1 + v_b->pos2)*0.5, v->pos1, force1, dp, 0, Simulation->tubular_settings.force_chain_attr_factor, Simulation->tubular_settings.force_chain_attr_factor, Simulation->tubular_settings.force_chain_attr_factor, false);
     v->force1 -= force1;
     v_b->force1 += force1*0.5;
     v_b->force2 += force1*0.5;
@@ -1407,17 +1571,17 @@ void tube_tube_sprout_force_top(anyTube *v)
 
     anyVector vv = v1*v2;
     vv.normalize();
-    force1 = vv*v1*cc*TubularSystemSettings.force_angle_factor;
+    force1 = vv*v1*cc*Simulation->tubular_settings.force_angle_factor;
     v->force2 += force1;
     v->force1 -= force1;
 
-    force2 = vv*v2*cc*TubularSystemSettings.force_angle_factor*r_mod;
+    force2 = vv*v2*cc*Simulation->tubular_settings.force_angle_factor*r_mod;
     v_b->force1 -= force2;
     v_b->force2 += force2;
 
 
     // connection...
-    calc_force((v_b->pos1 + v_b->pos2)*0.5, v->pos2, force1, dp, 0, TubularSystemSettings.force_chain_attr_factor, TubularSystemSettings.force_chain_attr_factor, TubularSystemSettings.force_chain_attr_factor, false);
+    calc_force((v_b->pos1 + v_b->pos2)*0.5, v->pos2, force1, dp, 0, Simulation->tubular_settings.force_chain_attr_factor, Simulation->tubular_settings.force_chain_attr_factor, Simulation->tubular_settings.force_chain_attr_factor, false);
     v->force2 -= force1;
     v_b->force1 += force1*0.5;
     v_b->force2 += force1*0.5;
@@ -1530,9 +1694,9 @@ void tube_tube_force(anyTube *v1, anyTube *v2)
     if (!calc_force(p1, p2,
                    force, dp,
                    v1->r + v2->r,
-                   TubularSystemSettings.force_rep_factor,
-                   TubularSystemSettings.force_atr1_factor,
-                   TubularSystemSettings.force_atr2_factor,
+                   Simulation->tubular_settings.force_rep_factor,
+                   Simulation->tubular_settings.force_atr1_factor,
+                   Simulation->tubular_settings.force_atr2_factor,
                    true))
         return;
     //LOG(llDebug, QString("Force! p1=") + p1.to_string() + ", p2=" + p2.to_string() + ", force=" + force.to_string());
@@ -1546,14 +1710,14 @@ void tube_tube_force(anyTube *v1, anyTube *v2)
         // tube connecting (case #1 - top->top)...
         if (!v1->next && !v1->top && !v2->next && !v2->top)
         {
-            if ((v1->pos2 - v2->pos2).length2() < SimulationSettings.force_r_cut2)
+            if ((v1->pos2 - v2->pos2).length2() < Simulation->settings.force_r_cut2)
                 scene::AddTubesToMerge(v1, v2);
         }
 
         // tube connecting (case #2 - top->middle)
         else if (!v1->next && !v1->top && !v2->fork && !v2->jab)
         {
-            if ((v1->pos2 - (v2->pos2 + v2->pos1)*0.5).length2() < SimulationSettings.force_r_cut2)
+            if ((v1->pos2 - (v2->pos2 + v2->pos1)*0.5).length2() < Simulation->settings.force_r_cut2)
             {
                 v1->top = v2;
                 v2->jab = v1;
@@ -1564,7 +1728,7 @@ void tube_tube_force(anyTube *v1, anyTube *v2)
         // tube connecting (case #3 - middle->top)
         else if (!v2->next && !v2->top && !v1->fork && !v1->jab)
         {
-            if ((v2->pos2 - (v1->pos2 + v1->pos1)*0.5).length2() < SimulationSettings.force_r_cut2)
+            if ((v2->pos2 - (v1->pos2 + v1->pos1)*0.5).length2() < Simulation->settings.force_r_cut2)
             {
                 v2->top = v1;
                 v1->jab = v2;
@@ -1575,7 +1739,7 @@ void tube_tube_force(anyTube *v1, anyTube *v2)
 
 
 
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (Simulation->settings.sim_phases & sat::spForces)
     {
         v1->force1 += force*(1 - t1);
         v1->force2 += force*t1;
@@ -1590,9 +1754,9 @@ void TubeTubeInChainsForces()
   Calculates forces between joined tubes.
 */
 {
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
             if (v->next)
@@ -1616,16 +1780,16 @@ void TubeTubeOutChainsForces()
     anyTube *v1, *v2;
     int box_id = 0;
 
-    for (int box_z = 0; box_z < SimulationSettings.no_boxes_z; box_z++)
-        for (int box_y = 0; box_y < SimulationSettings.no_boxes_y; box_y++)
-            for (int box_x = 0; box_x < SimulationSettings.no_boxes_x; box_x++, box_id++)
+    for (int box_z = 0; box_z < Simulation->settings.no_boxes_z; box_z++)
+        for (int box_y = 0; box_y < Simulation->settings.no_boxes_y; box_y++)
+            for (int box_x = 0; box_x < Simulation->settings.no_boxes_x; box_x++, box_id++)
             {
                 // loop over all pairs of tubes in box...
-                for (int i = 0; i < scene::BoxedTubes[box_id].no_tubes - 1; i++)
-                    for (int j = i + 1; j < scene::BoxedTubes[box_id].no_tubes; j++)
+                for (int i = 0; i < Simulation->boxed_tubes[box_id].no_tubes - 1; i++)
+                    for (int j = i + 1; j < Simulation->boxed_tubes[box_id].no_tubes; j++)
                     {
-                        v1 = scene::BoxedTubes[box_id].tubes[i];
-                        v2 = scene::BoxedTubes[box_id].tubes[j];
+                        v1 = Simulation->boxed_tubes[box_id].tubes[i];
+                        v2 = Simulation->boxed_tubes[box_id].tubes[j];
                         if (!scene::TubesJoined(v1, v2) && box_x == MAX(v1->nx, v2->nx) && box_y == MAX(v1->ny, v2->ny) && box_z == MAX(v1->nz, v2->nz))
                             tube_tube_force(v1, v2);
                     }
@@ -1645,7 +1809,7 @@ void tube_length_force(anyTube *v)
     float dl = dr.length() - v->length;
 
     dr.normalize();
-    anyVector force = dr*dl*TubularSystemSettings.force_length_keep_factor;
+    anyVector force = dr*dl*Simulation->tubular_settings.force_length_keep_factor;
 
     v->force1 += force;
     v->force2 -= force;
@@ -1657,9 +1821,9 @@ void TubeLengthForces()
   Keeps defined length of all tubes.
 */
 {
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
             tube_length_force(v);
@@ -1669,6 +1833,7 @@ void TubeLengthForces()
 }
 
 
+template <int DIM, unsigned PHASES>
 static
 void tube_cell_force(anyTube *v, anyCell *c)
 /**
@@ -1680,7 +1845,7 @@ void tube_cell_force(anyTube *v, anyCell *c)
 {
     float p = 0.5;
 
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (PHASES & sat::spForces)
     {
         anyVector p12 = v->pos2 - v->pos1;
         anyVector pc = c->pos - v->pos1;
@@ -1708,7 +1873,7 @@ void tube_cell_force(anyTube *v, anyCell *c)
 
         anyVector force;
         float dp;
-        if (!calc_force(c->pos, v->pos1*(1 - p) + v->pos2*p,
+        if (!calc_force<DIM, PHASES>(c->pos, v->pos1*(1 - p) + v->pos2*p,
                         force, dp,
                         v->r + c->r,
                         c->tissue->force_rep_factor,
@@ -1731,7 +1896,7 @@ void tube_cell_force(anyTube *v, anyCell *c)
         v->pressure_sum += c->pressure_prev;
     }
 
-    if ((SimulationSettings.sim_phases & sat::spDiffusion) && v->blood_flow)
+    if ((PHASES & sat::spDiffusion) && v->blood_flow)
     {
         const float vessel_conc_accel = 0.25;
         concentration_exchange(c->concentrations, v->concentrations,
@@ -1743,54 +1908,66 @@ void tube_cell_force(anyTube *v, anyCell *c)
 }
 
 
-void TubeCellForces()
+template <int DIM, unsigned PHASES>
+static
+void tube_cell_forces()
+/**
+  Calculates forces between tubes and cells (kernel of TubeCellForces()).
+*/
 {
-    if (SimulationSettings.sim_phases & sat::spForces)
-    {
-        int x1, y1, z1, x2, y2, z2;
-
-        StartTimer(TimerTubeCellForcesId);
+    int x1, y1, z1, x2, y2, z2;
 
-        // loop for every tube...
-        for (int i = 0; i < scene::NoTubeChains; i++)
+    // loop for every tube...
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+    {
+        anyTube *v = Simulation->tube_chains[i]->head;
+        while (v)
         {
-            anyTube *v = scene::TubeChains[i];
-            while (v)
-            {
-                // corner boxes...
-                x1 = floor((v->pos1.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-                y1 = floor((v->pos1.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-                z1 = floor((v->pos1.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
-
-                x2 = floor((v->pos2.x - SimulationSettings.comp_box_from.x)/SimulationSettings.box_size);
-                y2 = floor((v->pos2.y - SimulationSettings.comp_box_from.y)/SimulationSettings.box_size);
-                z2 = floor((v->pos2.z - SimulationSettings.comp_box_from.z)/SimulationSettings.box_size);
-
-                if (x1 > x2) SWAP(int, x1, x2);
-                if (y1 > y2) SWAP(int, y1, y2);
-                if (z1 > z2) SWAP(int, z1, z2);
-
-                //  loop over all boxes...
-                /// \todo: optimalization!!!
-                for (int x = x1 - 1; x <= x2 + 1; x++)
-                    for (int y = y1 - 1; y <= y2 + 1; y++)
-                        for (int z = z1 - 1; z <= z2 + 1; z++)
-                            if (VALID_BOX(x, y, z))
+            // corner boxes...
+            x1 = floor((v->pos1.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+            y1 = floor((v->pos1.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+            z1 = floor((v->pos1.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
+
+            x2 = floor((v->pos2.x - Simulation->settings.comp_box_from.x)/Simulation->settings.box_size);
+            y2 = floor((v->pos2.y - Simulation->settings.comp_box_from.y)/Simulation->settings.box_size);
+            z2 = floor((v->pos2.z - Simulation->settings.comp_box_from.z)/Simulation->settings.box_size);
+
+            if (x1 > x2) SWAP(int, x1, x2);
+            if (y1 > y2) SWAP(int, y1, y2);
+            if (z1 > z2) SWAP(int, z1, z2);
+
+            //  loop over all boxes...
+            /// \todo: optimalization!!!
+            for (int x = x1 - 1; x <= x2 + 1; x++)
+                for (int y = y1 - 1; y <= y2 + 1; y++)
+                    for (int z = z1 - 1; z <= z2 + 1; z++)
+                        if (VALID_BOX(x, y, z))
+                        {
+                            // loop over all particles in box...
+                            int first_cell = BOX_ID(x, y, z)*Simulation->settings.max_cells_per_box;
+                            int no_cells = Simulation->cells[first_cell].no_cells_in_box;
+
+                            for (int j = 0; j < no_cells; j++)
+                            // only active cells...
+                            if (Simulation->cells[first_cell + j].state != sat::csRemoved)
                             {
-                                // loop over all particles in box...
-                                int first_cell = BOX_ID(x, y, z)*SimulationSettings.max_cells_per_box;
-                                int no_cells = scene::Cells[first_cell].no_cells_in_box;
-
-                                for (int j = 0; j < no_cells; j++)
-                                // only active cells...
-                                if (scene::Cells[first_cell + j].state != sat::csRemoved)
-                                {
-                                    tube_cell_force(v, scene::Cells + first_cell + j);
-                                }
+                                tube_cell_force<DIM, PHASES>(v, Simulation->cells + first_cell + j);
                             }
-                v = v->next;
-            }
+                        }
+            v = v->next;
         }
+    }
+}
+
+
+void TubeCellForces()
+{
+    if (Simulation->settings.sim_phases & sat::spForces)
+    {
+        StartTimer(TimerTubeCellForcesId);
+
+        DISPATCH_KERNEL(tube_cell_forces)
+
         StopTimer(TimerTubeCellForcesId);
     }
 }
@@ -1801,7 +1978,7 @@ void TubeTubeForces()
   Calculates forces between tubes.
 */
 {
-    if (SimulationSettings.sim_phases & sat::spForces)
+    if (Simulation->settings.sim_phases & sat::spForces)
     {
         StartTimer(TimerTubeTubeForcesId);
 
@@ -1821,34 +1998,35 @@ void TubeTubeForces()
 
 
 
+template <int DIM>
 void GrowTube(anyTube *v)
 {
-    if (SimulationSettings.dimensions == 2)
+    if (DIM == 2)
         v->force1.z = v->force2.z = 0;
 
     // move...
 
     // dv = F/m*dt...
-    anyVector dv1(v->force1.x*SimulationSettings.time_step*v->one_by_mass*2,
-                  v->force1.y*SimulationSettings.time_step*v->one_by_mass*2,
-                  v->force1.z*SimulationSettings.time_step*v->one_by_mass*2);
-    anyVector dv2(v->force2.x*SimulationSettings.time_step*v->one_by_mass*2,
-                  v->force2.y*SimulationSettings.time_step*v->one_by_mass*2,
-                  v->force2.z*SimulationSettings.time_step*v->one_by_mass*2);
+    anyVector dv1(v->force1.x*Simulation->settings.time_step*v->one_by_mass*2,
+                  v->force1.y*Simulation->settings.time_step*v->one_by_mass*2,
+                  v->force1.z*Simulation->settings.time_step*v->one_by_mass*2);
+    anyVector dv2(v->force2.x*Simulation->settings.time_step*v->one_by_mass*2,
+                  v->force2.y*Simulation->settings.time_step*v->one_by_mass*2,
+                  v->force2.z*Simulation->settings.time_step*v->one_by_mass*2);
     // v += dv...
     v->velocity1 += dv1;
     v->velocity2 += dv2;
 
-    limit_velocity(v->velocity1, SimulationSettings.time_step);
-    limit_velocity(v->velocity2, SimulationSettings.time_step);
+    limit_velocity(v->velocity1, Simulation->settings.time_step);
+    limit_velocity(v->velocity2, Simulation->settings.time_step);
 
     // dr = v*dt
-    anyVector dr1(v->velocity1.x*SimulationSettings.time_step,
-                  v->velocity1.y*SimulationSettings.time_step,
-                  v->velocity1.z*SimulationSettings.time_step);
-    anyVector dr2(v->velocity2.x*SimulationSettings.time_step,
-                  v->velocity2.y*SimulationSettings.time_step,
-                  v->velocity2.z*SimulationSettings.time_step);
+    anyVector dr1(v->velocity1.x*Simulation->settings.time_step,
+                  v->velocity1.y*Simulation->settings.time_step,
+                  v->velocity1.z*Simulation->settings.time_step);
+    anyVector dr2(v->velocity2.x*Simulation->settings.time_step,
+                  v->velocity2.y*Simulation->settings.time_step,
+                  v->velocity2.z*Simulation->settings.time_step);
 
     // r += dr...
     v->pos1 += dr1;
@@ -1859,18 +2037,19 @@ void GrowTube(anyTube *v)
     v->velocity2 *= 0.5;
 
     // tip division...
-    if (SimulationSettings.sim_phases & sat::spTubeDiv
+    if (Simulation->settings.sim_phases & sat::spTubeDiv
         && !v->next
         && !v->top
         && (v->pos1 - v->pos2).length2() >= (v->final_length)*(v->final_length)*0.99
-        && (v->age > TubularSystemSettings.minimum_interphase_time)
+        && (v->age > Simulation->tubular_settings.minimum_interphase_time)
         && (v->taf_triggered)
        )
     {
         // create new tube and copy data...
-        anyTube *v2 = new anyTube;
+        anyTube *v2 = scene::NewTube();
         *v2 = *v;
         v2->base = v2->fork = 0;
+        v2->parsed_id = 0;
 
         change_tube_state(v2, sat::csAdded);
         v2->age = 0;
@@ -1885,32 +2064,30 @@ void GrowTube(anyTube *v)
         scene::AddTube(v2, false, false);
 
         // linkage...
-        v->next = v2;
-        v2->prev = v;
-        v2->base = 0;
-        v2->fork = 0;
+        scene::AppendTube(v, v2);
     }
 
     // sprout division...
-    else if (SimulationSettings.sim_phases & sat::spTubeDiv
+    else if (Simulation->settings.sim_phases & sat::spTubeDiv
         && (v->next)
         && (!v->fork)
         && (!v->jab)
         && (v->pos1 - v->pos2).length2() >= (v->final_length)*(v->final_length)*0.99
-        && (v->age > TubularSystemSettings.minimum_interphase_time)
+        && (v->age > Simulation->tubular_settings.minimum_interphase_time)
         && (v->taf_triggered)
        )
     {
         // create new tube and copy data...
-        anyTube *v2 = new anyTube;
+        anyTube *v2 = scene::NewTube();
         *v2 = *v;
+        v2->parsed_id = 0;
 
         change_tube_state(v2, sat::csAdded);
         v2->age = 0;
 
         // new ending points...
         anyVector end_point;
-        if (SimulationSettings.dimensions == 3)
+        if (DIM == 3)
         {
             // 3d...
             end_point.set_random(3, 1);
@@ -1953,14 +2130,17 @@ void GrowTube(anyTube *v)
     case sat::csAlive:
         // death?...
         if (!v->fixed_blood_pressure &&
-            SimulationSettings.time - v->flow_time > TubularSystemSettings.time_to_degradation &&
+            Simulation->settings.time - v->flow_time > Simulation->tubular_settings.time_to_degradation &&
             !v->next && !v->top && !v->fork && !v->jab)
+        {
             v->state = sat::csRemoved;
+            scene::QueueTubeRemoval(v);
+        }
 
         // lengthening...
         if (v->length < v->final_length)
         {
-            v->length += TubularSystemSettings.lengthening_speed*SimulationSettings.time_step;
+            v->length += Simulation->tubular_settings.lengthening_speed*Simulation->settings.time_step;
             if (v->length > v->final_length)
                 v->length = v->final_length;
             scene::SetTubeMass(v);
@@ -1969,7 +2149,7 @@ void GrowTube(anyTube *v)
         // thickening...
         if (v->r < v->final_r)
         {
-            v->r += TubularSystemSettings.thickening_speed*SimulationSettings.time_step;
+            v->r += Simulation->tubular_settings.thickening_speed*Simulation->settings.time_step;
             if (v->r > v->final_r)
                 v->r = v->final_r;
             scene::SetTubeMass(v);
@@ -1980,13 +2160,13 @@ void GrowTube(anyTube *v)
         throw new Error(__FILE__, __LINE__, "Unexpected state of cell");
     }
 
-    v->taf_triggered = v->concentrations[sat::dsTAF][conc_step_current()] > TubularSystemSettings.TAFtrigger;
+    v->taf_triggered = v->concentrations[sat::dsTAF][conc_step_current()] > Simulation->tubular_settings.TAFtrigger;
 
     // concentration changes...
     v->concentrations[sat::dsTAF][conc_step_current()] = 0;
     if (v->blood_flow != 0){
         v->concentrations[sat::dsO2][conc_step_current()] = 1;
-        if (SimulationSettings.add_medicine < SimulationSettings.step && SimulationSettings.step < SimulationSettings.remove_medicine)
+        if (Simulation->settings.add_medicine < Simulation->settings.step && Simulation->settings.step < Simulation->settings.remove_medicine)
         {
             v->concentrations[sat::dsMedicine][conc_step_current()] = 1;
         }
@@ -1996,12 +2176,31 @@ void GrowTube(anyTube *v)
         }
     }
     // update timers...
-    v->age += SimulationSettings.time_step;
-    v->state_age += SimulationSettings.time_step;
+    v->age += Simulation->settings.time_step;
+    v->state_age += Simulation->settings.time_step;
 
     // flow timer...
     if (ABS(v->blood_flow) > 0)
-        v->flow_time = SimulationSettings.time;
+        v->flow_time = Simulation->settings.time;
+}
+
+
+template <int DIM>
+void grow_all_tubes()
+/**
+  Growth of all tubes (DIM-dimensional simulation).
+*/
+{
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
+    {
+        anyTube *v = Simulation->tube_chains[i]->head;
+        while (v)
+        {
+            if (v->state != sat::csAdded)
+                GrowTube<DIM>(v);
+            v = v->next;
+        }
+    }
 }
 
 
@@ -2010,20 +2209,15 @@ void GrowAllTubes()
   Growth of all tubes.
 */
 {
-    if (SimulationSettings.sim_phases & sat::spGrow)
+    if (Simulation->settings.sim_phases & sat::spGrow)
     {
         StartTimer(TimerTubeGrowId);
 
-        for (int i = 0; i < scene::NoTubeChains; i++)
-        {
-            anyTube *v = scene::TubeChains[i];
-            while (v)
-            {
-                if (v->state != sat::csAdded)
-                    GrowTube(v);
-                v = v->next;
-            }
-        }
+        if (Simulation->settings.dimensions == 2)
+            grow_all_tubes<2>();
+        else
+            grow_all_tubes<3>();
+
         StopTimer(TimerTubeGrowId);
     }
 }
@@ -2033,18 +2227,18 @@ void CopyConcentrations()
 {
     StartTimer(TimerCopyConcentrationsId);
 
-    int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    #pragma omp parallel for schedule(static)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int first_cell = box_id*Simulation->settings.max_cells_per_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
         {
-            anyCell &currentCell = scene::Cells[first_cell + i];
+            anyCell &currentCell = Simulation->cells[first_cell + i];
 
             for (int k = 0; k < sat::dsLast; k++)
               currentCell.concentrations[k][conc_step_prev()] = currentCell.concentrations[k][conc_step_current()];
         }
-        first_cell += SimulationSettings.max_cells_per_box;
     }
 
     StopTimer(TimerCopyConcentrationsId);
@@ -2056,23 +2250,23 @@ void ResetForces()
     StartTimer(TimerResetForcesId);
 
     // cells...
-    int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    #pragma omp parallel for schedule(static)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int first_cell = box_id*Simulation->settings.max_cells_per_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
         {
-            anyCell& currentCell = scene::Cells[first_cell + i];
+            anyCell& currentCell = Simulation->cells[first_cell + i];
             currentCell.force.set(0, 0, 0);
             currentCell.nei_cnt[sat::ttNormal] = currentCell.nei_cnt[sat::ttTumor] = 0;
         }
-        first_cell += SimulationSettings.max_cells_per_box;
     }
 
     // tubes...
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
             v->force1.set(0, 0, 0);
@@ -2093,13 +2287,14 @@ void UpdatePressures()
     StartTimer(TimerUpdatePressuresId);
 
     // cells...
-    int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    #pragma omp parallel for schedule(static)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int first_cell = box_id*Simulation->settings.max_cells_per_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
         {
-            anyCell &currentCell = scene::Cells[first_cell + i];
+            anyCell &currentCell = Simulation->cells[first_cell + i];
             /* Pressure is counted from forces and should conform following conditions:
             * -when system is in stable state, pressure should have similiar values in all cells
             * -when pressure is not equall, system should move to position in which it will be equall
@@ -2107,7 +2302,7 @@ void UpdatePressures()
             * -pressure is calculated directly from forces acting on this cell and is not in direct way connected with pressures of other cells
             */
 
-            if (SimulationSettings.dimensions == 3)
+            if (Simulation->settings.dimensions == 3)
                 currentCell.pressure = (currentCell.pressure) / (currentCell.r * sqrt(currentCell.r));
             else
                 currentCell.pressure = (currentCell.pressure) / currentCell.r;
@@ -2116,17 +2311,15 @@ void UpdatePressures()
             currentCell.pressure_prev = currentCell.pressure;
             currentCell.pressure_sum = currentCell.pressure_prev;
         }
-
-        first_cell += SimulationSettings.max_cells_per_box;
     }
 
     // tubes...
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
-            if (SimulationSettings.dimensions == 3)
+            if (Simulation->settings.dimensions == 3)
                 v->pressure = (v->pressure) / (v->r*sqrt(v->r));
             else
                 v->pressure = (v->pressure) / v->r;
@@ -2146,101 +2339,99 @@ void RemoveTubes()
 {
     StartTimer(TimerRemoveTubesId);
 
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    // tubes queued by GrowTube()...
+    scene::RemoveQueuedTubes();
+
+    StopTimer(TimerRemoveTubesId);
+}
+
+
+static
+void blood_pressure_sweep(float relaxation)
+/**
+  One relaxation sweep of blood pressures (pressure of tube moves towards mean pressure of
+  its neighbours).
+
+  \param relaxation -- relaxation factor (1 -- pressure becomes mean pressure, 1..2 -- over-relaxation)
+*/
+{
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
-            if (v->state == sat::csRemoved)
+            if (!v->fixed_blood_pressure)
             {
-                // forked?...
-                if (v->base)
-                    v->base->fork = 0;
-
-                // in chain?...
+                float np = 0;
+                int np_cnt = 0;
+                if (v->next)
+                {
+                    np += v->next->blood_pressure;
+                    np_cnt++;
+                }
                 if (v->prev)
-                    v->prev->next = 0;
-                else
                 {
-                    // first in chain...
-                    scene::TubeChains[i] = scene::TubeChains[--scene::NoTubeChains];
-                    i--;
+                    np += v->prev->blood_pressure;
+                    np_cnt++;
+                }
+                if (v->base)
+                {
+                    np += v->base->blood_pressure;
+                    np_cnt++;
+                }
+                if (v->fork)
+                {
+                    np += v->fork->blood_pressure;
+                    np_cnt++;
+                }
+                if (v->top)
+                {
+                    np += v->top->blood_pressure;
+                    np_cnt++;
+                }
+                if (v->jab)
+                {
+                    np += v->jab->blood_pressure;
+                    np_cnt++;
                 }
 
-                delete v;
-                scene::NoTubes--;
-                break;
+                if (np_cnt)
+                {
+                    if (relaxation == 1)
+                        v->blood_pressure = np/np_cnt;
+                    else
+                        v->blood_pressure += relaxation*(np/np_cnt - v->blood_pressure);
+                }
             }
+
             v = v->next;
         }
     }
-
-    StopTimer(TimerRemoveTubesId);
 }
 
 
-void BloodFlow()
+void BloodFlow(bool force)
+/**
+  Relaxes blood pressures and calculates blood flow (every Simulation->settings.blood_flow_every steps).
+  Update runs one pressure sweep. Sweep of update covering n steps is over-relaxed with
+  factor 2 - 1/n (1 for n = 1, approaching 2 for long intervals, where over-relaxation is
+  still stable), so pressures keep converging while update runs n times less often.
+
+  \param force -- update regardless of Simulation->settings.blood_flow_every (e.g. warm-up before simulation)
+*/
 {
-    if (SimulationSettings.sim_phases & sat::spBloodFlow)
+    if (Simulation->settings.sim_phases & sat::spBloodFlow
+        && (force || sub_step_due(Simulation->settings.blood_flow_every)))
     {
         StartTimer(TimerBloodFlowId);
 
-        // pressure recalculation...
-        for (int i = 0; i < scene::NoTubeChains; i++)
-        {
-            anyTube *v = scene::TubeChains[i];
-            while (v)
-            {
-                if (!v->fixed_blood_pressure)
-                {
-                    float np = 0;
-                    int np_cnt = 0;
-                    if (v->next)
-                    {
-                        np += v->next->blood_pressure;
-                        np_cnt++;
-                    }
-                    if (v->prev)
-                    {
-                        np += v->prev->blood_pressure;
-                        np_cnt++;
-                    }
-                    if (v->base)
-                    {
-                        np += v->base->blood_pressure;
-                        np_cnt++;
-                    }
-                    if (v->fork)
-                    {
-                        np += v->fork->blood_pressure;
-                        np_cnt++;
-                    }
-                    if (v->top)
-                    {
-                        np += v->top->blood_pressure;
-                        np_cnt++;
-                    }
-                    if (v->jab)
-                    {
-                        np += v->jab->blood_pressure;
-                        np_cnt++;
-                    }
-
-                    if (np_cnt)
-                    {
-                        v->blood_pressure = np/np_cnt;
-                    }
-                }
-
-                v = v->next;
-            }
-        }
-
-
+        // pressure recalculation (relaxation grows with steps covered by this update)...
+        int n = force ? 1 : sub_steps(Simulation->settings.blood_flow_every);
+        blood_pressure_sweep(2 - 1.0f/n);
 
-        for (int i = 0; i < scene::NoTubeChains; i++)
+        for (int i = 0; i < Simulation->no_tube_chains; i++)
         {
-            anyTube *v = scene::TubeChains[i];
+            anyTube *v = Simulation->tube_chains[i]->head;
             while (v)
             {
                 float p1 = 0, p2 = 0;
@@ -2266,7 +2457,7 @@ void BloodFlow()
                 else
                     p2p = false;
 
-                if (p1p && p2p && ABS(p2-p1) > TubularSystemSettings.minimum_blood_flow)
+                if (p1p && p2p && ABS(p2-p1) > Simulation->tubular_settings.minimum_blood_flow)
                     v->blood_flow = p2 - p1;
                 else
                     v->blood_flow = 0;
@@ -2339,10 +2530,11 @@ void TimeStep()
     TissueProperties();
 
     // update time...
-    SimulationSettings.time += SimulationSettings.time_step;
-    SimulationSettings.step++;
+    Simulation->settings.time += Simulation->settings.time_step;
+    Simulation->settings.step++;
 
     StopTimer(TimerSimulationId);
+    AddTimerSimulatedTime(Simulation->settings.time_step);
 
 }
 
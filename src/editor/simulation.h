@@ -2,6 +2,8 @@
 #define SIMULATION_H
 
 void TimeStep();
-void BloodFlow();
+void BloodFlow(bool force = false);
+int StableDiffusionInterval();
+void CheckDiffusionInterval();
 
 #endif // SIMULATION_H
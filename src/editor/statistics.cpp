@@ -1,76 +1,173 @@
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
 #include "config.h"
 #include "scene.h"
 #include "statistics.h"
 #include "log.h"
 #include "anytube.h"
+#include "anyoutputwriter.h"
+#include "timers.h"
 
-anyStatData *Statistics = 0;
-anyStatData *LastStatistics = 0;
-anyStatData MaxStatistics;
 
-void DeallocStatistics()
+void anyStatStore::clear()
 {
-   anyStatData *sd = Statistics;
-   anyStatData *nsd;
+    no_counters = 0;
+    no_completed = 0;
+    steps.clear();
+    columns.clear();
+    max_values.clear();
+    levels.clear();
+}
 
-   while (sd)
-   {
-       nsd = sd->next;
 
-       delete [] sd->counter;
-       delete sd;
+void anyStatStore::set(int step, int counter, int value)
+/**
+  Sets counter of sample with given step. New sample is added if step differs
+  from step of last sample (previous sample is then completed).
+*/
+{
+    if (steps.empty())
+    {
+        clear();
+        no_counters = (Simulation->no_tissue_settings + 1)*sat::csLast;
+        columns.resize(no_counters);
+        max_values.assign(no_counters, 0);
+    }
+
+    if (counter < 0 || counter >= no_counters)
+        return;
+
+    if (steps.empty() || steps.back() != step)
+    {
+        if (!steps.empty())
+            complete_sample(steps.size() - 1);
 
-       sd = nsd;
-   }
+        steps.push_back(step);
+        for (int c = 0; c < no_counters; c++)
+            columns[c].push_back(0);
+    }
 
-   LastStatistics = Statistics = 0;
+    columns[counter].back() = value;
+    if (value > max_values[counter])
+        max_values[counter] = value;
 }
 
 
-void AddStatistics(int step, int tissue_id, int state_id, int count)
+void anyStatStore::complete_sample(int sample)
+/**
+  Updates decimation levels with blocks finished by given sample.
+*/
 {
-    if (tissue_id > scene::NoTissueSettings || state_id >= sat::csLast)
-        return;
+    no_completed = sample + 1;
 
-    anyStatData *sd;
-
-    if (LastStatistics && LastStatistics->step == step)
-        sd = LastStatistics;
-    else
+    int block_size = 1;
+    for (int l = 0; ; l++)
     {
-        // alloc new...
-        sd = new anyStatData;
+        int lower_size = block_size;
+        block_size *= STAT_DECIMATION;
+        if (no_completed % block_size)
+            break;
 
-        sd->step = step;
-        sd->counter = new int[(scene::NoTissueSettings + 1)*sat::csLast];
-        for (int i = 0; i < (scene::NoTissueSettings + 1)*sat::csLast; i++)
-            sd->counter[i] = 0;
+        if ((int)levels.size() <= l)
+            levels.resize(l + 1);
+        anyStatLevel &level = levels[l];
 
-        // add to linked list...
-        if (!Statistics)
+        // summarize last STAT_DECIMATION samples (or blocks of lower level)...
+        int first = no_completed/lower_size - STAT_DECIMATION;
+        for (int c = 0; c < no_counters; c++)
         {
-            Statistics = sd;
+            int mn, mx;
+            if (l == 0)
+            {
+                mn = mx = columns[c][first];
+                for (int k = first + 1; k < first + STAT_DECIMATION; k++)
+                {
+                    mn = MIN(mn, columns[c][k]);
+                    mx = MAX(mx, columns[c][k]);
+                }
+            }
+            else
+            {
+                anyStatLevel const &lower = levels[l - 1];
+                mn = lower.min[first*no_counters + c];
+                mx = lower.max[first*no_counters + c];
+                for (int k = first + 1; k < first + STAT_DECIMATION; k++)
+                {
+                    mn = MIN(mn, lower.min[k*no_counters + c]);
+                    mx = MAX(mx, lower.max[k*no_counters + c]);
+                }
+            }
+            level.min.push_back(mn);
+            level.max.push_back(mx);
+        }
+    }
+}
+
 
-            // reset max values...
-            delete [] MaxStatistics.counter;
-            MaxStatistics.counter = new int[(scene::NoTissueSettings + 1)*sat::csLast]; // 0,1,2,3,4    5,6,7,8,9    10,11,12,13,14
-            for (int i = 0; i < (scene::NoTissueSettings + 1)*sat::csLast; i++)
-                MaxStatistics.counter[i] = 0;
+void anyStatStore::min_max(int counter, int from, int to, int &mn, int &mx) const
+/**
+  Finds min and max of counter in samples [from, to).
+*/
+{
+    mn = mx = 0;
+    if (counter < 0 || counter >= no_counters || from >= to)
+        return;
+
+    mn = mx = columns[counter][from];
+    while (from < to)
+    {
+        // largest complete block starting at 'from' and fitting in range...
+        int l = -1;
+        int block_size = 1;
+        while (l + 1 < (int)levels.size() &&
+               from % (block_size*STAT_DECIMATION) == 0 &&
+               from + block_size*STAT_DECIMATION <= MIN(to, no_completed))
+        {
+            l++;
+            block_size *= STAT_DECIMATION;
+        }
+
+        if (l < 0)
+        {
+            mn = MIN(mn, columns[counter][from]);
+            mx = MAX(mx, columns[counter][from]);
         }
         else
-            LastStatistics->next = sd;
-        LastStatistics = sd;
+        {
+            int b = from/block_size;
+            mn = MIN(mn, levels[l].min[b*no_counters + counter]);
+            mx = MAX(mx, levels[l].max[b*no_counters + counter]);
+        }
+        from += block_size;
     }
+}
+
+
+void DeallocStatistics()
+{
+    Simulation->statistics_stream.close();
+
+    std::lock_guard<std::mutex> lock(Simulation->statistics.mutex);
+    Simulation->statistics.clear();
+}
+
+
+void AddStatistics(int step, int tissue_id, int state_id, int count)
+{
+    if (tissue_id > Simulation->no_tissue_settings || state_id >= sat::csLast)
+        return;
 
-    sd->counter[tissue_id*sat::csLast + state_id] = count;
-    if (count > MaxStatistics.counter[tissue_id*sat::csLast + state_id])
-        MaxStatistics.counter[tissue_id*sat::csLast + state_id] = count;
+    std::lock_guard<std::mutex> lock(Simulation->statistics.mutex);
+    Simulation->statistics.set(step, tissue_id*sat::csLast + state_id, count);
 }
 
 
 void AddAllStatistics()
 {
-    anyTissueSettings *ts = scene::FirstTissueSettings;
+    anyTissueSettings *ts = Simulation->first_tissue_settings;
 
     // reset counters...
     while (ts)
@@ -80,40 +177,184 @@ void AddAllStatistics()
         ts = ts->next;
     }
 
-    // count scene::Cells...
+    // count cells...
     int first_cell = 0;
-    for (int box_id = 0; box_id < SimulationSettings.no_boxes; box_id++)
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
     {
-        int no_cells = scene::Cells[first_cell].no_cells_in_box;
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
         for (int i = 0; i < no_cells; i++)
-            if (scene::Cells[first_cell + i].state >= sat::csAlive)
-                scene::Cells[first_cell + i].tissue->no_cells[scene::Cells[first_cell + i].state]++;
+            if (Simulation->cells[first_cell + i].state >= sat::csAlive)
+                Simulation->cells[first_cell + i].tissue->no_cells[Simulation->cells[first_cell + i].state]++;
 
-        first_cell += SimulationSettings.max_cells_per_box;
+        first_cell += Simulation->settings.max_cells_per_box;
     }
 
-    ts = scene::FirstTissueSettings;
+    ts = Simulation->first_tissue_settings;
     while (ts)
     {
         for (int i = 0; i < sat::csLast; i++)
-            AddStatistics(SimulationSettings.step, ts->id, i, ts->no_cells[i]);
+            AddStatistics(Simulation->settings.step, ts->id, i, ts->no_cells[i]);
         ts = ts->next;
     }
 
     // count tubes...
-    AddStatistics(SimulationSettings.step, scene::NoTissueSettings, 0, scene::NoTubes);
+    AddStatistics(Simulation->settings.step, Simulation->no_tissue_settings, 0, Simulation->no_tubes);
     int fl = 0;
-    for (int i = 0; i < scene::NoTubeChains; i++)
+    for (int i = 0; i < Simulation->no_tube_chains; i++)
     {
-        anyTube *v = scene::TubeChains[i];
+        anyTube *v = Simulation->tube_chains[i]->head;
         while (v)
         {
             if (v->blood_flow != 0) fl++;
             v = v->next;
         }
     }
-    AddStatistics(SimulationSettings.step, scene::NoTissueSettings, sat::csAlive, fl);
-    AddStatistics(SimulationSettings.step, scene::NoTissueSettings, sat::csHypoxia, scene::NoTubeChains);
+    AddStatistics(Simulation->settings.step, Simulation->no_tissue_settings, sat::csAlive, fl);
+    AddStatistics(Simulation->settings.step, Simulation->no_tissue_settings, sat::csHypoxia, Simulation->no_tube_chains);
+}
+
+
+static void append(std::string &s, char const *fmt, ...)
+/**
+  Appends formatted text to string.
+*/
+{
+    char buff[1000];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buff, 1000, fmt, args);
+    va_end(args);
+    s += buff;
+}
+
+
+static void statistics_header(std::string &s, std::vector<std::string> const &tissue_names)
+/**
+  Appends CSV header (column names).
+*/
+{
+    append(s, "time; ");
+    for (unsigned i = 0; i < tissue_names.size(); i++)
+    {
+        char const *name = tissue_names[i].c_str();
+
+        append(s, "%s; ", name);
+        append(s, "%s (%s); ", name, "ALIVE");
+        append(s, "%s (%s); ", name, "HYPOXIA");
+        append(s, "%s (%s); ", name, "APOPTOSIS");
+        append(s, "%s (%s); ", name, "NECROSIS");
+    }
+    append(s, "%s; ", MODEL_TUBE_SHORTNAME_PL_PCHAR);
+    append(s, "%s (with flow); ", MODEL_TUBE_SHORTNAME_PL_PCHAR);
+    append(s, "%s; ", MODEL_TUBECHAIN_SHORTNAME_PL_PCHAR);
+    append(s, "\n");
+}
+
+
+static void statistics_columns(int const *counter, int no_tissues, std::vector<int> &columns)
+/**
+  Picks values of columns (see statistics_header()) from counters of one sample.
+*/
+{
+    columns.clear();
+    for (int i = 0; i < no_tissues + 1; i++)
+    {
+        columns.push_back(counter[i*sat::csLast]);
+        columns.push_back(counter[i*sat::csLast + sat::csAlive]);
+        columns.push_back(counter[i*sat::csLast + sat::csHypoxia]);
+        if (i < no_tissues)
+        {
+            columns.push_back(counter[i*sat::csLast + sat::csApoptosis]);
+            columns.push_back(counter[i*sat::csLast + sat::csNecrosis]);
+        }
+    }
+}
+
+
+static void statistics_row(std::string &s, float time, std::vector<int> const &columns)
+/**
+  Appends CSV row.
+*/
+{
+    append(s, "%.1f; ", time);
+    for (unsigned i = 0; i < columns.size(); i++)
+        append(s, "%d; ", columns[i]);
+    append(s, "\n");
+}
+
+
+static std::vector<std::string> tissue_names()
+{
+    std::vector<std::string> names;
+    for (int i = 0; i < Simulation->no_tissue_settings; i++)
+        names.push_back(scene::FindTissueSettingById(i)->name);
+    return names;
+}
+
+
+class anyStatisticsJob: public anyOutputJob
+/**
+  Copy of statistics rows, written to CSV file by writer thread.
+*/
+{
+public:
+    float time_step;                         ///< simulation time step
+    std::vector<std::string> tissue_names;   ///< tissue names indexed by id
+    std::vector<int> steps;                  ///< step of every row
+    std::vector<int> counters;               ///< (no. of tissues + 1)*csLast counters of every row
+
+    void write();
+};
+
+
+void anyStatisticsJob::write()
+{
+    FILE *f = fopen(fname, "w");
+    if (f)
+    {
+        int no_tissues = tissue_names.size();
+        std::string s;
+        std::vector<int> columns;
+
+        statistics_header(s, tissue_names);
+        for (unsigned r = 0; r < steps.size(); r++)
+        {
+            statistics_columns(&counters[r*(no_tissues + 1)*sat::csLast], no_tissues, columns);
+            statistics_row(s, steps[r]*time_step, columns);
+        }
+
+        fwrite(s.data(), 1, s.size(), f);
+        fclose(f);
+    }
+}
+
+
+anyOutputJob *CaptureStatistics(char const *fname)
+/**
+  Copies statistics for writing in background.
+
+  \param fname -- name of output file
+*/
+{
+    LOG2(llInfo, "Saving statistics file: ", fname);
+
+    anyStatisticsJob *job = new anyStatisticsJob;
+    strncpy(job->fname, fname, P_MAX_PATH - 1);
+    job->step = Simulation->settings.step;
+    job->time_step = Simulation->settings.time_step;
+    job->tissue_names = tissue_names();
+
+    std::lock_guard<std::mutex> lock(Simulation->statistics.mutex);
+    int row_size = (Simulation->no_tissue_settings + 1)*sat::csLast;
+    job->counters.resize(Simulation->statistics.size()*row_size, 0);
+    for (int r = 0; r < Simulation->statistics.size(); r++)
+    {
+        job->steps.push_back(Simulation->statistics.step(r));
+        for (int c = 0; c < MIN(row_size, Simulation->statistics.get_no_counters()); c++)
+            job->counters[r*row_size + c] = Simulation->statistics.get(c, r);
+    }
+
+    return job;
 }
 
 
@@ -124,57 +365,111 @@ void SaveStatistics(char const *fname)
   \param fname -- name of output file, if NULL then name is generated.
 */
 {
+    anyOutputJob *job = CaptureStatistics(fname);
+    job->write();
+    delete job;
+}
+
+
+void anyStatisticsStream::open(char const *fname, bool binary, float flush_time)
+/**
+  Creates statistics file and writes header. Rows already collected are appended
+  with the first append() call.
+
+  \param fname -- name of output file
+  \param binary -- binary file (see statistics.h) instead of CSV?
+  \param flush_time -- minimum time between writes to disk [s]
+*/
+{
+    close();
+
     LOG2(llInfo, "Saving statistics file: ", fname);
+    f = fopen(fname, binary ? "wb" : "w");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
 
-    FILE *f = fopen(fname, "w");
-    if (f)
+    this->binary = binary;
+    this->flush_time = long(flush_time*1000);
+    next_row = 0;
+    last_flush = Time();
+    buffer.clear();
+
+    std::vector<std::string> names = tissue_names();
+    if (binary)
     {
-        // header...
-        fprintf(f, "time; ");
-        for (int i = 0; i < scene::NoTissueSettings; i++)
-        {
-            anyTissueSettings *t = scene::FindTissueSettingById(i);
+        int no_columns = 5*Simulation->no_tissue_settings + 3;
+        buffer.append(STATISTICS_MAGIC, 4);
+        buffer.append((char const *)&no_columns, sizeof(no_columns));
+        std::string header;
+        statistics_header(header, names);
+        buffer.append(header.c_str(), header.size() + 1);
+    }
+    else
+        statistics_header(buffer, names);
 
-            fprintf(f, "%s; ", t->name);
-            fprintf(f, "%s (%s); ", t->name, "ALIVE");
-            fprintf(f, "%s (%s); ", t->name, "HYPOXIA");
-            fprintf(f, "%s (%s); ", t->name, "APOPTOSIS");
-            fprintf(f, "%s (%s); ", t->name, "NECROSIS");
-        }
-        fprintf(f, "%s; ", MODEL_TUBE_SHORTNAME_PL_PCHAR);
-        fprintf(f, "%s (with flow); ", MODEL_TUBE_SHORTNAME_PL_PCHAR);
-        fprintf(f, "%s; ", MODEL_TUBECHAIN_SHORTNAME_PL_PCHAR);
-        fprintf(f, "\n");
-
-        // data...
-        anyStatData *sd = Statistics;
-        while (sd)
-        {
-            fprintf(f, "%.1f; ", sd->step*SimulationSettings.time_step);
+    flush();
+}
 
-            for (int i = 0; i < scene::NoTissueSettings + 1; i++)
-            {
-                if (i < scene::NoTissueSettings)
-                {
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csAlive]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csHypoxia]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csApoptosis]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csNecrosis]);
-                }
-                else
-                {
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csAlive]);
-                    fprintf(f, "%d; ", sd->counter[i*sat::csLast + sat::csHypoxia]);
-                }
-            }
 
-            fprintf(f, "\n");
-            sd = sd->next;
+void anyStatisticsStream::append()
+/**
+  Adds rows collected since previous call, writes them if flush time passed.
+*/
+{
+    if (!f)
+        return;
+
+    std::vector<int> counter(Simulation->statistics.get_no_counters());
+    std::vector<int> columns;
+    for (; next_row < Simulation->statistics.size(); next_row++)
+    {
+        for (unsigned c = 0; c < counter.size(); c++)
+            counter[c] = Simulation->statistics.get(c, next_row);
+        statistics_columns(&counter[0], Simulation->no_tissue_settings, columns);
+        float time = Simulation->statistics.step(next_row)*Simulation->settings.time_step;
+        if (binary)
+        {
+            buffer.append((char const *)&time, sizeof(time));
+            buffer.append((char const *)&columns[0], columns.size()*sizeof(int));
         }
+        else
+            statistics_row(buffer, time, columns);
+    }
 
-        fclose(f);
+    if (Time() - last_flush >= flush_time)
+        flush();
+}
+
+
+void anyStatisticsStream::flush()
+/**
+  Writes buffered rows.
+*/
+{
+    if (!f)
+        return;
+
+    if (!buffer.empty())
+    {
+        fwrite(buffer.data(), 1, buffer.size(), f);
+        fflush(f);
+        buffer.clear();
     }
+    last_flush = Time();
+}
+
+
+void anyStatisticsStream::close()
+/**
+  Appends remaining rows and closes file.
+*/
+{
+    if (!f)
+        return;
 
+    append();
+    flush();
+    fclose(f);
+    f = 0;
+    next_row = 0;
 }
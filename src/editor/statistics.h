@@ -1,32 +1,103 @@
 #ifndef STATISTICS_H
 #define STATISTICS_H
 
-class anyStatData
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#define STAT_DECIMATION 16  ///< number of samples (blocks) in block of next decimation level
+
+class anyStatStore
+/**
+  Statistics samples stored column by column (one contiguous array for every
+  counter). Counters of sample:
+
+  for every tissue (and tubes as last "tissue"):
+   0 - total number of cells
+   ( 1 - not used )
+   2 - csAlive
+   3 - csHypoxia
+   4 - csApoptosis
+   5 - csNecrosis
+
+  Completed samples are also summarized in decimation levels: level l keeps min
+  and max of every counter in blocks of STAT_DECIMATION^(l + 1) samples, so min_max()
+  of any range reads at most 2*STAT_DECIMATION values per level.
+*/
 {
+private:
+    class anyStatLevel
+    {
+    public:
+        std::vector<int> min;   ///< min of block (no_counters values per block)
+        std::vector<int> max;   ///< max of block
+    };
+
+    int no_counters;                        ///< counters in sample
+    int no_completed;                       ///< number of samples summarized in levels
+    std::vector<int> steps;                 ///< step of every sample
+    std::vector<std::vector<int> > columns; ///< values of every counter
+    std::vector<int> max_values;            ///< max value of every counter
+    std::vector<anyStatLevel> levels;       ///< decimation levels
+
+    void complete_sample(int sample);
+
 public:
-    int step;
+    std::mutex mutex;                       ///< guards data read in GUI thread while simulation runs
+
+    anyStatStore(): no_counters(0), no_completed(0) {}
 
-    int *counter; ///< NoTissues + 1
-    // for every tissue:
-    //  0 - total number of cells
-    //  ( 1 - not used )
-    //  2 - csAlive
-    //  3 - csHypoxia
-    //  4 - csApoptosis
-    //  5 - csNecrosis
+    void clear();
+    void set(int step, int counter, int value);
 
-    anyStatData *next;
+    bool empty() const { return steps.empty(); }
+    int size() const { return steps.size(); }
+    int get_no_counters() const { return no_counters; }
+    int step(int sample) const { return steps[sample]; }
+    int last_step() const { return steps.empty() ? 0 : steps.back(); }
+    int get(int counter, int sample) const { return columns[counter][sample]; }
+    int max(int counter) const { return counter < no_counters ? max_values[counter] : 0; }
+    void min_max(int counter, int from, int to, int &mn, int &mx) const;
+};
+
+#define STATISTICS_MAGIC "MSTB"
+
+class anyStatisticsStream
+/**
+  Statistics file written during simulation. Only rows added since previous
+  append() are written (header once), rows are buffered and written to disk
+  not more often than every flush_time.
+
+  Binary file: magic (4 chars), number of columns (int), CSV header (zero terminated),
+  then rows: time (float), columns (ints).
+*/
+{
+private:
+    FILE *f;                   ///< output file
+    bool binary;               ///< binary file?
+    long flush_time;           ///< minimum time between writes [ms]
+    long last_flush;           ///< time of last write [ms]
+    int next_row;              ///< first row not in buffer yet
+    std::string buffer;        ///< rows not written yet
+
+public:
+    anyStatisticsStream(): f(0), binary(false), flush_time(0), last_flush(0), next_row(0) {}
+    ~anyStatisticsStream() { close(); }
 
-    anyStatData(): counter(0), next(0) {}
+    void open(char const *fname, bool binary, float flush_time);
+    void append();
+    void flush();
+    void close();
+    bool is_open() const { return f != 0; }
 };
 
-extern anyStatData *Statistics;
-extern anyStatData *LastStatistics;
-extern anyStatData MaxStatistics;
 
 void DeallocStatistics();
 void AddStatistics(int step, int tissue_id, int state_id, int count);
 void AddAllStatistics();
+class anyOutputJob;
+anyOutputJob *CaptureStatistics(char const *fname);
 void SaveStatistics(char const *fname);
 
 
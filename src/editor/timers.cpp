@@ -14,6 +14,8 @@ static struct timeb ProgramStart = {0,0,0,0};  ///< Time of program start in sec
 
 static anyTimer Timers[MAX_TIMERS];        ///< Array of timers
 static int TimerCnt = 0;                   ///< Number of defined timers
+static double SimulatedTime = 0;           ///< Simulated time covered by timers [s] (since last reset of root timer)
+static thread_local bool Suspended = false; ///< Timers are ignored in this thread?
 
 int   TimerSimulationId;        ///< id of simulation timer
 int   TimerTubeUpdateId;        ///< tube array rearangement
@@ -111,6 +113,8 @@ void  StartTimer(int id)
  \param id -- timer id
 */
  {
+  if (Suspended)
+    return;
   Timers[id].time_start = Time();
   Timers[id].running = 1;
  }
@@ -130,6 +134,17 @@ long GetTimer(int id)
  }
 
 
+char const *GetTimerName(int id)
+/**
+ Returns name of timer.
+
+ \param id -- timer id
+*/
+ {
+  return Timers[id].name;
+ }
+
+
 
 void  StopTimer(int id)
 /**
@@ -138,11 +153,37 @@ void  StopTimer(int id)
  \param id -- timer id
 */
  {
+  if (Suspended)
+    return;
   Timers[id].time += Time() - Timers[id].time_start;
   Timers[id].running = 0;
  }
 
 
+void AddTimerSimulatedTime(float dt)
+/**
+ Adds simulated time covered by timers (used to report cost per simulated second).
+
+ \param dt -- simulated time [s]
+*/
+ {
+  if (!Suspended)
+    SimulatedTime += dt;
+ }
+
+
+void SuspendTimers(bool suspend)
+/**
+ Suspends (or resumes) timers in calling thread, suspended timers are not started
+ nor stopped. Used when several simulations run at once in different threads.
+
+ \param suspend -- true to suspend, false to resume
+*/
+ {
+  Suspended = suspend;
+ }
+
+
 static char *timer_to_str(long t, bool bold)
 {
     static char s[201];
@@ -204,6 +245,13 @@ char *ReportTimer(int id, bool bold)
         }
     }
 
+    // cost per simulated second...
+    if (SimulatedTime > 0)
+    {
+        int len = strlen(ret);
+        snprintf(ret + len, 200 - len, ", %.3g ms/s", t/SimulatedTime);
+    }
+
     return ret;
 }
 
@@ -215,6 +263,8 @@ void ResetTimer(int id)
 {
     StopTimer(id);
     Timers[id].time = Timers[id].time_start = 0;
+    if (Timers[id].parent_id == -1)
+        SimulatedTime = 0;
 
     for (int i = 0; i < TimerCnt; i++)
         if (Timers[i].parent_id == id)
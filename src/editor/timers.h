@@ -40,6 +40,9 @@ long Time();
 void StartTimer(int id);
 void StopTimer(int id);
 long GetTimer(int id);
+char const *GetTimerName(int id);
+void AddTimerSimulatedTime(float dt);
+void SuspendTimers(bool suspend);
 char *ReportTimer(int id, bool bold);
 void ResetTimer(int id);
 
@@ -293,8 +293,8 @@ public:
 
     char *toString(char const *delimiter1 = "<", char const *delimiter2 = ">") const
     {
-        static char h[10][500];
-        static int h_indx = 0;
+        static thread_local char h[10][500];
+        static thread_local int h_indx = 0;
         h_indx = (h_indx + 1) % 10;
         snprintf(h[h_indx], 500, "%s%g, %g, %g, %g,  %g, %g, %g, %g,  %g, %g, %g, %g,   %g, %g, %g, %g%s",
                  delimiter1,
@@ -309,8 +309,8 @@ public:
 
     char *toString2() const
     {
-        static char h[10][500];
-        static int h_indx = 0;
+        static thread_local char h[10][500];
+        static thread_local int h_indx = 0;
         h_indx = (h_indx + 1) % 10;
         snprintf(h[h_indx], 500, "\t%g, \t%g, \t%g, \t%g,\n\t%g, \t%g, \t%g, \t%g,\n\t%g, \t%g, \t%g, \t%g,\n\t%g, \t%g, \t%g, \t%g",
                  matrix[0], matrix[4], matrix[8], matrix[12],
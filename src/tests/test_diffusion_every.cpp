@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include "../editor/scene.h"
+#include "../editor/parser.h"
+#include "../editor/config.h"
+#include "../editor/timers.h"
+#include "../editor/simulation.h"
+#include "../editor/anysimulationsettings.h"
+#include "../editor/anyglobalsettings.h"
+#include "../editor/anytubularsystemsettings.h"
+#include "../editor/anyvisualsettings.h"
+#include "../editor/log.h"
+
+/*
+  Sub-cycled diffusion test (Simulation->settings.diffusion_every).
+
+  Usage: test_diffusion_every [<program dir>]
+    program dir -- directory with defaults/ and include/ (default: ../../)
+
+  Scene diffusion_every.ag is run with diffusion updated every step and every n-th step,
+  O2 concentrations of all cells are compared. Returns 0 if all checks pass.
+*/
+
+#define TEST_STEPS 80
+#define CONC_LOW 0.2f   ///< initial O2 concentration of second block (see diffusion_every.ag)
+#define CONC_HIGH 0.8f  ///< initial O2 concentration of first block
+
+
+static bool run(char const *scene_fname, int diffusion_every, std::vector<float> &conc)
+/**
+  Loads and generates test scene, runs TEST_STEPS steps and stores O2 concentrations of all cells.
+
+  \param scene_fname -- scene file
+  \param diffusion_every -- diffusion update interval [steps]
+  \param conc -- O2 concentrations of cells (output parameter)
+*/
+{
+    try
+    {
+        scene::DeallocSimulation();
+        scene::DeallocateCellBlocks();
+        scene::DeallocateTubeLines();
+        scene::DeallocateTubeBundles();
+        scene::DeallocateInteractionSettings();
+        scene::DeallocateTissueSettings();
+        scene::DeallocateBarriers();
+        DeallocateDefinitions();
+
+        Simulation->settings.reset();
+        Simulation->tubular_settings.reset();
+        VisualSettings.reset();
+
+        char basefile[P_MAX_PATH];
+        snprintf(basefile, P_MAX_PATH, "%sinclude/base.ag", GlobalSettings.app_dir);
+        ParseFile(basefile, false);
+        ParseFile(scene_fname, true);
+
+        Simulation->settings.diffusion_every = diffusion_every;
+
+        srand(1);
+        if (!Simulation->allocated)
+            scene::AllocSimulation();
+        scene::GenerateCellsInAllBlocks();
+
+        for (int i = 0; i < TEST_STEPS; i++)
+            TimeStep();
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        return false;
+    }
+
+    // cells are not moving, so order of cells is same in every run...
+    conc.clear();
+    int first_cell = 0;
+    for (int box_id = 0; box_id < Simulation->settings.no_boxes; box_id++)
+    {
+        int no_cells = Simulation->cells[first_cell].no_cells_in_box;
+        for (int i = 0; i < no_cells; i++)
+            conc.push_back(Simulation->cells[first_cell + i].concentrations[sat::dsO2][0]);
+        first_cell += Simulation->settings.max_cells_per_box;
+    }
+    return true;
+}
+
+
+static float sum(std::vector<float> const &conc)
+{
+    float s = 0;
+    for (unsigned i = 0; i < conc.size(); i++)
+        s += conc[i];
+    return s;
+}
+
+
+static float max_difference(std::vector<float> const &conc1, std::vector<float> const &conc2)
+{
+    float d = 0;
+    for (unsigned i = 0; i < conc1.size(); i++)
+        d = MAX(d, ABS(conc1[i] - conc2[i]));
+    return d;
+}
+
+
+static bool in_range(std::vector<float> const &conc)
+{
+    for (unsigned i = 0; i < conc.size(); i++)
+        if (conc[i] < CONC_LOW - 1e-4f || conc[i] > CONC_HIGH + 1e-4f)
+            return false;
+    return true;
+}
+
+
+static bool check(bool ok, char const *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    snprintf(GlobalSettings.app_dir, P_MAX_PATH, "%s", argc > 1 ? argv[1] : "../../");
+    snprintf(GlobalSettings.temp_dir, P_MAX_PATH, "%s", ".");
+    snprintf(GlobalSettings.user_dir, P_MAX_PATH, "%s", ".");
+    Slashify(GlobalSettings.app_dir, true);
+    Slashify(GlobalSettings.temp_dir, true);
+    Slashify(GlobalSettings.user_dir, true);
+
+    char scene_fname[P_MAX_PATH];
+    snprintf(scene_fname, P_MAX_PATH, "%ssrc/tests/diffusion_every.ag", GlobalSettings.app_dir);
+
+    DefineAllTimers();
+
+    std::vector<float> conc1, conc4, conc64;
+    if (!run(scene_fname, 1, conc1) || !run(scene_fname, 4, conc4) || !run(scene_fname, 64, conc64))
+        return 1;
+
+    bool ok = true;
+    ok &= check(!conc1.empty() && conc1.size() == conc4.size() && conc1.size() == conc64.size(), "same cells in all runs");
+    if (!ok)
+        return 1;
+
+    float total = sum(conc1);
+    printf("cells: %d, total O2: %g (n=1), %g (n=4), %g (n=64)\n", int(conc1.size()), total, sum(conc4), sum(conc64));
+    printf("max difference from n=1: %g (n=4), %g (n=64)\n", max_difference(conc1, conc4), max_difference(conc1, conc64));
+
+    // diffusion must have happened...
+    float spread = 0;
+    for (unsigned i = 0; i < conc1.size(); i++)
+        spread = MAX(spread, MIN(conc1[i] - CONC_LOW, CONC_HIGH - conc1[i]));
+    ok &= check(spread > 0.05, "n=1: O2 diffused between blocks");
+
+    // same amount of O2, similar distribution...
+    ok &= check(ABS(sum(conc4) - total) < 1e-3*total, "n=4: O2 conserved");
+    ok &= check(max_difference(conc1, conc4) < 0.02, "n=4: concentrations match n=1");
+
+    // too long step is limited to stable one (and warned about): no overshoot out of initial range...
+    int stable = StableDiffusionInterval();
+    printf("stable diffusion interval: %d\n", stable);
+    ok &= check(stable >= 4 && stable < 64, "n=4 stable, n=64 longer than stable interval");
+    ok &= check(in_range(conc1) && in_range(conc4) && in_range(conc64), "n=1, 4, 64: concentrations within initial range");
+    ok &= check(ABS(sum(conc64) - total) < 1e-3*total, "n=64: O2 conserved");
+
+    scene::DeallocSimulation();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+QT -= core gui
+TARGET = test_diffusion_every
+CONFIG   += console c++11 thread
+
+SOURCES += \
+    test_diffusion_every.cpp \
+    ../editor/config.cpp \
+    ../editor/anybarrier.cpp \
+    ../editor/anyboundingbox.cpp \
+    ../editor/anycell.cpp \
+    ../editor/anycellblock.cpp \
+    ../editor/anyglobalsettings.cpp \
+    ../editor/anysimulationsettings.cpp \
+    ../editor/anysoftwarerenderer.cpp \
+    ../editor/anytissuesettings.cpp \
+    ../editor/anytrajectory.cpp \
+    ../editor/anyoutputsnapshot.cpp \
+    ../editor/anyoutputwriter.cpp \
+    ../editor/anytube.cpp \
+    ../editor/anytubebundle.cpp \
+    ../editor/anytubeline.cpp \
+    ../editor/anytubularsystemsettings.cpp \
+    ../editor/anyvector.cpp \
+    ../editor/anyvisualsettings.cpp \
+    ../editor/color.cpp \
+    ../editor/log.cpp \
+    ../editor/parser.cpp \
+    ../editor/scene.cpp \
+    ../editor/simulation.cpp \
+    ../editor/statistics.cpp \
+    ../editor/timers.cpp \
+    ../editor/anyeditable.cpp \
+    ../editor/anysimulationcontext.cpp \
+    ../editor/anysimulation.cpp
+
+INCLUDEPATH += ../Editor
+
+OTHER_FILES += \
+    diffusion_every.ag
+
+HEADERS += \
+    ../editor/config.h \
+    ../editor/anybarrier.h \
+    ../editor/anyboundingbox.h \
+    ../editor/anycell.h \
+    ../editor/anycellblock.h \
+    ../editor/anyglobalsdialog.h \
+    ../editor/anyglobalsettings.h \
+    ../editor/anysimulationsettings.h \
+    ../editor/anysoftwarerenderer.h \
+    ../editor/anytissuesettings.h \
+    ../editor/anytissueinteraction.h \
+    ../editor/anytrajectory.h \
+    ../editor/anyoutputsnapshot.h \
+    ../editor/anyoutputwriter.h \
+    ../editor/anytube.h \
+    ../editor/anytubebox.h \
+    ../editor/anytubebundle.h \
+    ../editor/anytubechain.h \
+    ../editor/anytubeline.h \
+    ../editor/anytubemerge.h \
+    ../editor/anytubularsystemsettings.h \
+    ../editor/anyvector.h \
+    ../editor/anyvisualsettings.h \
+    ../editor/color.h \
+    ../editor/const.h \
+    ../editor/func.h \
+    ../editor/log.h \
+    ../editor/parser.h \
+    ../editor/scene.h \
+    ../editor/simulation.h \
+    ../editor/statistics.h \
+    ../editor/timers.h \
+    ../editor/transform.h \
+    ../editor/types.h \
+    ../editor/version.h \
+    ../editor/anyeditable.h \
+    ../editor/anyeditabledialog.h \
+    ../editor/anysimulationcontext.h \
+    ../editor/anysimulation.h
+
+QMAKE_CXXFLAGS += -fopenmp
+QMAKE_LFLAGS += -fopenmp
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../editor/version.h"
+#include "../editor/anytrajectory.h"
+#include "../editor/anyglobalsettings.h"
+#include "../editor/log.h"
+
+
+anyGlobalSettings GlobalSettings;  ///< global settings (used by logging)
+
+
+static char const *name(std::vector<std::string> const &names, int i)
+{
+    return i >= 0 && i < (int)names.size() ? names[i].c_str() : "?";
+}
+
+
+static void list_frames(anyTrajectoryReader &tr)
+{
+    printf("%d frames, %d tissues\n", tr.no_frames(), (int)tr.tissue_names.size());
+    printf("frame\tstep\ttime\tcells\ttubes\tkeyframe\n");
+    for (int i = 0; i < tr.no_frames(); i++)
+    {
+        anyTrajectoryFrame const &fr = tr.read_frame(i);
+        printf("%d\t%d\t%g\t%d\t%d\t%d\n", i, fr.step, fr.time, fr.no_cells, fr.no_tubes, (int)tr.frame_info(i).keyframe);
+    }
+}
+
+
+static void save_csv(anyTrajectoryReader &tr, anyTrajectoryFrame const &fr, char const *prefix)
+/**
+  Saves frame as two CSV files: <prefix>cells_<step>.csv and <prefix>tubes_<step>.csv.
+*/
+{
+    char fname[P_MAX_PATH];
+    FILE *f;
+
+    snprintf(fname, P_MAX_PATH, "%scells_%08d.csv", prefix, fr.step);
+    f = fopen(fname, "w");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
+    for (int c = 0; c < tcTubeId; c++)
+        fprintf(f, c ? ";%s" : "%s", TrajectoryColumnName(c));
+    fprintf(f, "\n");
+    for (int i = 0; i < fr.no_cells; i++)
+    {
+        fprintf(f, "%g;%g;%g;%g", fr.get_float(tcCellX, i), fr.get_float(tcCellY, i), fr.get_float(tcCellZ, i), fr.get_float(tcCellR, i));
+        fprintf(f, ";%s;%s", name(tr.state_names, fr.get_int(tcCellState, i)), name(tr.tissue_names, fr.get_int(tcCellTissue, i)));
+        for (int k = 0; k < sat::dsLast; k++)
+            fprintf(f, ";%g", fr.get_float(tcCellConc + k, i));
+        fprintf(f, "\n");
+    }
+    fclose(f);
+
+    snprintf(fname, P_MAX_PATH, "%stubes_%08d.csv", prefix, fr.step);
+    f = fopen(fname, "w");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
+    for (int c = tcTubeId; c < tcLast; c++)
+        fprintf(f, c != tcTubeId ? ";%s" : "%s", TrajectoryColumnName(c));
+    fprintf(f, "\n");
+    for (int i = 0; i < fr.no_tubes; i++)
+    {
+        fprintf(f, "%d", fr.get_int(tcTubeId, i));
+        for (int c = tcTubeX1; c <= tcTubeR; c++)
+            fprintf(f, ";%g", fr.get_float(c, i));
+        fprintf(f, ";%s;%d;%d;%d;%d;%g;%g\n", name(tr.state_names, fr.get_int(tcTubeState, i)),
+                fr.get_int(tcTubeFirst, i), fr.get_int(tcTubeBaseId, i), fr.get_int(tcTubeTopId, i),
+                fr.get_int(tcTubeFixedBloodPressure, i), fr.get_float(tcTubeBloodPressure, i), fr.get_float(tcTubeBloodFlow, i));
+    }
+    fclose(f);
+}
+
+
+static void save_ag(anyTrajectoryReader &tr, anyTrajectoryFrame const &fr, char const *prefix)
+/**
+  Saves frame as <prefix>step_<step>.ag (scene definition from trajectory header,
+  time of frame, tubes and cells).
+*/
+{
+    char fname[P_MAX_PATH];
+    snprintf(fname, P_MAX_PATH, "%sstep_%08d.ag", prefix, fr.step);
+    FILE *f = fopen(fname, "w");
+    if (!f)
+        throw new Error(__FILE__, __LINE__, "Cannot open file for writing", fname);
+
+    fputs(tr.scene.c_str(), f);
+    fprintf(f, "\nSimulation\n {\n  time = %g\n }\n", fr.time);
+
+    fprintf(f, "\n//---[ TUBES ]----------------------------------------------------------------\n");
+    for (int i = 0; i < fr.no_tubes; i++)
+    {
+        fprintf(f, "\nTube\n {\n");
+        fprintf(f, "  id = %d\n", fr.get_int(tcTubeId, i));
+        if (fr.get_int(tcTubeFirst, i))
+            fprintf(f, "  first\n");
+        if (fr.get_int(tcTubeBaseId, i) >= 0)
+            fprintf(f, "  base_id = %d\n", fr.get_int(tcTubeBaseId, i));
+        if (fr.get_int(tcTubeTopId, i) >= 0)
+            fprintf(f, "  top_id = %d\n", fr.get_int(tcTubeTopId, i));
+        fprintf(f, "  state = %s\n", name(tr.state_names, fr.get_int(tcTubeState, i)));
+        fprintf(f, "  pos1 = <%g, %g, %g>\n", fr.get_float(tcTubeX1, i), fr.get_float(tcTubeY1, i), fr.get_float(tcTubeZ1, i));
+        fprintf(f, "  pos2 = <%g, %g, %g>\n", fr.get_float(tcTubeX2, i), fr.get_float(tcTubeY2, i), fr.get_float(tcTubeZ2, i));
+        fprintf(f, "  r = %g\n", fr.get_float(tcTubeR, i));
+        fprintf(f, "  blood_pressure = %g\n", fr.get_float(tcTubeBloodPressure, i));
+        fprintf(f, "  fixed_blood_pressure = %d\n", fr.get_int(tcTubeFixedBloodPressure, i));
+        fprintf(f, " }\n");
+    }
+
+    fprintf(f, "\n//---[ CELLS ]------------------------------------------------------------------\n");
+    for (int i = 0; i < fr.no_cells; i++)
+    {
+        fprintf(f, "\nCell\n {\n");
+        fprintf(f, "  tissue = \"%s\"\n", name(tr.tissue_names, fr.get_int(tcCellTissue, i)));
+        fprintf(f, "  state = %s\n", name(tr.state_names, fr.get_int(tcCellState, i)));
+        fprintf(f, "  pos = <%g, %g, %g>\n", fr.get_float(tcCellX, i), fr.get_float(tcCellY, i), fr.get_float(tcCellZ, i));
+        fprintf(f, "  r = %g\n", fr.get_float(tcCellR, i));
+        for (int k = 0; k < sat::dsLast; k++)
+            fprintf(f, "  %s = %g\n", TrajectoryColumnName(tcCellConc + k), fr.get_float(tcCellConc + k, i));
+        fprintf(f, " }\n");
+    }
+
+    fclose(f);
+}
+
+
+static void usage(char const *prog)
+{
+    printf("Usage: %s [options] <trajectory file> [<output prefix>]\n", prog);
+    printf("Lists frames of trajectory file or converts them.\n");
+    printf("Options:\n");
+    printf("  -csv            save frames as CSV files (cells_<step>.csv, tubes_<step>.csv)\n");
+    printf("  -ag             save frames as *.ag files (step_<step>.ag)\n");
+    printf("  -frame <n>      convert only n-th frame (default: all frames)\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    printf("%s trajectory reader, %d.%d.%d\n", APP_NAME, MOTPUCA_VERSION, MOTPUCA_SUBVERSION, MOTPUCA_RELEASE);
+
+    bool csv = false, ag = false;
+    int frame = -1;
+
+    // options...
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (!strcmp(argv[arg], "-csv"))
+            csv = true;
+        else if (!strcmp(argv[arg], "-ag"))
+            ag = true;
+        else if (!strcmp(argv[arg], "-frame") && arg + 1 < argc)
+            frame = atoi(argv[++arg]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - arg < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    char const *prefix = argc - arg > 1 ? argv[arg + 1] : "";
+
+    try
+    {
+        anyTrajectoryReader tr;
+        tr.open(argv[arg]);
+
+        if (!csv && !ag)
+        {
+            list_frames(tr);
+            return 0;
+        }
+
+        for (int i = frame < 0 ? 0 : frame; i < (frame < 0 ? tr.no_frames() : frame + 1); i++)
+        {
+            anyTrajectoryFrame const &fr = tr.read_frame(i);
+            if (csv)
+                save_csv(tr, fr, prefix);
+            if (ag)
+                save_ag(tr, fr, prefix);
+        }
+    }
+    catch (Error *err)
+    {
+        LogError(err);
+        return 1;
+    }
+
+    return 0;
+}
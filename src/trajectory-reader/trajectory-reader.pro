@@ -0,0 +1,19 @@
+QT -= core gui
+CONFIG   += console c++11
+
+SOURCES += \
+    main.cpp \
+    ../editor/anyglobalsettings.cpp \
+    ../editor/anytrajectory.cpp \
+    ../editor/anyvector.cpp \
+    ../editor/log.cpp
+
+HEADERS += \
+    ../editor/anyglobalsettings.h \
+    ../editor/anytrajectory.h \
+    ../editor/anyvector.h \
+    ../editor/const.h \
+    ../editor/func.h \
+    ../editor/log.h \
+    ../editor/types.h \
+    ../editor/version.h